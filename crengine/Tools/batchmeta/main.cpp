@@ -0,0 +1,172 @@
+/***************************************************************************
+ *   crengine-ng                                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License           *
+ *   as published by the Free Software Foundation; either version 2        *
+ *   of the License, or (at your option) any later version.                *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,            *
+ *   MA 02110-1301, USA.                                                   *
+ ***************************************************************************/
+
+// Extracts metadata and cover thumbnails of all books in directory tree
+// with several concurrent workers, writes JSON-lines report.
+
+#include <lvbatchextractor.h>
+#include <lvfntman.h>
+#include <lvstreamutils.h>
+#include <lvcontaineriteminfo.h>
+#include <crconcurrent.h>
+#include <crlog.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+class JsonLinesWriter: public LVBatchExtractorCallback
+{
+    FILE* _out;
+public:
+    int total;
+    int failed;
+    explicit JsonLinesWriter(FILE* out)
+            : _out(out)
+            , total(0)
+            , failed(0) { }
+    virtual void onBookInfo(const LVBookInfo& info) {
+        total++;
+        if (!info.ok)
+            failed++;
+        fprintf(_out, "%s\n", info.toJson().c_str());
+        fflush(_out);
+    }
+};
+
+static const char* font_extensions[] = { ".ttf", ".ttc", ".otf", ".pfa", ".pfb", NULL };
+
+/// recursively registers font files of directory, returns number of registered fonts
+static int registerFontDir(const lString32& dir) {
+    lString32 path = dir;
+    LVAppendPathDelimiter(path);
+    LVContainerRef container = LVOpenDirectory(path);
+    if (container.isNull())
+        return 0;
+    int count = 0;
+    for (int i = 0; i < container->GetObjectCount(); i++) {
+        const LVContainerItemInfo* item = container->GetObjectInfo(i);
+        lString32 name = item->GetName();
+        if (item->IsContainer()) {
+            count += registerFontDir(path + name);
+            continue;
+        }
+        lString32 lc = name;
+        lc.lowercase();
+        for (int j = 0; font_extensions[j]; j++) {
+            if (lc.endsWith(font_extensions[j])) {
+                if (fontMan->RegisterFont(UnicodeToLocal(path + name)))
+                    count++;
+                break;
+            }
+        }
+    }
+    return count;
+}
+
+static void usage(const char* prog) {
+    printf("usage: %s [options] <books directory> [report.jsonl]\n", prog);
+    printf("  -j N          number of concurrent workers, 0 - number of processors (default)\n");
+    printf("  -m MB         memory budget for books processed at the same time, megabytes (default 256)\n");
+    printf("  -c DIR        save cover thumbnails to directory\n");
+    printf("  -s WxH        cover thumbnail size (default 300x400)\n");
+    printf("  -g            generate covers for books without cover image\n");
+    printf("  -f DIR        register fonts of directory, may be repeated (default: system fonts)\n");
+    printf("  -v            write log to stderr\n");
+}
+
+int main(int argc, char* argv[]) {
+    LVBatchExtractor extractor;
+    lString32Collection fontDirs;
+    bool generateCovers = false;
+    const char* booksDir = NULL;
+    const char* reportFile = NULL;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(arg, "-j") && hasValue) {
+            extractor.setThreadCount(atoi(argv[++i]));
+        } else if (!strcmp(arg, "-m") && hasValue) {
+            extractor.setMemoryBudget((lvsize_t)atoi(argv[++i]) * 1024 * 1024);
+        } else if (!strcmp(arg, "-c") && hasValue) {
+            extractor.setCoverDir(Utf8ToUnicode(argv[++i]));
+        } else if (!strcmp(arg, "-s") && hasValue) {
+            int w = 0, h = 0;
+            if (sscanf(argv[++i], "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            extractor.setThumbSize(w, h);
+        } else if (!strcmp(arg, "-g")) {
+            generateCovers = true;
+            extractor.setGenerateCovers(true);
+        } else if (!strcmp(arg, "-f") && hasValue) {
+            fontDirs.add(Utf8ToUnicode(argv[++i]));
+        } else if (!strcmp(arg, "-v")) {
+            CRLog::setStderrLogger();
+            CRLog::setLogLevel(CRLog::LL_INFO);
+        } else if (arg[0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else if (!booksDir) {
+            booksDir = arg;
+        } else if (!reportFile) {
+            reportFile = arg;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!booksDir) {
+        usage(argv[0]);
+        return 1;
+    }
+    CRSetupStdConcurrencyProvider();
+    CRSetupEngineConcurrency();
+    // system fonts are enumerated only when no font directory is given
+    if (!InitFontManager(lString8::empty_str, fontDirs.length() == 0)) {
+        fprintf(stderr, "Cannot initialize font manager\n");
+        return 2;
+    }
+    for (int i = 0; i < fontDirs.length(); i++) {
+        if (!registerFontDir(fontDirs[i]))
+            fprintf(stderr, "No fonts found in %s\n", LCSTR(fontDirs[i]));
+    }
+    if (generateCovers && !fontMan->GetFontCount()) {
+        fprintf(stderr, "No fonts are registered, covers cannot be generated: use -f option\n");
+        return 2;
+    }
+    FILE* out = stdout;
+    if (reportFile) {
+        out = fopen(reportFile, "wt");
+        if (!out) {
+            fprintf(stderr, "Cannot create report file %s\n", reportFile);
+            return 2;
+        }
+    }
+    lString32Collection files;
+    LVBatchExtractor::findBooks(Utf8ToUnicode(booksDir), files);
+    JsonLinesWriter writer(out);
+    extractor.run(files, &writer);
+    if (out != stdout)
+        fclose(out);
+    fprintf(stderr, "%d books processed, %d failed\n", writer.total, writer.failed);
+    ShutdownFontManager();
+    return writer.failed ? 3 : 0;
+}
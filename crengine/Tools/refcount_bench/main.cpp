@@ -0,0 +1,148 @@
+/***************************************************************************
+ *   crengine-ng                                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License           *
+ *   as published by the Free Software Foundation; either version 2        *
+ *   of the License, or (at your option) any later version.                *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,            *
+ *   MA 02110-1301, USA.                                                   *
+ ***************************************************************************/
+
+// Compares reference counting traffic of LVProtectedFastRef (atomic counter)
+// with previous implementation protected by global REF_GUARD mutex,
+// when references to the same object are copied from 1, 4 and 8 threads.
+
+#include <lvref.h>
+#include <crconcurrent.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <thread>
+#include <vector>
+#include <chrono>
+
+// Copy of LVProtectedFastRef before switching to atomic counters
+template <class T>
+class LVMutexProtectedRef
+{
+private:
+    T* _ptr;
+    inline T* Release() {
+        T* res = NULL;
+        if (_ptr) {
+            if (_ptr->Release() == 0) {
+                res = _ptr;
+            }
+            _ptr = NULL;
+        }
+        return res;
+    }
+public:
+    LVMutexProtectedRef()
+            : _ptr(NULL) { }
+    explicit LVMutexProtectedRef(T* ptr) {
+        REF_GUARD
+        _ptr = ptr;
+        if (_ptr)
+            _ptr->AddRef();
+    }
+    LVMutexProtectedRef(const LVMutexProtectedRef& ref) {
+        REF_GUARD
+        _ptr = ref._ptr;
+        if (_ptr)
+            _ptr->AddRef();
+    }
+    ~LVMutexProtectedRef() {
+        T* removed = NULL;
+        {
+            REF_GUARD
+            removed = Release();
+        }
+        if (removed)
+            delete removed;
+    }
+    T* get() const {
+        return _ptr;
+    }
+};
+
+class CountedObject: public LVRefCounter
+{
+public:
+    int value;
+    CountedObject()
+            : value(1) { }
+};
+
+class AtomicCountedObject: public LVAtomicRefCounter
+{
+public:
+    int value;
+    AtomicCountedObject()
+            : value(1) { }
+};
+
+// each thread copies and destroys references to the shared object
+template <class Ref>
+static double runBench(const Ref& shared, int threadCount, int iterations) {
+    std::vector<std::thread> threads;
+    std::vector<long> sums(threadCount, 0);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threadCount; t++) {
+        threads.push_back(std::thread([&shared, &sums, t, iterations]() {
+            long sum = 0;
+            for (int i = 0; i < iterations; i++) {
+                Ref copy(shared);
+                sum += copy.get()->value;
+            }
+            sums[t] = sum;
+        }));
+    }
+    for (int t = 0; t < threadCount; t++)
+        threads[t].join();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    long total = 0;
+    for (int t = 0; t < threadCount; t++)
+        total += sums[t];
+    if (total != (long)threadCount * iterations)
+        printf("  invalid result: %ld\n", total);
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    int iterations = 1000000;
+    if (argc > 1)
+        iterations = atoi(argv[1]);
+    if (iterations <= 0) {
+        printf("usage: %s [iterations per thread]\n", argv[0]);
+        return 1;
+    }
+    // creates _refMutex used by REF_GUARD
+    CRSetupStdConcurrencyProvider();
+    CRSetupEngineConcurrency();
+    printf("processors: %d, iterations per thread: %d\n", concurrencyProvider->getProcessorCount(), iterations);
+
+    LVMutexProtectedRef<CountedObject> mutexRef(new CountedObject());
+    LVProtectedFastRef<AtomicCountedObject> atomicRef(new AtomicCountedObject());
+    const int threadCounts[] = { 1, 4, 8 };
+    for (int i = 0; i < 3; i++) {
+        int threadCount = threadCounts[i];
+        double mutexMs = runBench(mutexRef, threadCount, iterations);
+        double atomicMs = runBench(atomicRef, threadCount, iterations);
+        double ops = (double)threadCount * iterations;
+        printf("threads: %d\n", threadCount);
+        printf("  REF_GUARD mutex:  %9.1f ms, %6.1f ns per copy\n", mutexMs, mutexMs * 1000000.0 / ops);
+        printf("  atomic counter:   %9.1f ms, %6.1f ns per copy\n", atomicMs, atomicMs * 1000000.0 / ops);
+    }
+    return 0;
+}
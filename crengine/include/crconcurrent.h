@@ -24,6 +24,10 @@
 #include <crlocks.h>
 #include <lvref.h>
 #include <lvqueue.h>
+#include <lvarray.h>
+
+#include <atomic>
+#include <mutex>
 
 enum
 {
@@ -47,10 +51,41 @@ public:
     virtual void setThreadPriority(int p) {
         CR_UNUSED(p);
     }
+    /// returns number of available processors (cores)
+    virtual int getProcessorCount() {
+        return 1;
+    }
 };
 
 extern CRConcurrencyProvider* concurrencyProvider;
 
+/// Built-in concurrency provider based on standard C++11 threads
+/**
+ * Installed by CRSetupStdConcurrencyProvider(), for applications not having their own provider.
+ * Engine has no GUI event loop, so executeGui(task) runs the task in the calling thread,
+ * delayed tasks are executed by the separate timer thread.
+ */
+class CRStdConcurrencyProvider: public CRConcurrencyProvider
+{
+    class TimerThread;
+    std::atomic<TimerThread*> _timer;
+    std::mutex _timerMutex;
+public:
+    CRStdConcurrencyProvider();
+    virtual ~CRStdConcurrencyProvider();
+    virtual CRMutex* createMutex();
+    virtual CRMonitor* createMonitor();
+    virtual CRThread* createThread(CRRunnable* threadTask);
+    virtual void executeGui(CRRunnable* task);
+    virtual void executeGui(CRRunnable* task, int delayMillis);
+    virtual void sleepMs(int durationMs);
+    virtual int getProcessorCount();
+};
+
+/// sets CRStdConcurrencyProvider as concurrencyProvider if application did not set its own one,
+/// call before CRSetupEngineConcurrency()
+void CRSetupStdConcurrencyProvider();
+
 class CRThreadExecutor: public CRRunnable, public CRExecutor
 {
     volatile bool _stopped;
@@ -65,4 +100,221 @@ public:
     virtual void run();
 };
 
+class CRThreadPool;
+
+/// Runnable wrapper for functor or lambda
+template <typename F>
+class CRFunctorRunnable: public CRRunnable
+{
+    F _func;
+public:
+    explicit CRFunctorRunnable(const F& func)
+            : _func(func) { }
+    virtual void run() {
+        _func();
+    }
+};
+
+/// Set of tasks executed by thread pool which can be waited for or cancelled as a whole
+class CRTaskGroup
+{
+    friend class CRThreadPool;
+    CRThreadPool* _pool;
+    CRMonitorRef _monitor;
+    int _pending;
+    std::atomic<bool> _cancelled;
+    void taskAdded();
+    void taskDone();
+public:
+    /// pool may be NULL, then all tasks are executed immediately in the calling thread
+    explicit CRTaskGroup(CRThreadPool* pool);
+    /// waits for all tasks of this group
+    ~CRTaskGroup();
+    CRThreadPool* getPool() const {
+        return _pool;
+    }
+    /// queue task for execution, takes ownership of task
+    void run(CRRunnable* task);
+    /// queue functor or lambda for execution
+    template <typename F>
+    void runFunc(const F& func) {
+        run(new CRFunctorRunnable<F>(func));
+    }
+    /// wait until all tasks are finished; calling thread executes pending tasks while waiting
+    void join();
+    /// wait until all tasks are finished without executing any queued task, for threads which must not run other tasks
+    void wait();
+    /// tasks not yet started are dropped, running tasks may poll isCancelled()
+    void cancel() {
+        _cancelled = true;
+    }
+    bool isCancelled() const {
+        return _cancelled;
+    }
+    /// number of queued and running tasks
+    int pendingCount();
+};
+
+/// Thread pool with per-worker task deques and work stealing
+/**
+ * Each worker pushes tasks created from inside of it's own task to the tail of own deque
+ * and takes them back from the tail (LIFO), tasks from other threads are placed to
+ * shared injection queue. Idle worker steals from the head of other workers deques.
+ * Pool with zero threads executes all tasks immediately in the calling thread.
+ */
+class CRThreadPool: public CRExecutor
+{
+public:
+    class Worker;
+    struct Task
+    {
+        CRRunnable* runnable;
+        CRTaskGroup* group;
+        Task()
+                : runnable(NULL)
+                , group(NULL) { }
+        Task(CRRunnable* r, CRTaskGroup* g)
+                : runnable(r)
+                , group(g) { }
+    };
+private:
+    friend class Worker;
+    LVArray<Worker*> _workers;
+    CRMonitorRef _monitor;
+    CRMutexRef _injectMutex;
+    LVQueue<Task> _injectQueue;
+    std::atomic<int> _queued;
+    volatile bool _stopped;
+    void push(const Task& task);
+    bool pop(Task& task, int workerIndex);
+    void runTask(Task& task);
+    static void dropTask(Task& task);
+public:
+    /// creates pool with specified number of worker threads, requires concurrencyProvider if threadCount > 0
+    explicit CRThreadPool(int threadCount);
+    /// stops all workers, not yet started tasks are deleted
+    virtual ~CRThreadPool();
+    int getThreadCount() const {
+        return _workers.length();
+    }
+    /// queue task for execution, takes ownership of task
+    virtual void execute(CRRunnable* task);
+    /// queue task as a part of group, takes ownership of task
+    void execute(CRRunnable* task, CRTaskGroup* group);
+    /// execute one queued task in the calling thread; returns false if there are no queued tasks
+    bool runPendingTask();
+    /// returns true if called from one of this pool workers
+    bool isWorkerThread() const;
+    /// stop all workers, queued tasks are deleted without execution
+    void stop();
+};
+
+/// Bounded single producer single consumer ring of reusable slots
+/**
+ * Producer fills the slot returned by beginWrite() in place and publishes it with endWrite(),
+ * consumer gets it with beginRead() and gives it back with endRead(), so slot buffers are
+ * allocated once and reused. Both sides block only when ring is full or empty.
+ * Producer calls close() when there will be no more items: beginRead() returns NULL when ring is drained.
+ * Consumer calls cancel() when it doesn't need more items: beginWrite() returns NULL.
+ * Requires concurrencyProvider.
+ */
+template <typename T>
+class CRSpscRing
+{
+    T* _slots;
+    unsigned _mask;
+    std::atomic<unsigned> _head; // next slot to read
+    std::atomic<unsigned> _tail; // next slot to write
+    std::atomic<bool> _closed;
+    std::atomic<bool> _cancelled;
+    std::atomic<int> _waiting;
+    CRMonitorRef _monitor;
+    bool canWrite() const {
+        return _cancelled || _tail - _head <= _mask;
+    }
+    bool canRead() const {
+        return _cancelled || _closed || _head != _tail;
+    }
+    // the other side changes state, then checks _waiting: no wakeup is lost
+    void waitFor(bool (CRSpscRing::*cond)() const) {
+        while (!(this->*cond)()) {
+            CRGuard guard(_monitor);
+            CR_UNUSED(guard);
+            _waiting++;
+            if (!(this->*cond)())
+                _monitor->wait();
+            _waiting--;
+        }
+    }
+    void wake() {
+        if (_waiting > 0) {
+            CRGuard guard(_monitor);
+            CR_UNUSED(guard);
+            _monitor->notifyAll();
+        }
+    }
+public:
+    /// capacity is rounded up to power of 2
+    explicit CRSpscRing(int capacity)
+            : _head(0)
+            , _tail(0)
+            , _closed(false)
+            , _cancelled(false)
+            , _waiting(0)
+            , _monitor(concurrencyProvider->createMonitor()) {
+        unsigned size = 2;
+        while (size < (unsigned)capacity)
+            size <<= 1;
+        _slots = new T[size];
+        _mask = size - 1;
+    }
+    ~CRSpscRing() {
+        delete[] _slots;
+    }
+    /// returns free slot to fill, waits if ring is full; NULL if consumer has cancelled
+    T* beginWrite() {
+        waitFor(&CRSpscRing::canWrite);
+        if (_cancelled)
+            return NULL;
+        return &_slots[_tail & _mask];
+    }
+    /// publishes slot returned by beginWrite()
+    void endWrite() {
+        _tail++;
+        wake();
+    }
+    /// returns next filled slot, waits if ring is empty; NULL if ring is closed and drained, or cancelled
+    T* beginRead() {
+        waitFor(&CRSpscRing::canRead);
+        if (_cancelled || _head == _tail)
+            return NULL;
+        return &_slots[_head & _mask];
+    }
+    /// releases slot returned by beginRead() for reuse by producer
+    void endRead() {
+        _head++;
+        wake();
+    }
+    /// called by producer: no more items will be written
+    void close() {
+        _closed = true;
+        wake();
+    }
+    /// called by consumer: no more items will be read
+    void cancel() {
+        _cancelled = true;
+        wake();
+    }
+    bool isCancelled() const {
+        return _cancelled;
+    }
+};
+
+/// returns shared engine thread pool, NULL if engine concurrency is not set up by CRSetupEngineConcurrency()
+CRThreadPool* CRGetSharedThreadPool();
+/// set number of worker threads of shared pool, 0 - number of processors (default), -1 - don't use threads
+void CRSetSharedThreadPoolSize(int threadCount);
+/// stop and destroy shared thread pool
+void CRShutdownSharedThreadPool();
+
 #endif // CRCONCURRENT_H
@@ -23,12 +23,20 @@
 
 #include <lvautoptr.h>
 
+#include <atomic>
+
 class CRMutex
 {
 public:
     virtual ~CRMutex() { }
     virtual void acquire() = 0;
     virtual void release() = 0;
+    /// acquire if not locked by another thread, returns false without waiting otherwise;
+    /// default implementation just waits for the lock, so contention is never reported
+    virtual bool tryAcquire() {
+        acquire();
+        return true;
+    }
 };
 
 class CRMonitor: public CRMutex
@@ -95,6 +103,80 @@ public:
     }
 };
 
+/// lock kinds having separate usage counters
+enum
+{
+    CR_LOCK_STATS_FONT = 0,         ///< FONT_GUARD
+    CR_LOCK_STATS_FONT_FACE,        ///< FONT_FACE_GUARD, all font instances together
+    CR_LOCK_STATS_FONT_GLYPH_CACHE, ///< FONT_GLYPH_CACHE_GUARD
+    CR_LOCK_STATS_COUNT
+};
+
+/// lock usage counters
+struct CRLockStats
+{
+    unsigned long long acquired;  ///< number of acquisitions
+    unsigned long long contended; ///< number of acquisitions which had to wait for another thread
+};
+
+extern std::atomic<bool> _lockStatsEnabled;
+
+/// acquire mutex, counting acquisition and contention for specified lock kind
+void CRAcquireCounted(CRMutex* mutex, int kind);
+
+/// enable or disable collecting of lock usage counters (disabled by default)
+void CRSetLockStatsEnabled(bool enabled);
+/// get lock usage counters for one of CR_LOCK_STATS_* kinds
+CRLockStats CRGetLockStats(int kind);
+/// reset all lock usage counters
+void CRResetLockStats();
+
+/// acquire mutex, counting it's usage if lock statistics is enabled
+inline void CRAcquire(CRMutex* mutex, int kind) {
+    if (_lockStatsEnabled.load(std::memory_order_relaxed))
+        CRAcquireCounted(mutex, kind);
+    else
+        mutex->acquire();
+}
+
+/// Guard for lock which usage is counted when lock statistics is enabled
+class CRCountedGuard
+{
+    CRMutex* mutex;
+public:
+    CRCountedGuard(CRMutex* _mutex, int kind)
+            : mutex(_mutex) {
+        if (mutex)
+            CRAcquire(mutex, kind);
+    }
+    ~CRCountedGuard() {
+        if (mutex)
+            mutex->release();
+    }
+};
+
+/// Mutex of single object, created on first use if engine concurrency is set up
+class CRLazyMutex
+{
+    std::atomic<CRMutex*> _mutex;
+    // non-copyable
+    CRLazyMutex(const CRLazyMutex&);
+    CRLazyMutex& operator=(const CRLazyMutex&);
+public:
+    CRLazyMutex()
+            : _mutex(NULL) { }
+    ~CRLazyMutex() {
+        delete _mutex.load();
+    }
+    /// returns NULL if CRSetupEngineConcurrency() was not called yet
+    CRMutex* get() {
+        CRMutex* mutex = _mutex.load(std::memory_order_acquire);
+        return mutex ? mutex : create();
+    }
+private:
+    CRMutex* create();
+};
+
 extern CRMutex* _refMutex;
 extern CRMutex* _fontMutex;
 extern CRMutex* _fontManMutex;
@@ -102,21 +184,25 @@ extern CRMutex* _fontGlyphCacheMutex;
 extern CRMutex* _fontLocalGlyphCacheMutex;
 extern CRMutex* _crengineMutex;
 
-// use REF_GUARD to acquire LVProtectedRef mutex
+// use REF_GUARD to acquire global references mutex (LVProtectedFastRef uses atomic counters instead)
 #define REF_GUARD                 \
     CRGuard _refGuard(_refMutex); \
     CR_UNUSED(_refGuard);
 // use FONT_GUARD to acquire font operations mutex
-#define FONT_GUARD                  \
-    CRGuard _fontGuard(_fontMutex); \
+#define FONT_GUARD                                             \
+    CRCountedGuard _fontGuard(_fontMutex, CR_LOCK_STATS_FONT); \
     CR_UNUSED(_fontGuard);
+// use FONT_FACE_GUARD(mutex) to acquire mutex of single font instance
+#define FONT_FACE_GUARD(mutex)                                     \
+    CRCountedGuard _fontFaceGuard(mutex, CR_LOCK_STATS_FONT_FACE); \
+    CR_UNUSED(_fontFaceGuard);
 // use FONT_MAN_GUARD to acquire font manager mutex
 #define FONT_MAN_GUARD                    \
     CRGuard _fontManGuard(_fontManMutex); \
     CR_UNUSED(_fontManGuard);
 // use FONT_GLYPH_CACHE_GUARD to acquire font global glyph cache operations mutex
-#define FONT_GLYPH_CACHE_GUARD                          \
-    CRGuard _fontGlyphCacheGuard(_fontGlyphCacheMutex); \
+#define FONT_GLYPH_CACHE_GUARD                                                                 \
+    CRCountedGuard _fontGlyphCacheGuard(_fontGlyphCacheMutex, CR_LOCK_STATS_FONT_GLYPH_CACHE); \
     CR_UNUSED(_fontGlyphCacheGuard);
 // use FONT_LOCAL_GLYPH_CACHE_GUARD to acquire font global glyph cache operations mutex
 #define FONT_LOCAL_GLYPH_CACHE_GUARD                              \
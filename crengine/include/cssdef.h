@@ -37,10 +37,11 @@
 #include <lvstring.h>
 
 // The order of items in following enums should match the order in the tables in src/lvstsheet.cpp
+// Enums of properties of css_style_rec_t are stored in a single byte to keep styles small
 /// display property values
 
 // Especially don't change the order of these ones, as we use "style->display > css_d_something" like tests
-enum css_display_t
+enum css_display_t : lUInt8
 {
     css_d_inherit, // Inheritance not implemented: should not be seen, unless specified in CSS, which then behave as inline
     css_d_ruby,    // Behave as inline, but inner content might be wrapped in a table like structure
@@ -100,7 +101,7 @@ enum css_display_t
 //     should not be dropped on wrap. We don't ensure that.
 //
 /// white-space property values: keep them ordered this way for easier checks
-enum css_white_space_t
+enum css_white_space_t : lUInt8
 {
     css_ws_inherit,
     css_ws_normal,
@@ -114,7 +115,7 @@ enum css_white_space_t
 };
 
 /// text-align property values
-enum css_text_align_t
+enum css_text_align_t : lUInt8
 {
     css_ta_inherit,
     css_ta_left,
@@ -148,7 +149,7 @@ enum css_vertical_align_t
 };
 
 /// text-decoration property values
-enum css_text_decoration_t
+enum css_text_decoration_t : lUInt8
 {
     // TODO: support multiple flags
     css_td_inherit = 0,
@@ -160,7 +161,7 @@ enum css_text_decoration_t
 };
 
 /// text-transform property values
-enum css_text_transform_t
+enum css_text_transform_t : lUInt8
 {
     css_tt_inherit = 0,
     css_tt_none = 1,
@@ -171,7 +172,7 @@ enum css_text_transform_t
 };
 
 /// hyphenate property values
-enum css_hyphenate_t
+enum css_hyphenate_t : lUInt8
 {
     css_hyph_inherit = 0,
     css_hyph_none = 1,
@@ -179,7 +180,7 @@ enum css_hyphenate_t
 };
 
 /// font-style property values
-enum css_font_style_t
+enum css_font_style_t : lUInt8
 {
     css_fs_inherit,
     css_fs_normal,
@@ -188,7 +189,7 @@ enum css_font_style_t
 };
 
 /// font-weight property values
-enum css_font_weight_t
+enum css_font_weight_t : lUInt8
 {
     css_fw_inherit,
     css_fw_normal,
@@ -207,7 +208,7 @@ enum css_font_weight_t
 };
 
 /// font-family property values
-enum css_font_family_t
+enum css_font_family_t : lUInt8
 {
     css_ff_inherit,
     css_ff_serif,
@@ -218,7 +219,7 @@ enum css_font_family_t
 };
 
 /// page split property values
-enum css_page_break_t
+enum css_page_break_t : lUInt8
 {
     css_pb_inherit,
     css_pb_auto,
@@ -232,7 +233,7 @@ enum css_page_break_t
 };
 
 /// list-style-type property values
-enum css_list_style_type_t
+enum css_list_style_type_t : lUInt8
 {
     css_lst_inherit,
     css_lst_disc,
@@ -247,7 +248,7 @@ enum css_list_style_type_t
 };
 
 /// list-style-position property values
-enum css_list_style_position_t
+enum css_list_style_position_t : lUInt8
 {
     css_lsp_inherit,
     css_lsp_inside,
@@ -281,7 +282,7 @@ enum css_value_type_t
 };
 
 /// css border style values
-enum css_border_style_type_t
+enum css_border_style_type_t : lUInt8
 {
     css_border_solid,
     css_border_dotted,
@@ -294,7 +295,7 @@ enum css_border_style_type_t
     css_border_none
 };
 /// css background property values
-enum css_background_repeat_value_t
+enum css_background_repeat_value_t : lUInt8
 {
     css_background_repeat,
     css_background_repeat_x,
@@ -304,7 +305,7 @@ enum css_background_repeat_value_t
     css_background_r_inherit,
     css_background_r_none
 };
-enum css_background_position_value_t
+enum css_background_position_value_t : lUInt8
 {
     css_background_left_top,
     css_background_left_center,
@@ -320,7 +321,7 @@ enum css_background_position_value_t
     css_background_p_none
 };
 
-enum css_border_collapse_value_t
+enum css_border_collapse_value_t : lUInt8
 {
     css_border_seperate,
     css_border_collapse,
@@ -329,7 +330,7 @@ enum css_border_collapse_value_t
     css_border_c_none
 };
 
-enum css_orphans_widows_value_t
+enum css_orphans_widows_value_t : lUInt8
 { // supported only if in range 1-9
     css_orphans_widows_inherit,
     css_orphans_widows_1,
@@ -344,7 +345,7 @@ enum css_orphans_widows_value_t
 };
 
 /// float property values
-enum css_float_t
+enum css_float_t : lUInt8
 {
     css_f_inherit,
     css_f_none,
@@ -353,7 +354,7 @@ enum css_float_t
 };
 
 /// clear property values
-enum css_clear_t
+enum css_clear_t : lUInt8
 {
     css_c_inherit,
     css_c_none,
@@ -363,7 +364,7 @@ enum css_clear_t
 };
 
 /// direction property values
-enum css_direction_t
+enum css_direction_t : lUInt8
 {
     css_dir_inherit,
     css_dir_unset,
@@ -372,7 +373,7 @@ enum css_direction_t
 };
 
 /// visibility property values
-enum css_visibility_t
+enum css_visibility_t : lUInt8
 {
     css_v_inherit,
     css_v_visible,
@@ -381,7 +382,7 @@ enum css_visibility_t
 };
 
 /// line-break property values
-enum css_line_break_t
+enum css_line_break_t : lUInt8
 {
     css_lb_inherit,
     css_lb_auto,
@@ -392,7 +393,7 @@ enum css_line_break_t
 };
 
 /// word-break property values
-enum css_word_break_t
+enum css_word_break_t : lUInt8
 {
     css_wb_inherit,
     css_wb_normal,
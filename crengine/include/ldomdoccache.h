@@ -33,6 +33,8 @@ public:
     static LVStreamRef openExisting(lString32 filename, lUInt32 crc, lUInt32 docFlags, lString32& cachePath);
     /// create new cache file
     static LVStreamRef createNew(lString32 filename, lUInt32 crc, lUInt32 docFlags, lUInt32 fileSize, lString32& cachePath);
+    /// update size of cache file and time (ms) spent to parse and render its document, used to choose files to remove
+    static bool updateFileInfo(lString32 cachePath, lUInt32 size, lUInt32 buildTime);
     /// init document cache
     static bool init(lString32 cacheDir, lvsize_t maxSize);
     /// close document cache manager
@@ -30,8 +30,10 @@
 #include <ldomxrange.h>
 #include <ldomxrangelist.h>
 #include <lvembeddedfont.h>
+#include <lvautoptr.h>
 
 class LVRendPageList;
+class ldomParallelFormatter;
 
 class ListNumberingProps
 {
@@ -65,6 +67,13 @@ private:
     ldomXRangeList _selections;
     lUInt32 _doc_rendering_hash;
     bool _open_from_cache;
+    bool _parallelFormatting;
+    ldomParallelFormatter* _parallelFormatter;
+    bool _asyncCacheWrites;
+    lUInt32 _parseTime;  // ms spent to parse document, 0 if opened from cache file
+    lUInt32 _renderTime; // ms spent for last full rendering
+    LVAutoPtr<LVStyleSheet> _styledStylesheet; // stylesheet node styles were last initialized with by render()
+    lUInt32 _styledDefaultsHash;               // hash of default style and font they were initialized with
 
     lString32 _docStylesheetFileName;
 
@@ -82,10 +91,26 @@ private:
     /// saves changes to cache file, limited by time interval (can be called again to continue after TIMEOUT)
     virtual ContinuousOperationResult saveChanges(CRTimerUtil& maxTime, LVDocViewCallback* progressCallback = NULL);
 
+    /// returns hash of render context parameters, known before initialization of node styles
+    lUInt32 calcRenderVariantKey(bool showCover, int y0, int usable_left_overflow, int usable_right_overflow);
+    /// keeps current rendering in cache file as render variant
+    bool saveRenderVariant();
+    /// replaces current rendering by render variant kept in cache file, returns false if there is no usable one
+    bool restoreRenderVariant(lUInt32 key, LVRendPageList* pages);
+    /// frees cache file blocks of render variant and removes it from list
+    void removeRenderVariant(int index);
+
     /// create XPointer from a non-normalized string made by toStringV1()
     ldomXPointer createXPointerV1(ldomNode* baseNode, const lString32& xPointerStr);
     /// create XPointer from a normalized string made by toStringV2()
     ldomXPointer createXPointerV2(ldomNode* baseNode, const lString32& xPointerStr);
+    /// updates node styles after change of stylesheet only, returns number of elements
+    /// whose style changed, or -1 if styles of all nodes need to be initialized again
+    /**
+     * Only restyling is incremental: when some node style changes, the whole document
+     * is laid out and paginated again, as after full restyle.
+     */
+    int updateChangedStyles(LVDocViewCallback* callback);
 protected:
     void applyDocumentStyleSheet();
 public:
@@ -150,8 +175,15 @@ public:
     virtual bool openFromCache(CacheLoadingCallback* formatCallback, LVDocViewCallback* progressCallback = NULL);
     /// saves recent changes to mapped file
     virtual ContinuousOperationResult updateMap(CRTimerUtil& maxTime, LVDocViewCallback* progressCallback = NULL);
+    /// calls OnCacheFileWritten() of callbacks passed to updateMap() whose data is written in background since then,
+    /// doesn't wait for data still being written
+    void deliverCacheFileNotifications();
+    /// drops notifications of callbacks passed to updateMap() whose data is still being written, they are never called
+    void discardCacheFileNotifications();
     /// swaps to cache file or saves changes, limited by time interval
     virtual ContinuousOperationResult swapToCache(CRTimerUtil& maxTime);
+    /// moves blocks of cache file to its start without gaps and truncates it, limited by time interval
+    ContinuousOperationResult compactCacheFile(CRTimerUtil& maxTime);
     /// saves recent changes to mapped file
     virtual bool updateMap(LVDocViewCallback* progressCallback = NULL) {
         CRTimerUtil infinite;
@@ -221,6 +253,10 @@ public:
     bool isOpenFromCache() const {
         return _open_from_cache;
     }
+    /// sets time (ms) spent to parse document, with rendering time it's rebuild cost of cache file
+    void setParseTime(lUInt32 ms) {
+        _parseTime = ms;
+    }
     /// renders (formats) document in memory: returns true if re-rendering needed, false if not
     virtual bool render(LVRendPageList* pages, LVDocViewCallback* callback, int width, int dy,
                         bool showCover, int y0, font_ref_t def_font, int def_interline_space,
@@ -242,10 +278,31 @@ public:
 
     /// create xpointer from doc point
     ldomXPointer createXPointer(lvPoint pt, int direction = PT_DIR_EXACT, bool strictBounds = false, ldomNode* from_node = NULL);
+    /// unpacks render rects of elements shown between doc y positions at once, before drawing or hit testing them,
+    /// returns number of elements in unpacked range
+    int prefetchRenderRects(int y0, int y1);
     /// get rendered block cache object
     CVRendBlockCache& getRendBlockCache() {
         return _renderedBlockCache;
     }
+    /// enable formatting of paragraphs ahead of render pass by shared thread pool workers
+    void setParallelFormatting(bool enabled) {
+        _parallelFormatting = enabled;
+    }
+    bool getParallelFormatting() const {
+        return _parallelFormatting;
+    }
+    /// enable compressing and writing of cache file blocks in background, by shared thread pool workers and I/O thread
+    void setAsyncCacheWrites(bool enabled) {
+        _asyncCacheWrites = enabled;
+    }
+    bool getAsyncCacheWrites() const {
+        return _asyncCacheWrites;
+    }
+    /// returns parallel formatter, only available while rendering
+    ldomParallelFormatter* getParallelFormatter() {
+        return _parallelFormatter;
+    }
 
     bool findText(lString32 pattern, bool caseInsensitive, bool reverse, int minY, int maxY, LVArray<ldomWord>& words, int maxCount, int maxHeight, int maxHeightCheckStartY = -1);
 };
@@ -0,0 +1,59 @@
+/***************************************************************************
+ *   crengine-ng                                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License           *
+ *   as published by the Free Software Foundation; either version 2        *
+ *   of the License, or (at your option) any later version.                *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,            *
+ *   MA 02110-1301, USA.                                                   *
+ ***************************************************************************/
+
+/**
+ * @file ldommemorygovernor.h
+ * @brief Process-wide limit of unpacked document storage data
+ *
+ * Unpacked text, element, render rect and style data chunks of all open
+ * documents are accounted together. When memory budget is set, it replaces
+ * per-document storage limits: document which is being accessed swaps out its
+ * least recently used chunks to the cache file when the total is over budget.
+ * Chunks of other documents are freed by setMemoryBudget() and onMemoryPressure()
+ * only, these must be called from the thread working with documents.
+ * Documents without access lock (not owned by LVDocView), documents busy in
+ * another thread and documents in use by calling thread (e.g. when called
+ * from rendering callbacks) are skipped.
+ */
+
+#ifndef __LDOMMEMORYGOVERNOR_H_INCLUDED__
+#define __LDOMMEMORYGOVERNOR_H_INCLUDED__
+
+#include <lvtypes.h>
+
+/// memory pressure level for ldomMemoryGovernor::onMemoryPressure()
+enum ldomMemoryPressure
+{
+    MEMORY_PRESSURE_MODERATE, ///< reduce unpacked data to half of budget (or half of used memory if there is no budget)
+    MEMORY_PRESSURE_CRITICAL  ///< free all chunks which can be read again, and not recently used node segments
+};
+
+class ldomMemoryGovernor
+{
+public:
+    /// set limit of unpacked data of all documents, bytes; 0 - no limit, per-document storage limits are used
+    static void setMemoryBudget(lUInt32 budget);
+    static lUInt32 getMemoryBudget();
+    /// returns size of unpacked data of all documents, bytes
+    static lUInt32 getUsedMemory();
+    /// frees unpacked data of all documents, least recently used and cheapest to restore first; returns freed bytes
+    static lUInt32 onMemoryPressure(ldomMemoryPressure level);
+};
+
+#endif // __LDOMMEMORYGOVERNOR_H_INCLUDED__
@@ -33,6 +33,7 @@ class ldomTextNode;
 class tinyElement;
 class LVDocViewCallback;
 class RenderRectAccessor;
+class LVCssSelector;
 
 struct lxmlAttribute;
 struct css_elem_def_props_t;
@@ -67,8 +68,10 @@ struct ldomNode
 {
     friend class tinyNodeCollection;
     friend class RenderRectAccessor;
+    friend class RenderRectReader;
     friend class NodeImageProxy;
     friend class ldomDocument;
+    friend class ldomTextView;
 private:
     static ldomDocument* _documentInstances[MAX_DOCUMENT_INSTANCE_COUNT];
 
@@ -170,6 +173,9 @@ public:
     void initNodeRendMethodRecursive();
     /// init render method for the whole subtree
     void initNodeStyleRecursive(LVDocViewCallback* progressCallback);
+    /// init style of subtree elements matched by selectors and of their descendants inheriting
+    /// a changed style, returns number of elements whose style or font changed
+    int updateNodeStyleRecursive(const LVArray<LVCssSelector*>& selectors, LVDocViewCallback* progressCallback);
 
     /// remove node, clear resources
     void destroy();
@@ -0,0 +1,64 @@
+/***************************************************************************
+ *   crengine-ng                                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License           *
+ *   as published by the Free Software Foundation; either version 2        *
+ *   of the License, or (at your option) any later version.                *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,            *
+ *   MA 02110-1301, USA.                                                   *
+ ***************************************************************************/
+
+
+#ifndef __LDOMTEXTVIEW_H_INCLUDED__
+#define __LDOMTEXTVIEW_H_INCLUDED__
+
+#include <lvstring.h>
+
+struct ldomNode;
+class ldomTextStorageChunk;
+
+/// Borrowed utf8 text of text node, without copying
+/**
+ * Text of persistent text node is used in place, in unpacked text storage chunk,
+ * which is kept unpacked while view exists. Text is not zero terminated.
+ * View must not outlive modifications of document.
+ */
+class ldomTextView
+{
+    const lChar8* _text;
+    int _length;
+    ldomTextStorageChunk* _chunk; // pinned chunk, NULL for mutable text node
+    // not copyable
+    ldomTextView(const ldomTextView&);
+    ldomTextView& operator=(const ldomTextView&);
+public:
+    /// empty view for element node
+    explicit ldomTextView(const ldomNode* node);
+    ~ldomTextView();
+    /// returns utf8 text, w/o zero byte at end
+    const lChar8* data() const {
+        return _text;
+    }
+    /// returns text length, bytes
+    int length() const {
+        return _length;
+    }
+    bool empty() const {
+        return _length == 0;
+    }
+    /// returns text length, characters
+    int charCount() const;
+    /// decodes text to dst, reusing its buffer when possible
+    void decode(lString32& dst) const;
+};
+
+#endif // __LDOMTEXTVIEW_H_INCLUDED__
@@ -0,0 +1,133 @@
+/***************************************************************************
+ *   crengine-ng                                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License           *
+ *   as published by the Free Software Foundation; either version 2        *
+ *   of the License, or (at your option) any later version.                *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,            *
+ *   MA 02110-1301, USA.                                                   *
+ ***************************************************************************/
+
+/**
+ * @file lvbatchextractor.h
+ * @brief Headless batch extraction of book metadata and cover thumbnails
+ *
+ * Processes list of book files with several concurrent workers. Each book is
+ * opened by separate LVDocView instance in metadata only mode, total estimated
+ * memory of books being processed at the same time is limited by memory budget.
+ * Results are reported in the order of input files.
+ */
+
+#ifndef LV_BATCH_EXTRACTOR_H
+#define LV_BATCH_EXTRACTOR_H
+
+#include <lvstring.h>
+#include <lvstring32collection.h>
+#include <lvstream.h>
+
+class LVColorDrawBuf;
+
+/// metadata and cover extraction result for single book
+struct LVBookInfo
+{
+    lString32 path;
+    bool ok;
+    lString32 error;
+    lString32 format;
+    lvsize_t fileSize;
+    lString32 title;
+    lString32 authors;
+    lString32 language;
+    lString32 seriesName;
+    int seriesNumber;
+    /// path of saved cover thumbnail, empty if not saved
+    lString32 coverPath;
+    /// true if cover thumbnail is generated from title and authors
+    bool coverGenerated;
+    /// size of original cover image, 0 if book has no cover image
+    int coverWidth;
+    int coverHeight;
+    /// phase timings, milliseconds: reading file, loading metadata, decoding and scaling cover, saving thumbnail
+    int readTime;
+    int loadTime;
+    int coverTime;
+    int saveTime;
+    LVBookInfo()
+            : ok(false)
+            , fileSize(0)
+            , seriesNumber(0)
+            , coverGenerated(false)
+            , coverWidth(0)
+            , coverHeight(0)
+            , readTime(0)
+            , loadTime(0)
+            , coverTime(0)
+            , saveTime(0) { }
+    /// returns single line JSON object with all fields
+    lString8 toJson() const;
+};
+
+class LVBatchExtractorCallback
+{
+public:
+    virtual ~LVBatchExtractorCallback() { }
+    /// called from the thread running LVBatchExtractor::run(), in the order of input files
+    virtual void onBookInfo(const LVBookInfo& info) = 0;
+};
+
+class LVBatchExtractor
+{
+    class Batch;
+    int _threadCount;
+    lvsize_t _memoryBudget;
+    lString32 _coverDir;
+    int _thumbWidth;
+    int _thumbHeight;
+    bool _generateCovers;
+    void processBook(LVBookInfo& info, Batch* batch);
+    LVColorDrawBuf* makeCover(LVBookInfo& info, LVStreamRef coverStream);
+public:
+    LVBatchExtractor();
+    /// number of concurrent workers, 0 - number of processors
+    void setThreadCount(int threadCount) {
+        _threadCount = threadCount;
+    }
+    int getThreadCount() const {
+        return _threadCount;
+    }
+    /// estimated memory limit for books processed at the same time, bytes
+    void setMemoryBudget(lvsize_t budget) {
+        _memoryBudget = budget;
+    }
+    lvsize_t getMemoryBudget() const {
+        return _memoryBudget;
+    }
+    /// directory to save cover thumbnails (as BMP files) to, empty - don't save covers
+    void setCoverDir(const lString32& dir) {
+        _coverDir = dir;
+    }
+    /// cover thumbnail size, image is scaled preserving aspect ratio
+    void setThumbSize(int width, int height) {
+        _thumbWidth = width;
+        _thumbHeight = height;
+    }
+    /// generate cover from title and authors for books without cover image
+    void setGenerateCovers(bool generate) {
+        _generateCovers = generate;
+    }
+    /// process books, callback is called for every file; returns number of successfully processed books
+    int run(const lString32Collection& files, LVBatchExtractorCallback* callback);
+    /// recursively finds files of supported book formats in directory, returns number of found files
+    static int findBooks(const lString32& dir, lString32Collection& files);
+};
+
+#endif // LV_BATCH_EXTRACTOR_H
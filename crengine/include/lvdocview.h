@@ -51,6 +51,7 @@
 #include <lvcolordrawbuf.h>
 #include <crhist.h>
 #include <lvthread.h>
+#include <crlocks.h>
 #include <lvcacheloadingcallback.h>
 #include <lvdocprops.h>
 #include <lvdocviewcmd.h>
@@ -120,93 +121,67 @@ public:
 
 typedef LVRef<LVDocImageHolder> LVDocImageRef;
 
+class LVDocView;
+class CRTaskGroup;
+
 /// page image cache
+/**
+    Ring of page images around the current page. Pages are rendered by
+    tasks of the shared engine thread pool when engine concurrency is set up
+    (see CRSetupEngineConcurrency()), or immediately in the calling thread
+    otherwise. Tasks are queued in order of distance from the current page,
+    pages dropped from the ring before their rendering is started are cancelled.
+*/
 class LVDocViewImageCache
 {
+public:
+    class Item;
+    class RenderTask;
 private:
+    friend class RenderTask;
     LVMutex _mutex;
-    class Item
-    {
-    public:
-        LVDrawBufRef _drawbuf;
-        LVRef<LVThread> _thread;
-        int _offset;
-        int _page;
-        bool _ready;
-        bool _valid;
-    };
-    Item _items[2];
-    int _last;
+    LVPtrVector<Item> _items;
+    // dropped items, which are still referenced by render tasks
+    LVPtrVector<Item> _released;
+    int _maxSize;
+    CRTaskGroup* _tasks;
+    CRMonitorRef _readyMonitor;
+    // pages to be rendered by render task, it doesn't take _mutex which may be held by image holder
+    LVMutex _queueMutex;
+    LVArray<Item*> _queue;
+    bool _renderTaskQueued;
+    Item* find(int offset, int page);
+    void makeReady(Item* item);
+    void release(Item* item);
+    void purgeReleased();
+    void notifyReady();
+    void enqueue(Item* item);
+    Item* dequeue();
 public:
     /// return mutex
     LVMutex& getMutex() {
         return _mutex;
     }
-    /// set page to cache
-    void set(int offset, int page, LVDrawBufRef drawbuf, LVRef<LVThread> thread) {
-        LVLock lock(_mutex);
-        _last = (_last + 1) & 1;
-        _items[_last]._ready = false;
-        _items[_last]._thread = thread;
-        _items[_last]._drawbuf = drawbuf;
-        _items[_last]._offset = offset;
-        _items[_last]._page = page;
-        _items[_last]._valid = true;
-    }
-    /// return page image, wait until ready
-    LVDrawBufRef getWithoutLock(int offset, int page) {
-        for (int i = 0; i < 2; i++) {
-            if (_items[i]._valid &&
-                ((_items[i]._offset == offset && offset != -1) || (_items[i]._page == page && page != -1))) {
-                if (!_items[i]._ready) {
-                    _items[i]._thread->join();
-                    _items[i]._thread = NULL;
-                    _items[i]._ready = true;
-                }
-                _last = i;
-                return _items[i]._drawbuf;
-            }
-        }
-        return LVDrawBufRef();
-    }
-    /// return page image, wait until ready
-    LVDocImageRef get(int offset, int page) {
-        _mutex.lock();
-        LVDrawBufRef buf = getWithoutLock(offset, page);
-        if (!buf.isNull())
-            return LVDocImageRef(new LVDocImageHolder(getWithoutLock(offset, page), _mutex));
-        return LVDocImageRef(NULL);
-    }
-    bool has(int offset, int page) {
-        _mutex.lock();
-        for (int i = 0; i < 2; i++) {
-            if (_items[i]._valid && ((_items[i]._offset == offset && offset != -1) || (_items[i]._page == page && page != -1))) {
-                return true;
-            }
-        }
-        return false;
-    }
-    void clear() {
-        LVLock lock(_mutex);
-        for (int i = 0; i < 2; i++) {
-            if (_items[i]._valid && !_items[i]._ready) {
-                _items[i]._thread->join();
-            }
-            _items[i]._thread.Clear();
-            _items[i]._valid = false;
-            _items[i]._drawbuf.Clear();
-            _items[i]._offset = -1;
-            _items[i]._page = -1;
-        }
-    }
-    LVDocViewImageCache()
-            : _last(0) {
-        for (int i = 0; i < 2; i++)
-            _items[i]._valid = false;
-    }
-    ~LVDocViewImageCache() {
-        clear();
-    }
+    /// set maximum number of cached pages (at least 2)
+    void setMaxSize(int size);
+    /// returns maximum number of cached pages
+    int getMaxSize() const {
+        return _maxSize;
+    }
+    /// queue page rendering; when cache is full, pages farthest from current position (curOffset or curPage) are dropped
+    void add(LVDocView* view, int offset, int page, LVDrawBufRef drawbuf, int curOffset, int curPage);
+    /// return page image, wait until ready; page not started yet is rendered under lock of view
+    LVDocImageRef get(LVDocView* view, int offset, int page);
+    /// returns true if page is in cache (probably not rendered yet)
+    bool has(int offset, int page);
+    /// returns true if page is in cache and its rendering is finished
+    bool isReady(int offset, int page);
+    /// drop pages which are not listed (offsets for scroll mode, page numbers for page mode), cancel their rendering
+    void retain(LVArray<int>& offsets, LVArray<int>& pages);
+    /// drop all pages, cancel their rendering and wait for render tasks started already
+    void clear();
+    LVDocViewImageCache();
+    ~LVDocViewImageCache();
 };
 #endif
 
@@ -399,6 +374,8 @@ private:
     LVMutex _mutex;
 #if CR_ENABLE_PAGE_IMAGE_CACHE == 1
     LVDocViewImageCache m_imageCache;
+    int m_imageCacheAhead;
+    int m_imageCacheBehind;
 #endif
 
     lString8 m_defaultFontFace;
@@ -439,6 +416,12 @@ private:
     /// format of document from cache is known
     virtual void OnCacheFileFormatDetected(doc_format_t fmt);
     void insertBookmarkPercentInfo(int start_page, int end_y, int percent);
+#if CR_ENABLE_PAGE_IMAGE_CACHE == 1
+    /// calculates page image position for page delta (0=current, -1=prev, 1=next), returns false if no such page
+    bool getPageImagePos(int delta, int& offset, int& page);
+    /// creates page image buffer of current view size and depth
+    LVDrawBufRef createPageImageBuffer();
+#endif
 
     void updateDocStyleSheet();
     /// get bookmark position text (for FictionBook format)
@@ -513,6 +496,8 @@ public:
     ContinuousOperationResult updateCache(CRTimerUtil& maxTime);
     /// save unsaved data to cache file (if one is created), w/o timeout
     ContinuousOperationResult updateCache();
+    /// defragment cache file (if one is created) and reduce its size, with timeout option
+    ContinuousOperationResult compactCache(CRTimerUtil& maxTime);
 
     /// returns selected (marked) ranges
     ldomMarkedRangeList* getMarkedRanges() {
@@ -600,12 +585,8 @@ public:
     virtual void drawPageBackground(LVDrawBuf& drawbuf, int offsetX, int offsetY, int alpha = 0);
 
     // callback functions
-    /// set callback
-    LVDocViewCallback* setCallback(LVDocViewCallback* callback) {
-        LVDocViewCallback* old = m_callback;
-        m_callback = callback;
-        return old;
-    }
+    /// set callback, cache file notifications of writes already done are delivered to previous one, pending ones are dropped
+    LVDocViewCallback* setCallback(LVDocViewCallback* callback);
     /// get callback
     LVDocViewCallback* getCallback() {
         return m_callback;
@@ -688,6 +669,10 @@ public:
     bool IsDrawed();
     /// cache page image (render in background if necessary) (0=current, -1=prev, 1=next)
     void cachePageImage(int delta);
+    /// set number of pages to pre-render in background after and before current page
+    void setPageImageCacheSize(int ahead, int behind);
+    /// queue background rendering of pages around current one (next pages first), cancel stale ones
+    void prerenderPageImages();
 #endif
     /// return view mutex
     LVMutex& getMutex() {
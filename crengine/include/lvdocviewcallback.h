@@ -76,6 +76,9 @@ public:
     virtual void OnSaveCacheFileEnd() { }
     /// save cache file progress, called with values 0..100
     virtual void OnSaveCacheFileProgress(int /*percent*/) { }
+    /// all changes are written to cache file; with background writing (PROP_CACHE_ASYNC_WRITE) called later on the same thread,
+    /// by next cache update, when callback is replaced or when document is closed, if writing is done by then (not called otherwise)
+    virtual void OnCacheFileWritten(bool /*success*/) { }
     /// destructor
     virtual ~LVDocViewCallback() { }
 };
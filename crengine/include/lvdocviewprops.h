@@ -72,6 +72,9 @@
 #define PROP_SHOW_PAGE_NUMBER     "window.status.pos.page.number"
 #define PROP_SHOW_BATTERY_PERCENT "window.status.battery.percent"
 #define PROP_LANDSCAPE_PAGES      "window.landscape.pages"
+// number of pages pre-rendered in background after/before current page (page image cache)
+#define PROP_PAGE_IMAGE_CACHE_AHEAD  "crengine.page.image.cache.ahead"
+#define PROP_PAGE_IMAGE_CACHE_BEHIND "crengine.page.image.cache.behind"
 
 // Generic font families font faces
 // For css_font_family_t enum (cssdef.h)
@@ -111,10 +114,28 @@
 #define PROP_RENDER_SCALE_FONT_WITH_DPI   "crengine.render.scale.font.with.dpi"
 #define PROP_RENDER_BLOCK_RENDERING_FLAGS "crengine.render.block.rendering.flags"
 #define PROP_REQUESTED_DOM_VERSION        "crengine.render.requested_dom_version"
+// format paragraphs ahead of render pass using shared thread pool (same result, faster on multicore)
+#define PROP_RENDER_PARALLEL_FORMATTING "crengine.render.parallel.formatting"
+// decode, tokenize and build DOM of XML/HTML documents in separate threads when loading,
+// tokenize EPUB spine items by thread pool workers
+#define PROP_LOAD_PIPELINED "crengine.load.pipelined"
 
 #define PROP_CACHE_VALIDATION_ENABLED            "crengine.cache.validation.enabled"
 #define PROP_MIN_FILE_SIZE_TO_CACHE              "crengine.cache.filesize.min"
 #define PROP_FORCED_MIN_FILE_SIZE_TO_CACHE       "crengine.cache.forced.filesize.min"
+// compress cache file blocks by thread pool workers and write them by background I/O thread,
+// LVDocViewCallback::OnCacheFileWritten() is called when done
+#define PROP_CACHE_ASYNC_WRITE                   "crengine.cache.async.write"
+// read existing cache file through memory mapping (not on Windows), uncompressed blocks are used in place
+#define PROP_CACHE_MMAP_READ                     "crengine.cache.mmap.read"
+// read node segments of document opened from cache file on first access, not accessed segments can be freed
+#define PROP_CACHE_LAZY_NODES                    "crengine.cache.lazy.nodes"
+// train zstd dictionary of text, element and render rect data of document when creating its cache file
+#define PROP_CACHE_COMPRESSION_DICT              "crengine.cache.compression.dictionary"
+// number of recent render contexts (font size, page size...) whose renderings are kept in cache file, 0 - only current one
+#define PROP_CACHE_RENDER_VARIANTS               "crengine.cache.render.variants"
+// keep parent, child and element name arrays of rendered document in memory and cache file, for tree walks without unpacking element data
+#define PROP_DOM_TRAVERSAL_INDEX                 "crengine.dom.traversal.index"
 #define PROP_HIGHLIGHT_COMMENT_BOOKMARKS         "crengine.highlight.bookmarks"
 #define PROP_HIGHLIGHT_SELECTION_COLOR           "crengine.highlight.selection.color"
 #define PROP_HIGHLIGHT_BOOKMARK_COLOR_COMMENT    "crengine.highlight.bookmarks.color.comment"
@@ -243,10 +243,11 @@ typedef LVProtectedFastRef<LVFont> LVFontRef;
 
     implements single interface for font of any engine
 */
-class LVFont: public LVRefCounter
+class LVFont: public LVAtomicRefCounter
 {
 protected:
     int _visual_alignment_width;
+    CRLazyMutex _instanceMutex;
 public:
     lUInt32 _hash;
     /// glyph properties structure
@@ -386,6 +387,11 @@ public:
             : _visual_alignment_width(-1)
             , _hash(0) { }
 
+    /// returns mutex protecting state and glyph cache of this font instance, NULL if engine concurrency is not set up
+    CRMutex* getInstanceMutex() {
+        return _instanceMutex.get();
+    }
+
     /// get bitmap mode (true=monochrome bitmap, false=antialiased)
     virtual bool getBitmapMode() {
         return false;
@@ -487,4 +493,18 @@ public:
 /// to compare two fonts
 bool operator==(const LVFont& r1, const LVFont& r2);
 
+/// Holds instance mutexes of font and all fonts of it's fallback chain
+/**
+ * Glyphs got from font caches may be used only while font instance mutex is held,
+ * glyphs of fallback fonts are returned by font itself, so the whole chain is locked.
+ */
+class LVFontChainGuard
+{
+    CRMutex* _mutexes[32];
+    int _count;
+public:
+    LVFontChainGuard(LVFont* font, lUInt32 fallbackPassMask);
+    ~LVFontChainGuard();
+};
+
 #endif //__LV_FONT_H_INCLUDED__
@@ -33,6 +33,8 @@
 #include <crlocks.h>
 #include <lvautoptr.h>
 
+#include <atomic>
+
 /// Memory manager pool for ref counting
 /**
     For fast and efficient allocation of ref counter structures
@@ -87,6 +89,28 @@ public:
     }
 };
 
+/// thread safe ref counter implementation for LVProtectedFastRef
+class LVAtomicRefCounter
+{
+    std::atomic<int> refCount;
+    // non-copyable
+    LVAtomicRefCounter(const LVAtomicRefCounter&);
+    LVAtomicRefCounter& operator=(const LVAtomicRefCounter&);
+public:
+    LVAtomicRefCounter()
+            : refCount(0) { }
+    void AddRef() {
+        refCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    int Release() {
+        // acquire-release: deleting thread must see all changes made by other owners
+        return refCount.fetch_sub(1, std::memory_order_acq_rel) - 1;
+    }
+    int getRefCount() {
+        return refCount.load(std::memory_order_relaxed);
+    }
+};
+
 /// Fast smart pointer with reference counting
 /**
     Stores pointer to object and reference counter.
@@ -226,14 +250,17 @@ public:
     }
 };
 
-/// Fast smart pointer with reference counting and protection by mutex
+/// Fast smart pointer with thread safe reference counting
 /**
     Stores pointer to object and reference counter.
     Imitates usual pointer behavior, but deletes object
     when there are no more references on it.
     On copy, increases reference counter.
     On destroy, decreases reference counter; deletes object if counter became 0.
-    T should implement AddRef() and Release() methods.
+    T should implement AddRef() and Release() methods atomically, like LVAtomicRefCounter does,
+    so different references to the same object may be copied and destroyed from different threads
+    without any lock. As for usual pointer, single reference instance must not be modified
+    by one thread while it is being accessed by another one.
     \param T class of stored object
  */
 template <class T>
@@ -241,15 +268,13 @@ class LVProtectedFastRef
 {
 private:
     T* _ptr;
-    inline T* Release() {
-        T* res = NULL;
+    inline void Release() {
         if (_ptr) {
             if (_ptr->Release() == 0) {
-                res = _ptr;
+                delete _ptr;
             }
             _ptr = NULL;
         }
-        return res;
     }
 public:
     /// Default constructor.
@@ -262,7 +287,6 @@ public:
     \param ptr is a pointer to object
      */
     explicit LVProtectedFastRef(T* ptr) {
-        REF_GUARD
         _ptr = ptr;
         if (_ptr)
             _ptr->AddRef();
@@ -273,7 +297,6 @@ public:
     \param ref is reference to copy
      */
     LVProtectedFastRef(const LVProtectedFastRef& ref) {
-        REF_GUARD
         _ptr = ref._ptr;
         if (_ptr)
             _ptr->AddRef();
@@ -282,25 +305,13 @@ public:
     /// Destructor.
     /** Decrements reference counter; deletes object if counter became 0. */
     ~LVProtectedFastRef() {
-        T* removed = NULL;
-        {
-            REF_GUARD
-            removed = Release();
-        }
-        if (removed)
-            delete removed;
+        Release();
     }
 
     /// Clears pointer.
     /** Sets object pointer to NULL. */
     void Clear() {
-        T* removed = NULL;
-        {
-            REF_GUARD
-            removed = Release();
-        }
-        if (removed)
-            delete removed;
+        Release();
     }
 
     /// Copy operator.
@@ -309,20 +320,7 @@ public:
     \param ref is reference to copy
      */
     LVProtectedFastRef& operator=(const LVProtectedFastRef& ref) {
-        T* removed = NULL;
-        {
-            REF_GUARD
-            if (_ptr) {
-                if (_ptr == ref._ptr)
-                    return *this;
-                removed = Release();
-            }
-            if (ref._ptr)
-                (_ptr = ref._ptr)->AddRef();
-        }
-        if (removed)
-            delete removed;
-        return *this;
+        return operator=(ref._ptr);
     }
 
     /// Object pointer assignment operator.
@@ -331,19 +329,13 @@ public:
     \param obj pointer to object
      */
     LVProtectedFastRef& operator=(T* obj) {
-        T* removed = NULL;
-        {
-            REF_GUARD
-            if (_ptr) {
-                if (_ptr == obj)
-                    return *this;
-                removed = Release();
-            }
-            if (obj)
-                (_ptr = obj)->AddRef();
-        }
-        if (removed)
-            delete removed;
+        if (_ptr == obj)
+            return *this;
+        // add new reference before releasing old one: obj may be owned by the old object
+        if (obj)
+            obj->AddRef();
+        Release();
+        _ptr = obj;
         return *this;
     }
 
@@ -51,6 +51,16 @@ public:
         _autoresize = true;
         _size = _pos = size;
     }
+    /// refer to external read-only data without copying, data should stay valid while buffer is used
+    void setExternal(const lUInt8* buf, lUInt32 size) {
+        if (_buf && _ownbuf)
+            free(_buf);
+        _buf = const_cast<lUInt8*>(buf);
+        _ownbuf = false;
+        _error = false;
+        _autoresize = false;
+        _size = _pos = size;
+    }
     bool copyTo(lUInt8* buf, lUInt32 maxSize);
     inline lUInt8* buf() {
         return _buf;
@@ -1520,6 +1520,10 @@ lString32 Utf8ToUnicode(const lString8& str);
 lString32 Utf8ToUnicode(const char* s);
 /// converts utf-8 string fragment to wide unicode string
 lString32 Utf8ToUnicode(const char* s, int sz);
+/// returns number of characters in utf-8 string fragment
+int Utf8CharCount(const lChar8* str, int len);
+/// converts utf-8 string fragment to wide unicode string, reusing buffer of dst when possible
+void Utf8ToUnicode(const char* s, int sz, lString32& dst);
 /// converts utf-8 string fragment to wide unicode string
 void Utf8ToUnicode(const lUInt8* src, int& srclen, lChar32* dst, int& dstlen);
 /// converts utf-16 string to wide unicode string
@@ -41,6 +41,7 @@
 #include <cssdef.h>
 #include <lvstyles.h>
 #include <lvptrvec.h>
+#include <lvhashtable.h>
 
 class lxmlDocBase;
 struct ldomNode;
@@ -155,10 +156,62 @@ public:
     bool isFullChecking() {
         return _type == cssrt_ancessor || _type == cssrt_predsibling;
     }
+    /// combinator rules move check to other node, next rules are about that node
+    bool isCombinator() {
+        return _type == cssrt_parent || _type == cssrt_ancessor || _type == cssrt_predecessor || _type == cssrt_predsibling;
+    }
+    LVCssSelectorRuleType getType() {
+        return _type;
+    }
+    lUInt16 getId() {
+        return _id;
+    }
+    lUInt16 getAttrId() {
+        return _attrid;
+    }
+    const lString32& getValue() {
+        return _value;
+    }
     lUInt32 getHash();
     lUInt32 getWeight();
 };
 
+/// max number of ancestor hashes checked against LVCssAncestorFilter per selector
+#define CSS_SELECTOR_MAX_ANCESTOR_HASHES 4
+/// number of counters of LVCssAncestorFilter
+#define CSS_ANCESTOR_FILTER_SIZE 4096
+
+/// counting Bloom filter of element names, ids and classes of ancestors of styled node
+/**
+    Kept by style traversal of DOM tree: node is pushed before its children are styled
+    and popped after them, so selectors with descendant and child combinators requiring
+    ancestors which are not there can be rejected without walking up the tree.
+*/
+class LVCssAncestorFilter
+{
+    lUInt8 _counters[CSS_ANCESTOR_FILTER_SIZE];
+    LVArray<lUInt32> _hashes;
+    LVArray<int> _nodeHashesStart;
+    LVArray<lUInt32> _nodes;
+    void add(lUInt32 hash);
+    void remove(lUInt32 hash);
+public:
+    LVCssAncestorFilter();
+    static lUInt32 elementHash(lUInt16 id);
+    static lUInt32 idHash(const lString32& id);
+    static lUInt32 classHash(const lString32& className);
+    /// adds node as the deepest ancestor
+    void push(const ldomNode* node);
+    /// removes the deepest ancestor
+    void pop();
+    /// returns data index of the deepest ancestor, 0 if there is none
+    lUInt32 top() const {
+        return _nodes.length() > 0 ? _nodes[_nodes.length() - 1] : 0;
+    }
+    /// returns false if no ancestor has hash (true may be false positive)
+    bool mayContain(lUInt32 hash) const;
+};
+
 /** \brief simple CSS selector
     
     Currently supports only element name and universal selector.
@@ -176,6 +229,7 @@ private:
     int _pseudo_elem; // from enum LVCssSelectorPseudoElement, or 0
     LVCssSelector* _next;
     LVCssSelectorRule* _rules;
+    lUInt32 _ancestorHashes[CSS_SELECTOR_MAX_ANCESTOR_HASHES]; // see initAncestorHashes()
     void insertRuleStart(LVCssSelectorRule* rule);
     void insertRuleAfterStart(LVCssSelectorRule* rule);
 public:
@@ -185,13 +239,17 @@ public:
             , _specificity(0)
             , _pseudo_elem(0)
             , _next(NULL)
-            , _rules(NULL) { }
+            , _rules(NULL) {
+        _ancestorHashes[0] = 0;
+    }
     LVCssSelector(int specificity)
             : _id(0)
             , _specificity(specificity)
             , _pseudo_elem(0)
             , _next(NULL)
-            , _rules(NULL) { }
+            , _rules(NULL) {
+        _ancestorHashes[0] = 0;
+    }
     ~LVCssSelector() {
         if (_next)
             delete _next;
@@ -203,18 +261,35 @@ public:
         return _id;
     }
     bool check(const ldomNode* node) const;
+    /// returns rule of rightmost compound selector to put selector in bucket by (#id, .class or [attr]), NULL if none
+    LVCssSelectorRule* getKeyRule() const;
+    /// collects hashes of element names, ids and classes required from ancestors of node
+    void initAncestorHashes();
+    /// returns true if selector checks siblings, position or children of elements (combinators + and ~, pseudo-classes)
+    bool isStructural() const;
+    /// returns false if ancestors in filter cannot match selector
+    bool mayMatch(const LVCssAncestorFilter* filter) const {
+        for (int i = 0; i < CSS_SELECTOR_MAX_ANCESTOR_HASHES && _ancestorHashes[i]; i++) {
+            if (!filter->mayContain(_ancestorHashes[i]))
+                return false;
+        }
+        return true;
+    }
     void applyToPseudoElement(const ldomNode* node, css_style_rec_t* style) const;
-    void apply(const ldomNode* node, css_style_rec_t* style) const {
-        if (check(node)) {
-            if (_pseudo_elem > 0) {
-                applyToPseudoElement(node, style);
-            } else {
-                _decl->apply(style);
-            }
-            // style->flags |= STYLE_REC_FLAG_MATCHED;
-            // Done in applyToPseudoElement() as currently only needed there.
-            // Uncomment if more generic usage needed.
+    /// applies declaration of selector already checked to match node
+    void applyChecked(const ldomNode* node, css_style_rec_t* style) const {
+        if (_pseudo_elem > 0) {
+            applyToPseudoElement(node, style);
+        } else {
+            _decl->apply(style);
         }
+        // style->flags |= STYLE_REC_FLAG_MATCHED;
+        // Done in applyToPseudoElement() as currently only needed there.
+        // Uncomment if more generic usage needed.
+    }
+    void apply(const ldomNode* node, css_style_rec_t* style) const {
+        if (check(node))
+            applyChecked(node, style);
     }
     void setDeclaration(LVCssDeclRef decl) {
         _decl = decl;
@@ -229,7 +304,48 @@ public:
         _next = next;
     }
     lUInt32 getHash();
+    /// calculate hash of this selector alone (without next ones of its chain and its parse order)
+    lUInt32 getOwnHash();
+};
+
+/// immutable set of selectors compiled from one stylesheet text, shared by stylesheets including it
+class LVCssSelectorSet
+{
+public:
+    /// selector chains by element name id (0 for none), sorted by specificity
+    LVPtrVector<LVCssSelector> selectors;
+    /// number of parsed selectors, order of selector in set is kept in its specificity
+    int selectorCount;
+    lUInt32 hash;
+    LVCssSelectorSet()
+            : selectorCount(0)
+            , hash(0) { }
+    bool empty() const {
+        return selectors.length() == 0;
+    }
+};
+typedef LVRef<LVCssSelectorSet> LVCssSelectorSetRef;
+
+/// selectors of all sets of stylesheet ordered and bucketed for LVStyleSheet::apply()
+/**
+    ordered holds them in order of application, buckets hold positions in ordered
+    of selectors keyed by #id, .class or [attr] of their rightmost compound selector,
+    or by element name if there is no such key (element name 0 for none).
+*/
+struct LVCssSelectorIndex
+{
+    LVArray<LVCssSelector*> ordered;
+    LVArray<bool> orderedStructural;
+    LVPtrVector<LVArray<int>> buckets;
+    LVArray<int> elementBuckets;
+    LVArray<int> attrBuckets;
+    LVHashTable<lString32, int> idBuckets;
+    LVHashTable<lString32, int> classBuckets;
+    LVCssSelectorIndex()
+            : idBuckets(64)
+            , classBuckets(256) { }
 };
+typedef LVRef<LVCssSelectorIndex> LVCssSelectorIndexRef;
 
 /** \brief stylesheet
     
@@ -237,6 +353,11 @@ public:
 
     Currently supports only subset of CSS features.
 
+    Rules are kept as a list of immutable selector sets, one per parsed text:
+    push() and pop() only save and restore length of this list (and its index),
+    and texts parsed again (like the same CSS file linked from each EPUB fragment)
+    reuse sets compiled before.
+
     \sa LVCssSelector
     \sa LVCssDeclaration
 */
@@ -244,63 +365,84 @@ class LVStyleSheet
 {
     lxmlDocBase* _doc;
 
-    int _selector_count;
-    LVArray<int> _selector_count_stack;
     lString8 _charset;
 
-    LVPtrVector<LVCssSelector> _selectors;
-    LVPtrVector<LVPtrVector<LVCssSelector>> _stack;
-    LVPtrVector<LVCssSelector>* dup() {
-        LVPtrVector<LVCssSelector>* res = new LVPtrVector<LVCssSelector>();
-        res->reserve(_selectors.length());
-        for (int i = 0; i < _selectors.length(); i++) {
-            LVCssSelector* selector = _selectors[i];
-            if (selector)
-                res->add(new LVCssSelector(*selector));
-            else
-                res->add(NULL);
-        }
-        return res;
-    }
+    LVArray<LVCssSelectorSetRef> _sets;
+    LVCssSelectorIndexRef _index; // NULL until built by apply() after change of sets
+
+    struct State
+    {
+        int setCount;
+        LVCssSelectorIndexRef index;
+    };
+    LVArray<State> _stack;
 
-    void set(LVPtrVector<LVCssSelector>& v);
+    // Recently parsed sets, see parse()
+    struct ParsedItem
+    {
+        lUInt32 hash;
+        lString8 text;
+        lString32 codeBase;
+        bool higherImportance;
+        lUInt32 domVersion;
+        LVCssSelectorSetRef set;
+    };
+    LVPtrVector<ParsedItem> _parsed;
+    lUInt32 _parsedTextSize;
+    lUInt32 _parsedHits;
+
+    LVArray<int> _applyBuckets; // buckets merged by apply(), to avoid allocations
+    LVArray<int> _applyPos;
+    LVCssAncestorFilter* _ancestorFilter;
+    LVArray<lUInt32> _lastApplyChecks; // see getLastApplyChecks()
+
+    void buildIndex();
+    void addApplyBucket(int bucket);
+    void parseSet(LVCssSelectorSet* set, const char* str, bool higher_importance, lString32 codeBase);
+    void addSet(LVCssSelectorSetRef set);
 public:
     // save current state of stylesheet
     void push() {
-        _selector_count_stack.add(_selector_count);
-        _stack.add(dup());
+        State state;
+        state.setCount = _sets.length();
+        state.index = _index;
+        _stack.add(state);
     }
     // restore previously saved state
     bool pop() {
-        // Restore original counter (so we don't overflow the 19 bits
-        // of _specificity reserved for storing selector order, so up
-        // to 524288, when we meet a book with 600 DocFragments each
-        // including a 1000 selectors stylesheet).
-        if (!_selector_count_stack.empty())
-            _selector_count = _selector_count_stack.remove(_selector_count_stack.length() - 1);
-        LVPtrVector<LVCssSelector>* v = _stack.pop();
-        if (!v)
+        if (_stack.empty())
             return false;
-        set(*v);
-        delete v;
+        State state = _stack.remove(_stack.length() - 1);
+        while (_sets.length() > state.setCount)
+            _sets.remove(_sets.length() - 1);
+        _index = state.index;
         return true;
     }
 
     /// remove all rules from stylesheet
     void clear() {
-        _selector_count = 0;
-        _selector_count_stack.clear();
-        _selectors.clear();
+        _sets.clear();
         _stack.clear();
+        _index.Clear();
     }
     /// set document to retrieve ID values from
     void setDocument(lxmlDocBase* doc) {
+        if (doc != _doc)
+            clearParsed(); // element and attribute name ids are not the same
         _doc = doc;
     }
+    /// forget recently parsed sets
+    void clearParsed();
+    /// number of parse() calls which reused selectors compiled from the same text before
+    lUInt32 getParsedHits() const {
+        return _parsedHits;
+    }
     /// constructor
     LVStyleSheet(lxmlDocBase* doc = NULL)
             : _doc(doc)
-            , _selector_count(0) { }
+            , _parsedTextSize(0)
+            , _parsedHits(0)
+            , _ancestorFilter(NULL) { }
     /// copy constructor
     LVStyleSheet(LVStyleSheet& sheet);
     /// parse stylesheet, compile and add found rules to sheet
@@ -309,6 +451,23 @@ public:
     bool parseCharsetRule(const char*& str);
     /// apply stylesheet to node style
     void apply(const ldomNode* node, css_style_rec_t* style);
+    /// returns structural selectors (see LVCssSelector::isStructural()) checked by last apply(),
+    /// as their index positions shifted left by 1 with lowest bit set if selector matched.
+    /// Result of other selectors depends only on name, attributes and ancestors of node.
+    const LVArray<lUInt32>& getLastApplyChecks() const {
+        return _lastApplyChecks;
+    }
+    /// returns true if structural selectors from getLastApplyChecks() of some node give
+    /// the same results for this node
+    bool checkSameResults(const ldomNode* node, const LVArray<lUInt32>& checks);
+    /// collects selectors applied by only one of this stylesheet and the old one: styles of nodes
+    /// matched by none of them are the same with both, if the function returns true.
+    /// Returns false if selectors of both are not applied in the same order.
+    bool getChangedSelectors(LVStyleSheet& old, LVArray<LVCssSelector*>& changed);
+    /// set ancestor filter of style traversal, NULL when there is no traversal
+    void setAncestorFilter(LVCssAncestorFilter* filter) {
+        _ancestorFilter = filter;
+    }
     /// calculate hash
     lUInt32 getHash();
 };
@@ -137,134 +137,138 @@ enum css_style_rec_important_bit
     \brief Element style record.
 
     Contains set of style properties.
+
+    Properties are ordered by how often they are used: single byte enums and
+    lengths needed for most elements come first, strings and !important
+    bitmaps (only used while applying stylesheets) last.
 */
 typedef struct css_style_rec_tag css_style_rec_t;
 struct css_style_rec_tag
 {
-    int refCount;                     // for reference counting
-    lUInt32 hash;                     // cache calculated hash value here
-    lUInt32 important[NB_IMP_SLOTS];  // bitmap for !important (used only by LVCssDeclaration)
-    lUInt32 importance[NB_IMP_SLOTS]; // bitmap for important bit's importance/origin
-                                      // (allows for 2 level of !important importance)
+    int refCount; // for reference counting
+    lUInt32 hash; // cache calculated hash value here
     css_display_t display;
     css_white_space_t white_space;
     css_text_align_t text_align;
     css_text_align_t text_align_last;
-    css_text_decoration_t text_decoration;
-    css_text_transform_t text_transform;
-    css_length_t vertical_align;
     css_font_family_t font_family;
-    lString8 font_name;
-    css_length_t font_size;
     css_font_style_t font_style;
     css_font_weight_t font_weight;
-    css_length_t font_features;
-    css_length_t text_indent;
-    css_length_t line_height;
-    css_length_t width;
-    css_length_t height;
-    css_length_t min_width;
-    css_length_t min_height;
-    css_length_t max_width;
-    css_length_t max_height;
-    css_length_t margin[4];  ///< margin-left, -right, -top, -bottom
-    css_length_t padding[4]; ///< padding-left, -right, -top, -bottom
-    css_length_t color;
-    css_length_t background_color;
-    css_length_t letter_spacing;
-    css_page_break_t page_break_before;
-    css_page_break_t page_break_after;
-    css_page_break_t page_break_inside;
+    css_float_t float_; // "float" is a C++ keyword...
+    css_clear_t clear;
+    css_direction_t direction;
+    css_visibility_t visibility;
+    css_text_decoration_t text_decoration;
+    css_text_transform_t text_transform;
     css_hyphenate_t hyphenate;
+    css_line_break_t line_break;
+    css_word_break_t word_break;
     css_list_style_type_t list_style_type;
     css_list_style_position_t list_style_position;
+    css_page_break_t page_break_before;
+    css_page_break_t page_break_after;
+    css_page_break_t page_break_inside;
+    css_orphans_widows_value_t orphans;
+    css_orphans_widows_value_t widows;
     css_border_style_type_t border_style_top;
     css_border_style_type_t border_style_bottom;
     css_border_style_type_t border_style_right;
     css_border_style_type_t border_style_left;
-    css_length_t border_width[4]; ///< border-top-width, -right-, -bottom-, -left-
-    css_length_t border_color[4]; ///< border-top-color, -right-, -bottom-, -left-
-    lString8 background_image;
+    css_border_collapse_value_t border_collapse;
     css_background_repeat_value_t background_repeat;
     css_background_position_value_t background_position;
+    lInt8 flags; // bitmap of STYLE_REC_FLAG_*, only used like pseudo_elem_*_style below
+    css_length_t font_size;
+    css_length_t line_height;
+    css_length_t text_indent;
+    css_length_t vertical_align;
+    css_length_t letter_spacing;
+    css_length_t margin[4];  ///< margin-left, -right, -top, -bottom
+    css_length_t padding[4]; ///< padding-left, -right, -top, -bottom
+    css_length_t color;
+    css_length_t background_color;
+    css_length_t width;
+    css_length_t height;
+    css_length_t min_width;
+    css_length_t min_height;
+    css_length_t max_width;
+    css_length_t max_height;
+    css_length_t border_width[4]; ///< border-top-width, -right-, -bottom-, -left-
+    css_length_t border_color[4]; ///< border-top-color, -right-, -bottom-, -left-
     css_length_t background_size[2]; //first width and second height
-    css_border_collapse_value_t border_collapse;
-    css_length_t border_spacing[2]; //first horizontal and the second vertical spacing
-    css_orphans_widows_value_t orphans;
-    css_orphans_widows_value_t widows;
-    css_float_t float_; // "float" is a C++ keyword...
-    css_clear_t clear;
-    css_direction_t direction;
-    css_visibility_t visibility;
-    css_line_break_t line_break;
-    css_word_break_t word_break;
-    lString32 content;
+    css_length_t border_spacing[2];  //first horizontal and the second vertical spacing
+    css_length_t font_features;
     css_length_t cr_hint;
-    lString32 cr_footnote_before;  // -cr-footnote-before: separator before inline footnote
-    lString32 cr_footnote_after;   // -cr-footnote-after: separator after inline footnote
-    lString32 cr_footnote_marker_before;  // -cr-footnote-marker-before: text before footnote marker
-    lString32 cr_footnote_marker_after;   // -cr-footnote-marker-after: text after footnote marker
+    lString8 font_name;
+    lString8 background_image;
+    lString32 content;
+    lString32 cr_footnote_before;        // -cr-footnote-before: separator before inline footnote
+    lString32 cr_footnote_after;         // -cr-footnote-after: separator after inline footnote
+    lString32 cr_footnote_marker_before; // -cr-footnote-marker-before: text before footnote marker
+    lString32 cr_footnote_marker_after;  // -cr-footnote-marker-after: text after footnote marker
+    lUInt32 important[NB_IMP_SLOTS];     // bitmap for !important (used only by LVCssDeclaration)
+    lUInt32 importance[NB_IMP_SLOTS];    // bitmap for important bit's importance/origin
+                                         // (allows for 2 level of !important importance)
     // The following should only be used when applying stylesheets while in lvend.cpp setNodeStyle(),
     // and cleaned up there, before the style is cached and shared. They are not serialized.
-    lInt8 flags; // bitmap of STYLE_REC_FLAG_*
     css_style_rec_t* pseudo_elem_before_style;
     css_style_rec_t* pseudo_elem_after_style;
 
     css_style_rec_tag()
             : refCount(0)
             , hash(0)
-            , important {} // zero-initialization of all array slots
-            , importance {}
             , display(css_d_inline)
             , white_space(css_ws_inherit)
             , text_align(css_ta_inherit)
             , text_align_last(css_ta_inherit)
-            , text_decoration(css_td_inherit)
-            , text_transform(css_tt_inherit)
-            , vertical_align(css_val_unspecified, css_va_baseline)
             , font_family(css_ff_inherit)
-            , font_size(css_val_inherited, 0)
             , font_style(css_fs_inherit)
             , font_weight(css_fw_inherit)
-            , font_features(css_val_inherited, 0)
-            , text_indent(css_val_inherited, 0)
-            , line_height(css_val_inherited, 0)
-            , width(css_val_unspecified, 0)
-            , height(css_val_unspecified, 0)
-            , min_width(css_val_unspecified, 0)
-            , min_height(css_val_unspecified, 0)
-            , max_width(css_val_unspecified, 0)
-            , max_height(css_val_unspecified, 0)
-            , color(css_val_inherited, 0)
-            , background_color(css_val_unspecified, 0)
-            , letter_spacing(css_val_inherited, 0)
-            , page_break_before(css_pb_auto)
-            , page_break_after(css_pb_auto)
-            , page_break_inside(css_pb_auto)
+            , float_(css_f_none)
+            , clear(css_c_none)
+            , direction(css_dir_inherit)
+            , visibility(css_v_inherit)
+            , text_decoration(css_td_inherit)
+            , text_transform(css_tt_inherit)
             , hyphenate(css_hyph_inherit)
+            , line_break(css_lb_inherit)
+            , word_break(css_wb_inherit)
             , list_style_type(css_lst_inherit)
             , list_style_position(css_lsp_inherit)
+            , page_break_before(css_pb_auto)
+            , page_break_after(css_pb_auto)
+            , page_break_inside(css_pb_auto)
+            , orphans(css_orphans_widows_inherit)
+            , widows(css_orphans_widows_inherit)
             , border_style_top(css_border_none)
             , border_style_bottom(css_border_none)
             , border_style_right(css_border_none)
             , border_style_left(css_border_none)
+            , border_collapse(css_border_seperate)
             , background_repeat(css_background_r_none)
             , background_position(css_background_p_none)
-            , border_collapse(css_border_seperate)
-            , orphans(css_orphans_widows_inherit)
-            , widows(css_orphans_widows_inherit)
-            , float_(css_f_none)
-            , clear(css_c_none)
-            , direction(css_dir_inherit)
-            , visibility(css_v_inherit)
-            , line_break(css_lb_inherit)
-            , word_break(css_wb_inherit)
+            , flags(0)
+            , font_size(css_val_inherited, 0)
+            , line_height(css_val_inherited, 0)
+            , text_indent(css_val_inherited, 0)
+            , vertical_align(css_val_unspecified, css_va_baseline)
+            , letter_spacing(css_val_inherited, 0)
+            , color(css_val_inherited, 0)
+            , background_color(css_val_unspecified, 0)
+            , width(css_val_unspecified, 0)
+            , height(css_val_unspecified, 0)
+            , min_width(css_val_unspecified, 0)
+            , min_height(css_val_unspecified, 0)
+            , max_width(css_val_unspecified, 0)
+            , max_height(css_val_unspecified, 0)
+            , font_features(css_val_inherited, 0)
             , cr_hint(css_val_inherited, 0)
             , cr_footnote_before(CR_FOOTNOTE_SEP_UNSET)
             , cr_footnote_after(CR_FOOTNOTE_SEP_UNSET)
             , cr_footnote_marker_before(CR_FOOTNOTE_SEP_UNSET)
             , cr_footnote_marker_after(CR_FOOTNOTE_SEP_UNSET)
-            , flags(0)
+            , important {} // zero-initialization of all array slots
+            , importance {}
             , pseudo_elem_before_style(NULL)
             , pseudo_elem_after_style(NULL) {
         // css_length_t fields are initialized by css_length_tag()
@@ -376,6 +380,7 @@ enum lvdom_element_render_method
 /// node format record
 class lvdomElementFormatRec
 {
+    friend class RenderRectReader;
 protected:
     // Values on the x-axis can be stored in a 16bit int, values
     // on the y-axis should better be stored in a 32bit int.
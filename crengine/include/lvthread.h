@@ -28,6 +28,10 @@
 
 #include <crsetup.h>
 
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
 #if (CR_USE_THREADS == 1)
 
 #if defined(_LINUX)
@@ -73,35 +77,6 @@ public:
     }
 };
 
-class LVMutex
-{
-private:
-    pthread_mutex_t _mutex;
-    bool _valid;
-public:
-    LVMutex() {
-        _valid = (pthread_mutex_init(&_mutex, NULL) != 0);
-    }
-    ~LVMutex() {
-        if (_valid)
-            pthread_mutex_destroy(&_mutex);
-    }
-    bool lock() {
-        if (_valid)
-            return (pthread_mutex_lock(&_mutex) == 0);
-        return false;
-    }
-    bool trylock() {
-        if (_valid)
-            return (pthread_mutex_trylock(&_mutex) == 0);
-        return false;
-    }
-    void unlock() {
-        if (_valid)
-            pthread_mutex_unlock(&_mutex);
-    }
-};
-
 #elif defined(_WIN32)
 
 class LVThread
@@ -147,38 +122,6 @@ public:
     }
 };
 
-class LVMutex
-{
-private:
-    HANDLE _mutex;
-    bool _valid;
-public:
-    LVMutex() {
-        _mutex = CreateMutex(NULL, FALSE, NULL);
-        _valid = (_mutex != NULL);
-    }
-    ~LVMutex() {
-        if (_valid)
-            CloseHandle(_mutex);
-    }
-    bool lock() {
-        if (_valid) {
-            return WaitForSingleObject(_mutex, INFINITE) == WAIT_OBJECT_0;
-        }
-        return false;
-    }
-    bool trylock() {
-        if (_valid) {
-            return WaitForSingleObject(_mutex, 0) == WAIT_OBJECT_0;
-        }
-        return false;
-    }
-    void unlock() {
-        if (_valid)
-            ReleaseMutex(_mutex);
-    }
-};
-
 #endif
 
 #else // CR_USE_THREADS
@@ -204,25 +147,87 @@ public:
     }
 };
 
+#endif // CR_USE_THREADS
+
+/// Recursive mutex
+/**
+    Always a real lock, regardless of CR_USE_THREADS value: engine's own
+    worker threads (see CRThreadPool) may access objects protected by it.
+    Waiting for the lock may be cancelled, see lockUnless().
+*/
 class LVMutex
 {
+private:
+    std::mutex _mutex;
+    std::condition_variable _released;
+    std::thread::id _owner;
+    int _depth;
+    int _waiting;
+    LVMutex(const LVMutex&);
+    LVMutex& operator=(const LVMutex&);
+    bool isFreeFor(std::thread::id thread) const {
+        return _depth == 0 || _owner == thread;
+    }
+    void take(std::thread::id thread) {
+        _owner = thread;
+        _depth++;
+    }
 public:
-    LVMutex() {
+    LVMutex()
+            : _depth(0)
+            , _waiting(0) {
     }
     ~LVMutex() {
     }
     bool lock() {
+        std::unique_lock<std::mutex> guard(_mutex);
+        std::thread::id self = std::this_thread::get_id();
+        _waiting++;
+        while (!isFreeFor(self))
+            _released.wait(guard);
+        _waiting--;
+        take(self);
         return true;
     }
     bool trylock() {
+        std::lock_guard<std::mutex> guard(_mutex);
+        std::thread::id self = std::this_thread::get_id();
+        if (!isFreeFor(self))
+            return false;
+        take(self);
         return true;
     }
+    /// waits for the lock until cancelled() returns true, returns false in this case
+    /**
+        cancelled() is called with internal lock held, it's checked again on each
+        unlock() and wakeWaiters() call: change its state before calling wakeWaiters().
+    */
+    template <typename F>
+    bool lockUnless(const F& cancelled) {
+        std::unique_lock<std::mutex> guard(_mutex);
+        std::thread::id self = std::this_thread::get_id();
+        _waiting++;
+        while (!cancelled() && !isFreeFor(self))
+            _released.wait(guard);
+        _waiting--;
+        if (cancelled())
+            return false;
+        take(self);
+        return true;
+    }
+    /// makes threads waiting in lockUnless() check their cancel condition
+    void wakeWaiters() {
+        std::lock_guard<std::mutex> guard(_mutex);
+        if (_waiting)
+            _released.notify_all();
+    }
     void unlock() {
+        std::lock_guard<std::mutex> guard(_mutex);
+        if (--_depth == 0 && _waiting)
+            _released.notify_all();
     }
 };
 
-#endif // CR_USE_THREADS
-
 class LVLock
 {
     LVMutex& _mutex;
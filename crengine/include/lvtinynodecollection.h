@@ -29,17 +29,25 @@
 #include <crprops.h>
 #include <lvstsheet.h>
 #include <lvtinydom_common.h>
+#include <lvthread.h>
+
+#include <atomic>
 
 struct ldomNode;
 class LVDocViewCallback;
 class CacheLoadingCallback;
 class ldomBlobCache;
+class ldomRenderVariants;
+class ldomTraversalIndex;
 class ldomDataStorageManager;
+class ldomTextStorageChunk;
 class CacheFile;
 
 /// final block cache
 typedef LVRef<LFormattedText> LFormattedTextRef;
 typedef LVCacheMap<ldomNode*, LFormattedTextRef> CVRendBlockCache;
+/// decoded texts of recently accessed persistent text nodes, by text storage address and node data index
+typedef LVCacheMap<lUInt64, lString32> CVDecodedTextCache;
 
 /// return value for continuous operations
 typedef enum
@@ -150,6 +158,8 @@ class tinyNodeCollection
     friend struct ldomNode;
     friend class tinyElement;
     friend class ldomDocument;
+    friend class ldomTextView;
+    friend class RenderRectReader;
 private:
     int _textCount;
     lUInt32 _textNextFree;
@@ -162,12 +172,40 @@ private:
     int _tinyElementCount;
     int _itemCount;
     int _docIndex;
+    /// state of node segments of document opened from cache file with lazy node loading
+    struct LazyNodeParts;
+    LazyNodeParts* _lazyParts;
+    /// returns node segment, reads it from cache file if it's not loaded yet
+    ldomNode* getNodePart(bool elem, int part);
+    ldomNode* loadNodePart(bool elem, int part);
+    CVDecodedTextCache _decodedTextCache;
+    /// guards decoded text cache and reading of text storage: text of the same document may be read by tasks of thread pool
+    LVMutex _textReadMutex;
+    /// returns text of persistent text node, decoded once while node is among recently accessed ones
+    lString32 getDecodedText(lUInt32 dataIndex, lUInt32 addr);
+    /// returns pinned chunk with utf8 text of persistent text node, NULL if not found
+    ldomTextStorageChunk* pinText(lUInt32 addr, const lChar8*& text, int& length);
+    /// accumulates style and font hash of element to hash, display style to _nodeDisplayStyleHash
+    lUInt32 addNodeStyleHash(lUInt32 hash, ldomNode* node);
+    /// recently styled elements whose style may be reused by their siblings, NULL when not styling the whole tree
+    struct StyleSharingCache;
+    StyleSharingCache* _styleSharing;
+    bool _styleSharingEnabled;
+    lUInt32 _styleSharingLookups;
+    lUInt32 _styleSharingHits;
 protected:
     /// final block cache
     CVRendBlockCache _renderedBlockCache;
     CacheFile* _cacheFile;
     bool _cacheFileStale;
     bool _cacheFileLeaveAsDirty;
+    bool _mappedCacheReads;
+    bool _lazyNodeLoading;
+    bool _cacheCompressionDictionary;
+    int _maxRenderVariants;
+    bool _traversalIndexEnabled;
+    LVMutex* _accessMutex;
+    std::atomic<int> _useDepth;
     bool _mapped;
     bool _maperror;
     int _mapSavingStage;
@@ -186,6 +224,8 @@ protected:
     bool _nodeStylesInvalidIfLoading;
 
     int calcFinalBlocks();
+    /// trains compression dictionary of new cache file from unpacked storage data, if enabled and there is enough of it
+    void trainCacheDictionary();
     void dropStyles();
     bool _hangingPunctuationEnabled;
     lUInt32 _renderBlockRenderingFlags;
@@ -208,18 +248,39 @@ protected:
 
     /// checks buffer sizes, compacts most unused chunks
     ldomBlobCache* _blobCache;
+    /// renderings of recent render contexts kept in cache file
+    ldomRenderVariants* _renderVariants;
+    /// tree structure arrays, NULL if disabled or tree is changed since it was built
+    ldomTraversalIndex* _traversalIndex;
+    /// builds traversal index if it's enabled and there is no valid one
+    void updateTraversalIndex();
+    /// called on any change of tree structure
+    void dropTraversalIndex() {
+        if (_traversalIndex)
+            freeTraversalIndex();
+    }
+    void freeTraversalIndex();
 
     /// uniquie id of file format parsing option (usually 0, but 1 for preformatted text files)
     int getPersistenceFlags();
 
+    /// writes style table (styles referenced by node style indexes) to buffer
+    bool serializeStyles(SerialBuf& buf);
+    /// reads style table written by serializeStyles(), list items are indexed by style index
+    bool deserializeStyles(SerialBuf& buf, LVArray<css_style_ref_t>& list);
     bool saveStylesData();
     bool loadStylesData();
     bool updateLoadedStyles(bool enabled);
     lUInt32 calcStyleHash(bool already_rendered);
+    /// mixes render settings and global settings into hash of node styles, or of what defines them
+    lUInt32 calcStyleHash(bool already_rendered, lUInt32 nodeStyleHash);
     bool saveNodeData();
     bool saveNodeData(lUInt16 type, ldomNode** list, int nodecount);
     bool loadNodeData();
     bool loadNodeData(lUInt16 type, ldomNode** list, int nodecount);
+    bool loadNodeData(lUInt16 type, int index, ldomNode** list, int nodecount);
+    /// reads traversal index saved with node data, if it's enabled
+    bool loadTraversalIndex();
 
     bool hasRenderData();
 
@@ -377,6 +438,93 @@ public:
     }
     /// get cache file full path
     lString32 getCacheFilePath();
+    /// read existing cache file through memory mapping, using uncompressed data in place (used on next cache file opening)
+    void setMappedCacheReads(bool enabled) {
+        _mappedCacheReads = enabled;
+    }
+    bool getMappedCacheReads() const {
+        return _mappedCacheReads;
+    }
+    /// read node segments from cache file on first access instead of reading all of them on opening (used on next cache file opening)
+    void setLazyNodeLoading(bool enabled) {
+        _lazyNodeLoading = enabled;
+    }
+    bool getLazyNodeLoading() const {
+        return _lazyNodeLoading;
+    }
+    /// train per-document compression dictionary for text, element and render rect data of new cache file (zstd only)
+    void setCacheCompressionDictionary(bool enabled) {
+        _cacheCompressionDictionary = enabled;
+    }
+    bool getCacheCompressionDictionary() const {
+        return _cacheCompressionDictionary;
+    }
+    /// keep renderings of up to count recent render contexts in cache file, to restore them instead of full rendering
+    void setMaxRenderVariants(int count);
+    int getMaxRenderVariants() const {
+        return _maxRenderVariants;
+    }
+    /// keep parent, child and element name id arrays of rendered document in memory and cache file,
+    /// so tree walks don't unpack element storage
+    void setTraversalIndex(bool enabled);
+    bool isTraversalIndexEnabled() const {
+        return _traversalIndexEnabled;
+    }
+    /// returns traversal index if it's built and valid, NULL otherwise
+    ldomTraversalIndex* getValidTraversalIndex() const {
+        return _traversalIndex;
+    }
+    /// when styling the whole tree, reuse style and font of previous sibling with the same
+    /// element name and attributes instead of applying stylesheet again when possible
+    void setStyleSharing(bool enabled) {
+        _styleSharingEnabled = enabled;
+    }
+    bool getStyleSharing() const {
+        return _styleSharingEnabled;
+    }
+    /// starts style sharing (if enabled) for the duration of styling of the whole tree
+    void startStyleSharing();
+    void endStyleSharing();
+    bool isStyleSharingActive() const {
+        return _styleSharing != NULL;
+    }
+    /// sets style and font of element to ones of previous sibling with the same element name and
+    /// attributes, returns false if there is no such sibling; pseudo element flags are set as they were for it
+    bool shareNodeStyle(ldomNode* node, bool& pseudoBefore, bool& pseudoAfter);
+    /// remembers element just styled by stylesheet for shareNodeStyle() of its next siblings
+    void addSharedNodeStyle(ldomNode* node, bool pseudoBefore, bool pseudoAfter);
+    /// number of shareNodeStyle() calls since document creation, and of ones which reused style of sibling
+    lUInt32 getStyleSharingLookups() const {
+        return _styleSharingLookups;
+    }
+    lUInt32 getStyleSharingHits() const {
+        return _styleSharingHits;
+    }
+    /// mutex held by owner while working with document: ldomMemoryGovernor doesn't touch document locked by another thread
+    void setAccessMutex(LVMutex* mutex) {
+        _accessMutex = mutex;
+    }
+    LVMutex* getAccessMutex() const {
+        return _accessMutex;
+    }
+    /// marks start and end of operation which keeps node pointers across callbacks or thread pool tasks
+    /// (rendering, page drawing, cache file loading and saving), see ldomUseGuard
+    void beginUse() {
+        _useDepth++;
+    }
+    void endUse() {
+        _useDepth--;
+    }
+    /// returns true while any operation keeping node pointers is running, in any thread
+    bool isInUse() const {
+        return _useDepth > 0;
+    }
+    /// frees node segments read from cache file and not modified since, which were not accessed
+    /// since previous call (all of them if unusedOnly is false); they are read again on next access.
+    /// Invalidates all ldomNode pointers, returns number of freed segments; does nothing while document is in use.
+    int unloadNodeParts(bool unusedOnly = true);
+    /// returns number of node segments in memory
+    int getLoadedNodePartCount() const;
 
     /// minimize memory consumption
     void compact();
@@ -401,6 +549,24 @@ public:
     virtual ~tinyNodeCollection();
 };
 
+/// marks document as in use while in scope: its node segments are not unloaded, memory governor skips it
+class ldomUseGuard
+{
+    tinyNodeCollection* _doc;
+    ldomUseGuard(const ldomUseGuard&);
+    ldomUseGuard& operator=(const ldomUseGuard&);
+public:
+    explicit ldomUseGuard(tinyNodeCollection* doc)
+            : _doc(doc) {
+        if (_doc)
+            _doc->beginUse();
+    }
+    ~ldomUseGuard() {
+        if (_doc)
+            _doc->endUse();
+    }
+};
+
 #if 0
 /// pass false to not compress data in cache files
 void setCacheCompressionType(CacheCompressionType type);
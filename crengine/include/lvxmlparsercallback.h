@@ -41,6 +41,20 @@ public:
     }
     /// sets flags
     virtual void setFlags(lUInt32) { }
+    /// returns true if parser may tokenize ahead of this callback, running in other thread
+    /**
+     * Parser takes flags affecting text splitting (TXTFLG_PRE_PARA_SPLITTING) from callback,
+     * so it should return true only when these won't change until next barrier tag (see below),
+     * and callback doesn't need parser to be in sync with it (other than calling LVFileFormatParser::Stop()).
+     */
+    virtual bool canParseAhead() {
+        return false;
+    }
+    /// returns true if parser should stop tokenizing ahead before this opening tag, until callback gets it
+    /// (called from parser thread, so should depend on tag name only)
+    virtual bool isParseAheadBarrier(const lChar32* /*tagname*/) {
+        return false;
+    }
     /// called on document encoding definition
     virtual void OnEncoding(const lChar32*, const lChar32*) { }
     /// called on parsing start
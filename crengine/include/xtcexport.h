@@ -107,6 +107,24 @@ public:
     static bool write(LVStream* stream, LVGrayDrawBuf& buf,
                       GrayToMonoPolicy grayPolicy = GRAY_SPLIT_LIGHT_DARK);
 
+    /**
+     * @brief Encode XTG image (header + image data) to memory
+     * @param buf Source grayscale buffer (will be converted to 1-bit)
+     * @param data Output buffer, resized to getTotalSize()
+     * @param grayPolicy Policy for converting grayscale to monochrome
+     */
+    static void encode(LVGrayDrawBuf& buf, LVArray<lUInt8>& data,
+                       GrayToMonoPolicy grayPolicy = GRAY_SPLIT_LIGHT_DARK);
+
+    /**
+     * @brief Pack image data without header
+     * @param buf Source grayscale buffer
+     * @param data Destination, xtg_data_size() bytes
+     * @param grayPolicy Policy for converting grayscale to monochrome
+     */
+    static void pack(LVGrayDrawBuf& buf, uint8_t* data,
+                     GrayToMonoPolicy grayPolicy = GRAY_SPLIT_LIGHT_DARK);
+
     /**
      * @brief Get XTG data size (header + image data)
      * @param width Image width
@@ -138,6 +156,20 @@ public:
      */
     static bool write(LVStream* stream, LVGrayDrawBuf& buf);
 
+    /**
+     * @brief Encode XTH image (header + bit planes) to memory
+     * @param buf Source grayscale buffer
+     * @param data Output buffer, resized to getTotalSize()
+     */
+    static void encode(LVGrayDrawBuf& buf, LVArray<lUInt8>& data);
+
+    /**
+     * @brief Pack bit planes without header
+     * @param buf Source grayscale buffer
+     * @param data Destination, xth_data_size() bytes
+     */
+    static void pack(LVGrayDrawBuf& buf, uint8_t* data);
+
     /**
      * @brief Get XTH data size (header + image data)
      * @param width Image width
@@ -217,6 +249,12 @@ public:
     /// Set progress callback
     XtcExporter& setProgressCallback(XtcExportCallback* callback);
 
+    /// Set number of threads used to pack rendered pages into XTG/XTH data
+    /// @param count 0 = shared engine thread pool (default, sequential if engine concurrency
+    ///              is not set up), 1 = everything on calling thread, N = private pool of N threads
+    /// Pages are always rendered on calling thread; output does not depend on this setting.
+    XtcExporter& setThreadCount(int count);
+
     /// Enable debug image dumping (saves pages as BMP files alongside export)
     /// @param limit Number of pages to dump: 0 = disabled (default), -1 = all pages, N = first N pages
     XtcExporter& dumpImages(int limit);
@@ -311,6 +349,7 @@ private:
     int m_endPage;    ///< Last page to export (0-based, inclusive, -1 = to end)
     int m_dumpImagesLimit;  ///< Number of pages to dump as BMP: 0 = disabled, -1 = all, N = first N
     lString8 m_dumpDir;     ///< Directory for BMP dump files (set from output filename)
+    int m_threadCount;      ///< Packing threads: 0 = shared pool, 1 = sequential, N = private pool
 
     // Preview mode
     int m_previewPage;              ///< Preview page number (-1 = normal export, >= 0 = preview mode)
@@ -334,7 +373,9 @@ private:
     int collectChapters(LVTocItem* item, LVArray<xtc_chapter_t>& chapters, int maxDepth, int currentDepth);
     bool writeChapters(LVStream* stream, const LVArray<xtc_chapter_t>& chapters);
     bool writePageIndex(LVStream* stream, const LVArray<xtc_page_index_t>& pageIndex);
-    bool writePage(LVStream* stream, LVGrayDrawBuf& buf, xtc_page_index_t& indexEntry);
+    void encodePage(LVGrayDrawBuf& buf, LVArray<lUInt8>& data);
+    bool writePage(LVStream* stream, LVArray<lUInt8>& data, uint16_t width, uint16_t height,
+                   xtc_page_index_t& indexEntry);
 };
 
 #endif // XTC_EXPORT_H
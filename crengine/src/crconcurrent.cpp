@@ -21,6 +21,11 @@
 #include <crconcurrent.h>
 #include <crlog.h>
 
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+
 CRMutex* _refMutex = NULL;
 CRMutex* _fontMutex = NULL;
 CRMutex* _fontManMutex = NULL;
@@ -49,6 +54,61 @@ void CRSetupEngineConcurrency() {
 
 CRConcurrencyProvider* concurrencyProvider = NULL;
 
+void CRSetupStdConcurrencyProvider() {
+    if (!concurrencyProvider)
+        concurrencyProvider = new CRStdConcurrencyProvider();
+}
+
+// Lock usage counters
+
+std::atomic<bool> _lockStatsEnabled(false);
+
+static std::atomic<unsigned long long> _lockStatsAcquired[CR_LOCK_STATS_COUNT];
+static std::atomic<unsigned long long> _lockStatsContended[CR_LOCK_STATS_COUNT];
+
+void CRAcquireCounted(CRMutex* mutex, int kind) {
+    if (!mutex->tryAcquire()) {
+        _lockStatsContended[kind].fetch_add(1, std::memory_order_relaxed);
+        mutex->acquire();
+    }
+    _lockStatsAcquired[kind].fetch_add(1, std::memory_order_relaxed);
+}
+
+void CRSetLockStatsEnabled(bool enabled) {
+    _lockStatsEnabled = enabled;
+}
+
+CRLockStats CRGetLockStats(int kind) {
+    CRLockStats stats;
+    stats.acquired = 0;
+    stats.contended = 0;
+    if (kind >= 0 && kind < CR_LOCK_STATS_COUNT) {
+        stats.acquired = _lockStatsAcquired[kind];
+        stats.contended = _lockStatsContended[kind];
+    }
+    return stats;
+}
+
+void CRResetLockStats() {
+    for (int i = 0; i < CR_LOCK_STATS_COUNT; i++) {
+        _lockStatsAcquired[i] = 0;
+        _lockStatsContended[i] = 0;
+    }
+}
+
+CRMutex* CRLazyMutex::create() {
+    if (!concurrencyProvider)
+        return NULL;
+    CRMutex* mutex = concurrencyProvider->createMutex();
+    CRMutex* expected = NULL;
+    if (!_mutex.compare_exchange_strong(expected, mutex, std::memory_order_acq_rel)) {
+        // created by another thread at the same time
+        delete mutex;
+        return expected;
+    }
+    return mutex;
+}
+
 CRThreadExecutor::CRThreadExecutor()
         : _stopped(false) {
     _monitor = concurrencyProvider->createMonitor();
@@ -109,3 +169,498 @@ void CRThreadExecutor::stop() {
     }
     _thread->join();
 }
+
+// CRStdConcurrencyProvider
+
+class CRStdMutex: public CRMutex
+{
+    std::recursive_mutex _mutex;
+public:
+    virtual void acquire() {
+        _mutex.lock();
+    }
+    virtual void release() {
+        _mutex.unlock();
+    }
+    virtual bool tryAcquire() {
+        return _mutex.try_lock();
+    }
+};
+
+class CRStdMonitor: public CRMonitor
+{
+    std::recursive_mutex _mutex;
+    std::condition_variable_any _cond;
+public:
+    virtual void acquire() {
+        _mutex.lock();
+    }
+    virtual void release() {
+        _mutex.unlock();
+    }
+    virtual bool tryAcquire() {
+        return _mutex.try_lock();
+    }
+    virtual void wait() {
+        _cond.wait(_mutex);
+    }
+    virtual void notify() {
+        _cond.notify_one();
+    }
+    virtual void notifyAll() {
+        _cond.notify_all();
+    }
+};
+
+class CRStdThread: public CRThread
+{
+    CRRunnable* _task;
+    std::thread _thread;
+public:
+    explicit CRStdThread(CRRunnable* task)
+            : _task(task) { }
+    virtual ~CRStdThread() {
+        if (_thread.joinable())
+            _thread.detach();
+    }
+    virtual void start() {
+        _thread = std::thread(&CRRunnable::run, _task);
+    }
+    virtual void join() {
+        if (_thread.joinable())
+            _thread.join();
+    }
+};
+
+/// executes single delayed task, scheduling of new task replaces previous one
+class CRStdConcurrencyProvider::TimerThread
+{
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::thread _thread;
+    CRRunnable* _task;
+    std::chrono::steady_clock::time_point _deadline;
+    bool _stopped;
+    void run() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (!_stopped) {
+            if (!_task) {
+                _cond.wait(lock);
+                continue;
+            }
+            if (_cond.wait_until(lock, _deadline) == std::cv_status::timeout && _task && std::chrono::steady_clock::now() >= _deadline) {
+                CRRunnable* task = _task;
+                _task = NULL;
+                lock.unlock();
+                task->run();
+                delete task;
+                lock.lock();
+            }
+        }
+    }
+public:
+    TimerThread()
+            : _task(NULL)
+            , _stopped(false) {
+        _thread = std::thread(&TimerThread::run, this);
+    }
+    ~TimerThread() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopped = true;
+            if (_task) {
+                delete _task;
+                _task = NULL;
+            }
+            _cond.notify_all();
+        }
+        _thread.join();
+    }
+    void schedule(CRRunnable* task, int delayMillis) {
+        CRRunnable* removed = NULL;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            removed = _task;
+            _task = task;
+            _deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(delayMillis);
+            _cond.notify_all();
+        }
+        if (removed)
+            delete removed;
+    }
+};
+
+CRStdConcurrencyProvider::CRStdConcurrencyProvider()
+        : _timer(NULL) {
+}
+
+CRStdConcurrencyProvider::~CRStdConcurrencyProvider() {
+    delete _timer.load();
+}
+
+CRMutex* CRStdConcurrencyProvider::createMutex() {
+    return new CRStdMutex();
+}
+
+CRMonitor* CRStdConcurrencyProvider::createMonitor() {
+    return new CRStdMonitor();
+}
+
+CRThread* CRStdConcurrencyProvider::createThread(CRRunnable* threadTask) {
+    return new CRStdThread(threadTask);
+}
+
+void CRStdConcurrencyProvider::executeGui(CRRunnable* task) {
+    if (task) {
+        task->run();
+        delete task;
+    }
+}
+
+void CRStdConcurrencyProvider::executeGui(CRRunnable* task, int delayMillis) {
+    TimerThread* timer = _timer.load(std::memory_order_acquire);
+    if (!timer) {
+        if (!task)
+            return;
+        std::lock_guard<std::mutex> lock(_timerMutex);
+        timer = _timer.load(std::memory_order_relaxed);
+        if (!timer) {
+            timer = new TimerThread();
+            _timer.store(timer, std::memory_order_release);
+        }
+    }
+    timer->schedule(task, delayMillis);
+}
+
+void CRStdConcurrencyProvider::sleepMs(int durationMs) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(durationMs));
+}
+
+int CRStdConcurrencyProvider::getProcessorCount() {
+    unsigned int n = std::thread::hardware_concurrency();
+    return n > 0 ? (int)n : 1;
+}
+
+// CRTaskGroup
+
+CRTaskGroup::CRTaskGroup(CRThreadPool* pool)
+        : _pool(pool)
+        , _pending(0)
+        , _cancelled(false) {
+    if (_pool && _pool->getThreadCount() > 0)
+        _monitor = concurrencyProvider->createMonitor();
+    else
+        _pool = NULL;
+}
+
+CRTaskGroup::~CRTaskGroup() {
+    join();
+}
+
+void CRTaskGroup::taskAdded() {
+    CRGuard guard(_monitor);
+    CR_UNUSED(guard);
+    _pending++;
+    // wake up joining threads: they can help to execute new task
+    if (!_monitor.isNull())
+        _monitor->notifyAll();
+}
+
+void CRTaskGroup::taskDone() {
+    CRGuard guard(_monitor);
+    CR_UNUSED(guard);
+    _pending--;
+    if (_pending == 0 && !_monitor.isNull())
+        _monitor->notifyAll();
+}
+
+void CRTaskGroup::run(CRRunnable* task) {
+    if (!task)
+        return;
+    if (!_pool) {
+        if (!_cancelled)
+            task->run();
+        delete task;
+        return;
+    }
+    _pool->execute(task, this);
+}
+
+int CRTaskGroup::pendingCount() {
+    CRGuard guard(_monitor);
+    CR_UNUSED(guard);
+    return _pending;
+}
+
+void CRTaskGroup::join() {
+    if (!_pool)
+        return;
+    for (;;) {
+        {
+            CRGuard guard(_monitor);
+            CR_UNUSED(guard);
+            if (_pending == 0)
+                return;
+        }
+        // help to execute queued tasks instead of blocking
+        if (_pool->runPendingTask())
+            continue;
+        CRGuard guard(_monitor);
+        CR_UNUSED(guard);
+        if (_pending == 0)
+            return;
+        _monitor->wait();
+    }
+}
+
+void CRTaskGroup::wait() {
+    if (!_pool)
+        return;
+    CRGuard guard(_monitor);
+    CR_UNUSED(guard);
+    while (_pending > 0)
+        _monitor->wait();
+}
+
+// CRThreadPool
+
+class CRThreadPool::Worker: public CRRunnable
+{
+public:
+    CRThreadPool* _pool;
+    int _index;
+    CRMutexRef _mutex;
+    LVQueue<Task> _deque;
+    CRThreadRef _thread;
+    Worker(CRThreadPool* pool, int index)
+            : _pool(pool)
+            , _index(index) {
+        _mutex = concurrencyProvider->createMutex();
+        _thread = concurrencyProvider->createThread(this);
+    }
+    virtual void run();
+};
+
+static thread_local CRThreadPool::Worker* _currentWorker = NULL;
+
+void CRThreadPool::Worker::run() {
+    _currentWorker = this;
+    for (;;) {
+        if (_pool->_stopped)
+            break;
+        Task task;
+        if (_pool->pop(task, _index)) {
+            _pool->runTask(task);
+            continue;
+        }
+        CRGuard guard(_pool->_monitor);
+        CR_UNUSED(guard);
+        if (_pool->_stopped)
+            break;
+        if (_pool->_queued == 0)
+            _pool->_monitor->wait();
+    }
+    _currentWorker = NULL;
+}
+
+CRThreadPool::CRThreadPool(int threadCount)
+        : _queued(0)
+        , _stopped(false) {
+    if (threadCount > 0) {
+        if (!concurrencyProvider) {
+            CRLog::error("CRThreadPool: No concurrency provider is set, tasks will be executed in calling thread");
+            return;
+        }
+        _monitor = concurrencyProvider->createMonitor();
+        _injectMutex = concurrencyProvider->createMutex();
+        for (int i = 0; i < threadCount; i++)
+            _workers.add(new Worker(this, i));
+        for (int i = 0; i < threadCount; i++)
+            _workers[i]->_thread->start();
+    }
+}
+
+CRThreadPool::~CRThreadPool() {
+    stop();
+    for (int i = 0; i < _workers.length(); i++)
+        delete _workers[i];
+    _workers.clear();
+}
+
+bool CRThreadPool::isWorkerThread() const {
+    return _currentWorker && _currentWorker->_pool == this;
+}
+
+void CRThreadPool::push(const Task& task) {
+    Worker* worker = _currentWorker;
+    if (worker && worker->_pool == this) {
+        CRGuard guard(worker->_mutex);
+        CR_UNUSED(guard);
+        worker->_deque.pushBack(task);
+    } else {
+        CRGuard guard(_injectMutex);
+        CR_UNUSED(guard);
+        _injectQueue.pushBack(task);
+    }
+    _queued++;
+    CRGuard guard(_monitor);
+    CR_UNUSED(guard);
+    _monitor->notify();
+}
+
+bool CRThreadPool::pop(Task& task, int workerIndex) {
+    if (_queued == 0)
+        return false;
+    // own deque: most recently pushed task first
+    if (workerIndex >= 0) {
+        Worker* worker = _workers[workerIndex];
+        CRGuard guard(worker->_mutex);
+        CR_UNUSED(guard);
+        if (worker->_deque.length() > 0) {
+            task = worker->_deque.popBack();
+            _queued--;
+            return true;
+        }
+    }
+    // tasks from outside of pool in FIFO order
+    {
+        CRGuard guard(_injectMutex);
+        CR_UNUSED(guard);
+        if (_injectQueue.length() > 0) {
+            task = _injectQueue.popFront();
+            _queued--;
+            return true;
+        }
+    }
+    // steal oldest task of other worker
+    int count = _workers.length();
+    for (int i = 1; i <= count; i++) {
+        Worker* victim = _workers[(workerIndex + i + count) % count];
+        if (victim->_index == workerIndex)
+            continue;
+        CRGuard guard(victim->_mutex);
+        CR_UNUSED(guard);
+        if (victim->_deque.length() > 0) {
+            task = victim->_deque.popFront();
+            _queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void CRThreadPool::runTask(Task& task) {
+    if (!task.group || !task.group->isCancelled())
+        task.runnable->run();
+    delete task.runnable;
+    if (task.group)
+        task.group->taskDone();
+}
+
+void CRThreadPool::dropTask(Task& task) {
+    delete task.runnable;
+    if (task.group)
+        task.group->taskDone();
+}
+
+void CRThreadPool::execute(CRRunnable* task) {
+    execute(task, NULL);
+}
+
+void CRThreadPool::execute(CRRunnable* task, CRTaskGroup* group) {
+    if (!task)
+        return;
+    if (_workers.length() == 0) {
+        if (!group || !group->isCancelled())
+            task->run();
+        delete task;
+        return;
+    }
+    if (_stopped) {
+        CRLog::error("Ignoring new task since thread pool is stopped");
+        delete task;
+        return;
+    }
+    if (group)
+        group->taskAdded();
+    push(Task(task, group));
+}
+
+bool CRThreadPool::runPendingTask() {
+    if (_workers.length() == 0)
+        return false;
+    Worker* worker = _currentWorker;
+    int index = (worker && worker->_pool == this) ? worker->_index : -1;
+    Task task;
+    if (!pop(task, index))
+        return false;
+    runTask(task);
+    return true;
+}
+
+void CRThreadPool::stop() {
+    if (_workers.length() == 0 || _stopped)
+        return;
+    {
+        CRGuard guard(_monitor);
+        CR_UNUSED(guard);
+        _stopped = true;
+        _monitor->notifyAll();
+    }
+    for (int i = 0; i < _workers.length(); i++)
+        _workers[i]->_thread->join();
+    Task task;
+    while (pop(task, -1))
+        dropTask(task);
+}
+
+// created on first use, read without lock
+static std::atomic<CRThreadPool*> _sharedThreadPool(NULL);
+// changed under _crengineMutex together with pool
+static int _sharedThreadPoolSize = 0;
+
+CRThreadPool* CRGetSharedThreadPool() {
+    if (!concurrencyProvider || !_crengineMutex)
+        return NULL;
+    CRThreadPool* pool = _sharedThreadPool.load(std::memory_order_acquire);
+    if (!pool) {
+        CRGuard guard(_crengineMutex);
+        CR_UNUSED(guard);
+        pool = _sharedThreadPool.load(std::memory_order_relaxed);
+        if (!pool) {
+            int count = _sharedThreadPoolSize;
+            if (count == 0)
+                count = concurrencyProvider->getProcessorCount();
+            else if (count < 0)
+                count = 0;
+            CRLog::debug("Creating shared thread pool with %d threads", count);
+            pool = new CRThreadPool(count);
+            _sharedThreadPool.store(pool, std::memory_order_release);
+        }
+    }
+    return pool;
+}
+
+void CRSetSharedThreadPoolSize(int threadCount) {
+    CRThreadPool* pool;
+    {
+        CRGuard guard(_crengineMutex);
+        CR_UNUSED(guard);
+        if (_sharedThreadPoolSize == threadCount)
+            return;
+        _sharedThreadPoolSize = threadCount;
+        pool = _sharedThreadPool.exchange(NULL);
+    }
+    // deleted out of lock: its tasks may still ask for shared pool while it waits for them
+    delete pool;
+}
+
+void CRShutdownSharedThreadPool() {
+    CRThreadPool* pool;
+    {
+        CRGuard guard(_crengineMutex);
+        CR_UNUSED(guard);
+        pool = _sharedThreadPool.exchange(NULL);
+    }
+    delete pool;
+}
@@ -38,10 +38,12 @@
 #include <lvtinydomutils.h>
 #include <lvdocviewcallback.h>
 #include <crlog.h>
+#include <crconcurrent.h>
 
 #include "streamproxy.h"
 #include "lvxml/lvxmlparser.h"
 #include "lvxml/lvhtmlparser.h"
+#include "lvxml/lvxmleventbuffer.h"
 #include "lvxml/lvxmlutils.h"
 #include "lvtinydom/ldomdocumentwriter.h"
 #include "lvtinydom/ldomdocumentfragmentwriter.h"
@@ -603,6 +605,94 @@ public:
     }
 };
 
+/// Container wrapper allowing to open streams from several threads at once
+/**
+ * Archive streams share the base stream of archive, so they are opened and
+ * read to memory while holding the lock; returned memory streams are independent.
+ */
+class SharedReadContainer: public LVContainer
+{
+    LVContainerRef _container;
+    CRMutexRef _lock;
+public:
+    SharedReadContainer(LVContainerRef baseContainer)
+            : _container(baseContainer)
+            , _lock(concurrencyProvider->createMutex()) {
+    }
+    virtual LVContainer* GetParentContainer() {
+        return _container->GetParentContainer();
+    }
+    virtual const LVContainerItemInfo* GetObjectInfo(int index) {
+        return _container->GetObjectInfo(index);
+    }
+    virtual int GetObjectCount() const {
+        return _container->GetObjectCount();
+    }
+    virtual lverror_t GetSize(lvsize_t* pSize) {
+        return _container->GetSize(pSize);
+    }
+    virtual LVStreamRef OpenStream(const lChar32* fname, lvopen_mode_t mode) {
+        CRGuard guard(_lock);
+        CR_UNUSED(guard);
+        LVStreamRef res;
+        LVStreamRef stream = _container->OpenStream(fname, mode);
+        if (stream.isNull())
+            return res;
+        res = LVCreateMemoryStream();
+        if (LVPumpStream(res, stream) != stream->GetSize())
+            return LVStreamRef();
+        res->SetPos(0);
+        res->SetName(stream->GetName());
+        return res;
+    }
+    virtual const lChar32* GetName() {
+        return _container->GetName();
+    }
+    virtual void SetName(const lChar32* name) {
+        _container->SetName(name);
+    }
+};
+
+// number of spine items parsed ahead, per thread pool worker
+#define EPUB_FRAGMENTS_AHEAD_PER_THREAD 2
+
+/// Spine item decompressed and tokenized by thread pool worker, to be passed to document writer in spine order
+struct EpubSpineFragment
+{
+    size_t index; // spine item index
+    lString32 name;
+    LVXMLEventBuffer events;
+    LVHTMLParser* parser; // NULL if not found in container
+    bool valid;
+    CRTaskGroup* task;
+    EpubSpineFragment(size_t i, lString32 fname)
+            : index(i)
+            , name(fname)
+            , parser(NULL)
+            , valid(false)
+            , task(NULL) { }
+    ~EpubSpineFragment() {
+        if (task) {
+            task->cancel();
+            task->join();
+            delete task;
+        }
+        delete parser;
+    }
+    void parse(CRThreadPool* pool, LVContainer* container, lUInt32 flags) {
+        task = new CRTaskGroup(pool);
+        EpubSpineFragment* fragment = this;
+        task->runFunc([fragment, container, flags]() {
+            LVStreamRef stream = container->OpenStream(fragment->name.c_str(), LVOM_READ);
+            if (stream.isNull())
+                return;
+            fragment->parser = new LVHTMLParser(stream, &fragment->events);
+            fragment->events.setFlags(flags);
+            fragment->valid = fragment->parser->CheckFormat() && fragment->parser->Tokenize(&fragment->events);
+        });
+    }
+};
+
 void createEncryptedEpubWarningDocument(ldomDocument* m_doc) {
     CRLog::error("EPUB document contains encrypted items");
     ldomDocumentWriter writer(m_doc);
@@ -941,7 +1031,7 @@ public:
     }
 };
 
-bool ImportEpubDocument(LVStreamRef stream, ldomDocument* m_doc, LVDocViewCallback* progressCallback, CacheLoadingCallback* formatCallback, bool metadataOnly) {
+bool ImportEpubDocument(LVStreamRef stream, ldomDocument* m_doc, LVDocViewCallback* progressCallback, CacheLoadingCallback* formatCallback, bool metadataOnly, bool pipelined) {
     LVContainerRef arc = LVOpenArchieve(stream);
     if (arc.isNull())
         return false; // not a ZIP archive
@@ -1461,6 +1551,22 @@ bool ImportEpubDocument(LVStreamRef stream, ldomDocument* m_doc, LVDocViewCallba
             //CRLog::trace("subst: %s => %s", LCSTR(name), LCSTR(subst));
         }
     }
+    // Spine items may be decompressed and tokenized by thread pool workers, while
+    // this thread builds DOM from the ones before them, in spine order
+    CRThreadPool* pool = pipelined && appender.canParseAhead() ? CRGetSharedThreadPool() : NULL;
+    if (pool && pool->getThreadCount() == 0)
+        pool = NULL;
+    LVContainerRef sharedArc;
+    LVPtrVector<EpubSpineFragment> fragments; // being parsed ahead, in spine order
+    size_t nextFragment = 0;                  // next spine item to start parsing ahead
+    int maxFragments = 0;
+    if (pool) {
+        sharedArc = LVContainerRef(new SharedReadContainer(m_arc));
+        // stylesheets are loaded from container by this thread while building DOM
+        m_doc->setContainer(sharedArc);
+        maxFragments = pool->getThreadCount() * EPUB_FRAGMENTS_AHEAD_PER_THREAD;
+        CRLog::debug("EPUB: parsing spine items by %d threads", pool->getThreadCount());
+    }
     int lastProgressPercent = 5;
     for (size_t i = 0; i < spineItemsNb; i++) {
         if (progressCallback) {
@@ -1474,16 +1580,36 @@ bool ImportEpubDocument(LVStreamRef stream, ldomDocument* m_doc, LVDocViewCallba
             lString32 name = LVCombinePaths(codeBase, spineItems[i]->href);
             {
                 CRLog::debug("Checking fragment: %s", LCSTR(name));
-                LVStreamRef stream = m_arc->OpenStream(name.c_str(), LVOM_READ);
-                if (!stream.isNull()) {
+                LVStreamRef stream;
+                LVAutoPtr<EpubSpineFragment> fragment;
+                if (pool) {
+                    for (; nextFragment < spineItemsNb && fragments.length() < maxFragments; nextFragment++) {
+                        if (spineItems[nextFragment]->mediaType != "application/xhtml+xml")
+                            continue;
+                        EpubSpineFragment* next = new EpubSpineFragment(nextFragment, LVCombinePaths(codeBase, spineItems[nextFragment]->href));
+                        fragments.add(next);
+                        next->parse(pool, sharedArc.get(), appender.getFlags());
+                    }
+                    fragment = fragments.remove(0);
+                    fragment->task->join();
+                } else {
+                    stream = m_arc->OpenStream(name.c_str(), LVOM_READ);
+                }
+                if (!stream.isNull() || (!fragment.isNull() && fragment->parser)) {
                     appender.setCodeBase(name);
                     lString32 base = name;
                     LVExtractLastPathElement(base);
                     //CRLog::trace("base: %s", LCSTR(base));
-                    //LVXMLParser
-                    LVHTMLParser parser(stream, &appender);
                     appender.setNonLinearFlag(spineItems[i]->nonlinear);
-                    if (parser.CheckFormat() && parser.Parse()) {
+                    bool parsed;
+                    if (!fragment.isNull()) {
+                        parsed = fragment->valid && fragment->parser->Replay(&fragment->events, &appender);
+                    } else {
+                        //LVXMLParser
+                        LVHTMLParser parser(stream, &appender);
+                        parsed = parser.CheckFormat() && parser.Parse();
+                    }
+                    if (parsed) {
                         // valid
                         fragmentCount++;
                         lString8 headCss = appender.getHeadStyleText();
@@ -1496,6 +1622,8 @@ bool ImportEpubDocument(LVStreamRef stream, ldomDocument* m_doc, LVDocViewCallba
             }
         }
     }
+    if (pool)
+        m_doc->setContainer(m_arc);
 
     // Clear any toc items possibly added while parsing the HTML
     m_doc->getToc()->clear();
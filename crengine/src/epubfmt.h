@@ -40,7 +40,8 @@ class LVDocViewCallback;
 class CacheLoadingCallback;
 
 bool DetectEpubFormat(LVStreamRef stream);
-bool ImportEpubDocument(LVStreamRef stream, ldomDocument* doc, LVDocViewCallback* progressCallback, CacheLoadingCallback* formatCallback, bool metadataOnly = false);
+/// pipelined: decompress and tokenize spine items by shared thread pool workers, ahead of DOM building
+bool ImportEpubDocument(LVStreamRef stream, ldomDocument* doc, LVDocViewCallback* progressCallback, CacheLoadingCallback* formatCallback, bool metadataOnly = false, bool pipelined = false);
 lString32 EpubGetRootFilePath(LVContainerRef m_arc);
 LVStreamRef GetEpubCoverpage(LVContainerRef arc);
 
@@ -0,0 +1,394 @@
+/***************************************************************************
+ *   crengine-ng                                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License           *
+ *   as published by the Free Software Foundation; either version 2        *
+ *   of the License, or (at your option) any later version.                *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,            *
+ *   MA 02110-1301, USA.                                                   *
+ ***************************************************************************/
+
+#include <lvbatchextractor.h>
+#include <lvdocview.h>
+#include <lvstreamutils.h>
+#include <lvcontaineriteminfo.h>
+#include <lvcolordrawbuf.h>
+#include <lvimg.h>
+#include <crconcurrent.h>
+#include <crtimerutil.h>
+#include <crlog.h>
+
+#include <stdio.h>
+
+// default estimated memory limit for books processed at the same time
+#define BATCH_DEFAULT_MEMORY_BUDGET 0x10000000
+// estimated memory used by document instance in addition to file contents
+#define BATCH_BOOK_BASE_MEMORY 0x200000
+// estimated document memory per byte of file: in-memory file copy and parsed metadata
+#define BATCH_BOOK_FILE_SIZE_FACTOR 3
+
+static const char* batch_book_extensions[] = {
+    ".fb2", ".fb3", ".epub", ".txt", ".rtf", ".doc", ".docx", ".odt", ".htm", ".html", ".xhtml",
+    ".chm", ".pdb", ".prc", ".mobi", ".azw", ".md", ".zip", NULL
+};
+
+/// shared state of single run(): memory budget accounting and ordered completion
+class LVBatchExtractor::Batch
+{
+public:
+    CRMonitorRef monitor;
+    lvsize_t budget;
+    lvsize_t inFlightSize;
+    int inFlightCount;
+    LVArray<bool> done;
+    explicit Batch(lvsize_t memoryBudget, int count)
+            : monitor(concurrencyProvider->createMonitor())
+            , budget(memoryBudget)
+            , inFlightSize(0)
+            , inFlightCount(0)
+            , done(count, false) { }
+    /// waits until estimated book memory fits into the budget; book is always allowed when nothing else is in flight
+    void acquire(lvsize_t size) {
+        CRGuard guard(monitor);
+        CR_UNUSED(guard);
+        while (inFlightCount > 0 && inFlightSize + size > budget)
+            monitor->wait();
+        inFlightCount++;
+        inFlightSize += size;
+    }
+    void release(lvsize_t size) {
+        CRGuard guard(monitor);
+        CR_UNUSED(guard);
+        inFlightCount--;
+        inFlightSize -= size;
+        monitor->notifyAll();
+    }
+    void setDone(int index) {
+        CRGuard guard(monitor);
+        CR_UNUSED(guard);
+        done[index] = true;
+        monitor->notifyAll();
+    }
+    void waitDone(int index) {
+        CRGuard guard(monitor);
+        CR_UNUSED(guard);
+        while (!done[index])
+            monitor->wait();
+    }
+};
+
+static LVStreamRef openBookStream(const lString32& path) {
+    lString32 arcname, item;
+    if (!LVSplitArcName(path, arcname, item))
+        return LVOpenFileStream(path.c_str(), LVOM_READ);
+    LVStreamRef arcstream = LVOpenFileStream(arcname.c_str(), LVOM_READ);
+    if (arcstream.isNull())
+        return arcstream;
+    LVContainerRef arc = LVOpenArchieve(arcstream);
+    if (arc.isNull())
+        return LVStreamRef();
+    return arc->OpenStream(item.c_str(), LVOM_READ);
+}
+
+static bool writeBmp24(LVColorDrawBuf* buf, const lString32& fileName) {
+    int dx = buf->GetWidth();
+    int dy = buf->GetHeight();
+    int rowSize = (dx * 3 + 3) & ~3;
+    int fileSize = 54 + rowSize * dy;
+    LVArray<lUInt8> data(fileSize, 0);
+    lUInt8* p = data.get();
+    const int header[] = { 0, fileSize, 0, 54, 40, dx, dy };
+    p[0] = 'B';
+    p[1] = 'M';
+    for (int i = 1; i < 7; i++) {
+        for (int b = 0; b < 4; b++)
+            p[i * 4 - 2 + b] = (lUInt8)(header[i] >> (b * 8));
+    }
+    p[26] = 1;  // planes
+    p[28] = 24; // bits per pixel
+    for (int y = 0; y < dy; y++) {
+        const lUInt32* src = (const lUInt32*)buf->GetScanLine(y);
+        lUInt8* dst = p + 54 + (dy - 1 - y) * rowSize;
+        for (int x = 0; x < dx; x++) {
+            lUInt32 c = src[x];
+            *dst++ = (lUInt8)c;
+            *dst++ = (lUInt8)(c >> 8);
+            *dst++ = (lUInt8)(c >> 16);
+        }
+    }
+    LVStreamRef out = LVOpenFileStream(fileName.c_str(), LVOM_WRITE);
+    if (out.isNull())
+        return false;
+    lvsize_t bytesWritten = 0;
+    return out->Write(p, fileSize, &bytesWritten) == LVERR_OK && bytesWritten == (lvsize_t)fileSize;
+}
+
+static void appendJsonString(lString8& buf, const lString32& str) {
+    lString8 s = UnicodeToUtf8(str);
+    buf << '"';
+    for (int i = 0; i < s.length(); i++) {
+        char ch = s[i];
+        switch (ch) {
+            case '"':
+                buf << "\\\"";
+                break;
+            case '\\':
+                buf << "\\\\";
+                break;
+            case '\n':
+                buf << "\\n";
+                break;
+            case '\r':
+                buf << "\\r";
+                break;
+            case '\t':
+                buf << "\\t";
+                break;
+            default:
+                if ((unsigned char)ch < 0x20) {
+                    char hex[8];
+                    snprintf(hex, sizeof(hex), "\\u%04x", (unsigned char)ch);
+                    buf << hex;
+                } else {
+                    buf << ch;
+                }
+                break;
+        }
+    }
+    buf << '"';
+}
+
+lString8 LVBookInfo::toJson() const {
+    lString8 buf;
+    buf << "{\"path\":";
+    appendJsonString(buf, path);
+    buf << ",\"ok\":" << (ok ? "true" : "false");
+    if (!ok) {
+        buf << ",\"error\":";
+        appendJsonString(buf, error);
+    }
+    buf << ",\"format\":";
+    appendJsonString(buf, format);
+    buf << ",\"size\":" << lString8::itoa((lInt64)fileSize);
+    buf << ",\"title\":";
+    appendJsonString(buf, title);
+    buf << ",\"authors\":";
+    appendJsonString(buf, authors);
+    buf << ",\"language\":";
+    appendJsonString(buf, language);
+    buf << ",\"series\":";
+    appendJsonString(buf, seriesName);
+    buf << ",\"seriesNumber\":" << lString8::itoa(seriesNumber);
+    buf << ",\"cover\":";
+    appendJsonString(buf, coverPath);
+    buf << ",\"coverGenerated\":" << (coverGenerated ? "true" : "false");
+    buf << ",\"coverWidth\":" << lString8::itoa(coverWidth);
+    buf << ",\"coverHeight\":" << lString8::itoa(coverHeight);
+    buf << ",\"timings\":{\"read\":" << lString8::itoa(readTime);
+    buf << ",\"load\":" << lString8::itoa(loadTime);
+    buf << ",\"cover\":" << lString8::itoa(coverTime);
+    buf << ",\"save\":" << lString8::itoa(saveTime) << "}}";
+    return buf;
+}
+
+LVBatchExtractor::LVBatchExtractor()
+        : _threadCount(0)
+        , _memoryBudget(BATCH_DEFAULT_MEMORY_BUDGET)
+        , _thumbWidth(300)
+        , _thumbHeight(400)
+        , _generateCovers(false) {
+}
+
+LVColorDrawBuf* LVBatchExtractor::makeCover(LVBookInfo& info, LVStreamRef coverStream) {
+    LVImageSourceRef image;
+    if (!coverStream.isNull()) {
+        // decoders work on private copy of image data: no engine lock is needed
+        image = LVCreateStreamImageSource(coverStream);
+        if (!image.isNull() && image->GetWidth() > 0 && image->GetHeight() > 0) {
+            info.coverWidth = image->GetWidth();
+            info.coverHeight = image->GetHeight();
+        } else {
+            image.Clear();
+        }
+    }
+    if (image.isNull() && !_generateCovers)
+        return NULL;
+    if (_thumbWidth <= 0 || _thumbHeight <= 0)
+        return NULL;
+    LVColorDrawBuf* thumb = new LVColorDrawBuf(_thumbWidth, _thumbHeight, 32);
+    thumb->Clear(0xFFFFFF);
+    if (!image.isNull()) {
+        LVDrawBookCover(*thumb, image, true, lString8::empty_str, info.title, info.authors, info.seriesName, info.seriesNumber);
+    } else {
+        // generated cover uses font manager
+        CRENGINE_GUARD;
+        LVDrawBookCover(*thumb, image, true, lString8::empty_str, info.title, info.authors, info.seriesName, info.seriesNumber);
+        info.coverGenerated = true;
+    }
+    return thumb;
+}
+
+void LVBatchExtractor::processBook(LVBookInfo& info, Batch* batch) {
+    CRTimerUtil timer;
+    LVStreamRef stream = openBookStream(info.path);
+    if (stream.isNull()) {
+        info.error = cs32("cannot open file");
+        return;
+    }
+    info.fileSize = stream->GetSize();
+    lvsize_t estimate = info.fileSize * BATCH_BOOK_FILE_SIZE_FACTOR + BATCH_BOOK_BASE_MEMORY +
+                        (lvsize_t)_thumbWidth * _thumbHeight * 4;
+    if (batch)
+        batch->acquire(estimate);
+    // read whole file to memory outside of engine lock
+    stream = LVCreateMemoryStream(stream);
+    info.readTime = (int)timer.elapsed();
+    LVStreamRef coverStream;
+    if (stream.isNull()) {
+        info.error = cs32("cannot read file");
+    } else {
+        timer.restart();
+        // each book has its own view and document: shared registries of documents, fonts
+        // and languages are locked by themselves, so books are loaded in parallel
+        LVDocView* view = new LVDocView(32, true);
+        if (view->LoadDocument(stream, info.path.c_str(), true)) {
+            info.ok = true;
+            info.format = lString32(getDocFormatName(view->getDocFormat()));
+            info.title = view->getTitle();
+            info.authors = view->getAuthors();
+            info.language = view->getLanguage();
+            info.seriesName = view->getSeriesName();
+            info.seriesNumber = view->getSeriesNumber();
+            coverStream = view->getBookCoverImageStream();
+            if (coverStream.isNull())
+                coverStream = LVGetBookCoverStream(info.path.c_str());
+            // detach cover data from document before it is closed
+            if (!coverStream.isNull())
+                coverStream = LVCreateMemoryStream(coverStream);
+        } else {
+            info.error = cs32("cannot load document");
+        }
+        delete view;
+        stream.Clear();
+        info.loadTime = (int)timer.elapsed();
+    }
+    if (info.ok && !_coverDir.empty()) {
+        timer.restart();
+        LVColorDrawBuf* thumb = makeCover(info, coverStream);
+        coverStream.Clear();
+        info.coverTime = (int)timer.elapsed();
+        if (thumb) {
+            timer.restart();
+            lString32 fileName = LVExtractFilenameWithoutExtension(info.path);
+            char hash[16];
+            snprintf(hash, sizeof(hash), "-%08x.bmp", (unsigned)getHash(info.path));
+            fileName << hash;
+            fileName = LVCombinePaths(_coverDir, fileName);
+            if (writeBmp24(thumb, fileName))
+                info.coverPath = fileName;
+            else
+                CRLog::error("Cannot write cover thumbnail %s", LCSTR(fileName));
+            delete thumb;
+            info.saveTime = (int)timer.elapsed();
+        }
+    }
+    if (batch)
+        batch->release(estimate);
+}
+
+int LVBatchExtractor::run(const lString32Collection& files, LVBatchExtractorCallback* callback) {
+    if (!_coverDir.empty()) {
+        LVAppendPathDelimiter(_coverDir);
+        if (!LVDirectoryExists(_coverDir))
+            LVCreateDirectory(_coverDir);
+    }
+    int threadCount = _threadCount;
+    if (!concurrencyProvider)
+        threadCount = -1;
+    else if (threadCount == 0)
+        threadCount = concurrencyProvider->getProcessorCount();
+    int count = files.length();
+    int okCount = 0;
+    if (threadCount <= 1) {
+        for (int i = 0; i < count; i++) {
+            LVBookInfo info;
+            info.path = files[i];
+            processBook(info, NULL);
+            if (info.ok)
+                okCount++;
+            if (callback)
+                callback->onBookInfo(info);
+        }
+        return okCount;
+    }
+    CRLog::info("LVBatchExtractor: processing %d files with %d workers", count, threadCount);
+    LVBookInfo* infos = new LVBookInfo[count];
+    Batch batch(_memoryBudget, count);
+    CRThreadPool pool(threadCount);
+    CRTaskGroup group(&pool);
+    for (int i = 0; i < count; i++) {
+        infos[i].path = files[i];
+        LVBookInfo* info = &infos[i];
+        Batch* b = &batch;
+        group.runFunc([this, info, b, i]() {
+            processBook(*info, b);
+            b->setDone(i);
+        });
+    }
+    // report in order of input files as soon as each result is ready
+    for (int i = 0; i < count; i++) {
+        batch.waitDone(i);
+        if (infos[i].ok)
+            okCount++;
+        if (callback)
+            callback->onBookInfo(infos[i]);
+        infos[i] = LVBookInfo();
+    }
+    group.join();
+    delete[] infos;
+    return okCount;
+}
+
+int LVBatchExtractor::findBooks(const lString32& dir, lString32Collection& files) {
+    int found = 0;
+    lString32 path = dir;
+    LVAppendPathDelimiter(path);
+    LVContainerRef container = LVOpenDirectory(path);
+    if (container.isNull())
+        return 0;
+    // sort names so the order of files doesn't depend on file system
+    lString32Collection names;
+    lString32Collection subdirs;
+    for (int i = 0; i < container->GetObjectCount(); i++) {
+        const LVContainerItemInfo* item = container->GetObjectInfo(i);
+        lString32 name = item->GetName();
+        if (item->IsContainer()) {
+            subdirs.add(path + name);
+            continue;
+        }
+        lString32 lc = name;
+        lc.lowercase();
+        for (int j = 0; batch_book_extensions[j]; j++) {
+            if (lc.endsWith(batch_book_extensions[j])) {
+                names.add(path + name);
+                break;
+            }
+        }
+    }
+    names.sort();
+    subdirs.sort();
+    files.addAll(names);
+    found += names.length();
+    for (int i = 0; i < subdirs.length(); i++)
+        found += findBooks(subdirs[i], files);
+    return found;
+}
@@ -34,6 +34,7 @@
  ***************************************************************************/
 
 #include <lvdocview.h>
+#include <crconcurrent.h>
 #include <lvimg.h>
 #include <fb2def.h>
 #include <lvstyles.h>
@@ -246,6 +247,10 @@ LVDocView::LVDocView(int bitsPerPixel, bool noDefaultDocument)
         , m_callback(NULL)
         , m_swapDone(false)
         , m_drawBufferBits(GRAY_BACKBUFFER_BITS) {
+#if CR_ENABLE_PAGE_IMAGE_CACHE == 1
+    m_imageCacheAhead = 0;
+    m_imageCacheBehind = 0;
+#endif
 #if (COLOR_BACKBUFFER == 1)
     m_backgroundColor = 0xFFFFFF;
     m_textColor = 0x000000;
@@ -288,6 +293,17 @@ LVDocView::~LVDocView() {
     delete _navigationHistory;
 }
 
+LVDocViewCallback* LVDocView::setCallback(LVDocViewCallback* callback) {
+    LVDocViewCallback* old = m_callback;
+    if (m_doc && callback != old) {
+        // previous callback may be gone when pending writes are done
+        m_doc->deliverCacheFileNotifications();
+        m_doc->discardCacheFileNotifications();
+    }
+    m_callback = callback;
+    return old;
+}
+
 CRPageSkinRef LVDocView::getPageSkin() {
     return _pageSkin;
 }
@@ -832,8 +848,13 @@ void LVDocView::updateDocStyleSheet() {
 void LVDocView::Clear() {
     {
         LVLock lock(getMutex());
-        if (m_doc)
+        // cancel and wait for page rendering before the document is destroyed
+        clearImageCache();
+        if (m_doc) {
+            // notifications of writes still pending are dropped: callback may be gone after view
+            m_doc->deliverCacheFileNotifications();
             delete m_doc;
+        }
         m_doc = NULL;
         m_doc_props->clear();
         if (!m_stream.isNull())
@@ -853,7 +874,6 @@ void LVDocView::Clear() {
         m_filename.clear();
         m_section_bounds_valid = false;
     }
-    clearImageCache();
     _navigationHistory->clear();
     // Also drop font instances from previous document (see
     // lvtinydom.cpp ldomDocument::render() for the reason)
@@ -920,6 +940,268 @@ void LVDocView::checkPos() {
 }
 
 #if CR_ENABLE_PAGE_IMAGE_CACHE == 1
+
+enum
+{
+    PAGE_IMAGE_QUEUED,
+    PAGE_IMAGE_RENDERING,
+    PAGE_IMAGE_READY,
+    PAGE_IMAGE_CANCELLED
+};
+
+class LVDocViewImageCache::Item
+{
+public:
+    LVDocView* _view;
+    LVDrawBufRef _drawbuf;
+    // raw pointer for render task: reference counter of _drawbuf is not thread safe
+    LVDrawBuf* _buf;
+    int _offset;
+    int _page;
+    std::atomic<int> _state;
+    // item is queued or being processed by render task, which may access it
+    std::atomic<bool> _taskPending;
+    Item(LVDocView* view, int offset, int page, LVDrawBufRef drawbuf)
+            : _view(view)
+            , _drawbuf(drawbuf)
+            , _buf(drawbuf.get())
+            , _offset(offset)
+            , _page(page)
+            , _state(PAGE_IMAGE_QUEUED)
+            , _taskPending(false) { }
+    bool matches(int offset, int page) const {
+        return (_offset == offset && offset != -1) || (_page == page && page != -1);
+    }
+    /// distance from current position, previous pages are farther than next ones
+    int distance(int curOffset, int curPage) const {
+        int delta = _page != -1 ? _page - curPage : _offset - curOffset;
+        return delta >= 0 ? delta * 2 : -delta * 2 + 1;
+    }
+    bool isQueued() const {
+        return _state == PAGE_IMAGE_QUEUED;
+    }
+    /// takes item for rendering, returns false if it is already taken or cancelled
+    bool claim() {
+        int expected = PAGE_IMAGE_QUEUED;
+        if (!_state.compare_exchange_strong(expected, PAGE_IMAGE_RENDERING))
+            return false;
+        // render task waiting for view lock to render this item gives up
+        _view->getMutex().wakeWaiters();
+        return true;
+    }
+    /// drops item which is not started yet
+    void cancel() {
+        int expected = PAGE_IMAGE_QUEUED;
+        if (_state.compare_exchange_strong(expected, PAGE_IMAGE_CANCELLED))
+            _view->getMutex().wakeWaiters();
+    }
+    void render() {
+        _view->Draw(*_buf, _offset, _page, true);
+        _state = PAGE_IMAGE_READY;
+    }
+};
+
+/// renders queued pages one by one, so pre-rendering occupies single worker of the pool
+class LVDocViewImageCache::RenderTask: public CRRunnable
+{
+    LVDocViewImageCache* _cache;
+public:
+    RenderTask(LVDocViewImageCache* cache)
+            : _cache(cache) {
+    }
+    virtual void run() {
+        while (Item* item = _cache->dequeue()) {
+            // Wait for document view lock until page is cancelled or taken by the thread
+            // which holds the lock and is waiting for this page. Worker must not stay blocked
+            // on cancelled page while view is locked for long, e.g. by document rendering.
+            LVMutex& viewMutex = item->_view->getMutex();
+            if (viewMutex.lockUnless([item]() { return !item->isQueued(); })) {
+                if (item->claim())
+                    item->render();
+                viewMutex.unlock();
+            }
+            // item must not be accessed after this point
+            item->_taskPending = false;
+            _cache->notifyReady();
+        }
+    }
+};
+
+LVDocViewImageCache::LVDocViewImageCache()
+        : _maxSize(2)
+        , _tasks(NULL)
+        , _renderTaskQueued(false) {
+}
+
+LVDocViewImageCache::~LVDocViewImageCache() {
+    clear();
+    if (_tasks) {
+        _tasks->join();
+        delete _tasks;
+    }
+}
+
+void LVDocViewImageCache::notifyReady() {
+    CRGuard guard(_readyMonitor);
+    CR_UNUSED(guard);
+    _readyMonitor->notifyAll();
+}
+
+void LVDocViewImageCache::enqueue(Item* item) {
+    LVLock lock(_queueMutex);
+    item->_taskPending = true;
+    _queue.add(item);
+    if (!_renderTaskQueued) {
+        _renderTaskQueued = true;
+        _tasks->run(new RenderTask(this));
+    }
+}
+
+LVDocViewImageCache::Item* LVDocViewImageCache::dequeue() {
+    LVLock lock(_queueMutex);
+    if (_queue.length() == 0) {
+        _renderTaskQueued = false;
+        return NULL;
+    }
+    return _queue.remove(0);
+}
+
+void LVDocViewImageCache::setMaxSize(int size) {
+    LVLock lock(_mutex);
+    _maxSize = size < 2 ? 2 : size;
+}
+
+LVDocViewImageCache::Item* LVDocViewImageCache::find(int offset, int page) {
+    for (int i = 0; i < _items.length(); i++) {
+        if (_items[i]->matches(offset, page))
+            return _items[i];
+    }
+    return NULL;
+}
+
+void LVDocViewImageCache::makeReady(Item* item) {
+    // page is not started yet: render it right now in this thread
+    if (item->claim()) {
+        item->render();
+        return;
+    }
+    if (item->_state == PAGE_IMAGE_RENDERING) {
+        CRGuard guard(_readyMonitor);
+        CR_UNUSED(guard);
+        while (item->_state == PAGE_IMAGE_RENDERING)
+            _readyMonitor->wait();
+    }
+}
+
+void LVDocViewImageCache::release(Item* item) {
+    item->cancel();
+    if (item->_taskPending)
+        _released.add(item);
+    else
+        delete item;
+}
+
+void LVDocViewImageCache::purgeReleased() {
+    for (int i = _released.length() - 1; i >= 0; i--) {
+        if (!_released[i]->_taskPending)
+            _released.erase(i, 1);
+    }
+}
+
+void LVDocViewImageCache::add(LVDocView* view, int offset, int page, LVDrawBufRef drawbuf, int curOffset, int curPage) {
+    LVLock lock(_mutex);
+    purgeReleased();
+    if (find(offset, page))
+        return;
+    Item* item = new Item(view, offset, page, drawbuf);
+    _items.add(item);
+    // drop page farthest from current one when the ring is full, the oldest one of equal distances
+    while (_items.length() > _maxSize) {
+        int worst = 0;
+        int worstDistance = _items[0]->distance(curOffset, curPage);
+        for (int i = 1; i < _items.length(); i++) {
+            int distance = _items[i]->distance(curOffset, curPage);
+            if (distance > worstDistance) {
+                worst = i;
+                worstDistance = distance;
+            }
+        }
+        release(_items.remove(worst));
+    }
+    if (find(offset, page) != item)
+        return;
+    if (!_tasks) {
+        CRThreadPool* pool = CRGetSharedThreadPool();
+        if (pool && pool->getThreadCount() > 0) {
+            _readyMonitor = concurrencyProvider->createMonitor();
+            _tasks = new CRTaskGroup(pool);
+        }
+    }
+    if (_tasks) {
+        enqueue(item);
+    } else {
+        item->claim();
+        item->render();
+    }
+}
+
+LVDocImageRef LVDocViewImageCache::get(LVDocView* view, int offset, int page) {
+    // queued page may be rendered by this thread, view is locked before the cache like in render tasks
+    LVLock viewLock(view->getMutex());
+    _mutex.lock();
+    purgeReleased();
+    Item* item = find(offset, page);
+    if (!item) {
+        _mutex.unlock();
+        return LVDocImageRef(NULL);
+    }
+    makeReady(item);
+    // mutex will be unlocked by image holder
+    return LVDocImageRef(new LVDocImageHolder(item->_drawbuf, _mutex));
+}
+
+bool LVDocViewImageCache::has(int offset, int page) {
+    LVLock lock(_mutex);
+    return find(offset, page) != NULL;
+}
+
+bool LVDocViewImageCache::isReady(int offset, int page) {
+    LVLock lock(_mutex);
+    Item* item = find(offset, page);
+    return item && item->_state == PAGE_IMAGE_READY;
+}
+
+void LVDocViewImageCache::retain(LVArray<int>& offsets, LVArray<int>& pages) {
+    LVLock lock(_mutex);
+    for (int i = _items.length() - 1; i >= 0; i--) {
+        Item* item = _items[i];
+        bool found = false;
+        if (item->_page != -1)
+            found = pages.indexOf(item->_page) >= 0;
+        else
+            found = offsets.indexOf(item->_offset) >= 0;
+        if (!found)
+            release(_items.remove(i));
+    }
+    purgeReleased();
+}
+
+void LVDocViewImageCache::clear() {
+    CRTaskGroup* tasks;
+    {
+        LVLock lock(_mutex);
+        while (_items.length() > 0)
+            release(_items.remove(_items.length() - 1));
+        tasks = _tasks;
+    }
+    // render task skips cancelled pages without touching the document,
+    // it's waited for without cache lock which it doesn't need
+    if (tasks)
+        tasks->join();
+    LVLock lock(_mutex);
+    purgeReleased();
+}
+
 /// returns true if current page image is ready
 bool LVDocView::IsDrawed() {
     return isPageImageReady(0);
@@ -929,91 +1211,55 @@ bool LVDocView::IsDrawed() {
 bool LVDocView::isPageImageReady(int delta) {
     if (!m_is_rendered || !_posIsSet)
         return false;
-    LVDocImageRef ref;
+    int offset;
+    int p;
+    if (!getPageImagePos(delta, offset, p))
+        return false;
+    return m_imageCache.isReady(offset, p);
+}
+
+bool LVDocView::getPageImagePos(int delta, int& offset, int& page) {
+    offset = -1;
+    page = -1;
     if (isPageMode()) {
-        int p = _page;
-        if (delta < 0)
-            p--;
-        else if (delta > 0)
-            p++;
-        //CRLog::trace("getPageImage: checking cache for page [%d] (delta=%d)", offset, delta);
-        ref = m_imageCache.get(-1, p);
+        page = _page + delta * getVisiblePageCount();
+        if (page < 0 || page >= m_pages.length())
+            return false;
     } else {
-        int offset = _pos;
+        offset = _pos;
         if (delta < 0)
             offset = getPrevPageOffset();
         else if (delta > 0)
             offset = getNextPageOffset();
-        //CRLog::trace("getPageImage: checking cache for page [%d] (delta=%d)", offset, delta);
-        ref = m_imageCache.get(offset, -1);
+        // only adjacent pages are known in scroll mode
+        if (delta < -1 || delta > 1 || (delta != 0 && offset == _pos))
+            return false;
     }
-    return (!ref.isNull());
+    return true;
 }
 
 /// get page image
 LVDocImageRef LVDocView::getPageImage(int delta) {
     checkPos();
-    // find existing object in cache
-    LVDocImageRef ref;
-    int p = -1;
-    int offset = -1;
-    if (isPageMode()) {
-        p = _page;
-        if (delta < 0)
-            p--;
-        else if (delta > 0)
-            p++;
-        if (p < 0 || p >= m_pages.length())
-            return ref;
-        ref = m_imageCache.get(-1, p);
-        if (!ref.isNull()) {
-            //CRLog::trace("getPageImage: + page [%d] found in cache", offset);
-            return ref;
-        }
-    } else {
-        offset = _pos;
-        if (delta < 0)
-            offset = getPrevPageOffset();
-        else if (delta > 0)
-            offset = getNextPageOffset();
-        //CRLog::trace("getPageImage: checking cache for page [%d] (delta=%d)", offset, delta);
-        ref = m_imageCache.get(offset, -1);
-        if (!ref.isNull()) {
-            //CRLog::trace("getPageImage: + page [%d] found in cache", offset);
-            return ref;
-        }
+    int p;
+    int offset;
+    if (!getPageImagePos(delta, offset, p))
+        return LVDocImageRef();
+    if (delta == 0 && m_imageCacheAhead + m_imageCacheBehind > 0) {
+        // drops stale pages and queues current and neighbour pages
+        prerenderPageImages();
     }
+    // find existing object in cache
+    LVDocImageRef ref = m_imageCache.get(this, offset, p);
     while (ref.isNull()) {
         //CRLog::trace("getPageImage: - page [%d] not found, force rendering", offset);
         cachePageImage(delta);
-        ref = m_imageCache.get(offset, p);
+        ref = m_imageCache.get(this, offset, p);
     }
     //CRLog::trace("getPageImage: page [%d] is ready", offset);
     return ref;
 }
-
-class LVDrawThread: public LVThread
-{
-    LVDocView* _view;
-    int _offset;
-    int _page;
-    LVDrawBufRef _drawbuf;
-public:
-    LVDrawThread(LVDocView* view, int offset, int page, LVDrawBufRef drawbuf)
-            : _view(view)
-            , _offset(offset)
-            , _page(page)
-            , _drawbuf(drawbuf) {
-        start();
-    }
-    virtual void run() {
-        //CRLog::trace("LVDrawThread::run() offset==%d", _offset);
-        _view->Draw(*_drawbuf, _offset, _page, true);
-        //_drawbuf->Rotate( _view->GetRotateAngle() );
-    }
-};
 #endif
-
 /// draw current page to specified buffer
 void LVDocView::Draw(LVDrawBuf& drawbuf, bool autoResize) {
     checkPos();
@@ -1032,31 +1278,7 @@ void LVDocView::Draw(LVDrawBuf& drawbuf, bool autoResize) {
 }
 
 #if CR_ENABLE_PAGE_IMAGE_CACHE == 1
-/// cache page image (render in background if necessary)
-void LVDocView::cachePageImage(int delta) {
-    int offset = -1;
-    int p = -1;
-    if (isPageMode()) {
-        p = _page;
-        if (delta < 0)
-            p--;
-        else if (delta > 0)
-            p++;
-        if (p < 0 || p >= m_pages.length())
-            return;
-    } else {
-        offset = _pos;
-        if (delta < 0)
-            offset = getPrevPageOffset();
-        else if (delta > 0)
-            offset = getNextPageOffset();
-    }
-    //CRLog::trace("cachePageImage: request to cache page [%d] (delta=%d)", offset, delta);
-    if (m_imageCache.has(offset, p)) {
-        //CRLog::trace("cachePageImage: Page [%d] is found in cache", offset);
-        return;
-    }
-    //CRLog::trace("cachePageImage: starting new render task for page [%d]", offset);
+LVDrawBufRef LVDocView::createPageImageBuffer() {
     LVDrawBuf* buf = NULL;
     if (m_bitsPerPixel == -1) {
 #if (COLOR_BACKBUFFER == 1)
@@ -1071,11 +1293,74 @@ void LVDocView::cachePageImage(int delta) {
             buf = new LVGrayDrawBuf(m_dx, m_dy, m_bitsPerPixel);
         }
     }
-    LVDrawBufRef drawbuf(buf);
-    LVRef<LVThread> thread(new LVDrawThread(this, offset, p, drawbuf));
-    m_imageCache.set(offset, p, drawbuf, thread);
+    return LVDrawBufRef(buf);
+}
+
+/// cache page image (render in background if necessary)
+void LVDocView::cachePageImage(int delta) {
+    int offset;
+    int p;
+    if (!getPageImagePos(delta, offset, p))
+        return;
+    //CRLog::trace("cachePageImage: request to cache page [%d] (delta=%d)", offset, delta);
+    if (m_imageCache.has(offset, p)) {
+        //CRLog::trace("cachePageImage: Page [%d] is found in cache", offset);
+        return;
+    }
+    //CRLog::trace("cachePageImage: starting new render task for page [%d]", offset);
+    int curOffset;
+    int curPage;
+    getPageImagePos(0, curOffset, curPage);
+    m_imageCache.add(this, offset, p, createPageImageBuffer(), curOffset, curPage);
     //CRLog::trace("cachePageImage: caching page [%d] is finished", offset);
 }
+
+void LVDocView::setPageImageCacheSize(int ahead, int behind) {
+    if (ahead < 0)
+        ahead = 0;
+    if (behind < 0)
+        behind = 0;
+    // only adjacent pages are available in scroll mode
+    m_imageCacheAhead = ahead;
+    m_imageCacheBehind = behind;
+    m_imageCache.setMaxSize(1 + ahead + behind);
+}
+
+void LVDocView::prerenderPageImages() {
+    if (!CRGetSharedThreadPool())
+        return; // don't block calling thread with pages it did not ask for
+    LVLock lock(getMutex());
+    if (!m_is_rendered || !_posIsSet)
+        return;
+    // current page, then next, previous, second next, second previous, etc
+    LVArray<int> deltas;
+    deltas.add(0);
+    for (int i = 1; i <= m_imageCacheAhead || i <= m_imageCacheBehind; i++) {
+        if (i <= m_imageCacheAhead)
+            deltas.add(i);
+        if (i <= m_imageCacheBehind)
+            deltas.add(-i);
+    }
+    LVArray<int> offsets;
+    LVArray<int> pages;
+    for (int i = 0; i < deltas.length(); i++) {
+        int offset;
+        int p;
+        if (getPageImagePos(deltas[i], offset, p)) {
+            offsets.add(offset);
+            pages.add(p);
+        }
+    }
+    m_imageCache.retain(offsets, pages);
+    int curOffset;
+    int curPage;
+    if (!getPageImagePos(0, curOffset, curPage))
+        return;
+    for (int i = 0; i < offsets.length(); i++) {
+        if (!m_imageCache.has(offsets[i], pages[i]))
+            m_imageCache.add(this, offsets[i], pages[i], createPageImageBuffer(), curOffset, curPage);
+    }
+}
 #endif
 
 bool LVDocView::exportWolFile(const char* fname, bool flgGray, int levels) {
@@ -2454,10 +2739,11 @@ void LVDocView::drawPageTo(LVDrawBuf* drawbuf, LVRendPageInfo& page,
             if (m_markRanges.length())
                 CRLog::trace("Entering DrawDocument() : %d ranges", m_markRanges.length());
             //CRLog::trace("Entering DrawDocument()");
-            if (page.height)
+            if (page.height) {
                 DrawDocument(*drawbuf, m_doc->getRootNode(), pageRect->left + m_pageMargins.left, clip.top, pageRect->width() - m_pageMargins.left - m_pageMargins.right, height, 0,
                              -start + offset, m_dy, &m_markRanges, &m_bmkRanges);
-                //CRLog::trace("Done DrawDocument() for main text");
+            }
+            //CRLog::trace("Done DrawDocument() for main text");
                 // draw footnotes
 #define FOOTNOTE_MARGIN_REM 1 // as in lvpagesplitter.cpp
             int footnote_margin = FOOTNOTE_MARGIN_REM * m_font_size;
@@ -2792,6 +3078,8 @@ void LVDocView::drawPageBackground(LVDrawBuf& drawbuf, int offsetX, int offsetY,
 /// draw to specified buffer
 void LVDocView::Draw(LVDrawBuf& drawbuf, int position, int page, bool rotate, bool autoresize) {
     LVLock lock(getMutex());
+    // formatted blocks drawn refer to nodes
+    ldomUseGuard use(m_doc);
     //CRLog::trace("Draw() : calling checkPos()");
     checkPos();
 
@@ -3339,6 +3627,11 @@ void LVDocView::Render(int dx, int dy, LVRendPageList* pages) {
 
         CRLog::debug("Render(width=%d, height=%d, fontSize=%d, currentFontSize=%d, 0 char width=%d)", dx, dy,
                      m_font_size, m_font->getSize(), m_font->getCharWidth('0'));
+#if CR_ENABLE_PAGE_IMAGE_CACHE == 1
+        // Pre-rendering tasks must not be run by this thread while it waits
+        // for paragraphs formatted ahead by the same thread pool.
+        m_imageCache.clear();
+#endif
         //CRLog::trace("calling render() for document %08X font=%08X", (unsigned int)m_doc, (unsigned int)m_font.get() );
         bool did_rerender = m_doc->render(pages, isDocumentOpened() ? m_callback : NULL, dx, dy,
                                           m_showCover, m_showCover ? dy + m_pageMargins.bottom * 4 : 0,
@@ -4476,7 +4769,10 @@ bool LVDocView::LoadDocument(const lChar32* fname, bool metadataOnly) {
             m_props->setInt(PROP_RENDER_BLOCK_RENDERING_FLAGS, BLOCK_RENDERING_FLAGS_LEGACY);
         }
         // loading document
+        CRTimerUtil loadTimer;
         if (loadDocumentInt(stream, metadataOnly)) {
+            if (!m_doc->isOpenFromCache())
+                m_doc->setParseTime((lUInt32)loadTimer.elapsed());
             m_filename = LVGetAbsolutePath(lString32(fname));
             m_stream.Clear();
             if (convertBookmarks) {
@@ -4540,7 +4836,10 @@ bool LVDocView::LoadDocument(const lChar32* fname, bool metadataOnly) {
         m_props->setInt(PROP_RENDER_BLOCK_RENDERING_FLAGS, BLOCK_RENDERING_FLAGS_LEGACY);
     }
 
+    CRTimerUtil loadTimer;
     if (loadDocumentInt(stream, metadataOnly)) {
+        if (!m_doc->isOpenFromCache())
+            m_doc->setParseTime((lUInt32)loadTimer.elapsed());
         m_filename = LVGetAbsolutePath(fileNameFromDocProps(m_doc_props));
         m_stream.Clear();
         if (convertBookmarks) {
@@ -4629,7 +4928,10 @@ bool LVDocView::LoadDocument(LVStreamRef stream, const lChar32* contentPath, boo
         m_props->setInt(PROP_RENDER_BLOCK_RENDERING_FLAGS, BLOCK_RENDERING_FLAGS_LEGACY);
     }
 
+    CRTimerUtil loadTimer;
     if (loadDocumentInt(stream, metadataOnly)) {
+        if (!m_doc->isOpenFromCache())
+            m_doc->setParseTime((lUInt32)loadTimer.elapsed());
         m_filename = LVGetAbsolutePath(fileNameFromDocProps(m_doc_props));
         if (convertBookmarks) {
             record->convertBookmarks(m_doc, newDOMVersion);
@@ -4817,7 +5119,8 @@ bool LVDocView::loadDocumentInt(LVStreamRef stream, bool metadataOnly) {
             if (m_callback)
                 m_callback->OnLoadFileFormatDetected(doc_format_epub);
             updateDocStyleSheet();
-            bool res = ImportEpubDocument(m_stream, m_doc, m_callback, this, metadataOnly);
+            bool res = ImportEpubDocument(m_stream, m_doc, m_callback, this, metadataOnly,
+                                          m_props->getBoolDef(PROP_LOAD_PIPELINED, false));
             if (!res) {
                 setDocFormat(doc_format_none);
                 createDefaultDocument(cs32("ERROR: Error reading EPUB format"), cs32("Cannot open document"));
@@ -5249,9 +5552,13 @@ void LVDocView::createEmptyDocument() {
 
     //m_doc ? m_doc->getDocFlags() : DOC_FLAG_DEFAULTS;
     m_is_rendered = false;
-    if (m_doc)
+    clearImageCache();
+    if (m_doc) {
+        m_doc->deliverCacheFileNotifications();
         delete m_doc;
+    }
     m_doc = new ldomDocument();
+    m_doc->setAccessMutex(&_mutex);
     m_cursorPos.clear();
     m_markRanges.clear();
     m_bmkRanges.clear();
@@ -5282,6 +5589,13 @@ void LVDocView::createEmptyDocument() {
     m_doc->setMaxAddedLetterSpacingPercent(m_props->getIntDef(PROP_FORMAT_MAX_ADDED_LETTER_SPACING_PERCENT, DEF_MAX_ADDED_LETTER_SPACING_PERCENT));
     m_doc->setHangingPunctiationEnabled(m_props->getBoolDef(PROP_FLOATING_PUNCTUATION, false));
     m_doc->setRenderBlockRenderingFlags(m_props->getIntDef(PROP_RENDER_BLOCK_RENDERING_FLAGS, BLOCK_RENDERING_FLAGS_DEFAULT));
+    m_doc->setParallelFormatting(m_props->getBoolDef(PROP_RENDER_PARALLEL_FORMATTING, false));
+    m_doc->setAsyncCacheWrites(m_props->getBoolDef(PROP_CACHE_ASYNC_WRITE, false));
+    m_doc->setMappedCacheReads(m_props->getBoolDef(PROP_CACHE_MMAP_READ, false));
+    m_doc->setLazyNodeLoading(m_props->getBoolDef(PROP_CACHE_LAZY_NODES, false));
+    m_doc->setCacheCompressionDictionary(m_props->getBoolDef(PROP_CACHE_COMPRESSION_DICT, false));
+    m_doc->setMaxRenderVariants(m_props->getIntDef(PROP_CACHE_RENDER_VARIANTS, 0));
+    m_doc->setTraversalIndex(m_props->getBoolDef(PROP_DOM_TRAVERSAL_INDEX, false));
     m_doc->setDOMVersionRequested(m_props->getIntDef(PROP_REQUESTED_DOM_VERSION, gDOMVersionCurrent));
     if (m_def_interline_space == 100) // (avoid any rounding issue)
         m_doc->setInterlineScaleFactor(INTERLINE_SCALE_FACTOR_NO_SCALE);
@@ -5476,6 +5790,7 @@ bool LVDocView::ParseDocument() {
 
             // parse
             parser->setProgressCallback(m_callback);
+            parser->setPipelined(m_props->getBoolDef(PROP_LOAD_PIPELINED, false));
             if (!parser->Parse()) {
                 if (m_callback) {
                     m_callback->OnLoadFileError(cs32("Bad document format"));
@@ -5611,6 +5926,11 @@ ContinuousOperationResult LVDocView::updateCache() {
     return swapToCache(infinite);
 }
 
+/// defragment cache file (if one is created) and reduce its size, with timeout option
+ContinuousOperationResult LVDocView::compactCache(CRTimerUtil& maxTime) {
+    return m_doc->compactCacheFile(maxTime);
+}
+
 /// save document to cache file, with timeout option
 ContinuousOperationResult LVDocView::swapToCache(CRTimerUtil& maxTime) {
     lInt64 fs = m_doc_props->getInt64Def(DOC_PROP_FILE_SIZE, 0);
@@ -7202,6 +7522,16 @@ void LVDocView::propsUpdateDefaults(CRPropRef props) {
     props->limitValueList(PROP_FONT_INTERPRETER, int_option_interpreter, sizeof(int_option_interpreter) / sizeof(int), 0);
     props->limitValueMinMax(PROP_FONT_SHAPING, 0, 2, 1);
     props->limitValueMinMax(PROP_LANDSCAPE_PAGES, 1, 2, 2);
+    props->limitValueMinMax(PROP_PAGE_IMAGE_CACHE_AHEAD, 0, 8, 0);
+    props->limitValueMinMax(PROP_PAGE_IMAGE_CACHE_BEHIND, 0, 8, 0);
+    props->setBoolDef(PROP_RENDER_PARALLEL_FORMATTING, false);
+    props->setBoolDef(PROP_LOAD_PIPELINED, false);
+    props->setBoolDef(PROP_CACHE_ASYNC_WRITE, false);
+    props->setBoolDef(PROP_CACHE_MMAP_READ, false);
+    props->setBoolDef(PROP_CACHE_LAZY_NODES, false);
+    props->setBoolDef(PROP_CACHE_COMPRESSION_DICT, false);
+    props->setIntDef(PROP_CACHE_RENDER_VARIANTS, 0);
+    props->setBoolDef(PROP_DOM_TRAVERSAL_INDEX, false);
     props->setBoolDef(PROP_PAGE_VIEW_MODE, true);
     props->setBoolDef(PROP_FOOTNOTES, true);
     // Migrate old PROP_FOOTNOTES boolean to new PROP_FOOTNOTES_MODE
@@ -7365,6 +7695,11 @@ CRPropRef LVDocView::propsApply(CRPropRef props) {
         } else if (name == PROP_LANDSCAPE_PAGES) {
             int pages = props->getIntDef(PROP_LANDSCAPE_PAGES, 2);
             setVisiblePageCount(pages);
+        } else if (name == PROP_PAGE_IMAGE_CACHE_AHEAD || name == PROP_PAGE_IMAGE_CACHE_BEHIND) {
+#if CR_ENABLE_PAGE_IMAGE_CACHE == 1
+            setPageImageCacheSize(props->getIntDef(PROP_PAGE_IMAGE_CACHE_AHEAD, 0),
+                                  props->getIntDef(PROP_PAGE_IMAGE_CACHE_BEHIND, 0));
+#endif
         } else if (name == PROP_FONT_KERNING_ENABLED) {
             bool kerning = props->getBoolDef(PROP_FONT_KERNING_ENABLED, false);
             fontMan->SetKerning(kerning);
@@ -7545,6 +7880,30 @@ CRPropRef LVDocView::propsApply(CRPropRef props) {
                 if (getDocument()->setDOMVersionRequested(value)) {
                     REQUEST_RENDER("propsApply requested dom version")
                 }
+        } else if (name == PROP_RENDER_PARALLEL_FORMATTING) {
+            // no need to re-render: result is the same
+            if (m_doc) // not when noDefaultDocument=true
+                getDocument()->setParallelFormatting(props->getBoolDef(PROP_RENDER_PARALLEL_FORMATTING, false));
+        } else if (name == PROP_LOAD_PIPELINED) {
+            // used on next document loading
+        } else if (name == PROP_CACHE_ASYNC_WRITE) {
+            if (m_doc) // not when noDefaultDocument=true
+                getDocument()->setAsyncCacheWrites(props->getBoolDef(PROP_CACHE_ASYNC_WRITE, false));
+        } else if (name == PROP_CACHE_MMAP_READ) {
+            if (m_doc) // not when noDefaultDocument=true
+                getDocument()->setMappedCacheReads(props->getBoolDef(PROP_CACHE_MMAP_READ, false));
+        } else if (name == PROP_CACHE_LAZY_NODES) {
+            if (m_doc) // not when noDefaultDocument=true
+                getDocument()->setLazyNodeLoading(props->getBoolDef(PROP_CACHE_LAZY_NODES, false));
+        } else if (name == PROP_CACHE_COMPRESSION_DICT) {
+            if (m_doc) // not when noDefaultDocument=true
+                getDocument()->setCacheCompressionDictionary(props->getBoolDef(PROP_CACHE_COMPRESSION_DICT, false));
+        } else if (name == PROP_CACHE_RENDER_VARIANTS) {
+            if (m_doc) // not when noDefaultDocument=true
+                getDocument()->setMaxRenderVariants(props->getIntDef(PROP_CACHE_RENDER_VARIANTS, 0));
+        } else if (name == PROP_DOM_TRAVERSAL_INDEX) {
+            if (m_doc) // not when noDefaultDocument=true
+                getDocument()->setTraversalIndex(props->getBoolDef(PROP_DOM_TRAVERSAL_INDEX, false));
         } else if (name == PROP_RENDER_BLOCK_RENDERING_FLAGS) {
             lUInt32 value = (lUInt32)props->getIntDef(PROP_RENDER_BLOCK_RENDERING_FLAGS, BLOCK_RENDERING_FLAGS_DEFAULT);
             if (m_doc) // not when noDefaultDocument=true
@@ -62,9 +62,9 @@ lUInt16 LBitmapFont::measureText(
 }
 
 lUInt32 LBitmapFont::getTextWidth(const lChar32* text, int len, TextLangCfg* lang_cfg) {
-    //
-    static lUInt16 widths[MAX_LINE_CHARS + 1];
-    static lUInt8 flags[MAX_LINE_CHARS + 1];
+    // text may be measured by formatting tasks of thread pool
+    static thread_local lUInt16 widths[MAX_LINE_CHARS + 1];
+    static thread_local lUInt8 flags[MAX_LINE_CHARS + 1];
     if (len > MAX_LINE_CHARS)
         len = MAX_LINE_CHARS;
     if (len <= 0)
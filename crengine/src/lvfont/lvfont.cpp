@@ -26,7 +26,7 @@
  * Max width of -/./,/!/? to use for visial alignment by width
  */
 int LVFont::getVisualAligmentWidth() {
-    FONT_GUARD
+    FONT_FACE_GUARD(getInstanceMutex())
     if (_visual_alignment_width == -1) {
         //lChar32 chars[] = { getHyphChar(), ',', '.', '!', ':', ';', 0 };
         lChar32 chars[] = { getHyphChar(), ',', '.', '!', ':', ';',
@@ -51,3 +51,21 @@ bool operator==(const LVFont& r1, const LVFont& r2) {
         return true;
     return r1.getSize() == r2.getSize() && r1.getWeight() == r2.getWeight() && r1.getItalic() == r2.getItalic() && r1.getFontFamily() == r2.getFontFamily() && r1.getTypeFace() == r2.getTypeFace() && r1.getShapingMode() == r2.getShapingMode() && r1.getKerning() == r2.getKerning() && r1.getHintingMode() == r2.getHintingMode();
 }
+
+LVFontChainGuard::LVFontChainGuard(LVFont* font, lUInt32 fallbackPassMask)
+        : _count(0) {
+    while (font && _count < 32) {
+        CRMutex* mutex = font->getInstanceMutex();
+        if (!mutex)
+            break;
+        CRAcquire(mutex, CR_LOCK_STATS_FONT_FACE);
+        _mutexes[_count++] = mutex;
+        fallbackPassMask |= font->getFallbackMask();
+        font = font->getFallbackFont(fallbackPassMask);
+    }
+}
+
+LVFontChainGuard::~LVFontChainGuard() {
+    while (_count > 0)
+        _mutexes[--_count]->release();
+}
@@ -46,7 +46,7 @@ LVFontBoldTransform::LVFontBoldTransform(LVFontRef baseFont, LVFontGlobalGlyphCa
 }
 
 int LVFontBoldTransform::getHyphenWidth() {
-    FONT_GUARD
+    FONT_FACE_GUARD(getInstanceMutex())
     if (_hyphWidth < 0)
         _hyphWidth = getCharWidth(getHyphChar());
     return _hyphWidth;
@@ -92,8 +92,10 @@ LVFontBoldTransform::measureText(const lChar32* text, int len, lUInt16* widths,
 }
 
 lUInt32 LVFontBoldTransform::getTextWidth(const lChar32* text, int len, TextLangCfg* lang_cfg) {
-    static lUInt16 widths[MAX_LINE_CHARS + 1];
-    static lUInt8 flags[MAX_LINE_CHARS + 1];
+    FONT_FACE_GUARD(getInstanceMutex())
+    // not static: other font instances may measure text at the same time
+    lUInt16 widths[MAX_LINE_CHARS + 1];
+    lUInt8 flags[MAX_LINE_CHARS + 1];
     if (len > MAX_LINE_CHARS)
         len = MAX_LINE_CHARS;
     if (len <= 0)
@@ -111,10 +113,14 @@ lUInt32 LVFontBoldTransform::getTextWidth(const lChar32* text, int len, TextLang
 }
 
 LVFontGlyphCacheItem* LVFontBoldTransform::getGlyph(lUInt32 ch, lChar32 def_char, lUInt32 fallbackPassMask) {
+    FONT_FACE_GUARD(getInstanceMutex())
     LVFontGlyphCacheItem* item = _glyph_cache.get(ch);
     if (item)
         return item;
 
+    // base font glyph is used to make bold one
+    LVFontChainGuard baseGuard(_baseFont, fallbackPassMask);
+    CR_UNUSED(baseGuard);
     LVFontGlyphCacheItem* olditem = _baseFont->getGlyph(ch, def_char, fallbackPassMask);
     if (!olditem)
         return NULL;
@@ -174,6 +180,7 @@ int LVFontBoldTransform::DrawTextString(LVDrawBuf* buf, int x, int y, const lCha
                                         lChar32 def_char, lUInt32* palette, bool addHyphen, TextLangCfg* lang_cfg,
                                         lUInt32 flags, int letter_spacing, int width, int text_decoration_back_gap,
                                         int target_w, int target_h, lUInt32 fallbackPassMask) {
+    FONT_FACE_GUARD(getInstanceMutex())
     if (len <= 0)
         return 0;
     if (letter_spacing < 0) {
@@ -24,13 +24,10 @@
 
 #include "lvfontglyphcache.h"
 
+#include <new>
+
 void LVFontGlobalGlyphCache::refresh(LVFontGlyphCacheItem* item) {
-    FONT_GLYPH_CACHE_GUARD
-    if (tail != item) {
-        //move to head
-        removeNoLock(item);
-        putNoLock(item);
-    }
+    item->referenced.store(true, std::memory_order_relaxed);
 }
 
 void LVFontGlobalGlyphCache::put(LVFontGlyphCacheItem* item) {
@@ -40,23 +37,34 @@ void LVFontGlobalGlyphCache::put(LVFontGlyphCacheItem* item) {
 
 void LVFontGlobalGlyphCache::putNoLock(LVFontGlyphCacheItem* item) {
     int sz = item->getSize();
-    // remove extra items from tail
+    // remove extra items from tail, recently used items are moved to head once
+    int skipped = 0;
     while (sz + size > max_size) {
         LVFontGlyphCacheItem* removed_item = tail;
         if (!removed_item)
             break;
         removeNoLock(removed_item);
-        removed_item->local_cache->remove(removed_item);
-        LVFontGlyphCacheItem::freeItem(removed_item);
+        if (skipped < size && removed_item->referenced.exchange(false, std::memory_order_relaxed)) {
+            skipped += removed_item->getSize();
+            linkNoLock(removed_item);
+            continue;
+        }
+        // item may be in use by other thread right now, owner will free it
+        removed_item->local_cache->pushEvicted(removed_item);
     }
-    // add new item to head
+    linkNoLock(item);
+}
+
+void LVFontGlobalGlyphCache::linkNoLock(LVFontGlyphCacheItem* item) {
+    // add item to head
+    item->prev_global = NULL;
     item->next_global = head;
     if (head)
         head->prev_global = item;
     head = item;
     if (!tail)
         tail = item;
-    size += sz;
+    size += item->getSize();
 }
 
 void LVFontGlobalGlyphCache::remove(LVFontGlyphCacheItem* item) {
@@ -69,8 +77,6 @@ void LVFontGlobalGlyphCache::removeNoLock(LVFontGlyphCacheItem* item) {
         head = item->next_global;
     if (item == tail)
         tail = item->prev_global;
-    if (!head || !tail)
-        return;
     if (item->prev_global)
         item->prev_global->next_global = item->next_global;
     if (item->next_global)
@@ -84,9 +90,8 @@ void LVFontGlobalGlyphCache::clear() {
     FONT_GLYPH_CACHE_GUARD
     while (head) {
         LVFontGlyphCacheItem* ptr = head;
-        remove(ptr);
-        ptr->local_cache->remove(ptr);
-        LVFontGlyphCacheItem::freeItem(ptr);
+        removeNoLock(ptr);
+        ptr->local_cache->pushEvicted(ptr);
     }
 }
 
@@ -105,6 +110,8 @@ LVFontGlyphCacheItem* LVFontGlyphCacheItem::newItem(LVFontLocalGlyphCache* local
         item->prev_local = NULL;
         item->next_local = NULL;
         item->local_cache = local_cache;
+        item->next_evicted = NULL;
+        new (&item->referenced) std::atomic<bool>(false);
     }
     return item;
 }
@@ -131,8 +138,6 @@ void LVLocalGlyphCacheHashTableStorage::remove(LVFontGlyphCacheItem* item) {
 }
 
 void LVLocalGlyphCacheHashTableStorage::clear() {
-    FONT_LOCAL_GLYPH_CACHE_GUARD
-
     LVHashTable<lUInt32, struct LVFontGlyphCacheItem*>::iterator it = hashTable.forwardIterator();
     LVHashTable<lUInt32, struct LVFontGlyphCacheItem*>::pair* pair;
     while ((pair = it.next())) {
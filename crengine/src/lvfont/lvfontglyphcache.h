@@ -37,11 +37,19 @@
 #include <crlocks.h>
 
 #include <stddef.h>
+#include <atomic>
 
 #define GLYPHCACHE_TABLE_SZ 256
 
 struct LVFontGlyphCacheItem;
 
+/**
+ * Size limited glyph cache shared by all fonts.
+ * Items are owned by local caches of font instances, which are protected by font instance mutex.
+ * Global cache chooses items to evict using CLOCK algorithm (second chance for recently used items),
+ * so cache hits don't need any global lock. Evicted items are passed back to their local cache
+ * and are freed by it on next access, from the thread owning font instance mutex.
+ */
 class LVFontGlobalGlyphCache
 {
 private:
@@ -52,6 +60,8 @@ private:
 
     void removeNoLock(LVFontGlyphCacheItem* item);
 
+    void linkNoLock(LVFontGlyphCacheItem* item);
+
     void putNoLock(LVFontGlyphCacheItem* item);
 public:
     LVFontGlobalGlyphCache(int maxSize)
@@ -69,8 +79,10 @@ public:
 
     void remove(LVFontGlyphCacheItem* item);
 
+    /// mark item as recently used, lock-free
     void refresh(LVFontGlyphCacheItem* item);
 
+    /// evict all items, they are freed by local caches on next access
     void clear();
 };
 
@@ -118,31 +130,38 @@ public:
     void clear();
 };
 
+/// Glyph cache of single font instance, to be used under font instance mutex
 template <class S>
 class LVFontLocalGlyphCache_t
 {
 public:
     LVFontLocalGlyphCache_t(LVFontGlobalGlyphCache* globalCache)
-            : m_storage(globalCache) {
+            : m_storage(globalCache)
+            , m_evicted(NULL) {
+    }
+    ~LVFontLocalGlyphCache_t() {
+        clear();
     }
     void clear() {
-        FONT_LOCAL_GLYPH_CACHE_GUARD
+        // no evictions from this cache while clearing
+        FONT_GLYPH_CACHE_GUARD
+        freeEvicted();
         m_storage.clear();
     }
     LVFontGlyphCacheItem* get(lUInt32 index) {
-        FONT_LOCAL_GLYPH_CACHE_GUARD
+        freeEvicted();
         return m_storage.get(index);
     }
     void put(LVFontGlyphCacheItem* item) {
-        FONT_LOCAL_GLYPH_CACHE_GUARD
+        freeEvicted();
         m_storage.put(item);
     }
-    void remove(LVFontGlyphCacheItem* item) {
-        FONT_LOCAL_GLYPH_CACHE_GUARD
-        m_storage.remove(item);
-    }
+    /// called by global cache for evicted item, from any thread
+    inline void pushEvicted(LVFontGlyphCacheItem* item);
 private:
     S m_storage;
+    std::atomic<LVFontGlyphCacheItem*> m_evicted; // list of evicted items to be freed
+    inline void freeEvicted();
 };
 
 #if USE_GLYPHCACHE_HASHTABLE == 1
@@ -164,6 +183,8 @@ struct LVFontGlyphCacheItem
     LVFontGlyphCacheItem* prev_local;
     LVFontGlyphCacheItem* next_local;
     LVFontLocalGlyphCache* local_cache;
+    LVFontGlyphCacheItem* next_evicted;
+    std::atomic<bool> referenced;
     LVFontGlyphCacheKeyType data;
     FontBmpPixelFormat bmp_fmt;
     lUInt16 bmp_width;
@@ -181,4 +202,24 @@ struct LVFontGlyphCacheItem
     static LVFontGlyphCacheItem* newItem(LVFontLocalGlyphCache* local_cache, LVFontGlyphCacheKeyType ch_or_index, int w, int h, unsigned int bmp_pitch, unsigned int bmp_sz);
     static void freeItem(LVFontGlyphCacheItem* item);
 };
+
+template <class S>
+inline void LVFontLocalGlyphCache_t<S>::pushEvicted(LVFontGlyphCacheItem* item) {
+    item->next_evicted = m_evicted.load(std::memory_order_relaxed);
+    while (!m_evicted.compare_exchange_weak(item->next_evicted, item, std::memory_order_release, std::memory_order_relaxed)) { }
+}
+
+template <class S>
+inline void LVFontLocalGlyphCache_t<S>::freeEvicted() {
+    if (!m_evicted.load(std::memory_order_relaxed))
+        return;
+    LVFontGlyphCacheItem* item = m_evicted.exchange(NULL, std::memory_order_acquire);
+    while (item) {
+        LVFontGlyphCacheItem* next = item->next_evicted;
+        m_storage.remove(item);
+        LVFontGlyphCacheItem::freeItem(item);
+        item = next;
+    }
+}
+
 #endif //__LV_FONTGLYPHCACHE_H_INCLUDED__
@@ -261,7 +261,6 @@ bool isHBScriptCursive(hb_script_t script) {
 
 static LVFontGlyphCacheItem* newItem(LVFontLocalGlyphCache* local_cache, lChar32 ch, FT_GlyphSlot slot, font_antialiasing_t aa_mode, int gammaIndex) // , bool drawMonochrome
 {
-    FONT_LOCAL_GLYPH_CACHE_GUARD
     FT_Bitmap* bitmap = &slot->bitmap;
     unsigned int w = (FT_PIXEL_MODE_LCD == bitmap->pixel_mode) ? bitmap->width / 3 : bitmap->width;
     unsigned int h = (FT_PIXEL_MODE_LCD_V == bitmap->pixel_mode) ? bitmap->rows / 3 : bitmap->rows;
@@ -312,7 +311,6 @@ static LVFontGlyphCacheItem* newItem(LVFontLocalGlyphCache* local_cache, lChar32
 #if USE_HARFBUZZ == 1
 
 static LVFontGlyphCacheItem* newItem(LVFontLocalGlyphCache* local_cache, lUInt32 index, FT_GlyphSlot slot, font_antialiasing_t aa_mode, int gammaIndex) {
-    FONT_LOCAL_GLYPH_CACHE_GUARD
     FT_Bitmap* bitmap = &slot->bitmap;
     unsigned int w = (FT_PIXEL_MODE_LCD == bitmap->pixel_mode) ? bitmap->width / 3 : bitmap->width;
     unsigned int h = (FT_PIXEL_MODE_LCD_V == bitmap->pixel_mode) ? bitmap->rows / 3 : bitmap->rows;
@@ -586,7 +584,7 @@ void LVFreeTypeFace::clearCache() {
 }
 
 int LVFreeTypeFace::getHyphenWidth() {
-    FONT_GUARD
+    FONT_FACE_GUARD(getInstanceMutex())
     if (!_hyphen_width) {
         _hyphen_width = getCharWidth(UNICODE_SOFT_HYPHEN_CODE);
     }
@@ -732,7 +730,8 @@ void LVFreeTypeFace::setSynthWeight(int synth_weight) {
 
 bool LVFreeTypeFace::loadFromBuffer(LVByteArrayRef buf, int index, int size, css_font_family_t fontFamily,
                                     bool monochrome, bool italicize, int weight) {
-    FONT_GUARD
+    // FreeType faces of the same library must not be created or destroyed concurrently
+    LVLock lock(_mutex);
     _hintingMode = fontMan->GetHintingMode();
     _aa_mode = fontMan->GetAntialiasMode();
     _drawMonochrome = monochrome;
@@ -873,7 +872,8 @@ bool LVFreeTypeFace::loadFromBuffer(LVByteArrayRef buf, int index, int size, css
 
 bool LVFreeTypeFace::loadFromFile(const char* fname, int index, int size, css_font_family_t fontFamily,
                                   bool monochrome, bool italicize, int weight) {
-    FONT_GUARD
+    // FreeType faces of the same library must not be created or destroyed concurrently
+    LVLock lock(_mutex);
     _hintingMode = fontMan->GetHintingMode();
     _aa_mode = fontMan->GetAntialiasMode();
     _drawMonochrome = monochrome;
@@ -1618,7 +1618,7 @@ void LVFreeTypeFace::setupHBFeatures() {
 #endif
 
 bool LVFreeTypeFace::getGlyphInfo(lUInt32 code, LVFont::glyph_info_t* glyph, lChar32 def_char, lUInt32 fallbackPassMask) {
-    //FONT_GUARD
+    FONT_FACE_GUARD(getInstanceMutex())
     FT_UInt glyph_index = getCharIndex(code, 0);
     if (glyph_index == 0) {
         LVFont* fallback = getFallbackFont(fallbackPassMask);
@@ -1637,6 +1637,7 @@ bool LVFreeTypeFace::getGlyphInfo(lUInt32 code, LVFont::glyph_info_t* glyph, lCh
 }
 
 bool LVFreeTypeFace::getGlyphExtraMetric(glyph_extra_metric_t metric, lUInt32 code, int& value, bool scaled_to_px, lChar32 def_char, lUInt32 fallbackPassMask) {
+    FONT_FACE_GUARD(getInstanceMutex())
     int glyph_index = getCharIndex(code, 0);
     if (glyph_index == 0) {
         LVFont* fallback = getFallbackFont(fallbackPassMask);
@@ -1693,7 +1694,7 @@ lUInt16 LVFreeTypeFace::measureText(const lChar32* text,
                                     int letter_spacing,
                                     bool allow_hyphenation,
                                     lUInt32 hints, lUInt32 fallbackPassMask) {
-    FONT_GUARD
+    FONT_FACE_GUARD(getInstanceMutex())
     if (len <= 0 || _face == NULL)
         return 0;
     LVFont* fallbackFont = getFallbackFont(fallbackPassMask);
@@ -2225,8 +2226,10 @@ lUInt16 LVFreeTypeFace::measureText(const lChar32* text,
 }
 
 lUInt32 LVFreeTypeFace::getTextWidth(const lChar32* text, int len, TextLangCfg* lang_cfg) {
-    static lUInt16 widths[MAX_LINE_CHARS + 1];
-    static lUInt8 flags[MAX_LINE_CHARS + 1];
+    FONT_FACE_GUARD(getInstanceMutex())
+    // not static: other font instances may measure text at the same time
+    lUInt16 widths[MAX_LINE_CHARS + 1];
+    lUInt8 flags[MAX_LINE_CHARS + 1];
     if (len > MAX_LINE_CHARS)
         len = MAX_LINE_CHARS;
     if (len <= 0)
@@ -2253,7 +2256,7 @@ void LVFreeTypeFace::updateTransform() {
 }
 
 LVFontGlyphCacheItem* LVFreeTypeFace::getGlyph(lUInt32 ch, lChar32 def_char, lUInt32 fallbackPassMask) {
-    //FONT_GUARD
+    FONT_FACE_GUARD(getInstanceMutex())
     FT_UInt ch_glyph_index = getCharIndex(ch, 0);
     if (ch_glyph_index == 0) {
         LVFont* fallback = getFallbackFont(fallbackPassMask);
@@ -2338,7 +2341,7 @@ LVFontGlyphCacheItem* LVFreeTypeFace::getGlyph(lUInt32 ch, lChar32 def_char, lUI
 #if USE_HARFBUZZ == 1
 
 LVFontGlyphCacheItem* LVFreeTypeFace::getGlyphByIndex(lUInt32 index) {
-    //FONT_GUARD
+    FONT_FACE_GUARD(getInstanceMutex())
     LVFontGlyphCacheItem* item = _glyph_cache2.get(index);
     if (!item) {
         // glyph not found in cache, rendering...
@@ -2403,6 +2406,7 @@ LVFontGlyphCacheItem* LVFreeTypeFace::getGlyphByIndex(lUInt32 index) {
 #endif // USE_HARFBUZZ==1
 
 int LVFreeTypeFace::getCharWidth(lChar32 ch, lChar32 def_char) {
+    FONT_FACE_GUARD(getInstanceMutex())
     lUInt16 w = _wcache.get(ch);
     if (w == CACHED_UNSIGNED_METRIC_NOT_SET) {
         glyph_info_t glyph;
@@ -2417,6 +2421,7 @@ int LVFreeTypeFace::getCharWidth(lChar32 ch, lChar32 def_char) {
 }
 
 int LVFreeTypeFace::getLeftSideBearing(lChar32 ch, bool negative_only, bool italic_only) {
+    FONT_FACE_GUARD(getInstanceMutex())
     if (italic_only && !getItalic())
         return 0;
     lInt16 b = _lsbcache.get(ch);
@@ -2435,6 +2440,7 @@ int LVFreeTypeFace::getLeftSideBearing(lChar32 ch, bool negative_only, bool ital
 }
 
 int LVFreeTypeFace::getRightSideBearing(lChar32 ch, bool negative_only, bool italic_only) {
+    FONT_FACE_GUARD(getInstanceMutex())
     if (italic_only && !getItalic())
         return 0;
     lInt16 b = _rsbcache.get(ch);
@@ -2455,6 +2461,7 @@ int LVFreeTypeFace::getRightSideBearing(lChar32 ch, bool negative_only, bool ita
 int LVFreeTypeFace::getExtraMetric(font_extra_metric_t metric, bool scaled_to_px) {
     if (metric < 0 || metric >= FONT_METRIC_MAX)
         return 0;
+    FONT_FACE_GUARD(getInstanceMutex())
     if (_extra_metrics.empty())
         _extra_metrics = LVArray<int>((int)FONT_METRIC_MAX, CACHED_SIGNED_METRIC_NOT_SET);
     if (_extra_metrics[metric] == CACHED_SIGNED_METRIC_NOT_SET) {
@@ -2821,7 +2828,7 @@ int LVFreeTypeFace::DrawTextString(LVDrawBuf* buf, int x, int y, const lChar32*
                                    lChar32 def_char, lUInt32* palette, bool addHyphen, TextLangCfg* lang_cfg,
                                    lUInt32 flags, int letter_spacing, int width, int text_decoration_back_gap,
                                    int target_w, int target_h, lUInt32 fallbackPassMask) {
-    FONT_GUARD
+    FONT_FACE_GUARD(getInstanceMutex())
     if (len <= 0 || _face == NULL)
         return 0;
     LVFont* fallbackFont = getFallbackFont(fallbackPassMask);
@@ -2829,6 +2836,9 @@ int LVFreeTypeFace::DrawTextString(LVDrawBuf* buf, int x, int y, const lChar32*
     // delegate this function to next fallback font (if exist)
     if (fallbackFont != NULL && (fallbackPassMask & _fallback_mask))
         return fallbackFont->DrawTextString(buf, x, y, text, len, def_char, palette, addHyphen, lang_cfg, flags, letter_spacing, width, text_decoration_back_gap, fallbackPassMask);
+    // glyphs of fallback fonts are drawn from their caches
+    LVFontChainGuard fallbackGuard(fallbackFont, fallbackPassMask | _fallback_mask);
+    CR_UNUSED(fallbackGuard);
     if (letter_spacing < 0) {
         letter_spacing = 0;
     } else if (letter_spacing > MAX_LETTER_SPACING) {
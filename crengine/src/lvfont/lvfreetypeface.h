@@ -53,6 +53,7 @@
 #endif
 
 #define CACHED_UNSIGNED_METRIC_NOT_SET 0xFFFF
+// to be used under font instance mutex
 class LVFontGlyphUnsignedMetricCache
 {
 private:
@@ -60,7 +61,6 @@ private:
     lUInt16* ptrs[COUNT]; //support up to 0X2CFFF=360*512-1
 public:
     lUInt16 get(lChar32 ch) {
-        FONT_GLYPH_CACHE_GUARD
         int inx = (ch >> 9) & 0x1ff;
         if (inx >= COUNT)
             return CACHED_UNSIGNED_METRIC_NOT_SET;
@@ -70,7 +70,6 @@ public:
         return ptr[ch & 0x1FF];
     }
     void put(lChar32 ch, lUInt16 m) {
-        FONT_GLYPH_CACHE_GUARD
         int inx = (ch >> 9) & 0x1ff;
         if (inx >= COUNT)
             return;
@@ -83,7 +82,6 @@ public:
         ptr[ch & 0x1FF] = m;
     }
     void clear() {
-        FONT_GLYPH_CACHE_GUARD
         for (int i = 0; i < 360; i++) {
             if (ptrs[i])
                 delete[] ptrs[i];
@@ -1308,11 +1308,13 @@ bool LVFreeTypeFontManager::RegisterDocumentFont(int documentId, LVContainerRef
 }
 
 void LVFreeTypeFontManager::UnregisterDocumentFonts(int documentId) {
+    FONT_MAN_GUARD
     _cache.removeDocumentFonts(documentId);
 }
 
 bool LVFreeTypeFontManager::RegisterExternalFont(int documentId, lString32 name, lString8 family_name, bool bold,
                                                  bool italic) {
+    FONT_MAN_GUARD
     if (name.startsWithNoCase(lString32("res://")))
         name = name.substr(6);
     else if (name.startsWithNoCase(lString32("file://")))
@@ -139,6 +139,7 @@ bool LVBaseWin32Font::Create(int size, int weight, bool italic, css_font_family_
 
 /// returns char width
 int LVWin32DrawFont::getCharWidth(lChar32 ch, lChar32 def_char) {
+    FONT_FACE_GUARD(getInstanceMutex())
     if (_hfont == NULL)
         return 0;
     // measure character widths
@@ -168,9 +169,10 @@ int LVWin32DrawFont::getCharWidth(lChar32 ch, lChar32 def_char) {
 }
 
 lUInt32 LVWin32DrawFont::getTextWidth(const lChar32* text, int len, TextLangCfg* lang_cfg) {
-    //
-    static lUInt16 widths[MAX_LINE_CHARS + 1];
-    static lUInt8 flags[MAX_LINE_CHARS + 1];
+    FONT_FACE_GUARD(getInstanceMutex())
+    // buffers are shared by all fonts, font lock doesn't protect them
+    static thread_local lUInt16 widths[MAX_LINE_CHARS + 1];
+    static thread_local lUInt8 flags[MAX_LINE_CHARS + 1];
     if (len > MAX_LINE_CHARS)
         len = MAX_LINE_CHARS;
     if (len <= 0)
@@ -202,6 +204,7 @@ lUInt16 LVWin32DrawFont::measureText(
         bool allow_hyphenation,
         lUInt32 hints,
         lUInt32 fallbackPassMask) {
+    FONT_FACE_GUARD(getInstanceMutex())
     if (_hfont == NULL)
         return 0;
 
@@ -303,6 +306,7 @@ int LVWin32DrawFont::DrawTextString(LVDrawBuf* buf, int x, int y,
                                     int text_decoration_back_gap,
                                     int target_w, int target_h,
                                     lUInt32 fallbackPassMask) {
+    FONT_FACE_GUARD(getInstanceMutex())
     if (_hfont == NULL)
         return 0;
 
@@ -500,6 +504,7 @@ void LVWin32Font::setGammaIndex(int index) {
     \return true if glyh was found 
 */
 bool LVWin32Font::getGlyphInfo(lUInt32 code, glyph_info_t* glyph, lChar32 def_char, lUInt32 fallbackPassMask) {
+    FONT_FACE_GUARD(getInstanceMutex())
     if (_hfont == NULL)
         return false;
     glyph_t* p = GetGlyphRec(code);
@@ -510,9 +515,10 @@ bool LVWin32Font::getGlyphInfo(lUInt32 code, glyph_info_t* glyph, lChar32 def_ch
 }
 
 lUInt32 LVWin32Font::getTextWidth(const lChar32* text, int len, TextLangCfg* lang_cfg) {
-    //
-    static lUInt16 widths[MAX_LINE_CHARS + 1];
-    static lUInt8 flags[MAX_LINE_CHARS + 1];
+    FONT_FACE_GUARD(getInstanceMutex())
+    // buffers are shared by all fonts, font lock doesn't protect them
+    static thread_local lUInt16 widths[MAX_LINE_CHARS + 1];
+    static thread_local lUInt8 flags[MAX_LINE_CHARS + 1];
     if (len > MAX_LINE_CHARS)
         len = MAX_LINE_CHARS;
     if (len <= 0)
@@ -544,6 +550,7 @@ lUInt16 LVWin32Font::measureText(
         bool allow_hyphenation,
         lUInt32 hints,
         lUInt32 fallbackPassMask) {
+    FONT_FACE_GUARD(getInstanceMutex())
     if (_hfont == NULL)
         return 0;
 
@@ -604,7 +611,6 @@ lUInt16 LVWin32Font::measureText(
 }
 
 static LVFontGlyphCacheItem* newItem(LVFontLocalGlyphCache* local_cache, lChar32 ch, glyph_t* g, int gammaIndex) {
-    FONT_LOCAL_GLYPH_CACHE_GUARD
     unsigned int w = g->gi.blackBoxX;
     unsigned int h = g->gi.blackBoxY;
     unsigned int bmp_sz = g->row_size * g->gi.blackBoxY;
@@ -644,6 +650,7 @@ static LVFontGlyphCacheItem* newItem(LVFontLocalGlyphCache* local_cache, lChar32
 }
 
 LVFontGlyphCacheItem* LVWin32Font::getGlyph(lUInt32 ch, lChar32 def_char, lUInt32 fallbackPassMask) {
+    FONT_FACE_GUARD(getInstanceMutex())
     LVFontGlyphCacheItem* item = _glyph_cache.get(ch);
     if (!item) {
         if (_hfont != NULL) {
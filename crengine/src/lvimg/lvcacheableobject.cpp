@@ -20,7 +20,10 @@
 
 #include <lvcacheableobject.h>
 
-static lUInt32 NEXT_CACHEABLE_OBJECT_ID = 1;
+#include <atomic>
+
+// image sources may be created from several threads
+static std::atomic<lUInt32> NEXT_CACHEABLE_OBJECT_ID(1);
 
 CacheableObject::CacheableObject()
         : _callback(NULL)
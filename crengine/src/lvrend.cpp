@@ -9500,7 +9500,7 @@ void DrawDocument(LVDrawBuf& drawbuf, ldomNode* enode, int x0, int y0, int dx, i
                     int base_width = 0; // for padding_top in %
                     ldomNode* parent = enode->getParentNode();
                     if (parent && !(parent->isNull())) {
-                        RenderRectAccessor pfmt(parent);
+                        RenderRectReader pfmt(parent);
                         base_width = pfmt.getWidth();
                     }
                     int padding_top = lengthToPx(enode, style->padding[2], base_width) + measureBorder(enode, 0) + DEBUG_TREE_DRAW;
@@ -9517,7 +9517,7 @@ void DrawDocument(LVDrawBuf& drawbuf, ldomNode* enode, int x0, int y0, int dx, i
                         while (tmpnode && tmpnode->hasChildren()) {
                             tmpnode = tmpnode->getChildNode(0);
                             if (tmpnode && tmpnode->getRendMethod() == erm_final) {
-                                RenderRectAccessor tmpfmt(tmpnode);
+                                RenderRectReader tmpfmt(tmpnode);
                                 if (RENDER_RECT_HAS_FLAG(tmpfmt, INNER_FIELDS_SET)) {
                                     int inner_width = tmpfmt.getInnerWidth();
                                     BlockFloatFootprint float_footprint;
@@ -9579,8 +9579,16 @@ void DrawDocument(LVDrawBuf& drawbuf, ldomNode* enode, int x0, int y0, int dx, i
 
                     // If not yet in 2-steps drawing, we need to check if we
                     // have to do that 2-steps drawing ourselves.
-                    RenderRectAccessor cfmt(child);
-                    if (cfmt.getBottomOverflow() == 0) {
+                    // (reader keeps its storage chunk pinned: it's released
+                    // before drawing recursively)
+                    int bottom_overflow;
+                    int overflow_y;
+                    {
+                        RenderRectReader cfmt(child);
+                        bottom_overflow = cfmt.getBottomOverflow();
+                        overflow_y = cfmt.getY() + cfmt.getHeight() + bottom_overflow;
+                    }
+                    if (bottom_overflow == 0) {
                         // No bottom overflow: just draw both content and background
                         DrawDocument(drawbuf, child, x0, y0, dx, dy, doc_x, doc_y, page_height, marks, bookmarks, true, true);
                         continue;
@@ -9588,9 +9596,8 @@ void DrawDocument(LVDrawBuf& drawbuf, ldomNode* enode, int x0, int y0, int dx, i
 
                     // This child has content that overflows: we need to 2-steps draw
                     // it and its siblings up until all overflow is passed.
-                    // printf("Starting 2-steps drawing at %d %s\n", cfmt.getY(),
+                    // printf("Starting 2-steps drawing at %d %s\n", overflow_y,
                     //      UnicodeToLocal(ldomXPointer(child, 0).toString()).c_str());
-                    int overflow_y = cfmt.getY() + cfmt.getHeight() + cfmt.getBottomOverflow();
                     int last_two_steps_drawn_node;
                     for (int j = i; j < cnt; j++) {
                         last_two_steps_drawn_node = j;
@@ -9601,9 +9608,9 @@ void DrawDocument(LVDrawBuf& drawbuf, ldomNode* enode, int x0, int y0, int dx, i
                         }
                         // Draw backgrounds (recusively)
                         DrawDocument(drawbuf, child, x0, y0, dx, dy, doc_x, doc_y, page_height, marks, bookmarks, false, true);
-                        cfmt = RenderRectAccessor(child);
-                        int current_y = cfmt.getY() + cfmt.getHeight();
-                        int this_overflow = cfmt.getBottomOverflow();
+                        RenderRectReader nfmt(child);
+                        int current_y = nfmt.getY() + nfmt.getHeight();
+                        int this_overflow = nfmt.getBottomOverflow();
                         if (current_y >= overflow_y && this_overflow == 0) {
                             // Overflow y passed by, and no more new overflow, we
                             // can switch back to 1-step drawing
@@ -9821,14 +9828,53 @@ inline void spreadParent(css_length_t& val, css_length_t& parent_val, bool unspe
         val = parent_val;
 }
 
+// Whether the style of this element may be shared with its siblings having the same
+// element name and attributes (see tinyNodeCollection::shareNodeStyle()): not if it
+// has its own style= or stylesheet, or if it is styled by setNodeStyle() below from
+// its siblings or children
+static bool isNodeStyleShareable(ldomNode* enode, lUInt16 nodeElementId) {
+    if (enode->isRoot())
+        return false; // no siblings
+    if (nodeElementId == el_DocFragment || nodeElementId == el_body)
+        return false; // may apply their own stylesheet
+    if (nodeElementId >= EL_BOXING_START && nodeElementId <= EL_BOXING_END)
+        return false; // styled from their child
+    if (nodeElementId == el_pseudoElem || nodeElementId == el_default || nodeElementId == el_annotation)
+        return false;
+#if MATHML_SUPPORT == 1
+    if (nodeElementId >= EL_MATHML_START && nodeElementId <= EL_MATHML_END)
+        return false;
+#endif
+    ldomDocument* doc = enode->getDocument();
+    if (doc->getDocFlag(DOC_FLAG_ENABLE_INTERNAL_STYLES) && enode->hasAttribute(LXML_NS_ANY, attr_style))
+        return false;
+    return true;
+}
+
 void setNodeStyle(ldomNode* enode, css_style_ref_t parent_style, LVFontRef parent_font) {
     CR_UNUSED(parent_font);
+    lUInt16 nodeElementId = enode->getNodeId();
+    ldomDocument* doc = enode->getDocument();
+
+    // When styling the whole tree, siblings like a thousand of <p class="x">
+    // can just reuse the style and font of the first one
+    bool shareable = doc->isStyleSharingActive() && isNodeStyleShareable(enode, nodeElementId);
+    if (shareable) {
+        bool pseudoBefore = false;
+        bool pseudoAfter = false;
+        if (doc->shareNodeStyle(enode, pseudoBefore, pseudoAfter)) {
+            if (pseudoBefore)
+                enode->ensurePseudoElement(true);
+            if (pseudoAfter)
+                enode->ensurePseudoElement(false);
+            return;
+        }
+    }
+
     //lvdomElementFormatRec * fmt = node->getRenderData();
     css_style_ref_t style(new css_style_rec_t);
     css_style_rec_t* pstyle = style.get();
 
-    lUInt16 nodeElementId = enode->getNodeId();
-    ldomDocument* doc = enode->getDocument();
     lUInt32 domVersionRequested = doc->getDOMVersionRequested();
 
     if (domVersionRequested < 20180524) {
@@ -10516,6 +10562,9 @@ void setNodeStyle(ldomNode* enode, css_style_ref_t parent_style, LVFontRef paren
     // set font
     enode->initNodeFont();
 
+    if (shareable)
+        doc->addSharedNodeStyle(enode, requires_pseudo_element_before, requires_pseudo_element_after);
+
     // Now that this node is fully styled, ensure these pseudo elements
     // are there as children, creating them if needed and possible
     if (requires_pseudo_element_before)
@@ -248,6 +248,7 @@ lverror_t LVBlockWriteStream::Flush(bool sync, CRTimerUtil& timeout) {
         }
     }
     _firstBlock = NULL;
+    _count = 0;
     _baseStream->Flush(sync);
     return res;
 }
@@ -301,8 +302,11 @@ lvpos_t LVBlockWriteStream::SetPos(lvpos_t p) {
 }
 
 lverror_t LVBlockWriteStream::SetSize(lvsize_t size) {
-    // TODO:
-    lverror_t res = _baseStream->SetSize(size);
+    // cached blocks may be beyond new end of file
+    lverror_t res = Flush(true);
+    if (res != LVERR_OK)
+        return res;
+    res = _baseStream->SetSize(size);
     if (res == LVERR_OK)
         _size = size;
     clearCachedHash();
@@ -268,14 +268,13 @@ lverror_t LVFileStream::SetSize(lvsize_t size) {
     clearCachedHash();
     return LVERR_OK;
 #else
-    if (m_fd == -1)
-        return LVERR_FAIL;
-    lvpos_t oldpos = 0;
-    if (!Tell(&oldpos))
+    if (m_fd == -1 || m_mode == LVOM_READ)
         return LVERR_FAIL;
-    if (!Seek(size, LVSEEK_SET, NULL))
+    if (ftruncate(m_fd, (off_t)size) != 0)
         return LVERR_FAIL;
-    Seek(oldpos, LVSEEK_SET, NULL);
+    m_size = size;
+    if (m_pos > size)
+        Seek(size, LVSEEK_SET, NULL);
     clearCachedHash();
     return LVERR_OK;
 #endif
@@ -3605,6 +3605,16 @@ lString32 Utf8ToUnicode(const char* s, int sz) {
     return dst;
 }
 
+void Utf8ToUnicode(const char* s, int sz, lString32& dst) {
+    int len = (!s || !s[0] || sz <= 0) ? 0 : Utf8CharCount(s, sz);
+    dst.reset(len);
+    if (!len)
+        return;
+    dst.append(len, 0);
+    lChar32* p = dst.modify();
+    DecodeUtf8(s, p, len);
+}
+
 lString32 Utf16ToUnicode(const lChar16* s) {
     if (!s || !s[0])
         return lString32::empty_str;
@@ -44,7 +44,8 @@ bool lString32HashedCollection::deserialize(SerialBuf& buf) {
         return false;
     clear();
     int start = buf.pos();
-    buf.putMagic(str_hash_magic);
+    if (!buf.checkMagic(str_hash_magic))
+        return false;
     lInt32 count = 0;
     buf >> count;
     for (int i = 0; i < count; i++) {
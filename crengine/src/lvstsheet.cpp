@@ -44,6 +44,7 @@
 
 #include "lvxml/lvxmlutils.h"
 #include "lvtinydom/renderrectaccessor.h"
+#include "lvtinydom/lxmlattribute.h"
 #include "textlang.h"
 #include "lvrend.h" // for getGenericFontFamilyFace()
 
@@ -4007,6 +4008,144 @@ bool LVCssSelector::check(const ldomNode* node) const {
     return true;
 }
 
+LVCssSelectorRule* LVCssSelector::getKeyRule() const {
+    // ::before/::after selectors are checked against pseudoElem nodes too,
+    // which have no attributes of their own: keep them out of buckets
+    if (_pseudo_elem)
+        return NULL;
+    // rules of rightmost compound selector are first in chain, up to first combinator
+    LVCssSelectorRule* key = NULL;
+    for (LVCssSelectorRule* rule = _rules; rule && !rule->isCombinator(); rule = rule->getNext()) {
+        LVCssSelectorRuleType type = rule->getType();
+        if (type == cssrt_id)
+            return rule; // most selective
+        if (type == cssrt_class) {
+            if (!key || key->getType() != cssrt_class)
+                key = rule;
+        } else if (type >= cssrt_attrset && type <= cssrt_attrcontains_i) {
+            if (!key)
+                key = rule;
+        }
+    }
+    return key;
+}
+
+void LVCssSelector::initAncestorHashes() {
+    int count = 0;
+    // Compound selectors left of descendant or child combinators are about
+    // ancestors, ones left of sibling combinators are about siblings, but
+    // compounds further left of them are still about ancestors.
+    bool ancestor = false;
+    for (LVCssSelectorRule* rule = _rules; rule && count < CSS_SELECTOR_MAX_ANCESTOR_HASHES; rule = rule->getNext()) {
+        if (rule->isCombinator()) {
+            LVCssSelectorRuleType type = rule->getType();
+            ancestor = type == cssrt_parent || type == cssrt_ancessor;
+            if (ancestor && rule->getId())
+                _ancestorHashes[count++] = LVCssAncestorFilter::elementHash(rule->getId());
+        } else if (ancestor) {
+            if (rule->getType() == cssrt_id)
+                _ancestorHashes[count++] = LVCssAncestorFilter::idHash(rule->getValue());
+            else if (rule->getType() == cssrt_class)
+                _ancestorHashes[count++] = LVCssAncestorFilter::classHash(rule->getValue());
+        }
+    }
+    if (count < CSS_SELECTOR_MAX_ANCESTOR_HASHES)
+        _ancestorHashes[count] = 0;
+}
+
+bool LVCssSelector::isStructural() const {
+    for (LVCssSelectorRule* rule = _rules; rule; rule = rule->getNext()) {
+        LVCssSelectorRuleType type = rule->getType();
+        if (type == cssrt_predecessor || type == cssrt_predsibling || type == cssrt_pseudoclass)
+            return true;
+    }
+    return false;
+}
+
+LVCssAncestorFilter::LVCssAncestorFilter() {
+    memset(_counters, 0, sizeof(_counters));
+}
+
+static inline lUInt32 mixAncestorHash(lUInt32 h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U;
+    h ^= h >> 16;
+    return h ? h : 1; // 0 marks end of hashes of selector
+}
+
+lUInt32 LVCssAncestorFilter::elementHash(lUInt16 id) {
+    return mixAncestorHash((lUInt32)id * 4 + 1);
+}
+
+lUInt32 LVCssAncestorFilter::idHash(const lString32& id) {
+    return mixAncestorHash(id.getHash() * 4 + 2);
+}
+
+lUInt32 LVCssAncestorFilter::classHash(const lString32& className) {
+    return mixAncestorHash(className.getHash() * 4 + 3);
+}
+
+void LVCssAncestorFilter::add(lUInt32 hash) {
+    lUInt8& c1 = _counters[hash % CSS_ANCESTOR_FILTER_SIZE];
+    if (c1 < 0xFF)
+        c1++;
+    lUInt8& c2 = _counters[(hash >> 16) % CSS_ANCESTOR_FILTER_SIZE];
+    if (c2 < 0xFF)
+        c2++;
+    _hashes.add(hash);
+}
+
+void LVCssAncestorFilter::remove(lUInt32 hash) {
+    // saturated counters are never decremented
+    lUInt8& c1 = _counters[hash % CSS_ANCESTOR_FILTER_SIZE];
+    if (c1 < 0xFF)
+        c1--;
+    lUInt8& c2 = _counters[(hash >> 16) % CSS_ANCESTOR_FILTER_SIZE];
+    if (c2 < 0xFF)
+        c2--;
+}
+
+bool LVCssAncestorFilter::mayContain(lUInt32 hash) const {
+    return _counters[hash % CSS_ANCESTOR_FILTER_SIZE] && _counters[(hash >> 16) % CSS_ANCESTOR_FILTER_SIZE];
+}
+
+void LVCssAncestorFilter::push(const ldomNode* node) {
+    _nodes.add(node->getDataIndex());
+    _nodeHashesStart.add(_hashes.length());
+    add(elementHash(node->getNodeId()));
+    if (!node->hasAttributes())
+        return;
+    // same values as checked by cssrt_id and cssrt_class rules
+    lString32 id = node->getAttributeValue(attr_id);
+    if (!id.empty()) {
+        int pos = id.pos(" ");
+        if (pos != -1)
+            id = id.substr(pos + 1, id.length() - pos - 1);
+        add(idHash(id));
+    }
+    lString32 classes = node->getAttributeValue(attr_class);
+    int start = 0;
+    for (int i = 0; i <= classes.length(); i++) {
+        if (i == classes.length() || classes[i] == ' ') {
+            if (i > start)
+                add(classHash(classes.substr(start, i - start)));
+            start = i + 1;
+        }
+    }
+}
+
+void LVCssAncestorFilter::pop() {
+    if (_nodes.empty())
+        return;
+    int start = _nodeHashesStart.remove(_nodeHashesStart.length() - 1);
+    for (int i = start; i < _hashes.length(); i++)
+        remove(_hashes[i]);
+    _hashes.erase(start, _hashes.length() - start);
+    _nodes.remove(_nodes.length() - 1);
+}
+
 bool parse_attr_value(const char*& str, char* buf, bool& parse_trailing_i, char stop_char = ']') {
     int pos = 0;
     skip_spaces(str);
@@ -4464,33 +4603,133 @@ LVCssSelector::LVCssSelector(LVCssSelector& v)
         _rules = new LVCssSelectorRule(*v._rules);
 }
 
-void LVStyleSheet::set(LVPtrVector<LVCssSelector>& v) {
-    _selectors.clear();
-    if (!v.size())
-        return;
-    _selectors.reserve(v.size());
-    for (int i = 0; i < v.size(); i++) {
-        LVCssSelector* selector = v[i];
-        if (selector)
-            _selectors.add(new LVCssSelector(*selector));
-        else
-            _selectors.add(NULL);
+LVStyleSheet::LVStyleSheet(LVStyleSheet& sheet)
+        : _doc(sheet._doc)
+        , _charset(sheet._charset)
+        , _sets(sheet._sets)
+        , _index(sheet._index)
+        , _parsedTextSize(0)
+        , _parsedHits(0)
+        , _ancestorFilter(NULL) {
+}
+
+struct LVCssSelectorOrder
+{
+    LVCssSelector* selector;
+    int specificity;
+    int set;
+    int chain;
+    int pos;
+};
+
+// Lower bits of specificity keep order of selector in its set, see LVStyleSheet::parseSet()
+#define SELECTOR_ORDER_MASK ((WEIGHT_SPECIFICITY_ELEMENT)-1)
+
+static int compareSelectorOrder(const void* a, const void* b) {
+    const LVCssSelectorOrder* o1 = (const LVCssSelectorOrder*)a;
+    const LVCssSelectorOrder* o2 = (const LVCssSelectorOrder*)b;
+    // with equal CSS specificity, selectors of sets parsed later go after ones
+    // of sets parsed before, and by parse order in the same set
+    int weight1 = o1->specificity & ~SELECTOR_ORDER_MASK;
+    int weight2 = o2->specificity & ~SELECTOR_ORDER_MASK;
+    if (weight1 != weight2)
+        return weight1 < weight2 ? -1 : 1;
+    if (o1->set != o2->set)
+        return o1->set < o2->set ? -1 : 1;
+    if (o1->specificity != o2->specificity)
+        return o1->specificity < o2->specificity ? -1 : 1;
+    // with equal specificity, selectors with element name go before ones
+    // without it, as when _selectors[id] and _selectors[0] were merged
+    if ((o1->chain == 0) != (o2->chain == 0))
+        return o1->chain == 0 ? 1 : -1;
+    if (o1->chain != o2->chain)
+        return o1->chain < o2->chain ? -1 : 1;
+    return o1->pos - o2->pos;
+}
+
+static int getIndexBucket(LVCssSelectorIndex* index, int bucket) {
+    if (bucket < 0) {
+        bucket = index->buckets.length();
+        index->buckets.add(new LVArray<int>());
     }
+    return bucket;
 }
 
-LVStyleSheet::LVStyleSheet(LVStyleSheet& sheet)
-        : _doc(sheet._doc) {
-    set(sheet._selectors);
-    _selector_count = sheet._selector_count;
-    _charset = sheet._charset;
+void LVStyleSheet::buildIndex() {
+    LVCssSelectorIndex* index = new LVCssSelectorIndex();
+    _index = index;
+    LVArray<LVCssSelectorOrder> order;
+    for (int s = 0; s < _sets.length(); s++) {
+        LVPtrVector<LVCssSelector>& selectors = _sets[s]->selectors;
+        for (int i = 0; i < selectors.length(); i++) {
+            int pos = 0;
+            for (LVCssSelector* p = selectors[i]; p; p = p->getNext()) {
+                LVCssSelectorOrder item;
+                item.selector = p;
+                item.specificity = p->getSpecificity();
+                item.set = s;
+                item.chain = i;
+                item.pos = pos++;
+                order.add(item);
+            }
+        }
+    }
+    if (order.length() > 1)
+        qsort(order.get(), order.length(), sizeof(LVCssSelectorOrder), compareSelectorOrder);
+    for (int i = 0; i < order.length(); i++) {
+        LVCssSelector* selector = order[i].selector;
+        selector->initAncestorHashes();
+        index->ordered.add(selector);
+        index->orderedStructural.add(selector->isStructural());
+        int bucket = -1;
+        LVCssSelectorRule* key = selector->getKeyRule();
+        if (!key) {
+            int id = selector->getElementNameId();
+            while (index->elementBuckets.length() <= id)
+                index->elementBuckets.add(-1);
+            bucket = getIndexBucket(index, index->elementBuckets[id]);
+            index->elementBuckets[id] = bucket;
+        } else if (key->getType() == cssrt_id) {
+            index->idBuckets.get(key->getValue(), bucket);
+            bucket = getIndexBucket(index, bucket);
+            index->idBuckets.set(key->getValue(), bucket);
+        } else if (key->getType() == cssrt_class) {
+            index->classBuckets.get(key->getValue(), bucket);
+            bucket = getIndexBucket(index, bucket);
+            index->classBuckets.set(key->getValue(), bucket);
+        } else {
+            int attrId = key->getAttrId();
+            while (index->attrBuckets.length() <= attrId)
+                index->attrBuckets.add(-1);
+            bucket = getIndexBucket(index, index->attrBuckets[attrId]);
+            index->attrBuckets[attrId] = bucket;
+        }
+        index->buckets[bucket]->add(i);
+    }
+}
+
+void LVStyleSheet::addApplyBucket(int bucket) {
+    if (bucket < 0)
+        return;
+    for (int i = 0; i < _applyBuckets.length(); i++) {
+        if (_applyBuckets[i] == bucket)
+            return; // same class twice
+    }
+    _applyBuckets.add(bucket);
+    _applyPos.add(0);
 }
 
 void LVStyleSheet::apply(const ldomNode* node, css_style_rec_t* style) {
-    if (!_selectors.length())
+    _lastApplyChecks.reset();
+    if (!_sets.length())
         return; // no rules!
+    if (_index.isNull())
+        buildIndex();
+    LVCssSelectorIndex* index = _index.get();
 
     lUInt16 id = node->getNodeId();
-    if (id == el_pseudoElem) { // get the id chain from the parent element
+    bool pseudoElem = id == el_pseudoElem;
+    if (pseudoElem) { // get the id chain from the parent element
         // Note that a "div:before {float:left}" will result in: <div><floatBox><pseudoElem>
         // There is just one kind of boxing element that is explicitely
         // added when parsing MathML (and can't be implicitely added) that
@@ -4498,39 +4737,101 @@ void LVStyleSheet::apply(const ldomNode* node, css_style_rec_t* style) {
         id = node->getUnboxedParent(el_mathBox)->getNodeId();
     }
 
-    // _selectors[0] holds the ordered chain of selectors starting (from
-    // the right of the selector) with a rule with no element name attached
-    // (eg. "div p .quote1", class name .quote1 should be checked against
-    // all elements' classnames before continuing checking for ancestors).
-    // _selectors[element_name_id] holds the ordered chain of selector starting
-    // with that element name (eg. ".body div.chapter > p" should be
-    // first checked agains all <p>).
-    // To see which selectors apply to a <p>, we must iterate thru both chains,
+    // Selectors are bucketed by the rightmost #id, .class or [attr] of their
+    // rightmost compound selector (eg. "div p .quote1" by .quote1), or by their
+    // rightmost element name if they have none of them ("div.chapter > p" by <p>,
+    // bucket of element name 0 holds selectors like "*" or ":first-child").
+    // To see which selectors apply to a <p class="a b">, we iterate thru buckets
+    // of element name 0, <p>, .a and .b and buckets of its #id and attributes,
     // checking and applying them in the order of specificity/parsed position.
-    LVCssSelector* selector_0 = _selectors[0];
-    LVCssSelector* selector_id = id > 0 && id < _selectors.length() ? _selectors[id] : NULL;
+    _applyBuckets.reset();
+    _applyPos.reset();
+    if (index->elementBuckets.length() > 0)
+        addApplyBucket(index->elementBuckets[0]);
+    if (id > 0 && id < index->elementBuckets.length())
+        addApplyBucket(index->elementBuckets[id]);
+    if (!pseudoElem && node->hasAttributes()) {
+        if (index->idBuckets.length() > 0) {
+            lString32 val = node->getAttributeValue(attr_id);
+            if (!val.empty()) {
+                // same as in cssrt_id rule check
+                int pos = val.pos(" ");
+                if (pos != -1)
+                    val = val.substr(pos + 1, val.length() - pos - 1);
+                int bucket = -1;
+                if (index->idBuckets.get(val, bucket))
+                    addApplyBucket(bucket);
+            }
+        }
+        if (index->classBuckets.length() > 0) {
+            lString32 classes = node->getAttributeValue(attr_class);
+            int start = 0;
+            for (int i = 0; i <= classes.length(); i++) {
+                if (i == classes.length() || classes[i] == ' ') {
+                    int bucket = -1;
+                    if (i > start && index->classBuckets.get(classes.substr(start, i - start), bucket))
+                        addApplyBucket(bucket);
+                    start = i + 1;
+                }
+            }
+        }
+        if (index->attrBuckets.length() > 0) {
+            int count = node->getAttrCount();
+            for (int i = 0; i < count; i++) {
+                lUInt16 attrId = node->getAttribute(i)->id;
+                if (attrId < index->attrBuckets.length())
+                    addApplyBucket(index->attrBuckets[attrId]);
+            }
+        }
+    }
 
+    // Ancestor filter can be used only if it's about ancestors of this node
+    const LVCssAncestorFilter* filter = NULL;
+    if (_ancestorFilter && !node->isRoot() && _ancestorFilter->top() == (lUInt32)node->getParentNode()->getDataIndex())
+        filter = _ancestorFilter;
+
+    int bucketCount = _applyBuckets.length();
     for (;;) {
-        if (selector_0 != NULL) {
-            if (selector_id == NULL || selector_0->getSpecificity() < selector_id->getSpecificity()) {
-                // step by sel_0
-                selector_0->apply(node, style);
-                selector_0 = selector_0->getNext();
-            } else {
-                // step by sel_id
-                selector_id->apply(node, style);
-                selector_id = selector_id->getNext();
+        // merge buckets by position in index->ordered
+        int best = -1;
+        int bestIndex = 0;
+        for (int i = 0; i < bucketCount; i++) {
+            LVArray<int>* bucket = index->buckets[_applyBuckets[i]];
+            int pos = _applyPos[i];
+            if (pos < bucket->length() && (best < 0 || (*bucket)[pos] < bestIndex)) {
+                best = i;
+                bestIndex = (*bucket)[pos];
             }
-        } else if (selector_id != NULL) {
-            // step by sel_id
-            selector_id->apply(node, style);
-            selector_id = selector_id->getNext();
-        } else {
-            break; // end of chains
         }
+        if (best < 0)
+            break; // end of buckets
+        _applyPos[best]++;
+        LVCssSelector* selector = index->ordered[bestIndex];
+        if (filter && !selector->mayMatch(filter))
+            continue;
+        if (index->orderedStructural[bestIndex]) {
+            // result may differ for siblings: remember it
+            bool matched = selector->check(node);
+            _lastApplyChecks.add(((lUInt32)bestIndex << 1) | (matched ? 1 : 0));
+            if (matched)
+                selector->applyChecked(node, style);
+            continue;
+        }
+        selector->apply(node, style);
     }
 }
 
+bool LVStyleSheet::checkSameResults(const ldomNode* node, const LVArray<lUInt32>& checks) {
+    if (_index.isNull())
+        return false; // index positions are no longer the same
+    for (int i = 0; i < checks.length(); i++) {
+        lUInt32 index = checks[i] >> 1;
+        if ((int)index >= _index->ordered.length() || _index->ordered[index]->check(node) != ((checks[i] & 1) != 0))
+            return false;
+    }
+    return true;
+}
+
 lUInt32 LVCssSelectorRule::getHash() {
     lUInt32 hash = 0;
     hash = ((((lUInt32)_type * 31 + (lUInt32)_id) * 31) + (lUInt32)_attrid * 31) + ::getHash(_value);
@@ -4556,22 +4857,77 @@ lUInt32 LVCssSelector::getHash() {
     return hash;
 }
 
+lUInt32 LVCssSelector::getOwnHash() {
+    lUInt32 hash = _id;
+    for (LVCssSelectorRule* p = _rules; p; p = p->getNext())
+        hash = hash * 31 + p->getHash();
+    hash = hash * 31 + (_specificity & ~SELECTOR_ORDER_MASK);
+    hash = hash * 31 + _pseudo_elem;
+    if (!_decl.isNull())
+        hash = hash * 31 + _decl->getHash();
+    return hash;
+}
+
+// Adds selectors of index not counted in otherCounts to changed, and hashes of
+// the other ones (as many as counted) to common, in order of application
+static void diffSelectors(LVCssSelectorIndex* index, LVHashTable<lUInt32, int>& otherCounts,
+                          LVArray<LVCssSelector*>& changed, LVArray<lUInt32>& common) {
+    for (int i = 0; i < index->ordered.length(); i++) {
+        lUInt32 hash = index->ordered[i]->getOwnHash();
+        int count = otherCounts.get(hash);
+        if (count > 0) {
+            otherCounts.set(hash, count - 1);
+            common.add(hash);
+        } else {
+            changed.add(index->ordered[i]);
+        }
+    }
+}
+
+static void countSelectors(LVCssSelectorIndex* index, LVHashTable<lUInt32, int>& counts) {
+    for (int i = 0; i < index->ordered.length(); i++) {
+        lUInt32 hash = index->ordered[i]->getOwnHash();
+        counts.set(hash, counts.get(hash) + 1);
+    }
+}
+
+bool LVStyleSheet::getChangedSelectors(LVStyleSheet& old, LVArray<LVCssSelector*>& changed) {
+    if (_index.isNull())
+        buildIndex();
+    if (old._index.isNull())
+        old.buildIndex();
+    if (_index.get() == old._index.get())
+        return true; // same sets
+    int size = _index->ordered.length() + old._index->ordered.length() + 16;
+    LVHashTable<lUInt32, int> counts(size);
+    LVHashTable<lUInt32, int> oldCounts(size);
+    countSelectors(_index.get(), counts);
+    countSelectors(old._index.get(), oldCounts);
+    // Selectors parsed again from changed text only differ by their parse order:
+    // the ones found in both stylesheets give the same styles if they are
+    // still applied in the same order
+    LVArray<lUInt32> common;
+    LVArray<lUInt32> oldCommon;
+    diffSelectors(_index.get(), oldCounts, changed, common);
+    diffSelectors(old._index.get(), counts, changed, oldCommon);
+    if (common.length() != oldCommon.length())
+        return false;
+    for (int i = 0; i < common.length(); i++) {
+        if (common[i] != oldCommon[i])
+            return false;
+    }
+    return true;
+}
+
 /// calculate hash
 lUInt32 LVStyleSheet::getHash() {
     lUInt32 hash = 0;
-    for (int i = 0; i < _selectors.length(); i++) {
-        if (_selectors[i])
-            hash = hash * 31 + _selectors[i]->getHash() + i * 15324;
-    }
-    //CRLog::trace("LVStyleSheet::getHash() selector count: %d  hash: %x", _selectors.length(), hash);
+    for (int i = 0; i < _sets.length(); i++)
+        hash = hash * 31 + _sets[i]->hash;
     return hash;
 }
 
-bool LVStyleSheet::parse(const char* str, bool higher_importance, lString32 codeBase) {
-    if (!_doc) {
-        // We can't parse anything if no _doc to get element name ids from
-        return false;
-    }
+void LVStyleSheet::parseSet(LVCssSelectorSet* set, const char* str, bool higher_importance, lString32 codeBase) {
     LVCssSelector* selector = NULL;
     LVCssSelector* prev_selector;
     int err_count = 0;
@@ -4589,8 +4945,8 @@ bool LVStyleSheet::parse(const char* str, bool higher_importance, lString32 code
             // Have selector count number make the initial value
             // of _specificity, so order of selectors is preserved
             // when applying selectors with the same CSS specificity.
-            selector = new LVCssSelector(_selector_count);
-            _selector_count += 1; // = +WEIGHT_SELECTOR_ORDER
+            selector = new LVCssSelector(set->selectorCount);
+            set->selectorCount += 1; // = +WEIGHT_SELECTOR_ORDER
             selector->setNext(prev_selector);
             if (!selector->parse(str, _doc)) {
                 err = true;
@@ -4625,20 +4981,21 @@ bool LVStyleSheet::parse(const char* str, bool higher_importance, lString32 code
         } else {
             // Ok:
             // place rules to sheet
+            LVPtrVector<LVCssSelector>& selectors = set->selectors;
             for (LVCssSelector* p = selector; p;) {
                 LVCssSelector* item = p;
                 p = p->getNext();
                 lUInt16 id = item->getElementNameId();
-                if (_selectors.length() <= id)
-                    _selectors.set(id, NULL);
+                if (selectors.length() <= id)
+                    selectors.set(id, NULL);
                 // insert with specificity sorting
-                if (_selectors[id] == NULL || _selectors[id]->getSpecificity() > item->getSpecificity()) {
+                if (selectors[id] == NULL || selectors[id]->getSpecificity() > item->getSpecificity()) {
                     // insert as first item
-                    item->setNext(_selectors[id]);
-                    _selectors[id] = item;
+                    item->setNext(selectors[id]);
+                    selectors[id] = item;
                 } else {
                     // insert as internal item
-                    for (LVCssSelector* p = _selectors[id]; p; p = p->getNext()) {
+                    for (LVCssSelector* p = selectors[id]; p; p = p->getNext()) {
                         if (p->getNext() == NULL || p->getNext()->getSpecificity() > item->getSpecificity()) {
                             item->setNext(p->getNext());
                             p->setNext(item);
@@ -4649,7 +5006,67 @@ bool LVStyleSheet::parse(const char* str, bool higher_importance, lString32 code
             }
         }
     }
-    return _selectors.length() > 0;
+    for (int i = 0; i < set->selectors.length(); i++) {
+        if (set->selectors[i])
+            set->hash = set->hash * 31 + set->selectors[i]->getHash() + i * 15324;
+    }
+}
+
+/// max number of recently parsed selector sets kept by stylesheet
+#define CSS_PARSED_SETS_MAX_COUNT 32
+/// max total size of texts of recently parsed selector sets kept by stylesheet
+#define CSS_PARSED_SETS_MAX_TEXT_SIZE 0x400000
+
+void LVStyleSheet::clearParsed() {
+    _parsed.clear();
+    _parsedTextSize = 0;
+}
+
+void LVStyleSheet::addSet(LVCssSelectorSetRef set) {
+    if (set->empty())
+        return;
+    _sets.add(set);
+    _index.Clear();
+}
+
+bool LVStyleSheet::parse(const char* str, bool higher_importance, lString32 codeBase) {
+    if (!_doc) {
+        // We can't parse anything if no _doc to get element name ids from
+        return false;
+    }
+    // Same text may be parsed many times, like a CSS file linked from each
+    // EPUB fragment: reuse set of selectors compiled before.
+    lString8 text(str);
+    lUInt32 hash = text.getHash();
+    lUInt32 domVersion = _doc->getDOMVersionRequested();
+    for (int i = _parsed.length() - 1; i >= 0; i--) {
+        ParsedItem* item = _parsed[i];
+        if (item->hash == hash && item->domVersion == domVersion && item->higherImportance == higher_importance &&
+            item->codeBase == codeBase && item->text == text) {
+            LVCssSelectorSetRef set = item->set;
+            _parsed.move(_parsed.length() - 1, i); // most recently used is last
+            _parsedHits++;
+            addSet(set);
+            return _sets.length() > 0;
+        }
+    }
+    LVCssSelectorSetRef set(new LVCssSelectorSet());
+    parseSet(set.get(), str, higher_importance, codeBase);
+    ParsedItem* item = new ParsedItem();
+    item->hash = hash;
+    item->text = text;
+    item->codeBase = codeBase;
+    item->higherImportance = higher_importance;
+    item->domVersion = domVersion;
+    item->set = set;
+    _parsed.add(item);
+    _parsedTextSize += text.length();
+    while (_parsed.length() > 1 && (_parsed.length() > CSS_PARSED_SETS_MAX_COUNT || _parsedTextSize > CSS_PARSED_SETS_MAX_TEXT_SIZE)) {
+        _parsedTextSize -= _parsed[0]->text.length();
+        _parsed.erase(0, 1);
+    }
+    addSet(set);
+    return _sets.length() > 0;
 }
 
 bool LVStyleSheet::parseCharsetRule(const char*& str) {
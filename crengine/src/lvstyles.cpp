@@ -29,6 +29,9 @@
 #include <lvstyles.h>
 #include <lvserialbuf.h>
 
+#define XXH_INLINE_ALL
+#include "xxhash.h"
+
 // #include <stdio.h>
 
 //DEFINE_NULL_REF( css_style_rec_t )
@@ -55,87 +58,113 @@ lUInt32 calcHash(font_ref_t& f) {
     return v;
 }
 
+// Fixed size properties of style record packed in bytes, to be hashed in one pass
+class StyleHashBuf
+{
+public:
+    enum
+    {
+        CAPACITY = 256
+    };
+private:
+    lUInt8 _data[CAPACITY];
+    int _pos;
+public:
+    StyleHashBuf()
+            : _pos(0) { }
+    void putByte(int v) {
+        _data[_pos++] = (lUInt8)v;
+    }
+    void put(lUInt32 v) {
+        _data[_pos++] = (lUInt8)v;
+        _data[_pos++] = (lUInt8)(v >> 8);
+        _data[_pos++] = (lUInt8)(v >> 16);
+        _data[_pos++] = (lUInt8)(v >> 24);
+    }
+    void put(const css_length_t& v) {
+        putByte(v.type);
+        put((lUInt32)v.value);
+    }
+    void put(const css_length_t* v, int count) {
+        for (int i = 0; i < count; i++)
+            put(v[i]);
+    }
+    lUInt32 getHash() {
+        return XXH32(_data, _pos, 0);
+    }
+};
+
 lUInt32 calcHash(css_style_rec_t& rec) {
-    if (!rec.hash)
-        rec.hash = (((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((
-         + (lUInt32)rec.important[0]) * 31
-         + (lUInt32)rec.important[1]) * 31
-         + (lUInt32)rec.important[2]) * 31
-         + (lUInt32)rec.importance[0]) * 31
-         + (lUInt32)rec.importance[1]) * 31
-         + (lUInt32)rec.importance[2]) * 31
-         + (lUInt32)rec.display) * 31
-         + (lUInt32)rec.white_space) * 31
-         + (lUInt32)rec.text_align) * 31
-         + (lUInt32)rec.text_align_last) * 31
-         + (lUInt32)rec.text_decoration) * 31
-         + (lUInt32)rec.text_transform) * 31
-         + (lUInt32)rec.hyphenate) * 31
-         + (lUInt32)rec.list_style_type) * 31
-         + (lUInt32)rec.letter_spacing.pack()) * 31
-         + (lUInt32)rec.list_style_position) * 31
-         + (lUInt32)(rec.page_break_before | (rec.page_break_after<<4) | (rec.page_break_inside<<8))) * 31
-         + (lUInt32)rec.vertical_align.pack()) * 31
-         + (lUInt32)rec.font_size.type) * 31
-         + (lUInt32)rec.font_size.value) * 31
-         + (lUInt32)rec.font_style) * 31
-         + (lUInt32)rec.font_weight) * 31
-         + (lUInt32)rec.font_features.pack()) * 31
-         + (lUInt32)rec.line_height.pack()) * 31
-         + (lUInt32)rec.color.pack()) * 31
-         + (lUInt32)rec.background_color.pack()) * 31
-         + (lUInt32)rec.width.pack()) * 31
-         + (lUInt32)rec.height.pack()) * 31
-         + (lUInt32)rec.min_width.pack()) * 31
-         + (lUInt32)rec.min_height.pack()) * 31
-         + (lUInt32)rec.max_width.pack()) * 31
-         + (lUInt32)rec.max_height.pack()) * 31
-         + (lUInt32)rec.text_indent.pack()) * 31
-         + (lUInt32)rec.margin[0].pack()) * 31
-         + (lUInt32)rec.margin[1].pack()) * 31
-         + (lUInt32)rec.margin[2].pack()) * 31
-         + (lUInt32)rec.margin[3].pack()) * 31
-         + (lUInt32)rec.padding[0].pack()) * 31
-         + (lUInt32)rec.padding[1].pack()) * 31
-         + (lUInt32)rec.padding[2].pack()) * 31
-         + (lUInt32)rec.padding[3].pack()) * 31
-         + (lUInt32)rec.border_style_top) * 31
-         + (lUInt32)rec.border_style_right) * 31
-         + (lUInt32)rec.border_style_bottom) * 31
-         + (lUInt32)rec.border_style_left) * 31
-         + (lUInt32)rec.border_width[0].pack()) * 31
-         + (lUInt32)rec.border_width[1].pack()) * 31
-         + (lUInt32)rec.border_width[2].pack()) * 31
-         + (lUInt32)rec.border_width[3].pack()) * 31
-         + (lUInt32)rec.border_color[0].pack()) * 31
-         + (lUInt32)rec.border_color[1].pack()) * 31
-         + (lUInt32)rec.border_color[2].pack()) * 31
-         + (lUInt32)rec.border_color[3].pack()) * 31
-         + (lUInt32)rec.background_repeat)*31
-         + (lUInt32)rec.background_position)*31
-         + (lUInt32)rec.background_size[0].pack())*31
-         + (lUInt32)rec.background_size[1].pack())*31
-         + (lUInt32)rec.font_family) * 31
-         + (lUInt32)rec.border_collapse)*31
-         + (lUInt32)rec.border_spacing[0].pack())*31
-         + (lUInt32)rec.border_spacing[1].pack())*31
-         + (lUInt32)rec.orphans) * 31
-         + (lUInt32)rec.widows) * 31
-         + (lUInt32)rec.float_) * 31
-         + (lUInt32)rec.clear) * 31
-         + (lUInt32)rec.direction) * 31
-         + (lUInt32)rec.visibility) * 31
-         + (lUInt32)rec.line_break) * 31
-         + (lUInt32)rec.word_break) * 31
-         + (lUInt32)rec.cr_hint.pack()) * 31
-         + (lUInt32)rec.font_name.getHash()
-         + (lUInt32)rec.background_image.getHash()
-         + (lUInt32)rec.content.getHash()
-         + (lUInt32)rec.cr_footnote_before.getHash()
-         + (lUInt32)rec.cr_footnote_after.getHash()
-         + (lUInt32)rec.cr_footnote_marker_before.getHash()
-         + (lUInt32)rec.cr_footnote_marker_after.getHash());
-    return rec.hash;
+    if (rec.hash)
+        return rec.hash;
+    // 6 bitmaps, 30 enums, 35 lengths (1 + 4 bytes): keep it updated with fields put below
+    static_assert(2 * NB_IMP_SLOTS * 4 + 30 + 35 * 5 <= StyleHashBuf::CAPACITY, "style hash buffer is too small");
+    StyleHashBuf buf;
+    for (int i = 0; i < NB_IMP_SLOTS; i++) {
+        buf.put(rec.important[i]);
+        buf.put(rec.importance[i]);
+    }
+    buf.putByte(rec.display);
+    buf.putByte(rec.white_space);
+    buf.putByte(rec.text_align);
+    buf.putByte(rec.text_align_last);
+    buf.putByte(rec.font_family);
+    buf.putByte(rec.font_style);
+    buf.putByte(rec.font_weight);
+    buf.putByte(rec.float_);
+    buf.putByte(rec.clear);
+    buf.putByte(rec.direction);
+    buf.putByte(rec.visibility);
+    buf.putByte(rec.text_decoration);
+    buf.putByte(rec.text_transform);
+    buf.putByte(rec.hyphenate);
+    buf.putByte(rec.line_break);
+    buf.putByte(rec.word_break);
+    buf.putByte(rec.list_style_type);
+    buf.putByte(rec.list_style_position);
+    buf.putByte(rec.page_break_before);
+    buf.putByte(rec.page_break_after);
+    buf.putByte(rec.page_break_inside);
+    buf.putByte(rec.orphans);
+    buf.putByte(rec.widows);
+    buf.putByte(rec.border_style_top);
+    buf.putByte(rec.border_style_bottom);
+    buf.putByte(rec.border_style_right);
+    buf.putByte(rec.border_style_left);
+    buf.putByte(rec.border_collapse);
+    buf.putByte(rec.background_repeat);
+    buf.putByte(rec.background_position);
+    buf.put(rec.font_size);
+    buf.put(rec.line_height);
+    buf.put(rec.text_indent);
+    buf.put(rec.vertical_align);
+    buf.put(rec.letter_spacing);
+    buf.put(rec.margin, 4);
+    buf.put(rec.padding, 4);
+    buf.put(rec.color);
+    buf.put(rec.background_color);
+    buf.put(rec.width);
+    buf.put(rec.height);
+    buf.put(rec.min_width);
+    buf.put(rec.min_height);
+    buf.put(rec.max_width);
+    buf.put(rec.max_height);
+    buf.put(rec.border_width, 4);
+    buf.put(rec.border_color, 4);
+    buf.put(rec.background_size, 2);
+    buf.put(rec.border_spacing, 2);
+    buf.put(rec.font_features);
+    buf.put(rec.cr_hint);
+    lUInt32 hash = buf.getHash();
+    hash = hash * 31 + rec.font_name.getHash();
+    hash = hash * 31 + rec.background_image.getHash();
+    hash = hash * 31 + rec.content.getHash();
+    hash = hash * 31 + rec.cr_footnote_before.getHash();
+    hash = hash * 31 + rec.cr_footnote_after.getHash();
+    hash = hash * 31 + rec.cr_footnote_marker_before.getHash();
+    hash = hash * 31 + rec.cr_footnote_marker_after.getHash();
+    rec.hash = hash;
+    return hash;
 }
 
 bool operator==(const css_style_rec_t& r1, const css_style_rec_t& r2) {
@@ -430,7 +459,8 @@ bool css_style_rec_t::serialize(SerialBuf& buf) {
 bool css_style_rec_t::deserialize(SerialBuf& buf) {
     if (buf.error())
         return false;
-    buf.putMagic(style_magic);
+    if (!buf.checkMagic(style_magic))
+        return false;
     buf >> important[0];                                         //    lUInt32              important[0];
     buf >> important[1];                                         //    lUInt32              important[1];
     buf >> important[2];                                         //    lUInt32              important[2];
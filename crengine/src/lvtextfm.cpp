@@ -369,6 +369,44 @@ void LFormattedText::AddSourceObject(
     //   width) and can better apply values in %
 }
 
+#define STATIC_BUFS_SIZE 8192
+#define MAX_LINE_SIZE    4096
+
+// Buffers reused by all LVFormatter instances of a thread, to avoid
+// allocations for each paragraph. They are per thread (paragraphs may
+// be formatted by pool workers, see ldomDocument::setParallelFormatting())
+// and allocated on first use.
+struct LVFormatterBuffers
+{
+    bool inUse;
+    lChar32 text[STATIC_BUFS_SIZE];
+    lUInt16 flags[STATIC_BUFS_SIZE];
+    src_text_fragment_t* srcs[STATIC_BUFS_SIZE];
+    lUInt16 charindex[STATIC_BUFS_SIZE];
+    int widths[STATIC_BUFS_SIZE];
+#if (USE_FRIBIDI == 1)
+    FriBidiCharType bidi_ctypes[STATIC_BUFS_SIZE];
+    FriBidiBracketType bidi_btypes[STATIC_BUFS_SIZE];
+    FriBidiLevel bidi_levels[STATIC_BUFS_SIZE];
+    // temporary buffers for line reordering, see LVFormatter::addLine()
+    lChar32 bidi_tmp_text[MAX_LINE_SIZE];
+    lUInt16 bidi_tmp_flags[MAX_LINE_SIZE];
+    src_text_fragment_t* bidi_tmp_srcs[MAX_LINE_SIZE];
+    lUInt16 bidi_tmp_charindex[MAX_LINE_SIZE];
+    int bidi_tmp_widths[MAX_LINE_SIZE];
+    FriBidiStrIndex bidi_indices_map[MAX_LINE_SIZE];
+#endif
+    LVFormatterBuffers()
+            : inUse(false) { }
+};
+
+static LVFormatterBuffers* getFormatterBuffers() {
+    static thread_local LVAutoPtr<LVFormatterBuffers> buffers;
+    if (buffers.isNull())
+        buffers = new LVFormatterBuffers();
+    return buffers.get();
+}
+
 class LVFormatter
 {
 public:
@@ -378,10 +416,7 @@ public:
     int m_length;
     int m_size;
     bool m_staticBufs;
-    static bool m_staticBufs_inUse;
-#if (USE_LIBUNIBREAK == 1)
-    static bool m_libunibreak_init_done;
-#endif
+    LVFormatterBuffers* m_buffers;
     lChar32* m_text;
     lUInt16* m_flags;
     src_text_fragment_t** m_srcs;
@@ -428,15 +463,15 @@ public:
             , m_length(0)
             , m_size(0)
             , m_staticBufs(true)
+            , m_buffers(getFormatterBuffers())
             , m_y(0) {
 #if (USE_LIBUNIBREAK == 1)
-        if (!m_libunibreak_init_done) {
-            m_libunibreak_init_done = true;
-            // Have libunibreak build up a few lookup tables for quicker computation
-            init_linebreak();
-        }
+        // Have libunibreak build up a few lookup tables for quicker computation
+        // (done once, thread-safe static initialization)
+        static bool libunibreak_init_done = (init_linebreak(), true);
+        CR_UNUSED(libunibreak_init_done);
 #endif
-        if (m_staticBufs_inUse)
+        if (m_buffers->inUse)
             m_staticBufs = false;
         m_text = NULL;
         m_flags = NULL;
@@ -933,8 +968,7 @@ public:
         // to zero the additional slot seems enough, as all previous slots seems
         // to be correctly filled.)
 
-#define STATIC_BUFS_SIZE 8192
-#define ITEMS_RESERVED   16
+#define ITEMS_RESERVED 16
 
         // "m_length+1" to keep room for the additional slot to be zero'ed
         if (!m_staticBufs || m_length + 1 > STATIC_BUFS_SIZE) {
@@ -958,29 +992,19 @@ public:
             }
             m_staticBufs = false;
         } else {
-            // static buffer space
-            static lChar32 m_static_text[STATIC_BUFS_SIZE];
-            static lUInt16 m_static_flags[STATIC_BUFS_SIZE];
-            static src_text_fragment_t* m_static_srcs[STATIC_BUFS_SIZE];
-            static lUInt16 m_static_charindex[STATIC_BUFS_SIZE];
-            static int m_static_widths[STATIC_BUFS_SIZE];
-#if (USE_FRIBIDI == 1)
-            static FriBidiCharType m_static_bidi_ctypes[STATIC_BUFS_SIZE];
-            static FriBidiBracketType m_static_bidi_btypes[STATIC_BUFS_SIZE];
-            static FriBidiLevel m_static_bidi_levels[STATIC_BUFS_SIZE];
-#endif
-            m_text = m_static_text;
-            m_flags = m_static_flags;
-            m_charindex = m_static_charindex;
-            m_srcs = m_static_srcs;
-            m_widths = m_static_widths;
+            // static (per thread) buffer space
+            m_text = m_buffers->text;
+            m_flags = m_buffers->flags;
+            m_charindex = m_buffers->charindex;
+            m_srcs = m_buffers->srcs;
+            m_widths = m_buffers->widths;
             m_staticBufs = true;
-            m_staticBufs_inUse = true;
+            m_buffers->inUse = true;
 // printf("using static buffers\n");
 #if (USE_FRIBIDI == 1)
-            m_bidi_ctypes = m_static_bidi_ctypes;
-            m_bidi_btypes = m_static_bidi_btypes;
-            m_bidi_levels = m_static_bidi_levels;
+            m_bidi_ctypes = m_buffers->bidi_ctypes;
+            m_bidi_btypes = m_buffers->bidi_btypes;
+            m_bidi_levels = m_buffers->bidi_levels;
 #endif
         }
         memset(m_flags, 0, sizeof(lUInt16) * m_length); // start with all flags set to zero
@@ -1671,10 +1695,10 @@ public:
         src_text_fragment_t* srcline = &m_pbuffer->srctext[word->src_text_index];
         LVFont* srcfont = (LVFont*)srcline->u.t.font;
         const lChar32* str = srcline->u.t.text + word->u.t.start;
-// Avoid malloc by using static buffers. Returns false if word too long.
+// Avoid malloc by using stack buffers. Returns false if word too long.
 #define MAX_MEASURED_WORD_SIZE 127
-        static lUInt16 widths[MAX_MEASURED_WORD_SIZE + 1];
-        static lUInt8 flags[MAX_MEASURED_WORD_SIZE + 1];
+        lUInt16 widths[MAX_MEASURED_WORD_SIZE + 1];
+        lUInt8 flags[MAX_MEASURED_WORD_SIZE + 1];
         if (word->u.t.len > MAX_MEASURED_WORD_SIZE)
             return false;
         lUInt32 hints = WORD_FLAGS_TO_FNT_FLAGS(word->flags);
@@ -1701,8 +1725,8 @@ public:
         int start = 0;
         int lastWidth = 0;
 #define MAX_TEXT_CHUNK_SIZE 4096
-        static lUInt16 widths[MAX_TEXT_CHUNK_SIZE + 1];
-        static lUInt8 flags[MAX_TEXT_CHUNK_SIZE + 1];
+        lUInt16 widths[MAX_TEXT_CHUNK_SIZE + 1];
+        lUInt8 flags[MAX_TEXT_CHUNK_SIZE + 1];
         int tabIndex = -1;
 #if (USE_FRIBIDI == 1)
         FriBidiLevel lastBidiLevel = 0;
@@ -2583,23 +2607,22 @@ public:
 //   reflect where each glyph ends up
 //
 // For re-ordering, we need some temporary buffers.
-// We use static buffers, and don't bother with dynamic buffers
+// We use static (per thread) buffers, and don't bother with dynamic buffers
 // in case we would overflow the static buffers.
-// (4096, if some glyphs spans 4 composing unicode codepoints, would
-// make 1000 glyphs, which with a small font of width 4px, would
+// (MAX_LINE_SIZE=4096, if some glyphs spans 4 composing unicode codepoints,
+// would make 1000 glyphs, which with a small font of width 4px, would
 // allow them to be displayed on a 4000px screen.
 // Increase that if not enough.)
-#define MAX_LINE_SIZE 4096
             if (end - start > MAX_LINE_SIZE) {
                 // Show a warning and truncate to avoid a segfault.
                 printf("CRE WARNING: bidi processing line overflow (%d > %d)\n", end - start, MAX_LINE_SIZE);
                 end = start + MAX_LINE_SIZE;
             }
-            static lChar32 bidi_tmp_text[MAX_LINE_SIZE];
-            static lUInt16 bidi_tmp_flags[MAX_LINE_SIZE];
-            static src_text_fragment_t* bidi_tmp_srcs[MAX_LINE_SIZE];
-            static lUInt16 bidi_tmp_charindex[MAX_LINE_SIZE];
-            static int bidi_tmp_widths[MAX_LINE_SIZE];
+            lChar32* bidi_tmp_text = m_buffers->bidi_tmp_text;
+            lUInt16* bidi_tmp_flags = m_buffers->bidi_tmp_flags;
+            src_text_fragment_t** bidi_tmp_srcs = m_buffers->bidi_tmp_srcs;
+            lUInt16* bidi_tmp_charindex = m_buffers->bidi_tmp_charindex;
+            int* bidi_tmp_widths = m_buffers->bidi_tmp_widths;
             // Map of string indices which is reordered to reflect where each
             // glyph ends up. Note that fribidi will access it starting
             // from 0 (and not from 'start'): this would need us to allocate
@@ -2609,7 +2632,7 @@ public:
             // if some other part than [start:end] would be accessed, but
             // we know fribid doesn't - by contract as it shouldn't reorder
             // any other part except between start:end).
-            static FriBidiStrIndex bidi_indices_map[MAX_LINE_SIZE];
+            FriBidiStrIndex* bidi_indices_map = m_buffers->bidi_indices_map;
             for (int i = start; i < end; i++) {
                 bidi_indices_map[i - start] = i;
             }
@@ -3556,7 +3579,6 @@ public:
                             word->width -= font->getHyphenWidth(); // TODO: strange fix - need some other solution
                         }
                         else if ( lastc=='.' || lastc==',' || lastc=='!' || lastc==':' || lastc==';' || lastc=='?') {
-                            FONT_GUARD
                             int w = font->getCharWidth(lastc);
                             TR_VA("floating: %c w=%d", lastc, w);
                             if (frmline->width + w + wAlign + x >= maxWidth)
@@ -3567,7 +3589,6 @@ public:
                                   lastc==0x300d || lastc==0x300f ||   // 」 』 ideographic right bracket
                                   lastc==0xff01 || lastc==0xff0c ||   // ！ ， fullwidth ! and ,
                                   lastc==0xff1a || lastc==0xff1b ) {  // ： ； fullwidth : and ;
-                            FONT_GUARD
                             int w = font->getCharWidth(lastc);
                             if (frmline->width + w + wAlign + x >= maxWidth)
                                 word->width -= w;
@@ -3586,7 +3607,6 @@ public:
                             // (Chinese) add spaces between words in last line or single line
                             // (so they get visually aligned on a grid with the char on the
                             // previous justified lines)
-                            FONT_GUARD
                             int properwordcount = maxWidth/font->getSize() - 2;
                             int extraSpace = maxWidth - properwordcount*font->getSize() - wAlign;
                             int exccess = (frmline->width + x + word->width + extraSpace) - maxWidth;
@@ -3623,7 +3643,6 @@ public:
                         if ( first && font->getSize()!=0 && (maxWidth/font->getSize()-2)!=0 ) {
                             // proportionally enlarge text-indent when visualAlignment or
                             // floating punctuation is enabled
-                            FONT_GUARD
                             int cnt = ((x-wAlign/2)%font->getSize()==0) ? (x-wAlign/2)/font->getSize() : 0;
                                 // ugly way to caculate text-indent value, I can not get text-indent from here
                             int p = cnt*(cnt+1)/2;
@@ -4198,8 +4217,8 @@ public:
                     // expects a lUInt8 array. We added flagSize=1|2 so it can set the correct
                     // flags on our upgraded (from lUInt8 to lUInt16) m_flags.
                     lUInt8* flags = (lUInt8*)(m_flags + wstart);
-                    // Fill static array with cumulative widths relative to word start
-                    static lUInt16 widths[MAX_WORD_SIZE];
+                    // Fill stack array with cumulative widths relative to word start
+                    lUInt16 widths[MAX_WORD_SIZE];
                     int wordStart_w = wstart > 0 ? m_widths[wstart - 1] : 0;
                     for (int i = 0; i < len; i++) {
                         widths[i] = m_widths[wstart + i] - wordStart_w;
@@ -4534,7 +4553,7 @@ public:
             m_staticBufs = true;
             // printf("freeing dynamic buffers\n");
         } else {
-            m_staticBufs_inUse = false;
+            m_buffers->inUse = false;
             // printf("releasing static buffers\n");
         }
     }
@@ -4550,11 +4569,6 @@ public:
     }
 };
 
-bool LVFormatter::m_staticBufs_inUse = false;
-#if (USE_LIBUNIBREAK == 1)
-bool LVFormatter::m_libunibreak_init_done = false;
-#endif
-
 static void freeFrmLines(formatted_text_fragment_t* m_pbuffer) {
     // clear existing formatted data, if any
     if (m_pbuffer->frmlines) {
@@ -25,13 +25,17 @@
 #include "cachefile.h"
 
 #include <lvstreamutils.h>
+#include <lvdocviewcallback.h>
+#include <crconcurrent.h>
 #include <crlog.h>
 
 #include "lvtinydom_private.h"
 #include "../lvstream/lvstreamfragment.h"
+#include "../lvstream/lvstreambuffer.h"
 
 #if (USE_ZSTD == 1)
 #include <zstd.h>
+#include <zdict.h>
 #endif
 #if (USE_ZLIB == 1)
 #include <zlib.h>
@@ -45,6 +49,18 @@
 #define UNPACK_BUF_SIZE 0x40000
 #endif
 
+#if (USE_ZSTD == 1)
+/// max size of trained compression dictionary
+#ifndef CACHE_FILE_DICT_SIZE
+#define CACHE_FILE_DICT_SIZE 0x8000
+#endif
+#endif
+
+/// max size of data snapshots queued for background writing
+#ifndef CACHE_FILE_ASYNC_MAX_PENDING_SIZE
+#define CACHE_FILE_ASYNC_MAX_PENDING_SIZE 0x2000000
+#endif
+
 /// set to 1 to enable crc check of all blocks of cache file on open
 #ifndef ENABLE_CACHE_FILE_CONTENTS_VALIDATION
 #define ENABLE_CACHE_FILE_CONTENTS_VALIDATION 1
@@ -73,6 +89,12 @@ struct zstd_decomp_res_t
     size_t buffOutSize;
     ZSTD_DCtx* dctx;
 };
+struct zstd_dict_t
+{
+    ZSTD_CDict* cdict;
+    ZSTD_DDict* ddict;
+    unsigned id;
+};
 #endif
 
 #if (USE_ZLIB == 1)
@@ -130,6 +152,300 @@ static lUInt32 calcHash(const lUInt8* s, int len) {
     if (!(x))      \
     crFatalError(1111, "assertion failed: " #x)
 
+/// Background writer of cache file blocks
+/**
+ * Snapshot of each block is compressed by thread pool worker,
+ * then I/O thread takes blocks in order of queuing, and writes them and index changes to file.
+ */
+class CacheFile::AsyncWriter: public CRRunnable
+{
+    struct Job
+    {
+        enum
+        {
+            WRITE,
+            FLUSH,
+            NOTIFY,
+            TRAIN
+        };
+        int kind;
+        lUInt16 type;
+        lUInt16 index;
+        lUInt8* buf; // data snapshot, replaced with packed data by compression task
+        size_t* sampleSizes; // sizes of dictionary samples in buf, for TRAIN
+        int sampleCount;
+        int size;
+        int srcSize;
+        lUInt32 hash;
+        lUInt32 uncompressedSize;
+        bool hashed;
+        bool deferred; // queued during dictionary training: packed by I/O thread after it
+        bool clearDirtyFlag;
+        LVDocViewCallback* callback;
+        CRTaskGroup* task;
+        explicit Job(int k)
+                : kind(k)
+                , type(0)
+                , index(0)
+                , buf(NULL)
+                , sampleSizes(NULL)
+                , sampleCount(0)
+                , size(0)
+                , srcSize(0)
+                , hash(0)
+                , uncompressedSize(0)
+                , hashed(false)
+                , deferred(false)
+                , clearDirtyFlag(false)
+                , callback(NULL)
+                , task(NULL) { }
+        ~Job() {
+            if (task) {
+                task->wait();
+                delete task;
+            }
+            if (buf)
+                free(buf);
+            if (sampleSizes)
+                free(sampleSizes);
+        }
+    };
+    CacheFile* _file;
+    CRThreadPool* _pool;
+    CRMonitorRef _monitor;
+    CRThreadRef _thread;
+    LVQueue<Job*> _queue;
+    int _pendingJobs;    // queued and being written
+    int _pendingSize;    // size of data snapshots of pending jobs
+    int _pendingNotifications; // queued NOTIFY jobs
+    int _discardedNotifications; // next NOTIFY jobs to drop
+    LVArray<AsyncNotification> _notifications; // reached NOTIFY jobs, delivered by owner thread
+    bool _stopped;       // no more jobs will be queued
+    std::atomic<bool> _failed;
+    std::atomic<bool> _training; // TRAIN job is queued and not done yet
+    CRMutexRef _compressorsMutex;
+    LVPtrVector<CacheFile> _compressors; // unopened cache files used for packing only, one per task at a time
+
+    CacheFile* takeCompressor() {
+        CRGuard guard(_compressorsMutex);
+        CR_UNUSED(guard);
+        if (_compressors.length() > 0)
+            return _compressors.remove(_compressors.length() - 1);
+        return new CacheFile(_file->_domVersion, _file->_compType);
+    }
+    void returnCompressor(CacheFile* compressor) {
+        CRGuard guard(_compressorsMutex);
+        CR_UNUSED(guard);
+        _compressors.add(compressor);
+    }
+    void queue(Job* job) {
+        CRGuard guard(_monitor);
+        CR_UNUSED(guard);
+        // limit memory used by snapshots
+        while (_pendingSize > CACHE_FILE_ASYNC_MAX_PENDING_SIZE && !_failed)
+            _monitor->wait();
+        _queue.pushBack(job);
+        _pendingJobs++;
+        _pendingSize += job->srcSize;
+        if (job->kind == Job::NOTIFY)
+            _pendingNotifications++;
+        _monitor->notifyAll();
+    }
+    void pack(Job* job) {
+        job->hash = calcHash(job->buf, job->size);
+        CacheFile* compressor = takeCompressor();
+        lUInt8* dstbuf = NULL;
+        lUInt32 dstsize = 0;
+        if (compressor->packBlock(job->type, job->buf, job->size, dstbuf, dstsize, _file)) {
+            free(job->buf);
+            job->buf = dstbuf;
+            job->size = dstsize;
+            job->uncompressedSize = job->srcSize;
+        }
+        returnCompressor(compressor);
+        job->hashed = true;
+    }
+    bool commit(Job* job) {
+        CRTimerUtil infinite;
+        switch (job->kind) {
+            case Job::WRITE:
+                // don't run other pool tasks in I/O thread
+                if (job->task)
+                    job->task->wait();
+                if (job->deferred)
+                    pack(job);
+                if (!job->hashed) {
+                    // not compressed, or compression task was dropped by stopped pool
+                    job->hash = calcHash(job->buf, job->size);
+                }
+                if (_file->isBlockUnchanged(job->type, job->index, job->srcSize, job->hash))
+                    return true;
+                if (!_file->writeBlock(job->type, job->index, job->buf, job->size, job->hash, job->uncompressedSize)) {
+                    CRLog::error("CacheFile: cannot write block %d:%d in background", job->type, job->index);
+                    return false;
+                }
+                return true;
+            case Job::FLUSH:
+                return _file->flushIndex(job->clearDirtyFlag, infinite);
+            case Job::NOTIFY:
+                // callback may be used only by thread it belongs to
+                return true;
+            case Job::TRAIN: {
+                // compression tasks of blocks queued before are done, ones queued after it are deferred
+#if (USE_ZSTD == 1)
+                // blocks are packed without dictionary if it cannot be trained
+                _file->zstdTrainDict(job->buf, job->sampleSizes, job->sampleCount);
+#endif
+                _training = false;
+                return true;
+            }
+        }
+        return true;
+    }
+public:
+    AsyncWriter(CacheFile* file, CRThreadPool* pool)
+            : _file(file)
+            , _pool(pool)
+            , _pendingJobs(0)
+            , _pendingSize(0)
+            , _pendingNotifications(0)
+            , _discardedNotifications(0)
+            , _stopped(false)
+            , _failed(false)
+            , _training(false) {
+        _monitor = concurrencyProvider->createMonitor();
+        _compressorsMutex = concurrencyProvider->createMutex();
+        _thread = concurrencyProvider->createThread(this);
+        _thread->start();
+    }
+    virtual ~AsyncWriter() {
+        finish();
+    }
+    bool write(lUInt16 type, lUInt16 index, const lUInt8* buf, int size, bool compress) {
+        if (_failed)
+            return false;
+        Job* job = new Job(Job::WRITE);
+        job->type = type;
+        job->index = index;
+        job->buf = (lUInt8*)malloc(size > 0 ? size : 1);
+        memcpy(job->buf, buf, size);
+        job->size = size;
+        job->srcSize = size;
+        if (compress) {
+            if (_training) {
+                // dictionary is not ready yet
+                job->deferred = true;
+            } else {
+                job->task = new CRTaskGroup(_pool);
+                job->task->runFunc([this, job]() {
+                    pack(job);
+                });
+            }
+        }
+        queue(job);
+        return true;
+    }
+    bool train(const lUInt8* samples, const size_t* sampleSizes, int sampleCount) {
+        if (_failed || sampleCount <= 0)
+            return false;
+        Job* job = new Job(Job::TRAIN);
+        size_t size = 0;
+        for (int i = 0; i < sampleCount; i++)
+            size += sampleSizes[i];
+        job->buf = (lUInt8*)malloc(size > 0 ? size : 1);
+        memcpy(job->buf, samples, size);
+        job->sampleSizes = (size_t*)malloc(sampleCount * sizeof(size_t));
+        memcpy(job->sampleSizes, sampleSizes, sampleCount * sizeof(size_t));
+        job->sampleCount = sampleCount;
+        job->srcSize = (int)size;
+        _training = true;
+        queue(job);
+        return true;
+    }
+    bool flush(bool clearDirtyFlag) {
+        if (_failed)
+            return false;
+        Job* job = new Job(Job::FLUSH);
+        job->clearDirtyFlag = clearDirtyFlag;
+        queue(job);
+        return true;
+    }
+    void notify(LVDocViewCallback* callback) {
+        Job* job = new Job(Job::NOTIFY);
+        job->callback = callback;
+        queue(job);
+    }
+    /// moves notifications of done jobs to list
+    void takeNotifications(LVArray<AsyncNotification>& list) {
+        CRGuard guard(_monitor);
+        CR_UNUSED(guard);
+        list.add(_notifications);
+        _notifications.clear();
+    }
+    /// drops queued and done notifications
+    void discardNotifications() {
+        CRGuard guard(_monitor);
+        CR_UNUSED(guard);
+        _discardedNotifications = _pendingNotifications;
+        _notifications.clear();
+    }
+    /// returns true if all queued jobs are done
+    bool isIdle() {
+        CRGuard guard(_monitor);
+        CR_UNUSED(guard);
+        return _pendingJobs == 0;
+    }
+    /// waits for all queued jobs, stops I/O thread; returns false if any of them failed
+    bool finish() {
+        if (!_thread.isNull()) {
+            {
+                CRGuard guard(_monitor);
+                CR_UNUSED(guard);
+                _stopped = true;
+                _monitor->notifyAll();
+            }
+            _thread->join();
+            _thread.clear();
+        }
+        return !_failed;
+    }
+    // I/O thread
+    virtual void run() {
+        for (;;) {
+            Job* job = NULL;
+            {
+                CRGuard guard(_monitor);
+                CR_UNUSED(guard);
+                while (_queue.length() == 0 && !_stopped)
+                    _monitor->wait();
+                if (_queue.length() == 0)
+                    break;
+                job = _queue.popFront();
+            }
+            // after first error file is left dirty, only notifications are delivered
+            if ((!_failed || job->kind == Job::NOTIFY) && !commit(job))
+                _failed = true;
+            {
+                CRGuard guard(_monitor);
+                CR_UNUSED(guard);
+                _pendingJobs--;
+                _pendingSize -= job->srcSize;
+                if (job->kind == Job::NOTIFY) {
+                    _pendingNotifications--;
+                    if (_discardedNotifications > 0) {
+                        _discardedNotifications--;
+                    } else {
+                        AsyncNotification n = { job->callback, !_failed };
+                        _notifications.add(n);
+                    }
+                }
+                _monitor->notifyAll();
+            }
+            delete job;
+        }
+    }
+};
+
 // create uninitialized cache file, call open or create to initialize
 CacheFile::CacheFile(lUInt32 domVersion, CacheCompressionType compType)
         : _sectorSize(CACHE_FILE_SECTOR_SIZE)
@@ -139,10 +455,16 @@ CacheFile::CacheFile(lUInt32 domVersion, CacheCompressionType compType)
         , _domVersion(domVersion)
         , _compType(compType)
         , _map(1024)
+        , _async(NULL)
+        , _mapping(NULL)
+        , _mappingSize(0)
+        , _mappingStale(false)
         , _cachePath(lString32::empty_str)
 #if (USE_ZSTD == 1)
         , _zstd_comp_res(nullptr)
         , _zstd_decomp_res(nullptr)
+        , _zstd_dict(nullptr)
+        , _zstd_dictTried(false)
 #endif
 #if (USE_ZLIB == 1)
         , _zlib_comp_res(nullptr)
@@ -153,6 +475,7 @@ CacheFile::CacheFile(lUInt32 domVersion, CacheCompressionType compType)
 
 // free resources
 CacheFile::~CacheFile() {
+    finishAsyncWrites();
     if (!_stream.isNull()) {
         // don't flush -- leave file dirty
         //CRTimerUtil infinite;
@@ -161,6 +484,7 @@ CacheFile::~CacheFile() {
 #if (USE_ZSTD == 1)
     zstdCleanComp();
     zstdCleanDecomp();
+    zstdCleanDict();
 #endif
 #if (USE_ZLIB == 1)
     zlibCompCleanup();
@@ -170,6 +494,12 @@ CacheFile::~CacheFile() {
 
 /// sets dirty flag value, returns true if value is changed
 bool CacheFile::setDirtyFlag(bool dirty) {
+    if (_async)
+        finishAsyncWrites();
+    return writeDirtyFlag(dirty);
+}
+
+bool CacheFile::writeDirtyFlag(bool dirty) {
     if (_dirty == dirty)
         return false;
     if (!dirty) {
@@ -179,7 +509,7 @@ bool CacheFile::setDirtyFlag(bool dirty) {
         CRLog::info("CacheFile::setting Dirty flag");
     }
     _dirty = dirty;
-    SimpleCacheFileHeader hdr(_dirty ? 1 : 0, _domVersion, _compType);
+    SimpleCacheFileHeader hdr(_dirty ? 1 : 0, _domVersion, _compType, hasDictionary());
     _stream->SetPos(0);
     lvsize_t bytesWritten = 0;
     _stream->Write(&hdr, sizeof(hdr), &bytesWritten);
@@ -191,11 +521,13 @@ bool CacheFile::setDirtyFlag(bool dirty) {
 }
 
 bool CacheFile::setDOMVersion(lUInt32 domVersion) {
+    if (_async)
+        finishAsyncWrites();
     if (_domVersion == domVersion)
         return false;
     CRLog::info("CacheFile::setting DOM version value");
     _domVersion = domVersion;
-    SimpleCacheFileHeader hdr(_dirty ? 1 : 0, _domVersion, _compType);
+    SimpleCacheFileHeader hdr(_dirty ? 1 : 0, _domVersion, _compType, hasDictionary());
     _stream->SetPos(0);
     lvsize_t bytesWritten = 0;
     _stream->Write(&hdr, sizeof(hdr), &bytesWritten);
@@ -208,11 +540,19 @@ bool CacheFile::setDOMVersion(lUInt32 domVersion) {
 
 // flushes index
 bool CacheFile::flush(bool clearDirtyFlag, CRTimerUtil& maxTime) {
+    if (_async)
+        return _async->flush(clearDirtyFlag);
+    return flushIndex(clearDirtyFlag, maxTime);
+}
+
+bool CacheFile::flushIndex(bool clearDirtyFlag, CRTimerUtil& maxTime) {
     if (clearDirtyFlag) {
         //setDirtyFlag(true);
         if (!writeIndex())
             return false;
-        setDirtyFlag(false);
+        writeDirtyFlag(false);
+        if (_mappingStale && _stream->Flush(false) == LVERR_OK)
+            _mappingStale = false;
     } else {
         _stream->Flush(false, maxTime);
         //CRLog::trace("CacheFile->flush() took %d ms ", (int)timer.elapsed());
@@ -307,6 +647,10 @@ bool CacheFile::readIndex() {
         CRLog::error("CacheFile::readIndex: index block info doesn't match header");
         return false;
     }
+    if (hdr.hasCompressionDictionary() && !findBlock(CBT_ZSTD_DICT, 0)) {
+        CRLog::error("CacheFile::readIndex: compression dictionary block is missing");
+        return false;
+    }
     _dirty = hdr._dirty ? true : false;
     return true;
 }
@@ -339,7 +683,9 @@ bool CacheFile::writeIndex() {
             index[i]._dataSize = 0;
         }
     }
-    bool res = write(CBT_INDEX, 0, (const lUInt8*)index, sz, false);
+    // written directly, also by I/O thread of background writer
+    lUInt32 hash = calcHash((const lUInt8*)index, sz);
+    bool res = isBlockUnchanged(CBT_INDEX, 0, sz, hash) || writeBlock(CBT_INDEX, 0, (const lUInt8*)index, sz, hash, 0);
     delete[] index;
 
     indexItem = findBlock(CBT_INDEX, 0);
@@ -357,7 +703,7 @@ bool CacheFile::writeIndex() {
 bool CacheFile::updateHeader() {
     CacheFileItem* indexItem = NULL;
     indexItem = findBlock(CBT_INDEX, 0);
-    CacheFileHeader hdr(indexItem, _size, _dirty ? 1 : 0, _domVersion, _compType);
+    CacheFileHeader hdr(indexItem, _size, _dirty ? 1 : 0, _domVersion, _compType, hasDictionary());
     _stream->SetPos(0);
     lvsize_t bytesWritten = 0;
     _stream->Write(&hdr, sizeof(hdr), &bytesWritten);
@@ -379,6 +725,8 @@ void CacheFile::freeBlock(CacheFileItem* block) {
 
 /// reads block as a stream
 LVStreamRef CacheFile::readStream(lUInt16 type, lUInt16 index) {
+    if (_async)
+        finishAsyncWrites();
     CacheFileItem* block = findBlock(type, index);
     if (block && block->_dataSize) {
 #if 0
@@ -393,6 +741,44 @@ LVStreamRef CacheFile::readStream(lUInt16 type, lUInt16 index) {
     return LVStreamRef();
 }
 
+/// returns true if block exists
+bool CacheFile::hasBlock(lUInt16 type, lUInt16 index) {
+    if (_async)
+        finishAsyncWrites();
+    return findBlock(type, index) != NULL;
+}
+
+/// copies block to block of another type and index as is, without unpacking
+bool CacheFile::copyBlock(lUInt16 type, lUInt16 index, lUInt16 newType, lUInt16 newIndex) {
+    if (_async)
+        finishAsyncWrites();
+    CacheFileItem* block = findBlock(type, index);
+    if (!block)
+        return false;
+    CacheFileItem* existing = findBlock(newType, newIndex);
+    if (existing && existing->_dataSize == block->_dataSize && existing->_dataHash == block->_dataHash &&
+        existing->_packedHash == block->_packedHash && existing->_uncompressedSize == block->_uncompressedSize)
+        return true; // already copied
+    lUInt8* data = readPackedData(block);
+    if (!data)
+        return false;
+    bool res = writeBlock(newType, newIndex, data, block->_dataSize, (lUInt32)block->_dataHash, block->_uncompressedSize);
+    free(data);
+    return res;
+}
+
+/// frees block, if it exists
+void CacheFile::removeBlock(lUInt16 type, lUInt16 index) {
+    if (_async)
+        finishAsyncWrites();
+    CacheFileItem* block = findBlock(type, index);
+    if (!block)
+        return;
+    writeDirtyFlag(true);
+    freeBlock(block);
+    _indexChanged = true;
+}
+
 // searches for existing block
 CacheFileItem* CacheFile::findBlock(lUInt16 type, lUInt16 index) {
     lUInt32 key = ((lUInt32)type) << 16 | index;
@@ -451,6 +837,8 @@ CacheFileItem* CacheFile::allocBlock(lUInt16 type, lUInt16 index, int size) {
 
 /// reads and validates block
 bool CacheFile::validate(CacheFileItem* block) {
+    if (_async)
+        finishAsyncWrites();
     lUInt8* buf = NULL;
     unsigned size = 0;
 
@@ -481,114 +869,179 @@ bool CacheFile::validate(CacheFileItem* block) {
     return true;
 }
 
-// reads and allocates block in memory
-bool CacheFile::read(lUInt16 type, lUInt16 dataIndex, lUInt8*& buf, int& size) {
+// returns pointer to packed block data inside of file mapping
+const lUInt8* CacheFile::getMappedData(CacheFileItem* block) {
+    if (!_mapping || _mappingStale)
+        return NULL;
+    if (block->_blockFilePos + block->_dataSize > _mappingSize)
+        return NULL; // written after mapping
+    return _mapping + block->_blockFilePos;
+}
+
+// reads block data into buffer of at least minBufSize bytes
+bool CacheFile::readBlock(CacheFileItem* block, lUInt8*& buf, int& size, int minBufSize) {
+    lUInt16 type = block->_dataType;
+    lUInt16 dataIndex = block->_dataIndex;
     buf = NULL;
     size = 0;
-    CacheFileItem* block = findBlock(type, dataIndex);
-    if (!block) {
-        CRLog::error("CacheFile::read: Block %d:%d not found in file", type, dataIndex);
-        return false;
-    }
-    if ((int)_stream->SetPos(block->_blockFilePos) != block->_blockFilePos)
-        return false;
-
-    // read block from file
-    size = block->_dataSize;
-    buf = (lUInt8*)malloc(size);
-    lvsize_t bytesRead = 0;
-    _stream->Read(buf, size, &bytesRead);
-    if ((int)bytesRead != size) {
-        CRLog::error("CacheFile::read: Cannot read block %d:%d of size %d, bytesRead=%d", type, dataIndex, (int)size, (int)bytesRead);
-        free(buf);
-        buf = NULL;
-        size = 0;
-        return false;
-    }
-
+    int packedSize = block->_dataSize;
     bool compressed = block->_uncompressedSize != 0;
+    int dataSize = compressed ? (int)block->_uncompressedSize : packedSize;
+    int bufSize = dataSize > minBufSize ? dataSize : minBufSize;
+
+    // packed data: in place from mapping, or read from file
+    lUInt8* packedBuf = NULL;
+    const lUInt8* packed = getMappedData(block);
+    if (!packed) {
+        if ((int)_stream->SetPos(block->_blockFilePos) != block->_blockFilePos)
+            return false;
+        // uncompressed block is read directly to destination buffer
+        packedBuf = (lUInt8*)malloc(compressed ? packedSize : bufSize);
+        lvsize_t bytesRead = 0;
+        _stream->Read(packedBuf, packedSize, &bytesRead);
+        if ((int)bytesRead != packedSize) {
+            CRLog::error("CacheFile::read: Cannot read block %d:%d of size %d, bytesRead=%d", type, dataIndex, (int)packedSize, (int)bytesRead);
+            free(packedBuf);
+            return false;
+        }
+        packed = packedBuf;
+    }
 
+    lUInt8* data = NULL;
     if (compressed) {
-        // block is compressed
-
         // check crc separately only for compressed data
-        lUInt32 packedhash = calcHash(buf, size);
+        lUInt32 packedhash = calcHash(packed, packedSize);
         if (packedhash != block->_packedHash) {
-            CRLog::error("CacheFile::read: packed data CRC doesn't match for block %d:%d of size %d", type, dataIndex, (int)size);
-            free(buf);
-            buf = NULL;
-            size = 0;
+            CRLog::error("CacheFile::read: packed data CRC doesn't match for block %d:%d of size %d", type, dataIndex, (int)packedSize);
+            free(packedBuf);
             return false;
         }
-
-        // uncompress block data
-        lUInt8* uncomp_buf = NULL;
-        lUInt32 uncomp_size = 0;
-        if (ldomUnpack(buf, size, uncomp_buf, uncomp_size) && uncomp_size == block->_uncompressedSize) {
-            free(buf);
-            buf = uncomp_buf;
-            size = uncomp_size;
-        } else {
-            CRLog::error("CacheFile::read: error while uncompressing data for block %d:%d of size %d", type, dataIndex, (int)size);
-            free(buf);
-            buf = NULL;
-            size = 0;
+        // uncompress block data to its final buffer
+        data = (lUInt8*)malloc(bufSize);
+        if (!ldomUnpackTo(packed, packedSize, data, dataSize)) {
+            CRLog::error("CacheFile::read: error while uncompressing data for block %d:%d of size %d", type, dataIndex, (int)packedSize);
+            free(packedBuf);
+            free(data);
             return false;
         }
+        free(packedBuf);
+    } else if (packedBuf) {
+        data = packedBuf;
+    } else {
+        data = (lUInt8*)malloc(bufSize);
+        memcpy(data, packed, dataSize);
     }
 
     // check CRC
-    lUInt32 hash = calcHash(buf, size);
+    lUInt32 hash = calcHash(data, dataSize);
     if (hash != block->_dataHash) {
-        CRLog::error("CacheFile::read: CRC doesn't match for block %d:%d of size %d", type, dataIndex, (int)size);
-        free(buf);
-        buf = NULL;
-        size = 0;
+        CRLog::error("CacheFile::read: CRC doesn't match for block %d:%d of size %d", type, dataIndex, (int)dataSize);
+        free(data);
         return false;
     }
     // Success. Don't forget to free allocated block externally
+    buf = data;
+    size = dataSize;
     return true;
 }
 
-// writes block to file
-bool CacheFile::write(lUInt16 type, lUInt16 dataIndex, const lUInt8* buf, int size, bool compress) {
-    // check whether data is changed
-    lUInt32 newhash = calcHash(buf, size);
-    CacheFileItem* existingblock = findBlock(type, dataIndex);
+// reads and allocates block in memory
+bool CacheFile::read(lUInt16 type, lUInt16 dataIndex, lUInt8*& buf, int& size) {
+    return read(type, dataIndex, buf, size, 0);
+}
+
+// reads block to allocated buffer of at least minBufSize bytes
+bool CacheFile::read(lUInt16 type, lUInt16 dataIndex, lUInt8*& buf, int& size, int minBufSize) {
+    if (_async)
+        finishAsyncWrites();
+    buf = NULL;
+    size = 0;
+    CacheFileItem* block = findBlock(type, dataIndex);
+    if (!block) {
+        CRLog::error("CacheFile::read: Block %d:%d not found in file", type, dataIndex);
+        return false;
+    }
+    return readBlock(block, buf, size, minBufSize);
+}
+
+// returns pointer to uncompressed block data inside of file mapping
+const lUInt8* CacheFile::readMapped(lUInt16 type, lUInt16 dataIndex, int& size) {
+    size = 0;
+    if (!_mapping)
+        return NULL;
+    if (_async)
+        finishAsyncWrites();
+    CacheFileItem* block = findBlock(type, dataIndex);
+    if (!block || block->_uncompressedSize != 0)
+        return NULL;
+    const lUInt8* data = getMappedData(block);
+    if (!data)
+        return NULL;
+    if (calcHash(data, block->_dataSize) != block->_dataHash) {
+        CRLog::error("CacheFile::readMapped: CRC doesn't match for block %d:%d of size %d", type, dataIndex, (int)block->_dataSize);
+        return NULL;
+    }
+    size = block->_dataSize;
+    return data;
+}
 
+// returns true if block with the same data is already written
+bool CacheFile::isBlockUnchanged(lUInt16 type, lUInt16 dataIndex, int size, lUInt32 hash) {
+    CacheFileItem* existingblock = findBlock(type, dataIndex);
     if (existingblock) {
         bool sameSize = ((int)existingblock->_uncompressedSize == size) || (existingblock->_uncompressedSize == 0 && (int)existingblock->_dataSize == size);
-        if (sameSize && existingblock->_dataHash == newhash) {
+        if (sameSize && existingblock->_dataHash == hash) {
             return true;
         }
     }
+    return false;
+}
 
-#if 0
-    if (existingblock)
-        CRLog::trace("*    oldsz=%d oldhash=%08x", (int)existingblock->_uncompressedSize, (int)existingblock->_dataHash);
-    CRLog::trace("* wr block t=%d[%d] sz=%d hash=%08x", type, dataIndex, size, newhash);
-#endif
-    setDirtyFlag(true);
-
-    lUInt32 uncompressedSize = 0;
-    lUInt64 newpackedhash = newhash;
+// writes block to file
+bool CacheFile::write(lUInt16 type, lUInt16 dataIndex, const lUInt8* buf, int size, bool compress) {
     if (_compType == CacheCompressionNone)
         compress = false;
+    if (_async)
+        return _async->write(type, dataIndex, buf, size, compress);
+
+    // check whether data is changed
+    lUInt32 newhash = calcHash(buf, size);
+    if (isBlockUnchanged(type, dataIndex, size, newhash))
+        return true;
+
+    lUInt32 uncompressedSize = 0;
     if (compress) {
         lUInt8* dstbuf = NULL;
         lUInt32 dstsize = 0;
-        if (!ldomPack(buf, size, dstbuf, dstsize)) {
+        if (!packBlock(type, buf, size, dstbuf, dstsize, this)) {
             compress = false;
         } else {
             uncompressedSize = size;
             size = dstsize;
             buf = dstbuf;
-            newpackedhash = calcHash(buf, size);
 #if DEBUG_DOM_STORAGE == 1
             //CRLog::trace("packed block %d:%d : %d to %d bytes (%d%%)", type, dataIndex, srcsize, dstsize, srcsize>0?(100*dstsize/srcsize):0 );
 #endif
         }
     }
+    bool res = writeBlock(type, dataIndex, buf, size, newhash, uncompressedSize);
+    if (compress) {
+        free((void*)buf);
+    }
+    return res;
+}
+
+// writes already packed (if uncompressedSize != 0) data to block, updates index
+bool CacheFile::writeBlock(lUInt16 type, lUInt16 dataIndex, const lUInt8* buf, int size, lUInt32 newhash, lUInt32 uncompressedSize) {
+    CacheFileItem* existingblock = findBlock(type, dataIndex);
+#if 0
+    if (existingblock)
+        CRLog::trace("*    oldsz=%d oldhash=%08x", (int)existingblock->_uncompressedSize, (int)existingblock->_dataHash);
+    CRLog::trace("* wr block t=%d[%d] sz=%d hash=%08x", type, dataIndex, size, newhash);
+#endif
+    writeDirtyFlag(true);
+
+    lUInt64 newpackedhash = uncompressedSize ? calcHash(buf, size) : newhash;
 
     CacheFileItem* block = NULL;
     if (existingblock && existingblock->_dataSize >= size) {
@@ -600,35 +1053,19 @@ bool CacheFile::write(lUInt16 type, lUInt16 dataIndex, const lUInt8* buf, int si
             freeBlock(existingblock);
         block = allocBlock(type, dataIndex, size);
     }
-    if (!block) {
-#if DOC_DATA_COMPRESSION_LEVEL != 0
-        if (compress) {
-            free((void*)buf);
-        }
-#endif
+    if (!block)
         return false;
-    }
-    if ((int)_stream->SetPos(block->_blockFilePos) != block->_blockFilePos) {
-#if DOC_DATA_COMPRESSION_LEVEL != 0
-        if (compress) {
-            free((void*)buf);
-        }
-#endif
+    if ((int)_stream->SetPos(block->_blockFilePos) != block->_blockFilePos)
         return false;
-    }
+    if (_mapping && block->_blockFilePos < _mappingSize)
+        _mappingStale = true; // mapping gets new data after flush
     // assert: size == block->_dataSize
     // actual writing of data
     block->_dataSize = size;
     lvsize_t bytesWritten = 0;
     _stream->Write(buf, size, &bytesWritten);
-    if ((int)bytesWritten != size) {
-#if DOC_DATA_COMPRESSION_LEVEL != 0
-        if (compress) {
-            free((void*)buf);
-        }
-#endif
+    if ((int)bytesWritten != size)
         return false;
-    }
 #if CACHE_FILE_WRITE_BLOCK_PADDING == 1
     int paddingSize = block->_blockSize - size; //roundSector( size ) - size
     if (paddingSize) {
@@ -654,9 +1091,6 @@ bool CacheFile::write(lUInt16 type, lUInt16 dataIndex, const lUInt8* buf, int si
     block->_packedHash = newpackedhash;
     block->_uncompressedSize = uncompressedSize;
 
-    if (compress) {
-        free((void*)buf);
-    }
     _indexChanged = true;
 
     //CRLog::error("CacheFile::write: block %d:%d (pos %ds, size %ds) is written (crc=%08x)", type, dataIndex, (int)block->_blockFilePos/_sectorSize, (int)(size+_sectorSize-1)/_sectorSize, block->_dataCRC);
@@ -681,6 +1115,201 @@ bool CacheFile::read(lUInt16 type, lUInt16 index, SerialBuf& buf) {
     return res;
 }
 
+/// reads content of serial buffer, refers to mapped file data when possible
+bool CacheFile::readInPlace(lUInt16 type, lUInt16 index, SerialBuf& buf) {
+    int size = 0;
+    const lUInt8* data = readMapped(type, index, size);
+    if (!data)
+        return read(type, index, buf);
+    buf.setExternal(data, size);
+    buf.setPos(0);
+    return true;
+}
+
+// blocks read on document opening, in order of reading, see ldomDocument::loadCacheFileContent()
+static const lUInt16 _compactionHotBlocks[] = {
+    CBT_ZSTD_DICT, CBT_PROP_DATA, CBT_MAPS_DATA, CBT_PAGE_DATA, CBT_FONT_DATA, CBT_REND_PARAMS,
+    CBT_NODE_INDEX, CBT_ELEM_NODE, CBT_TEXT_NODE, CBT_TRAVERSAL_INDEX, CBT_TOC_DATA, CBT_PAGEMAP_DATA, CBT_STYLE_DATA,
+    CBT_BLOB_INDEX
+};
+
+static int compactionRank(lUInt16 type) {
+    int count = sizeof(_compactionHotBlocks) / sizeof(_compactionHotBlocks[0]);
+    for (int i = 0; i < count; i++) {
+        if (_compactionHotBlocks[i] == type)
+            return i;
+    }
+    return count + type;
+}
+
+static int compareCompactionOrder(const void* a, const void* b) {
+    const CacheFileItem* pa = *(const CacheFileItem* const*)a;
+    const CacheFileItem* pb = *(const CacheFileItem* const*)b;
+    int ra = compactionRank(pa->_dataType);
+    int rb = compactionRank(pb->_dataType);
+    if (ra != rb)
+        return ra < rb ? -1 : 1;
+    return (int)pa->_dataIndex - (int)pb->_dataIndex;
+}
+
+// returns first position >= pos where block of size doesn't overlap pinned blocks
+static int skipPinnedBlocks(LVArray<CacheFileItem*>& pinned, int pos, int size) {
+    for (int i = 0; i < pinned.length(); i++) {
+        CacheFileItem* p = pinned[i];
+        if (pos < p->_blockFilePos + p->_blockSize && p->_blockFilePos < pos + size) {
+            pos = p->_blockFilePos + p->_blockSize;
+            i = -1; // check all again
+        }
+    }
+    return pos;
+}
+
+// reads packed data of block to newly allocated buffer
+lUInt8* CacheFile::readPackedData(CacheFileItem* block) {
+    if ((int)_stream->SetPos(block->_blockFilePos) != block->_blockFilePos)
+        return NULL;
+    lUInt8* data = (lUInt8*)malloc(block->_dataSize > 0 ? block->_dataSize : 1);
+    lvsize_t bytesRead = 0;
+    _stream->Read(data, block->_dataSize, &bytesRead);
+    if ((int)bytesRead != block->_dataSize || calcHash(data, block->_dataSize) != block->_packedHash) {
+        CRLog::error("CacheFile::readPackedData: cannot read block %d:%d of size %d", block->_dataType, block->_dataIndex, block->_dataSize);
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+// moves block to file position pos
+bool CacheFile::relocateBlock(CacheFileItem* block, int pos, const lUInt8* data) {
+    int blockSize = roundSector(block->_dataSize);
+    if ((int)_stream->SetPos(pos) != pos)
+        return false;
+    lvsize_t bytesWritten = 0;
+    _stream->Write(data, block->_dataSize, &bytesWritten);
+    if ((int)bytesWritten != block->_dataSize)
+        return false;
+    int paddingSize = blockSize - block->_dataSize;
+    if (paddingSize) {
+        LVArray<lUInt8> padding(paddingSize, 0xFF);
+        _stream->Write(padding.get(), paddingSize, &bytesWritten);
+        if ((int)bytesWritten != paddingSize)
+            return false;
+    }
+    block->_blockFilePos = pos;
+    block->_blockSize = blockSize;
+    _indexChanged = true;
+    return true;
+}
+
+// moves all blocks to the start of file without gaps, truncates file
+ContinuousOperationResult CacheFile::compact(CRTimerUtil& maxTime) {
+    if (_async)
+        finishAsyncWrites();
+    if (_stream.isNull())
+        return CR_ERROR;
+    if (_mapping) {
+        // data of mapped file may be referred without copying
+        CRLog::info("CacheFile::compact: file is mapped for reading, skipped");
+        return CR_DONE;
+    }
+    // index is written after all other blocks when compaction is finished
+    LVArray<CacheFileItem*> blocks;
+    LVArray<CacheFileItem*> pinned;
+    CacheFileItem* indexItem = NULL;
+    int freeCount = 0;
+    for (int i = 0; i < _index.length(); i++) {
+        CacheFileItem* item = _index[i];
+        if (item->_dataType == CBT_FREE)
+            freeCount++;
+        else if (item->_dataType == CBT_INDEX)
+            indexItem = item;
+        else if (item->_dataType == CBT_BLOB_DATA)
+            pinned.add(item);
+        else
+            blocks.add(item);
+    }
+    qsort(blocks.get(), blocks.length(), sizeof(CacheFileItem*), compareCompactionOrder);
+    // new layout
+    LVArray<int> targets;
+    int pos = _sectorSize;
+    bool compacted = freeCount == 0;
+    for (int i = 0; i < blocks.length(); i++) {
+        int size = roundSector(blocks[i]->_dataSize);
+        pos = skipPinnedBlocks(pinned, pos, size);
+        targets.add(pos);
+        if (blocks[i]->_blockFilePos != pos)
+            compacted = false;
+        pos += size;
+    }
+    int end = pos;
+    for (int i = 0; i < pinned.length(); i++) {
+        if (end < pinned[i]->_blockFilePos + pinned[i]->_blockSize)
+            end = pinned[i]->_blockFilePos + pinned[i]->_blockSize;
+    }
+    if (compacted && (indexItem ? indexItem->_blockFilePos == end && indexItem->_blockFilePos + indexItem->_blockSize == _size : end == _size)) {
+        CRLog::debug("CacheFile::compact: file is already compact");
+        return CR_DONE;
+    }
+
+    writeDirtyFlag(true);
+    if (freeCount || indexItem) {
+        for (int i = _index.length() - 1; i >= 0; i--) {
+            CacheFileItem* item = _index[i];
+            if (item->_dataType == CBT_FREE)
+                _freeIndex.remove(item);
+            else if (item == indexItem)
+                _map.remove(((lUInt32)CBT_INDEX) << 16);
+            else
+                continue;
+            delete _index.remove(i);
+        }
+        for (int i = 0; i < _index.length(); i++)
+            _index[i]->_blockIndex = i;
+        _indexChanged = true;
+    }
+
+    for (int i = 0; i < blocks.length(); i++) {
+        CacheFileItem* block = blocks[i];
+        int target = targets[i];
+        int size = roundSector(block->_dataSize);
+        if (block->_blockFilePos == target) {
+            if (block->_blockSize != size) {
+                block->_blockSize = size;
+                _indexChanged = true;
+            }
+            continue;
+        }
+        // blocks occupying target place are moved to the end of file
+        for (int j = i + 1; j < blocks.length(); j++) {
+            CacheFileItem* other = blocks[j];
+            if (other->_blockFilePos < target + size && target < other->_blockFilePos + other->_dataSize) {
+                lUInt8* data = readPackedData(other);
+                bool res = data && relocateBlock(other, _size, data);
+                free(data);
+                if (!res)
+                    return CR_ERROR;
+                _size += other->_blockSize;
+            }
+        }
+        lUInt8* data = readPackedData(block);
+        bool res = data && relocateBlock(block, target, data);
+        free(data);
+        if (!res)
+            return CR_ERROR;
+        if (maxTime.expired())
+            return CR_TIMEOUT;
+    }
+
+    _size = end;
+    if (!writeIndex())
+        return CR_ERROR;
+    if (_stream->SetSize(_size) != LVERR_OK)
+        CRLog::warn("CacheFile::compact: cannot truncate file");
+    writeDirtyFlag(false);
+    CRLog::info("CacheFile::compact: file is compacted to %d bytes", _size);
+    return CR_DONE;
+}
+
 // try open existing cache file
 bool CacheFile::open(lString32 filename) {
     LVStreamRef stream = LVOpenFileStream(filename.c_str(), LVOM_APPEND);
@@ -706,9 +1335,59 @@ bool CacheFile::open(LVStreamRef stream) {
         CRLog::error("CacheFile::open : file contents validation failed");
         return false;
     }
+    if (findBlock(CBT_ZSTD_DICT, 0)) {
+        // blocks packed with dictionary cannot be read without it
+        bool res = false;
+#if (USE_ZSTD == 1)
+        lUInt8* dict = NULL;
+        int dictSize = 0;
+        if (_compType == CacheCompressionZSTD && read(CBT_ZSTD_DICT, 0, dict, dictSize)) {
+            res = zstdCreateDict(dict, dictSize);
+            free(dict);
+        }
+#endif
+        if (!res) {
+            CRLog::error("CacheFile::open : cannot read compression dictionary");
+            return false;
+        }
+    }
     return true;
 }
 
+// map already opened file to memory for reading
+bool CacheFile::mapForReading(const lString32& filename) {
+#if defined(_WIN32)
+    // mapped file cannot be deleted or resized on Windows
+    CR_UNUSED(filename);
+    return false;
+#else
+    if (_async)
+        finishAsyncWrites();
+    _mapping = NULL;
+    _mappingBuf.Clear();
+    _mappingStream.Clear();
+    // all data written before mapping should be in file
+    if (_stream.isNull() || _stream->Flush(false) != LVERR_OK)
+        return false;
+    LVStreamRef stream = LVMapFileStream(filename.c_str(), LVOM_READ, 0);
+    if (stream.isNull())
+        return false;
+    lvsize_t size = stream->GetSize();
+    if (size < (lvsize_t)_sectorSize)
+        return false;
+    LVStreamBufferRef buf = stream->GetReadBuffer(0, size);
+    if (buf.isNull() || !buf->getReadOnly())
+        return false;
+    _mappingStream = stream;
+    _mappingBuf = buf;
+    _mapping = buf->getReadOnly();
+    _mappingSize = (int)size;
+    _mappingStale = false;
+    CRLog::info("CacheFile::mapForReading: %d bytes of %s are mapped", _mappingSize, LCSTR(filename));
+    return true;
+#endif
+}
+
 bool CacheFile::create(lString32 filename) {
     LVStreamRef stream = LVOpenFileStream(filename.c_str(), LVOM_APPEND);
     if (_stream.isNull()) {
@@ -743,6 +1422,84 @@ bool CacheFile::create(LVStreamRef stream) {
     return true;
 }
 
+bool CacheFile::startAsyncWrites(CRThreadPool* pool) {
+    if (_async)
+        return true;
+    if (!concurrencyProvider || _stream.isNull())
+        return false;
+    CRLog::debug("CacheFile: starting background writing");
+    _async = new AsyncWriter(this, pool);
+    return true;
+}
+
+void CacheFile::notifyAsyncWritten(LVDocViewCallback* callback) {
+    if (!callback)
+        return;
+    if (_async)
+        _async->notify(callback);
+    else
+        callback->OnCacheFileWritten(true);
+}
+
+void CacheFile::deliverAsyncNotifications() {
+    if (_async)
+        _async->takeNotifications(_asyncNotifications);
+    // callbacks may use this file again
+    LVArray<AsyncNotification> list;
+    list.add(_asyncNotifications);
+    _asyncNotifications.clear();
+    for (int i = 0; i < list.length(); i++)
+        list[i].callback->OnCacheFileWritten(list[i].success);
+}
+
+void CacheFile::discardAsyncNotifications() {
+    if (_async)
+        _async->discardNotifications();
+    _asyncNotifications.clear();
+}
+
+bool CacheFile::finishAsyncWrites() {
+    if (!_async)
+        return true;
+    AsyncWriter* async = _async;
+    bool res = async->finish();
+    async->takeNotifications(_asyncNotifications);
+    _async = NULL;
+    delete async;
+    CRLog::debug("CacheFile: background writing is finished%s", res ? "" : " with errors");
+    return res;
+}
+
+// cache files released while their background writes were pending
+static LVPtrVector<CacheFile, false> _releasedCacheFiles;
+static CRLazyMutex _releasedCacheFilesMutex;
+
+void CacheFile::release(CacheFile* file) {
+    if (!file)
+        return;
+    // callbacks may be gone when writes of released file are done
+    file->discardAsyncNotifications();
+    CRGuard guard(_releasedCacheFilesMutex.get());
+    CR_UNUSED(guard);
+    // delete ones which are already written
+    for (int i = _releasedCacheFiles.length() - 1; i >= 0; i--) {
+        if (_releasedCacheFiles[i]->_async->isIdle())
+            delete _releasedCacheFiles.remove(i);
+    }
+    if (file->_async && !file->_async->isIdle())
+        _releasedCacheFiles.add(file);
+    else
+        delete file;
+}
+
+void CacheFile::waitReleased() {
+    CRGuard guard(_releasedCacheFilesMutex.get());
+    CR_UNUSED(guard);
+    for (int i = 0; i < _releasedCacheFiles.length(); i++)
+        delete _releasedCacheFiles[i];
+    _releasedCacheFiles.clear();
+}
+
 #if (USE_ZSTD == 1)
 bool CacheFile::zstdAllocComp() {
     // printf("zstdtag: CacheFile::zstdAllocComp\n");
@@ -791,8 +1548,76 @@ void CacheFile::zstdCleanComp() {
     }
 }
 
+bool CacheFile::zstdCreateDict(const lUInt8* data, size_t size) {
+    zstdCleanDict();
+    zstd_dict_t* dict = (zstd_dict_t*)malloc(sizeof(zstd_dict_t));
+    if (!dict)
+        return false;
+    // both copy dictionary data
+    dict->cdict = ZSTD_createCDict(data, size, ZSTD_CLEVEL_DEFAULT);
+    dict->ddict = ZSTD_createDDict(data, size);
+    dict->id = dict->ddict ? ZSTD_getDictID_fromDDict(dict->ddict) : 0;
+    if (!dict->cdict || !dict->ddict || !dict->id) {
+        // frames packed with raw content dictionary have no dictionary ID, only trained dictionaries are accepted
+        CRLog::error("zstdCreateDict() failed to create dictionary of size %d", (int)size);
+        ZSTD_freeCDict(dict->cdict);
+        ZSTD_freeDDict(dict->ddict);
+        free(dict);
+        return false;
+    }
+    _zstd_dict = dict;
+    return true;
+}
+
+void CacheFile::zstdCleanDict() {
+    zstd_dict_t* dict = _zstd_dict.exchange(nullptr);
+    if (dict) {
+        ZSTD_freeCDict(dict->cdict);
+        ZSTD_freeDDict(dict->ddict);
+        free(dict);
+    }
+}
+
+bool CacheFile::zstdTrainDict(const lUInt8* samples, const size_t* sampleSizes, int sampleCount) {
+    lUInt8* dict = (lUInt8*)malloc(CACHE_FILE_DICT_SIZE);
+    if (!dict)
+        return false;
+    size_t dictSize = ZDICT_trainFromBuffer(dict, CACHE_FILE_DICT_SIZE, samples, sampleSizes, (unsigned)sampleCount);
+    if (ZDICT_isError(dictSize)) {
+        CRLog::warn("CacheFile::trainDictionary: %s (%d samples)", ZDICT_getErrorName(dictSize), sampleCount);
+        free(dict);
+        return false;
+    }
+    // dictionary is written before any block packed with it
+    bool res = zstdCreateDict(dict, dictSize) && writeBlock(CBT_ZSTD_DICT, 0, dict, (int)dictSize, calcHash(dict, (int)dictSize), 0);
+    free(dict);
+    if (!res) {
+        zstdCleanDict();
+        return false;
+    }
+    CRLog::info("CacheFile::trainDictionary: %d bytes dictionary is trained from %d samples", (int)dictSize, sampleCount);
+    return true;
+}
+
+/// select dictionary referenced by compressed frame for decompression
+bool CacheFile::zstdRefDict(const lUInt8* compbuf, size_t compsize) {
+    unsigned id = ZSTD_getDictID_fromFrame(compbuf, compsize);
+    zstd_dict_t* dict = _zstd_dict;
+    if (id && (!dict || dict->id != id)) {
+        CRLog::error("zstdtag: dictionary %u of compressed data is not available", id);
+        return false;
+    }
+    // dictionary reference is sticky: set or clear it for each frame
+    size_t const err = ZSTD_DCtx_refDDict(_zstd_decomp_res->dctx, id ? dict->ddict : NULL);
+    if (ZSTD_isError(err)) {
+        CRLog::error("ZSTD_DCtx_refDDict() error: %s", ZSTD_getErrorName(err));
+        return false;
+    }
+    return true;
+}
+
 /// pack data from buf to dstbuf (using zstd)
-bool CacheFile::zstdPack(const lUInt8* buf, size_t bufsize, lUInt8*& dstbuf, lUInt32& dstsize) {
+bool CacheFile::zstdPack(const lUInt8* buf, size_t bufsize, lUInt8*& dstbuf, lUInt32& dstsize, const zstd_dict_t* dict) {
     // printf("zstdtag: zstdPack() <- %p (%zu)\n", buf, bufsize);
 
     // Lazy init our resources, and keep 'em around
@@ -804,7 +1629,6 @@ bool CacheFile::zstdPack(const lUInt8* buf, size_t bufsize, lUInt8*& dstbuf, lUI
     }
 
     // c.f., ZSTD's examples/streaming_compression.c
-    // NOTE: We could probably gain much by training zstd and using a dictionary, here ;).
     size_t const buffOutSize = _zstd_comp_res->buffOutSize;
     void* const buffOut = _zstd_comp_res->buffOut;
     ZSTD_CCtx* const cctx = _zstd_comp_res->cctx;
@@ -815,6 +1639,12 @@ bool CacheFile::zstdPack(const lUInt8* buf, size_t bufsize, lUInt8*& dstbuf, lUI
         CRLog::error("ZSTD_CCtx_reset() error: %s", ZSTD_getErrorName(err));
         return false;
     }
+    // dictionary reference is sticky: set or clear it for each block
+    size_t const dictErr = ZSTD_CCtx_refCDict(cctx, dict ? dict->cdict : NULL);
+    if (ZSTD_isError(dictErr)) {
+        CRLog::error("ZSTD_CCtx_refCDict() error: %s", ZSTD_getErrorName(dictErr));
+        return false;
+    }
 
     // Tell the compressor just how much data we need to compress
     ZSTD_CCtx_setPledgedSrcSize(cctx, bufsize);
@@ -918,6 +1748,8 @@ bool CacheFile::zstdUnpack(const lUInt8* compbuf, size_t compsize, lUInt8*& dstb
         CRLog::error("ZSTD_DCtx_reset() error: %s", ZSTD_getErrorName(err));
         return false;
     }
+    if (!zstdRefDict(compbuf, compsize))
+        return false;
 
     size_t uncompressed_size = 0;
     lUInt8* uncompressed_buf = NULL;
@@ -962,6 +1794,44 @@ bool CacheFile::zstdUnpack(const lUInt8* compbuf, size_t compsize, lUInt8*& dstb
     // printf("zstdtag: zstdUnpack() done: %zu -> %zu\n", compsize, uncompressed_size);
     return true;
 }
+
+/// unpack data from compbuf to preallocated dstbuf (using zstd)
+bool CacheFile::zstdUnpackTo(const lUInt8* compbuf, size_t compsize, lUInt8* dstbuf, lUInt32 dstsize) {
+    if (!_zstd_decomp_res) {
+        if (!zstdAllocDecomp()) {
+            CRLog::error("zstdUnpackTo() failed to allocate resources");
+            return false;
+        }
+    }
+    ZSTD_DCtx* const dctx = _zstd_decomp_res->dctx;
+    size_t const err = ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only);
+    if (ZSTD_isError(err)) {
+        CRLog::error("ZSTD_DCtx_reset() error: %s", ZSTD_getErrorName(err));
+        return false;
+    }
+    if (!zstdRefDict(compbuf, compsize))
+        return false;
+    // output size is known: decompress directly to destination, without intermediate buffer
+    ZSTD_inBuffer input = { compbuf, compsize, 0 };
+    ZSTD_outBuffer output = { dstbuf, dstsize, 0 };
+    size_t ret = 0;
+    while (input.pos < input.size) {
+        size_t const prevIn = input.pos;
+        size_t const prevOut = output.pos;
+        ret = ZSTD_decompressStream(dctx, &output, &input);
+        if (ZSTD_isError(ret)) {
+            CRLog::error("zstdtag: ZSTD_decompressStream() error: %s (%zu -> %zu)", ZSTD_getErrorName(ret), compsize, output.pos);
+            return false;
+        }
+        if (input.pos == prevIn && output.pos == prevOut)
+            break; // output buffer is full
+    }
+    if (ret != 0 || input.pos != input.size || output.pos != dstsize) {
+        CRLog::error("zstdtag: zstdUnpackTo(): unexpected uncompressed size %zu, expected %u", output.pos, dstsize);
+        return false;
+    }
+    return true;
+}
 #endif // (USE_ZSTD==1)
 
 #if (USE_ZLIB == 1)
@@ -1121,6 +1991,33 @@ bool CacheFile::zlibUnpack(const lUInt8* compbuf, size_t compsize, lUInt8*& dstb
     // printf("zlibtag: inflate() done %d > %d\n", compsize, uncompressed_size);
     return true;
 }
+
+/// unpack data from compbuf to preallocated dstbuf (using zlib)
+bool CacheFile::zlibUnpackTo(const lUInt8* compbuf, size_t compsize, lUInt8* dstbuf, lUInt32 dstsize) {
+    if (!_zlib_uncomp_res) {
+        if (!zlibAllocUncompRes()) {
+            CRLog::error("zlibtag: zlibUnpackTo() failed to allocate resources");
+            return false;
+        }
+    }
+    z_streamp z = &_zlib_uncomp_res->zstream;
+    int ret = inflateReset(z);
+    if (ret != Z_OK) {
+        CRLog::error("zlibtag: inflateReset() error: %d", ret);
+        return false;
+    }
+    // output size is known: inflate directly to destination, without intermediate buffer
+    z->avail_in = compsize;
+    z->next_in = (unsigned char*)compbuf;
+    z->avail_out = dstsize;
+    z->next_out = dstbuf;
+    ret = inflate(z, Z_FINISH);
+    if (ret != Z_STREAM_END || z->avail_out != 0) {
+        CRLog::error("zlibtag: zlibUnpackTo(): inflate() error: %d, %u bytes of %u uncompressed", ret, dstsize - z->avail_out, dstsize);
+        return false;
+    }
+    return true;
+}
 #endif // (USE_ZLIB==1)
 
 void CacheFile::cleanupCompressor() {
@@ -1157,6 +2054,49 @@ void CacheFile::cleanupUncompressor() {
     }
 }
 
+/// pack data of block, DOM storage data blocks are packed with dictionary of dictOwner if it has one
+bool CacheFile::packBlock(lUInt16 type, const lUInt8* buf, size_t bufsize, lUInt8*& dstbuf, lUInt32& dstsize, const CacheFile* dictOwner) {
+#if (USE_ZSTD == 1)
+    bool dictType = type == CBT_TEXT_DATA || type == CBT_ELEM_DATA || type == CBT_RECT_DATA;
+    const zstd_dict_t* dict = dictType ? dictOwner->_zstd_dict.load() : NULL;
+    if (_compType == CacheCompressionZSTD && dict)
+        return zstdPack(buf, bufsize, dstbuf, dstsize, dict);
+#else
+    CR_UNUSED2(type, dictOwner);
+#endif
+    return ldomPack(buf, bufsize, dstbuf, dstsize);
+}
+
+bool CacheFile::canTrainDictionary() const {
+#if (USE_ZSTD == 1)
+    return _compType == CacheCompressionZSTD && !_zstd_dict && !_zstd_dictTried && !_stream.isNull();
+#else
+    return false;
+#endif
+}
+
+bool CacheFile::hasDictionary() const {
+#if (USE_ZSTD == 1)
+    return _zstd_dict != NULL;
+#else
+    return false;
+#endif
+}
+
+bool CacheFile::trainDictionary(const lUInt8* samples, const size_t* sampleSizes, int sampleCount) {
+    if (!canTrainDictionary())
+        return false;
+#if (USE_ZSTD == 1)
+    _zstd_dictTried = true; // one attempt per file
+    if (_async)
+        return _async->train(samples, sampleSizes, sampleCount);
+    return zstdTrainDict(samples, sampleSizes, sampleCount);
+#else
+    CR_UNUSED3(samples, sampleSizes, sampleCount);
+    return false;
+#endif
+}
+
 /// pack data from buf to dstbuf
 bool CacheFile::ldomPack(const lUInt8* buf, size_t bufsize, lUInt8*& dstbuf, lUInt32& dstsize) {
     switch (_compType) {
@@ -1195,3 +2135,22 @@ bool CacheFile::ldomUnpack(const lUInt8* compbuf, size_t compsize, lUInt8*& dstb
     }
     return false;
 }
+
+/// unpack data from compbuf to preallocated dstbuf of exact uncompressed size
+bool CacheFile::ldomUnpackTo(const lUInt8* compbuf, size_t compsize, lUInt8* dstbuf, lUInt32 dstsize) {
+    switch (_compType) {
+        case CacheCompressionZSTD:
+#if (USE_ZSTD == 1)
+            return zstdUnpackTo(compbuf, compsize, dstbuf, dstsize);
+#endif
+            break;
+        case CacheCompressionZlib:
+#if (USE_ZLIB == 1)
+            return zlibUnpackTo(compbuf, compsize, dstbuf, dstsize);
+#endif
+            break;
+        case CacheCompressionNone:
+            break;
+    }
+    return false;
+}
@@ -29,15 +29,21 @@
 #include <lvptrvec.h>
 #include <lvhashtable.h>
 #include <lvserialbuf.h>
+#include <lvtinynodecollection.h>
 
 #include "cachefileitem.h"
 #include "cachefileheader.h"
 
+#include <atomic>
+
 struct CacheFileItem;
+class CRThreadPool;
+class LVDocViewCallback;
 
 #if (USE_ZSTD == 1)
 struct zstd_comp_res_t;
 struct zstd_decomp_res_t;
+struct zstd_dict_t;
 #endif
 
 #if (USE_ZLIB == 1)
@@ -66,7 +72,12 @@ enum CacheFileBlockType
     CBT_STYLE_DATA,
     CBT_BLOB_INDEX, //16
     CBT_BLOB_DATA,
-    CBT_FONT_DATA //18
+    CBT_FONT_DATA, //18
+    CBT_ZSTD_DICT,
+    CBT_REND_VARIANTS, //20
+    CBT_REND_VARIANT_RECT_DATA,
+    CBT_REND_VARIANT_STYLE_DATA,
+    CBT_TRAVERSAL_INDEX
 };
 
 class CacheFile
@@ -82,9 +93,24 @@ class CacheFile
     LVPtrVector<CacheFileItem, true> _index;      // full file block index
     LVPtrVector<CacheFileItem, false> _freeIndex; // free file block index
     LVHashTable<lUInt32, CacheFileItem*> _map;    // hash map for fast search
+    class AsyncWriter;
+    AsyncWriter* _async;            // background writer, when started
+    struct AsyncNotification
+    {
+        LVDocViewCallback* callback;
+        bool success;
+    };
+    LVArray<AsyncNotification> _asyncNotifications; // written by stopped background writer, not delivered yet
+    LVStreamRef _mappingStream;     // read-only memory mapping of file, when mapped reads are enabled
+    LVStreamBufferRef _mappingBuf;  // buffer of whole mapped file
+    const lUInt8* _mapping;         // mapped file data, NULL if not mapped
+    int _mappingSize;               // mapped size, blocks written after end of mapping are read from stream
+    bool _mappingStale;             // blocks are written but not flushed yet: mapping may have old data
 #if (USE_ZSTD == 1)
     zstd_comp_res_t* _zstd_comp_res;
     zstd_decomp_res_t* _zstd_decomp_res;
+    std::atomic<zstd_dict_t*> _zstd_dict; // dictionary of DOM storage data blocks, trained or read from file
+    bool _zstd_dictTried;                 // dictionary training was started, don't try again
 #endif
 #if (USE_ZLIB == 1)
     zlib_res_t* _zlib_comp_res;
@@ -96,6 +122,14 @@ class CacheFile
     CacheFileItem* allocBlock(lUInt16 type, lUInt16 index, int size);
     // mark block as free, for later reusing
     void freeBlock(CacheFileItem* block);
+    // returns true if block with the same data is already written
+    bool isBlockUnchanged(lUInt16 type, lUInt16 index, int size, lUInt32 hash);
+    // writes already packed (if uncompressedSize != 0) data to block, updates index
+    bool writeBlock(lUInt16 type, lUInt16 index, const lUInt8* buf, int size, lUInt32 hash, lUInt32 uncompressedSize);
+    // writes dirty flag to file header
+    bool writeDirtyFlag(bool dirty);
+    // flushes index or stream
+    bool flushIndex(bool clearDirtyFlag, CRTimerUtil& maxTime);
     // writes file header
     bool updateHeader();
     // writes index block
@@ -104,16 +138,37 @@ class CacheFile
     bool readIndex();
     // reads all blocks of index and checks CRCs
     bool validateContents();
+    // returns pointer to packed block data inside of file mapping, NULL if block cannot be read from mapping
+    const lUInt8* getMappedData(CacheFileItem* block);
+    // reads block data into buffer of at least minBufSize bytes, uncompresses directly to it
+    bool readBlock(CacheFileItem* block, lUInt8*& buf, int& size, int minBufSize);
+    /// unpack data from compbuf to preallocated dstbuf of exact uncompressed size
+    bool ldomUnpackTo(const lUInt8* compbuf, size_t compsize, lUInt8* dstbuf, lUInt32 dstsize);
+    // moves block to file position pos, writing its packed data and padding up to new block size
+    bool relocateBlock(CacheFileItem* block, int pos, const lUInt8* data);
+    // reads packed data of block to newly allocated buffer
+    lUInt8* readPackedData(CacheFileItem* block);
+    /// pack data of block, DOM storage data blocks are packed with dictionary of dictOwner if it has one
+    bool packBlock(lUInt16 type, const lUInt8* buf, size_t bufsize, lUInt8*& dstbuf, lUInt32& dstsize, const CacheFile* dictOwner);
 
 #if (USE_ZSTD == 1)
     bool zstdAllocComp();
     void zstdCleanComp();
     bool zstdAllocDecomp();
     void zstdCleanDecomp();
-    /// pack data from buf to dstbuf (using zstd)
-    bool zstdPack(const lUInt8* buf, size_t bufsize, lUInt8*& dstbuf, lUInt32& dstsize);
+    /// create compression and decompression dictionaries from dictionary data
+    bool zstdCreateDict(const lUInt8* data, size_t size);
+    /// trains dictionary from samples, writes it to file; called by background writer when it's started
+    bool zstdTrainDict(const lUInt8* samples, const size_t* sampleSizes, int sampleCount);
+    void zstdCleanDict();
+    /// select dictionary referenced by compressed frame for decompression
+    bool zstdRefDict(const lUInt8* compbuf, size_t compsize);
+    /// pack data from buf to dstbuf (using zstd), with dictionary if not NULL
+    bool zstdPack(const lUInt8* buf, size_t bufsize, lUInt8*& dstbuf, lUInt32& dstsize, const zstd_dict_t* dict = NULL);
     /// unpack data from compbuf to dstbuf (using zstd)
     bool zstdUnpack(const lUInt8* compbuf, size_t compsize, lUInt8*& dstbuf, lUInt32& dstsize);
+    /// unpack data from compbuf to preallocated dstbuf (using zstd)
+    bool zstdUnpackTo(const lUInt8* compbuf, size_t compsize, lUInt8* dstbuf, lUInt32 dstsize);
 #endif
 #if (USE_ZLIB == 1)
     bool zlibAllocCompRes();
@@ -124,10 +179,14 @@ class CacheFile
     bool zlibPack(const lUInt8* buf, size_t bufsize, lUInt8*& dstbuf, lUInt32& dstsize);
     /// unpack data from compbuf to dstbuf (using zlib)
     bool zlibUnpack(const lUInt8* compbuf, size_t compsize, lUInt8*& dstbuf, lUInt32& dstsize);
+    /// unpack data from compbuf to preallocated dstbuf (using zlib)
+    bool zlibUnpackTo(const lUInt8* compbuf, size_t compsize, lUInt8* dstbuf, lUInt32 dstsize);
 #endif
 public:
     // return current file size
     int getSize() {
+        if (_async)
+            finishAsyncWrites();
         return _size;
     }
     // create uninitialized cache file, call open or create to initialize
@@ -138,6 +197,16 @@ public:
     bool open(lString32 filename);
     // try open existing cache file from stream
     bool open(LVStreamRef stream);
+    /// map already opened file to memory for reading, filename should be path of opened file
+    /**
+     * Uncompressed blocks are available in place by readMapped(),
+     * compressed blocks are uncompressed directly from mapping.
+     */
+    bool mapForReading(const lString32& filename);
+    /// returns true if file is mapped for reading
+    bool isMapped() const {
+        return _mapping != NULL;
+    }
     // create new cache file
     bool create(lString32 filename);
     // create new cache file in stream
@@ -146,12 +215,24 @@ public:
     bool write(lUInt16 type, lUInt16 dataIndex, const lUInt8* buf, int size, bool compress);
     /// reads and allocates block in memory
     bool read(lUInt16 type, lUInt16 dataIndex, lUInt8*& buf, int& size);
+    /// reads block to allocated buffer of at least minBufSize bytes, rest of buffer is not initialized
+    bool read(lUInt16 type, lUInt16 dataIndex, lUInt8*& buf, int& size, int minBufSize);
+    /// returns pointer to uncompressed block data inside of file mapping without copying, NULL if unavailable
+    /**
+     * Data is valid while cache file object exists and block is not rewritten.
+     */
+    const lUInt8* readMapped(lUInt16 type, lUInt16 dataIndex, int& size);
     /// reads and validates block
     bool validate(CacheFileItem* block);
     /// writes content of serial buffer
     bool write(lUInt16 type, lUInt16 index, SerialBuf& buf, bool compress);
     /// reads content of serial buffer
     bool read(lUInt16 type, lUInt16 index, SerialBuf& buf);
+    /// reads content of serial buffer, refers to mapped file data without copying when possible
+    /**
+     * Buffer should be used for reading only and should not outlive cache file object.
+     */
+    bool readInPlace(lUInt16 type, lUInt16 index, SerialBuf& buf);
     /// writes content of serial buffer
     bool write(lUInt16 type, SerialBuf& buf, bool compress) {
         return write(type, 0, buf, compress);
@@ -160,8 +241,31 @@ public:
     bool read(lUInt16 type, SerialBuf& buf) {
         return read(type, 0, buf);
     }
+    /// reads content of serial buffer, refers to mapped file data without copying when possible
+    bool readInPlace(lUInt16 type, SerialBuf& buf) {
+        return readInPlace(type, 0, buf);
+    }
     /// reads block as a stream
     LVStreamRef readStream(lUInt16 type, lUInt16 index);
+    /// returns true if block exists
+    bool hasBlock(lUInt16 type, lUInt16 index);
+    /// copies block to block of another type and index as is, without unpacking
+    bool copyBlock(lUInt16 type, lUInt16 index, lUInt16 newType, lUInt16 newIndex);
+    /// frees block, if it exists
+    void removeBlock(lUInt16 type, lUInt16 index);
+
+    /// returns true if compression dictionary can be trained for this file
+    bool canTrainDictionary() const;
+    /// returns true if file has compression dictionary of DOM storage data blocks
+    bool hasDictionary() const;
+    /// trains compression dictionary of text, element and render rect data blocks from samples, writes it to file
+    /**
+     * Dictionary is used for blocks written after this call. It cannot be replaced later,
+     * as blocks packed with it depend on it. Supported for zstd compression only.
+     * When background writes are started, training is queued to the writer thread and
+     * samples are copied: blocks written meanwhile are packed after it by that thread.
+     */
+    bool trainDictionary(const lUInt8* samples, const size_t* sampleSizes, int sampleCount);
 
     /// cleanup resources used by the compressor
     void cleanupCompressor();
@@ -178,10 +282,21 @@ public:
     bool setDOMVersion(lUInt32 domVersion);
     // flushes index
     bool flush(bool clearDirtyFlag, CRTimerUtil& maxTime);
+    /// moves all blocks to the start of file without gaps, then truncates the file
+    /**
+     * Blocks read on document opening (properties, node index, page list, TOC...) are placed first,
+     * in order of reading, other ones are ordered by type and index.
+     * When maxTime is expired, returns CR_TIMEOUT: file is consistent, next call continues compaction.
+     * Embedded images data blocks are not moved, as their streams read directly from file may be in use.
+     * File mapped for reading is not compacted.
+     */
+    ContinuousOperationResult compact(CRTimerUtil& maxTime);
     int roundSector(int n) {
         return (n + (_sectorSize - 1)) & ~(_sectorSize - 1);
     }
     void setAutoSyncSize(int sz) {
+        if (_async)
+            finishAsyncWrites();
         _stream->setAutoSyncSize(sz);
     }
     void setCachePath(const lString32 cachePath) {
@@ -190,6 +305,31 @@ public:
     const lString32 getCachePath() {
         return _cachePath;
     }
+
+    /// start background writing mode
+    /**
+     * write() and flush() only queue snapshot of data and return immediately,
+     * blocks are compressed by pool workers and written by separate I/O thread in order of queuing.
+     * Any other access to the file waits for queued writes and stops background writing mode.
+     * Requires concurrencyProvider.
+     */
+    bool startAsyncWrites(CRThreadPool* pool);
+    /// returns true if background writing mode is started
+    bool isAsyncWriting() const {
+        return _async != NULL;
+    }
+    /// call callback->OnCacheFileWritten() after all queued writes, by deliverAsyncNotifications() in background writing mode
+    void notifyAsyncWritten(LVDocViewCallback* callback);
+    /// call callbacks of notifications whose writes are already done on this thread, doesn't wait for pending ones
+    void deliverAsyncNotifications();
+    /// drop notifications not delivered yet, their callbacks are not called
+    void discardAsyncNotifications();
+    /// wait for all queued writes and stop background writing mode, returns false if any of them failed
+    bool finishAsyncWrites();
+    /// delete cache file object; if there are queued writes, object is deleted after finishing them
+    static void release(CacheFile* file);
+    /// wait for queued writes of all released cache files
+    static void waitReleased();
 };
 
 /// pass true to enable CRC check for
@@ -39,16 +39,26 @@ static const char COMPRESSED_ZSTD_CACHE_FILE_MAGIC[] = "CoolReader 3 Cache"
                                                        "mS"
                                                        "\n";
 
+// readers not supporting dictionaries don't accept file once blocks are packed with one
+static const char COMPRESSED_ZSTD_DICT_CACHE_FILE_MAGIC[] = "CoolReader 3 Cache"
+                                                            " File v" CACHE_FILE_FORMAT_VERSION ": "
+                                                            "c0"
+                                                            "mD"
+                                                            "\n";
+
 static const char UNCOMPRESSED_CACHE_FILE_MAGIC[] = "CoolReader 3 Cache"
                                                     " File v" CACHE_FILE_FORMAT_VERSION ": "
                                                     "c0"
                                                     "m0"
                                                     "\n";
 
-SimpleCacheFileHeader::SimpleCacheFileHeader(lUInt32 dirtyFlag, lUInt32 domVersion, CacheCompressionType comptype) {
+SimpleCacheFileHeader::SimpleCacheFileHeader(lUInt32 dirtyFlag, lUInt32 domVersion, CacheCompressionType comptype, bool compDict) {
     switch (comptype) {
         case CacheCompressionZSTD:
-            memcpy(_magic, COMPRESSED_ZSTD_CACHE_FILE_MAGIC, CACHE_FILE_MAGIC_SIZE);
+            if (compDict)
+                memcpy(_magic, COMPRESSED_ZSTD_DICT_CACHE_FILE_MAGIC, CACHE_FILE_MAGIC_SIZE);
+            else
+                memcpy(_magic, COMPRESSED_ZSTD_CACHE_FILE_MAGIC, CACHE_FILE_MAGIC_SIZE);
             break;
         case CacheCompressionZlib:
             memcpy(_magic, COMPRESSED_ZLIB_CACHE_FILE_MAGIC, CACHE_FILE_MAGIC_SIZE);
@@ -65,6 +75,8 @@ SimpleCacheFileHeader::SimpleCacheFileHeader(lUInt32 dirtyFlag, lUInt32 domVersi
 bool CacheFileHeader::validate(lUInt32 domVersionRequested) {
     bool comp_match = false;
     comp_match = memcmp(_magic, COMPRESSED_ZSTD_CACHE_FILE_MAGIC, CACHE_FILE_MAGIC_SIZE) == 0;
+    if (!comp_match)
+        comp_match = memcmp(_magic, COMPRESSED_ZSTD_DICT_CACHE_FILE_MAGIC, CACHE_FILE_MAGIC_SIZE) == 0;
     if (!comp_match)
         comp_match = memcmp(_magic, COMPRESSED_ZLIB_CACHE_FILE_MAGIC, CACHE_FILE_MAGIC_SIZE) == 0;
     if (!comp_match)
@@ -89,11 +101,17 @@ bool CacheFileHeader::validate(lUInt32 domVersionRequested) {
 CacheCompressionType CacheFileHeader::compressionType() {
     if (memcmp(_magic, COMPRESSED_ZSTD_CACHE_FILE_MAGIC, CACHE_FILE_MAGIC_SIZE) == 0)
         return CacheCompressionZSTD;
+    if (memcmp(_magic, COMPRESSED_ZSTD_DICT_CACHE_FILE_MAGIC, CACHE_FILE_MAGIC_SIZE) == 0)
+        return CacheCompressionZSTD;
     if (memcmp(_magic, COMPRESSED_ZLIB_CACHE_FILE_MAGIC, CACHE_FILE_MAGIC_SIZE) == 0)
         return CacheCompressionZlib;
     return CacheCompressionNone;
 }
 
+bool CacheFileHeader::hasCompressionDictionary() {
+    return memcmp(_magic, COMPRESSED_ZSTD_DICT_CACHE_FILE_MAGIC, CACHE_FILE_MAGIC_SIZE) == 0;
+}
+
 CacheFileHeader::CacheFileHeader()
         : SimpleCacheFileHeader(0, 0, CacheCompressionNone)
         , _fsize(0)
@@ -102,8 +120,8 @@ CacheFileHeader::CacheFileHeader()
     memset((void*)&_indexBlock, 0, sizeof(CacheFileItem));
 }
 
-CacheFileHeader::CacheFileHeader(CacheFileItem* indexRec, int fsize, lUInt32 dirtyFlag, lUInt32 domVersion, CacheCompressionType comptype)
-        : SimpleCacheFileHeader(dirtyFlag, domVersion, comptype)
+CacheFileHeader::CacheFileHeader(CacheFileItem* indexRec, int fsize, lUInt32 dirtyFlag, lUInt32 domVersion, CacheCompressionType comptype, bool compDict)
+        : SimpleCacheFileHeader(dirtyFlag, domVersion, comptype, compDict)
         , _padding(0)
         , _indexBlock(0, 0) {
     if (indexRec) {
@@ -35,7 +35,7 @@ struct SimpleCacheFileHeader
     char _magic[CACHE_FILE_MAGIC_SIZE] = { 0 }; // magic
     lUInt32 _dirty;
     lUInt32 _dom_version;
-    SimpleCacheFileHeader(lUInt32 dirtyFlag, lUInt32 domVersion, CacheCompressionType comptype);
+    SimpleCacheFileHeader(lUInt32 dirtyFlag, lUInt32 domVersion, CacheCompressionType comptype, bool compDict = false);
 };
 
 struct CacheFileHeader: public SimpleCacheFileHeader
@@ -48,8 +48,10 @@ struct CacheFileHeader: public SimpleCacheFileHeader
     // duplicate of one of index records which contains
     bool validate(lUInt32 domVersionRequested);
     CacheCompressionType compressionType();
+    /// returns true if some blocks are packed with compression dictionary stored in file
+    bool hasCompressionDictionary();
     CacheFileHeader();
-    CacheFileHeader(CacheFileItem* indexRec, int fsize, lUInt32 dirtyFlag, lUInt32 domVersion, CacheCompressionType comptype);
+    CacheFileHeader(CacheFileItem* indexRec, int fsize, lUInt32 dirtyFlag, lUInt32 domVersion, CacheCompressionType comptype, bool compDict = false);
 };
 
 #endif // __CACHEFILEHEADER_H_INCLUDED__
@@ -35,7 +35,7 @@ ldomBlobCache::ldomBlobCache()
 bool ldomBlobCache::loadIndex() {
     bool res;
     SerialBuf buf(0, true);
-    res = _cacheFile->read(CBT_BLOB_INDEX, buf);
+    res = _cacheFile->readInPlace(CBT_BLOB_INDEX, buf);
     if (!res) {
         _list.clear();
         return true; // missing blob index: treat as empty list of blobs
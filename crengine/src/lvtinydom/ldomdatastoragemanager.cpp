@@ -25,6 +25,7 @@
 #include <lvtinynodecollection.h>
 #include <lvstyles.h>
 #include <lvserialbuf.h>
+#include <ldommemorygovernor.h>
 #include <crlog.h>
 
 #include "lvtinydom_private.h"
@@ -85,7 +86,7 @@ bool ldomDataStorageManager::load() {
         return false;
     //load chunk index
     SerialBuf buf(0, true);
-    if (!_cache->read(cacheType(), 0xFFFF, buf)) {
+    if (!_cache->readInPlace(cacheType(), 0xFFFF, buf)) {
         CRLog::error("ldomDataStorageManager::load() - Cannot read chunk index");
         return false;
     }
@@ -109,6 +110,70 @@ bool ldomDataStorageManager::load() {
     return true;
 }
 
+/// returns number of chunks copied by saveCopy(), -1 if there is no copy
+int ldomDataStorageManager::getCopyChunkCount(lUInt16 type, lUInt16 firstIndex) {
+    if (!_cache->hasBlock(type, firstIndex))
+        return -1;
+    SerialBuf buf(0, true);
+    if (!_cache->readInPlace(type, firstIndex, buf))
+        return -1;
+    lUInt32 n = 0;
+    buf >> n;
+    if (buf.error() || n > 0xFFFF)
+        return -1;
+    return (int)n;
+}
+
+/// saves all chunks and copies them with chunk index to blocks of another type
+bool ldomDataStorageManager::saveCopy(lUInt16 type, lUInt16 firstIndex, int maxCount) {
+    if (!_cache || _chunks.length() + 1 > maxCount)
+        return false;
+    int oldCount = getCopyChunkCount(type, firstIndex);
+    CRTimerUtil infinite;
+    // writes chunk index as well
+    if (!save(infinite))
+        return false;
+    if (!_cache->copyBlock(cacheType(), 0xFFFF, type, firstIndex))
+        return false;
+    int n = _chunks.length();
+    for (int i = 0; i < n; i++) {
+        if (!_cache->copyBlock(cacheType(), (lUInt16)i, type, (lUInt16)(firstIndex + 1 + i)))
+            return false;
+    }
+    for (int i = n; i < oldCount; i++)
+        _cache->removeBlock(type, (lUInt16)(firstIndex + 1 + i));
+    return true;
+}
+
+/// replaces content by chunks copied by saveCopy()
+bool ldomDataStorageManager::loadCopy(lUInt16 type, lUInt16 firstIndex) {
+    if (!_cache)
+        return false;
+    int n = getCopyChunkCount(type, firstIndex);
+    bool res = n >= 0 && _cache->copyBlock(type, firstIndex, cacheType(), 0xFFFF);
+    for (int i = 0; i < n && res; i++)
+        res = _cache->copyBlock(type, (lUInt16)(firstIndex + 1 + i), cacheType(), (lUInt16)i);
+    if (res)
+        res = load();
+    if (!res) {
+        CRLog::error("ldomDataStorageManager::loadCopy() - cannot restore chunks of storage '%c'", _type);
+        _recentChunk = NULL;
+        _activeChunk = NULL;
+        _chunks.clear();
+    }
+    return res;
+}
+
+/// frees blocks copied by saveCopy()
+void ldomDataStorageManager::removeCopy(lUInt16 type, lUInt16 firstIndex) {
+    if (!_cache)
+        return;
+    int n = getCopyChunkCount(type, firstIndex);
+    for (int i = 0; i < n; i++)
+        _cache->removeBlock(type, (lUInt16)(firstIndex + 1 + i));
+    _cache->removeBlock(type, firstIndex);
+}
+
 /// get chunk pointer and update usage data
 ldomTextStorageChunk* ldomDataStorageManager::getChunk(lUInt32 address) {
     ldomTextStorageChunk* chunk = _chunks[address >> 16];
@@ -121,6 +186,7 @@ ldomTextStorageChunk* ldomDataStorageManager::getChunk(lUInt32 address) {
         if (((chunk->_nextRecent = _recentChunk)))
             _recentChunk->_prevRecent = chunk;
         _recentChunk = chunk;
+        chunk->_lastAccess = ldomMemoryGovernorImpl::nextTick();
     }
     chunk->ensureUnpacked();
     return chunk;
@@ -213,6 +279,30 @@ void ldomDataStorageManager::setRendRectData(lUInt32 elemDataIndex, const lvdomE
     chunk->setRaw(offsetIndex * sizeof(lvdomElementFormatRec), sizeof(lvdomElementFormatRec), (const lUInt8*)src);
 }
 
+ldomTextStorageChunk* ldomDataStorageManager::pinRendRectData(lUInt32 elemDataIndex, const lvdomElementFormatRec*& data) {
+    int index = elemDataIndex >> 4; // element sequential index
+    int chunkIndex = index >> RECT_DATA_CHUNK_ITEMS_SHIFT;
+    if (chunkIndex >= _chunks.length())
+        return NULL; // not allocated: no write here, unlike getRendRectData()
+    ldomTextStorageChunk* chunk = getChunk(chunkIndex << 16);
+    lUInt32 offset = (index & RECT_DATA_CHUNK_MASK) * sizeof(lvdomElementFormatRec);
+    if (!chunk->_buf || offset + sizeof(lvdomElementFormatRec) > chunk->_bufpos)
+        return NULL;
+    data = (const lvdomElementFormatRec*)(chunk->_buf + offset);
+    chunk->pin();
+    return chunk;
+}
+
+void ldomDataStorageManager::prefetchRendRectData(lUInt32 firstElemDataIndex, lUInt32 lastElemDataIndex) {
+    int firstChunk = (firstElemDataIndex >> 4) >> RECT_DATA_CHUNK_ITEMS_SHIFT;
+    int lastChunk = (lastElemDataIndex >> 4) >> RECT_DATA_CHUNK_ITEMS_SHIFT;
+    if (lastChunk >= _chunks.length())
+        lastChunk = _chunks.length() - 1;
+    // in reverse order: if they all don't fit in memory, chunks of start of range stay unpacked
+    for (int i = lastChunk; i >= firstChunk; i--)
+        getChunk(i << 16);
+}
+
 lUInt32 ldomDataStorageManager::allocText(lUInt32 dataIndex, lUInt32 parentIndex, const lString8& text) {
     if (!_activeChunk) {
         _activeChunk = new ldomTextStorageChunk(this, _chunks.length());
@@ -280,6 +370,14 @@ lString8 ldomDataStorageManager::getText(lUInt32 address) {
     return chunk->getText(address & 0xFFFF);
 }
 
+ldomTextStorageChunk* ldomDataStorageManager::pinText(lUInt32 address, const lChar8*& text, int& length) {
+    ldomTextStorageChunk* chunk = getChunk(address);
+    if (!chunk->getTextData(address & 0xFFFF, text, length))
+        return NULL;
+    chunk->pin();
+    return chunk;
+}
+
 /// get pointer to element data
 ElementDataStorageItem* ldomDataStorageManager::getElem(lUInt32 addr) {
     ldomTextStorageChunk* chunk = getChunk(addr);
@@ -293,6 +391,11 @@ lUInt32 ldomDataStorageManager::getParent(lUInt32 addr) {
 }
 
 void ldomDataStorageManager::compact(lUInt32 reservedSpace, const ldomTextStorageChunk* excludedChunk) {
+    if (ldomMemoryGovernor::getMemoryBudget()) {
+        // process-wide limit replaces per-storage ones
+        ldomMemoryGovernorImpl::compactStorage(this, reservedSpace, excludedChunk);
+        return;
+    }
     if (_uncompressedSize + reservedSpace > _maxUncompressedSize + _maxUncompressedSize / 10) { // allow +10% overflow
         if (!_maxSizeReachedWarned) {
             // Log once to stdout that we reached maxUncompressedSize, so we can know
@@ -325,6 +428,30 @@ void ldomDataStorageManager::compact(lUInt32 reservedSpace, const ldomTextStorag
     }
 }
 
+void ldomDataStorageManager::addDictionarySamples(LVArray<lUInt8>& samples, LVArray<size_t>& sampleSizes, lUInt32 pieceSize, lUInt32 maxSize) {
+    lUInt32 available = 0;
+    for (int i = 0; i < _chunks.length(); i++) {
+        if (_chunks[i]->_buf)
+            available += _chunks[i]->_bufpos;
+    }
+    if (!available || !maxSize)
+        return;
+    int step = available > maxSize ? available / maxSize + 1 : 1;
+    int n = 0;
+    for (int i = 0; i < _chunks.length(); i++) {
+        ldomTextStorageChunk* p = _chunks[i];
+        if (!p->_buf)
+            continue;
+        for (lUInt32 pos = 0; pos < p->_bufpos; pos += pieceSize) {
+            if (n++ % step)
+                continue;
+            lUInt32 size = p->_bufpos - pos < pieceSize ? p->_bufpos - pos : pieceSize;
+            samples.add(p->_buf + pos, size);
+            sampleSizes.add(size);
+        }
+    }
+}
+
 // max 512K of uncompressed data (~8 chunks)
 #define DEF_MAX_UNCOMPRESSED_SIZE 0x80000
 ldomDataStorageManager::ldomDataStorageManager(tinyNodeCollection* owner, char type, lUInt32 maxUnpackedSize, lUInt32 chunkSize)
@@ -337,7 +464,11 @@ ldomDataStorageManager::ldomDataStorageManager(tinyNodeCollection* owner, char t
         , _chunkSize(chunkSize)
         , _type(type)
         , _maxSizeReachedWarned(false) {
+    ldomMemoryGovernorImpl::registerStorage(this);
 }
 
 ldomDataStorageManager::~ldomDataStorageManager() {
+    ldomMemoryGovernorImpl::unregisterStorage(this);
+    // chunks account their memory in this storage
+    _chunks.clear();
 }
@@ -24,9 +24,12 @@
 #define __LDOMDATASTORAGEMANAGER_H_INCLUDED__
 
 #include <lvptrvec.h>
+#include <lvarray.h>
 #include <crtimerutil.h>
 #include <lvstring.h>
 
+#include "ldommemorygovernorimpl.h"
+
 class tinyNodeCollection;
 class ldomTextStorageChunk;
 class CacheFile;
@@ -38,6 +41,7 @@ class lvdomElementFormatRec;
 class ldomDataStorageManager
 {
     friend class ldomTextStorageChunk;
+    friend class ldomMemoryGovernorImpl;
 protected:
     tinyNodeCollection* _owner;
     LVPtrVector<ldomTextStorageChunk> _chunks;
@@ -50,6 +54,13 @@ protected:
     char _type; /// type, to show in log
     bool _maxSizeReachedWarned;
     ldomTextStorageChunk* getChunk(lUInt32 address);
+    /// returns number of chunks copied by saveCopy(), -1 if there is no copy
+    int getCopyChunkCount(lUInt16 type, lUInt16 firstIndex);
+    /// accounts change of unpacked chunks size
+    void addUncompressedSize(lInt32 delta) {
+        _uncompressedSize += delta;
+        ldomMemoryGovernorImpl::addUsedMemory(delta);
+    }
 public:
     /// type
     lUInt16 cacheType();
@@ -57,10 +68,20 @@ public:
     bool save(CRTimerUtil& maxTime);
     /// load chunk index from cache file
     bool load();
+    /// saves all chunks and copies them with chunk index to blocks of another type:
+    /// index is copied to block firstIndex, chunks follow it; fails if there are more than maxCount - 1 chunks
+    bool saveCopy(lUInt16 type, lUInt16 firstIndex, int maxCount);
+    /// replaces content by chunks copied by saveCopy(), storage is empty on failure
+    bool loadCopy(lUInt16 type, lUInt16 firstIndex);
+    /// frees blocks copied by saveCopy()
+    void removeCopy(lUInt16 type, lUInt16 firstIndex);
     /// sets cache file
     void setCache(CacheFile* cache);
     /// checks buffer sizes, compacts most unused chunks
     void compact(lUInt32 reservedSpace, const ldomTextStorageChunk* excludedChunk = NULL);
+    /// appends pieces of unpacked chunks to samples for training of cache file compression dictionary,
+    /// evenly distributed ones when there are more than maxSize bytes of them
+    void addDictionarySamples(LVArray<lUInt8>& samples, LVArray<size_t>& sampleSizes, lUInt32 pieceSize, lUInt32 maxSize);
     lUInt32 getUncompressedSize() {
         return _uncompressedSize;
     }
@@ -72,6 +93,9 @@ public:
     lString8 getText(lUInt32 address);
     /// get pointer to text data
     TextDataStorageItem* getTextItem(lUInt32 addr);
+    /// get pointer to utf8 text (w/o zero byte at end) by address and its length,
+    /// returns chunk kept unpacked until its unpin() is called, NULL if there is no such text
+    ldomTextStorageChunk* pinText(lUInt32 address, const lChar8*& text, int& length);
     /// get pointer to element data
     ElementDataStorageItem* getElem(lUInt32 addr);
     /// change node's parent, returns true if modified
@@ -91,6 +115,11 @@ public:
     void getRendRectData(lUInt32 elemDataIndex, lvdomElementFormatRec* dst);
     /// set rect data item
     void setRendRectData(lUInt32 elemDataIndex, const lvdomElementFormatRec* src);
+    /// get pointer to rect data item in place, returns chunk kept unpacked until its unpin() is called,
+    /// NULL if there is no space allocated for item yet
+    ldomTextStorageChunk* pinRendRectData(lUInt32 elemDataIndex, const lvdomElementFormatRec*& data);
+    /// unpacks chunks of rect data items of range of elements at once, before accessing them one by one
+    void prefetchRendRectData(lUInt32 firstElemDataIndex, lUInt32 lastElemDataIndex);
 
     /// get or allocate space for element style data item
     void getStyleData(lUInt32 elemDataIndex, ldomNodeStyleInfo* dst);
@@ -25,6 +25,7 @@
 #include <crlog.h>
 
 #include "ldomdoccacheimpl.h"
+#include "cachefile.h"
 
 static ldomDocCacheImpl* _cacheInstance = NULL;
 
@@ -42,6 +43,7 @@ bool ldomDocCache::init(lString32 cacheDir, lvsize_t maxSize) {
 }
 
 bool ldomDocCache::close() {
+    CacheFile::waitReleased();
     if (!_cacheInstance)
         return false;
     delete _cacheInstance;
@@ -53,6 +55,8 @@ bool ldomDocCache::close() {
 LVStreamRef ldomDocCache::openExisting(lString32 filename, lUInt32 crc, lUInt32 docFlags, lString32& cachePath) {
     if (!_cacheInstance)
         return LVStreamRef();
+    // cache file of recently closed document may be still written
+    CacheFile::waitReleased();
     return _cacheInstance->openExisting(filename, crc, docFlags, cachePath);
 }
 
@@ -60,13 +64,22 @@ LVStreamRef ldomDocCache::openExisting(lString32 filename, lUInt32 crc, lUInt32
 LVStreamRef ldomDocCache::createNew(lString32 filename, lUInt32 crc, lUInt32 docFlags, lUInt32 fileSize, lString32& cachePath) {
     if (!_cacheInstance)
         return LVStreamRef();
+    CacheFile::waitReleased();
     return _cacheInstance->createNew(filename, crc, docFlags, fileSize, cachePath);
 }
 
+/// update size of cache file and time spent to parse and render its document
+bool ldomDocCache::updateFileInfo(lString32 cachePath, lUInt32 size, lUInt32 buildTime) {
+    if (!_cacheInstance)
+        return false;
+    return _cacheInstance->updateFileInfo(cachePath, size, buildTime);
+}
+
 /// delete all cache files
 bool ldomDocCache::clear() {
     if (!_cacheInstance)
         return false;
+    CacheFile::waitReleased();
     return _cacheInstance->clear();
 }
 
@@ -26,11 +26,27 @@
 #include <lvserialbuf.h>
 #include <lvcontaineriteminfo.h>
 #include <crlog.h>
+#include <lvhashtable.h>
+#include <lvthread.h>
 
 #include <stdio.h>
+#include <string.h>
+
+#if !defined(__SYMBIAN32__) && defined(_WIN32)
+extern "C" {
+#include <windows.h>
+}
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include "lvtinydom_private.h"
 #include "../lvstream/lvstreambuffer.h"
+#include "../lvstream/lvnamedstream.h"
 
 //--------------------------------------------------------
 // cache memory sizes
@@ -46,62 +62,389 @@
 #define WRITE_CACHE_BLOCK_COUNT (WRITE_CACHE_TOTAL_SIZE / WRITE_CACHE_BLOCK_SIZE)
 #define TEST_BLOCK_STREAM       0
 
-static const char* doccache_magic = "CoolReader3 Document Cache Directory Index\nV1.00\n";
+static const char* doccache_magic = "CoolReader3 Document Cache Directory Index\nV1.01\n";
+// index without build times and priorities
+static const char* doccache_magic_v100 = "CoolReader3 Document Cache Directory Index\nV1.00\n";
+
+#define DOC_CACHE_INDEX_FILE_NAME "cr3cache.inx"
+#define DOC_CACHE_LOCK_FILE_NAME  "cr3cache.lock"
+
+// build time assumed for file of document never built in this cache (bytes of file per ms),
+// the same for all such files, so they are removed in order of use
+#define DOC_CACHE_UNKNOWN_BUILD_RATE 16384
+// max priority gain of file on single use
+#define DOC_CACHE_MAX_CREDIT 0x10000000
+// inflation value after which all priorities are decreased to avoid overflow
+#define DOC_CACHE_MAX_INFLATION 0x80000000
+
+// Windows locks are mandatory: byte range far beyond end of file is locked, so file data stay accessible
+#define DOC_CACHE_LOCK_OFFSET_LOW  0xFFFFFFF0
+#define DOC_CACHE_LOCK_OFFSET_HIGH 0x7FFFFFFF
+
+/// advisory shared or exclusive lock of file
+/**
+ * Lock belongs to open file, so it's not shared by two instances opening the same file in one process.
+ * Files locked by this process are registered, see isLockedByThisProcess().
+ */
+class ldomDocCacheFileLock
+{
+#ifdef _WIN32
+    HANDLE _handle;
+#else
+    int _fd;
+#endif
+    bool _locked;
+    lString32 _filename;
+    static LVMutex& ownLocksMutex() {
+        static LVMutex mutex;
+        return mutex;
+    }
+    /// number of locks held by this process for each file name
+    static LVHashTable<lString32, int>& ownLocks() {
+        static LVHashTable<lString32, int> locks(16);
+        return locks;
+    }
+    void setLocked(bool locked) {
+        if (locked == _locked)
+            return;
+        _locked = locked;
+        LVLock guard(ownLocksMutex());
+        int count = 0;
+        ownLocks().get(_filename, count);
+        count += locked ? 1 : -1;
+        if (count > 0)
+            ownLocks().set(_filename, count);
+        else
+            ownLocks().remove(_filename);
+    }
+public:
+    ldomDocCacheFileLock()
+#ifdef _WIN32
+            : _handle(INVALID_HANDLE_VALUE)
+#else
+            : _fd(-1)
+#endif
+            , _locked(false) {
+    }
+    /// returns true if file is locked by any instance in this process
+    static bool isLockedByThisProcess(const lString32& filename) {
+        LVLock guard(ownLocksMutex());
+        int count = 0;
+        return ownLocks().get(filename, count) && count > 0;
+    }
+    ~ldomDocCacheFileLock() {
+        close();
+    }
+    /// opens file to lock, creates it if necessary and create is true
+    bool open(const lString32& filename, bool create) {
+        close();
+        _filename = filename;
+#ifdef _WIN32
+        _handle = CreateFileW(UnicodeToUtf16(filename).c_str(), GENERIC_READ | GENERIC_WRITE,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                              create ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        return _handle != INVALID_HANDLE_VALUE;
+#else
+        _fd = ::open(UnicodeToLocal(filename).c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT : 0), (mode_t)0666);
+        return _fd != -1;
+#endif
+    }
+    /// locks open file, fails immediately if it's locked by other process and wait is false
+    bool lock(bool exclusive, bool wait) {
+#ifdef _WIN32
+        if (_handle == INVALID_HANDLE_VALUE)
+            return false;
+        // lock type cannot be changed, only new lock can be set
+        bool wasLocked = _locked;
+        unlock();
+        OVERLAPPED ov;
+        memset(&ov, 0, sizeof(ov));
+        ov.Offset = DOC_CACHE_LOCK_OFFSET_LOW;
+        ov.OffsetHigh = DOC_CACHE_LOCK_OFFSET_HIGH;
+        DWORD flags = (exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0) | (wait ? 0 : LOCKFILE_FAIL_IMMEDIATELY);
+        if (LockFileEx(_handle, flags, 0, 1, 0, &ov)) {
+            setLocked(true);
+        } else {
+            // failed conversion: shared lock released above is taken back, like flock() keeps it
+            if (wasLocked && exclusive)
+                setLocked(LockFileEx(_handle, LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0, &ov) != 0);
+            return false;
+        }
+#else
+        if (_fd == -1)
+            return false;
+        int op = (exclusive ? LOCK_EX : LOCK_SH) | (wait ? 0 : LOCK_NB);
+        int res;
+        while ((res = flock(_fd, op)) == -1 && errno == EINTR) { }
+        // failed conversion of existing lock may release it
+        if (res == -1 && _locked && exclusive)
+            setLocked(flock(_fd, LOCK_SH | LOCK_NB) == 0);
+        else
+            setLocked(res == 0);
+        if (res == -1)
+            return false;
+#endif
+        return _locked;
+    }
+    void unlock() {
+        if (!_locked)
+            return;
+#ifdef _WIN32
+        OVERLAPPED ov;
+        memset(&ov, 0, sizeof(ov));
+        ov.Offset = DOC_CACHE_LOCK_OFFSET_LOW;
+        ov.OffsetHigh = DOC_CACHE_LOCK_OFFSET_HIGH;
+        UnlockFileEx(_handle, 0, 1, 0, &ov);
+#else
+        flock(_fd, LOCK_UN);
+#endif
+        setLocked(false);
+    }
+    void close() {
+        unlock();
+#ifdef _WIN32
+        if (_handle != INVALID_HANDLE_VALUE)
+            CloseHandle(_handle);
+        _handle = INVALID_HANDLE_VALUE;
+#else
+        if (_fd != -1)
+            ::close(_fd);
+        _fd = -1;
+#endif
+    }
+};
+
+/// advisory exclusive lock of cache directory, held while index is reread, changed and written,
+/// and while cache files are opened, created or removed
+class ldomDocCacheLock
+{
+    ldomDocCacheFileLock _lock;
+public:
+    explicit ldomDocCacheLock(const lString32& cacheDir) {
+        if (!_lock.open(cacheDir + DOC_CACHE_LOCK_FILE_NAME, true) || !_lock.lock(true, true))
+            CRLog::warn("Cannot lock document cache directory, index is updated without lock");
+    }
+};
+
+/// cache file stream holding advisory lock of the file until it's closed
+/**
+ * Existing file is opened with shared lock, other processes may read it too. Lock is
+ * made exclusive on first write, if file is used by other process then, nothing is
+ * written to it at all, so file is kept consistent. Files locked by other processes
+ * are not removed from cache.
+ */
+class ldomDocCacheLockedStream: public LVNamedStream
+{
+    LVStreamRef _base;
+    ldomDocCacheFileLock* _lock;
+    bool _exclusive;
+    bool _writeFailed;
+    bool lockForWrite() {
+        if (!_exclusive && !_writeFailed) {
+            _exclusive = _lock->lock(true, false);
+            if (!_exclusive) {
+                CRLog::warn("Cache file %s is used by other process, changes are not saved", LCSTR(m_fname));
+                _writeFailed = true;
+            }
+        }
+        return _exclusive;
+    }
+public:
+    ldomDocCacheLockedStream(LVStreamRef base, ldomDocCacheFileLock* lock, bool exclusive)
+            : _base(base)
+            , _lock(lock)
+            , _exclusive(exclusive)
+            , _writeFailed(false) {
+        m_fname = base->GetName();
+        m_mode = base->GetMode();
+    }
+    virtual ~ldomDocCacheLockedStream() {
+        _base.Clear();
+        delete _lock;
+    }
+    virtual lverror_t Flush(bool sync) {
+        return _base->Flush(sync);
+    }
+    virtual lverror_t Flush(bool sync, CRTimerUtil& timeout) {
+        return _base->Flush(sync, timeout);
+    }
+    virtual lverror_t Seek(lvoffset_t offset, lvseek_origin_t origin, lvpos_t* pNewPos) {
+        return _base->Seek(offset, origin, pNewPos);
+    }
+    virtual lverror_t Tell(lvpos_t* pPos) {
+        return _base->Tell(pPos);
+    }
+    virtual lvpos_t SetPos(lvpos_t p) {
+        return _base->SetPos(p);
+    }
+    virtual lvpos_t GetPos() {
+        return _base->GetPos();
+    }
+    virtual lvsize_t GetSize() {
+        return _base->GetSize();
+    }
+    virtual lverror_t SetSize(lvsize_t size) {
+        if (!lockForWrite())
+            return LVERR_FAIL;
+        return _base->SetSize(size);
+    }
+    virtual lverror_t Read(void* buf, lvsize_t count, lvsize_t* nBytesRead) {
+        return _base->Read(buf, count, nBytesRead);
+    }
+    virtual lverror_t Write(const void* buf, lvsize_t count, lvsize_t* nBytesWritten) {
+        if (!lockForWrite()) {
+            if (nBytesWritten)
+                *nBytesWritten = 0;
+            return LVERR_FAIL;
+        }
+        return _base->Write(buf, count, nBytesWritten);
+    }
+    virtual bool Eof() {
+        return _base->Eof();
+    }
+};
+
+/// returns true if file is locked by this process or by other process
+static bool isCacheFileInUse(const lString32& pathname) {
+    // own locks are checked without opening the file: exclusive lock of new descriptor
+    // would fail for them, as if file were locked by other process
+    if (ldomDocCacheFileLock::isLockedByThisProcess(pathname))
+        return true;
+    ldomDocCacheFileLock lock;
+    if (!lock.open(pathname, false))
+        return false; // doesn't exist or cannot be locked anyway
+    return !lock.lock(true, false);
+}
+
+/// opens cache file holding its lock, with shared lock for existing file or exclusive lock for new one,
+/// returns NULL stream if file is in use
+static LVStreamRef openLockedCacheFile(const lString32& pathname, bool create) {
+    ldomDocCacheFileLock* lock = new ldomDocCacheFileLock();
+    if (!lock->open(pathname, create) || !lock->lock(create, false)) {
+        CRLog::warn("Cache file %s is in use", LCSTR(pathname));
+        delete lock;
+        return LVStreamRef();
+    }
+    LVStreamRef stream = LVOpenFileStream(pathname.c_str(), LVOM_APPEND | LVOM_FLAG_SYNC);
+    if (stream.isNull()) {
+        delete lock;
+        return stream;
+    }
+    return LVStreamRef(new ldomDocCacheLockedStream(stream, lock, create));
+}
 
 ldomDocCacheImpl::ldomDocCacheImpl(lString32 cacheDir, lvsize_t maxSize)
         : _cacheDir(cacheDir)
         , _maxSize(maxSize)
         , _oldStreamSize(0)
-        , _oldStreamCRC(0) {
+        , _oldStreamCRC(0)
+        , _inflation(0) {
+    memset(_indexStamp, 0, sizeof(_indexStamp));
     LVAppendPathDelimiter(_cacheDir);
     CRLog::trace("ldomDocCacheImpl(%s maxSize=%d)", LCSTR(_cacheDir), (int)maxSize);
 }
 
-bool ldomDocCacheImpl::writeIndex() {
-    lString32 filename = _cacheDir + "cr3cache.inx";
-    if (_oldStreamSize == 0) {
-        LVStreamRef oldStream = LVOpenFileStream(filename.c_str(), LVOM_READ);
-        if (!oldStream.isNull()) {
-            _oldStreamSize = (lUInt32)oldStream->GetSize();
-            _oldStreamCRC = (lUInt32)oldStream->getcrc32();
-        }
+/// reads modification time, size and file id of file, all zeros if file doesn't exist
+static void getFileStamp(const lString32& filename, lUInt64 stamp[3]) {
+    memset(stamp, 0, sizeof(lUInt64) * 3);
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (GetFileAttributesExW(UnicodeToUtf16(filename).c_str(), GetFileExInfoStandard, &data)) {
+        stamp[0] = ((lUInt64)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+        stamp[1] = ((lUInt64)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    }
+#else
+    struct stat st;
+    if (stat(UnicodeToLocal(filename).c_str(), &st) == 0) {
+#if defined(__linux__)
+        stamp[0] = (lUInt64)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#else
+        stamp[0] = (lUInt64)st.st_mtime;
+#endif
+        stamp[1] = (lUInt64)st.st_size;
+        // index is replaced by renaming, so it's a new file after each change
+        stamp[2] = (lUInt64)st.st_ino;
     }
+#endif
+}
+
+lUInt32 ldomDocCacheImpl::calcCredit(lUInt32 size, lUInt32 buildTime) {
+    if (!buildTime)
+        buildTime = size / DOC_CACHE_UNKNOWN_BUILD_RATE + 1;
+    lUInt64 credit = (lUInt64)buildTime * 1024 / (size / 1024 + 1);
+    return credit < DOC_CACHE_MAX_CREDIT ? (lUInt32)credit : DOC_CACHE_MAX_CREDIT;
+}
+
+void ldomDocCacheImpl::touch(FileItem* item) {
+    item->priority = _inflation + calcCredit(item->size, item->buildTime);
+}
+
+bool ldomDocCacheImpl::writeIndex() {
+    lString32 filename = _cacheDir + DOC_CACHE_INDEX_FILE_NAME;
 
     // fill buffer
     SerialBuf buf(16384, true);
     buf.putMagic(doccache_magic);
     lUInt32 start = buf.pos();
     int count = _files.length();
+    buf << _inflation;
     buf << (lUInt32)count;
     for (int i = 0; i < count && !buf.error(); i++) {
         FileItem* item = _files[i];
         buf << item->filename;
         buf << item->size;
-        CRLog::trace("cache item: %s %d", LCSTR(item->filename), (int)item->size);
+        buf << item->buildTime;
+        buf << item->priority;
+        CRLog::trace("cache item: %s %d %dms", LCSTR(item->filename), (int)item->size, (int)item->buildTime);
     }
+    // CRC of content with its own CRC32 appended is the same for any content of the same size
+    lUInt32 newCRC = buf.getCRC();
     buf.putCRC(buf.pos() - start);
     if (buf.error())
         return false;
-    lUInt32 newCRC = buf.getCRC();
     lUInt32 newSize = buf.pos();
 
     // check to avoid rewritting of identical file
     if (newCRC != _oldStreamCRC || newSize != _oldStreamSize) {
         // changed: need to write
+        // new index is written to temporary file which replaces old one,
+        // so it's never seen partially written by other process
         CRLog::trace("Writing cache index");
-        LVStreamRef stream = LVOpenFileStream(filename.c_str(), LVOM_WRITE);
-        if (!stream)
-            return false;
-        if (stream->Write(buf.buf(), buf.pos(), NULL) != LVERR_OK)
+        lString32 tmpFilename = filename + ".tmp";
+        {
+            LVStreamRef stream = LVOpenFileStream(tmpFilename.c_str(), LVOM_WRITE);
+            if (!stream)
+                return false;
+            if (stream->Write(buf.buf(), buf.pos(), NULL) != LVERR_OK || stream->Flush(true) != LVERR_OK) {
+                stream.Clear();
+                LVDeleteFile(tmpFilename);
+                return false;
+            }
+        }
+#ifdef _WIN32
+        // MoveFile() doesn't replace existing file, it's safe to remove it under lock
+        LVDeleteFile(filename);
+#endif
+        if (!LVRenameFile(tmpFilename, filename)) {
+            CRLog::error("Cannot replace cache index file");
+            LVDeleteFile(tmpFilename);
             return false;
+        }
         _oldStreamCRC = newCRC;
         _oldStreamSize = newSize;
+        getFileStamp(filename, _indexStamp);
     }
     return true;
 }
 
 bool ldomDocCacheImpl::readIndex() {
-    lString32 filename = _cacheDir + "cr3cache.inx";
+    lString32 filename = _cacheDir + DOC_CACHE_INDEX_FILE_NAME;
+    // index may be changed by other process since last reading
+    getFileStamp(filename, _indexStamp);
+    _files.clear();
+    _inflation = 0;
+    _oldStreamSize = 0;
+    _oldStreamCRC = 0;
     // read index
     lUInt32 totalSize = 0;
     LVStreamRef instream = LVOpenFileStream(filename.c_str(), LVOM_READ);
@@ -109,32 +452,51 @@ bool ldomDocCacheImpl::readIndex() {
         LVStreamBufferRef sb = instream->GetReadBuffer(0, instream->GetSize());
         if (!sb)
             return false;
+        int v100MagicLen = (int)strlen(doccache_magic_v100);
+        bool v100 = (int)sb->getSize() >= v100MagicLen && !memcmp(sb->getReadOnly(), doccache_magic_v100, v100MagicLen);
         SerialBuf buf(sb->getReadOnly(), sb->getSize());
-        if (!buf.checkMagic(doccache_magic)) {
+        if (!buf.checkMagic(v100 ? doccache_magic_v100 : doccache_magic)) {
             CRLog::error("wrong cache index file format");
             return false;
         }
 
         lUInt32 start = buf.pos();
         lUInt32 count;
+        if (!v100)
+            buf >> _inflation;
         buf >> count;
         for (lUInt32 i = 0; i < count && !buf.error(); i++) {
             FileItem* item = new FileItem();
             _files.add(item);
             buf >> item->filename;
             buf >> item->size;
+            if (v100) {
+                item->buildTime = 0;
+                touch(item);
+            } else {
+                buf >> item->buildTime;
+                buf >> item->priority;
+            }
             CRLog::trace("cache %d: %s [%d]", i, UnicodeToUtf8(item->filename).c_str(), (int)item->size);
             totalSize += item->size;
         }
+        lUInt32 contentCRC = buf.getCRC();
         if (!buf.checkCRC(buf.pos() - start)) {
             CRLog::error("CRC32 doesn't match in cache index file");
+            _files.clear();
             return false;
         }
 
-        if (buf.error())
+        if (buf.error()) {
+            _files.clear();
             return false;
+        }
+        if (!v100) {
+            _oldStreamSize = buf.pos();
+            _oldStreamCRC = contentCRC;
+        }
 
-        CRLog::info("Document cache index file read ok, %d files in cache, %d bytes", _files.length(), totalSize);
+        CRLog::debug("Document cache index file read ok, %d files in cache, %d bytes", _files.length(), totalSize);
         return true;
     } else {
         CRLog::error("Document cache index file cannot be read");
@@ -142,6 +504,14 @@ bool ldomDocCacheImpl::readIndex() {
     }
 }
 
+bool ldomDocCacheImpl::refreshIndex() {
+    lUInt64 stamp[3];
+    getFileStamp(_cacheDir + DOC_CACHE_INDEX_FILE_NAME, stamp);
+    if (stamp[1] != 0 && !memcmp(stamp, _indexStamp, sizeof(stamp)))
+        return true;
+    return readIndex();
+}
+
 bool ldomDocCacheImpl::removeExtraFiles() {
     LVContainerRef container;
     container = LVOpenDirectory(_cacheDir.c_str(), U"*.cr3");
@@ -162,7 +532,7 @@ bool ldomDocCacheImpl::removeExtraFiles() {
             lString32 fn = item->GetName();
             if (!fn.endsWith(".cr3"))
                 continue;
-            if (findFileIndex(fn) < 0) {
+            if (findFileIndex(fn) < 0 && !isCacheFileInUse(_cacheDir + fn)) {
                 // delete file
                 CRLog::info("Removing cache file not specified in index: %s", UnicodeToUtf8(fn).c_str());
                 if (!LVDeleteFile(_cacheDir + fn)) {
@@ -176,28 +546,55 @@ bool ldomDocCacheImpl::removeExtraFiles() {
 
 bool ldomDocCacheImpl::reserve(lvsize_t allocSize) {
     bool res = true;
-    // remove extra files specified in list
     lvsize_t dirsize = allocSize;
     for (int i = 0; i < _files.length();) {
         if (LVFileExists(_cacheDir + _files[i]->filename)) {
-            if ((i > 0 || allocSize > 0) && dirsize + _files[i]->size > _maxSize) {
-                if (LVDeleteFile(_cacheDir + _files[i]->filename)) {
-                    _files.erase(i, 1);
-                } else {
-                    CRLog::error("Cannot delete cache file %s", UnicodeToUtf8(_files[i]->filename).c_str());
-                    dirsize += _files[i]->size;
-                    res = false;
-                    i++;
-                }
-            } else {
-                dirsize += _files[i]->size;
-                i++;
-            }
+            dirsize += _files[i]->size;
+            i++;
         } else {
             CRLog::error("File %s is found in cache index, but does not exist", UnicodeToUtf8(_files[i]->filename).c_str());
             _files.erase(i, 1);
         }
     }
+    if (dirsize <= _maxSize)
+        return true;
+    // remove files with lowest priority, less recently used first if equal,
+    // most recently used one is kept unless space is needed for new file
+    LVArray<int> candidates;
+    for (int i = allocSize > 0 ? 0 : 1; i < _files.length(); i++) {
+        int pos = candidates.length();
+        while (pos > 0 && _files[candidates[pos - 1]]->priority >= _files[i]->priority)
+            pos--;
+        candidates.insert(pos, i);
+    }
+    LVArray<bool> removed(_files.length(), false);
+    for (int i = 0; i < candidates.length() && dirsize > _maxSize; i++) {
+        FileItem* item = _files[candidates[i]];
+        if (isCacheFileInUse(_cacheDir + item->filename)) {
+            CRLog::debug("Cache file %s is in use, not removed", UnicodeToUtf8(item->filename).c_str());
+            continue;
+        }
+        if (item->priority > _inflation)
+            _inflation = item->priority;
+        if (LVDeleteFile(_cacheDir + item->filename)) {
+            CRLog::debug("Removing cache file %s, priority %u", UnicodeToUtf8(item->filename).c_str(), item->priority);
+            dirsize -= item->size;
+            removed[candidates[i]] = true;
+        } else {
+            // may be still open by other process on some platforms
+            CRLog::error("Cannot delete cache file %s", UnicodeToUtf8(item->filename).c_str());
+            res = false;
+        }
+    }
+    for (int i = _files.length() - 1; i >= 0; i--) {
+        if (removed[i])
+            _files.erase(i, 1);
+    }
+    if (_inflation >= DOC_CACHE_MAX_INFLATION) {
+        for (int i = 0; i < _files.length(); i++)
+            _files[i]->priority = _files[i]->priority > _inflation ? _files[i]->priority - _inflation : 0;
+        _inflation = 0;
+    }
     return res;
 }
 
@@ -215,26 +612,42 @@ bool ldomDocCacheImpl::moveFileToTop(lString32 filename, lUInt32 size) {
         FileItem* item = new FileItem();
         item->filename = filename;
         item->size = size;
+        item->buildTime = 0;
         _files.insert(0, item);
     } else {
         _files.move(0, index);
         _files[0]->size = size;
     }
+    touch(_files[0]);
+    return writeIndex();
+}
+
+bool ldomDocCacheImpl::setFileInfo(lString32 filename, lUInt32 size, lUInt32 buildTime) {
+    int index = findFileIndex(filename);
+    if (index < 0)
+        return false; // removed or not maintained in index
+    FileItem* item = _files[index];
+    item->size = size;
+    // document opened from cache file is built faster than it was parsed first
+    if (buildTime > item->buildTime)
+        item->buildTime = buildTime;
+    touch(item);
     return writeIndex();
 }
 
 bool ldomDocCacheImpl::init() {
     CRLog::info("Initialize document cache in directory %s", UnicodeToUtf8(_cacheDir).c_str());
+    if (!LVCreateDirectory(_cacheDir)) {
+        CRLog::error("Document Cache: cannot create cache directory %s, disabling cache", UnicodeToUtf8(_cacheDir).c_str());
+        return false;
+    }
+    ldomDocCacheLock lock(_cacheDir);
     // read index
     if (readIndex()) {
         // read successfully
         // remove files not specified in list
         removeExtraFiles();
     } else {
-        if (!LVCreateDirectory(_cacheDir)) {
-            CRLog::error("Document Cache: cannot create cache directory %s, disabling cache", UnicodeToUtf8(_cacheDir).c_str());
-            return false;
-        }
         _files.clear();
     }
     reserve(0);
@@ -244,9 +657,15 @@ bool ldomDocCacheImpl::init() {
 }
 
 bool ldomDocCacheImpl::clear() {
-    for (int i = 0; i < _files.length(); i++)
-        LVDeleteFile(_cacheDir + _files[i]->filename);
-    _files.clear();
+    ldomDocCacheLock lock(_cacheDir);
+    refreshIndex();
+    // files used right now are kept
+    for (int i = _files.length() - 1; i >= 0; i--) {
+        if (!isCacheFileInUse(_cacheDir + _files[i]->filename) && LVDeleteFile(_cacheDir + _files[i]->filename))
+            _files.erase(i, 1);
+    }
+    if (_files.empty())
+        _inflation = 0;
     return writeIndex();
 }
 
@@ -289,7 +708,7 @@ LVStreamRef ldomDocCacheImpl::openExisting(lString32 filename, lUInt32 crc, lUIn
     // to not be deleted by crengine)
     lString32 fn_keep = _cacheDir + fn + ".keep";
     if (LVFileExists(fn_keep)) {
-        LVStreamRef stream = LVOpenFileStream(fn_keep.c_str(), LVOM_APPEND | LVOM_FLAG_SYNC);
+        LVStreamRef stream = openLockedCacheFile(fn_keep, false);
         if (!stream.isNull()) {
             CRLog::info("ldomDocCache::openExisting - opening user renamed cache file %s", UnicodeToUtf8(fn_keep).c_str());
             cachePath = fn_keep;
@@ -300,12 +719,14 @@ LVStreamRef ldomDocCacheImpl::openExisting(lString32 filename, lUInt32 crc, lUIn
         }
     }
     LVStreamRef res;
+    ldomDocCacheLock lock(_cacheDir);
+    refreshIndex();
     if (findFileIndex(fn) < 0) {
         CRLog::error("ldomDocCache::openExisting - File %s is not found in cache index", UnicodeToUtf8(fn).c_str());
         return res;
     }
     lString32 pathname = _cacheDir + fn;
-    res = LVOpenFileStream(pathname.c_str(), LVOM_APPEND | LVOM_FLAG_SYNC);
+    res = openLockedCacheFile(pathname, false);
     if (!res) {
         CRLog::error("ldomDocCache::openExisting - File %s is listed in cache index, but cannot be opened", UnicodeToUtf8(fn).c_str());
         return res;
@@ -341,9 +762,12 @@ LVStreamRef ldomDocCacheImpl::createNew(lString32 filename, lUInt32 crc, lUInt32
     // so it stays (as wished by the user) not maintained by crengine.
     lString32 fn_keep = pathname + ".keep";
     if (LVFileExists(fn_keep)) {
+        ldomDocCacheLock lock(_cacheDir);
+        if (isCacheFileInUse(pathname) || isCacheFileInUse(fn_keep))
+            return LVStreamRef();
         LVDeleteFile(pathname); // delete .cr3 if any
         LVDeleteFile(fn_keep);  // delete invalid .cr3.keep
-        LVStreamRef stream = LVOpenFileStream(fn_keep.c_str(), LVOM_APPEND | LVOM_FLAG_SYNC);
+        LVStreamRef stream = openLockedCacheFile(fn_keep, true);
         if (!stream.isNull()) {
             CRLog::info("ldomDocCache::createNew - re-creating user renamed cache file %s", UnicodeToUtf8(fn_keep).c_str());
             cachePath = fn_keep;
@@ -353,12 +777,17 @@ LVStreamRef ldomDocCacheImpl::createNew(lString32 filename, lUInt32 crc, lUInt32
             return stream;
         }
     }
-    if (findFileIndex(pathname) >= 0)
-        LVDeleteFile(pathname);
+    ldomDocCacheLock lock(_cacheDir);
+    refreshIndex();
+    // old file may be still read by other process
+    if (isCacheFileInUse(pathname)) {
+        CRLog::warn("ldomDocCache::createNew - file %s is in use", UnicodeToUtf8(fn).c_str());
+        return res;
+    }
     reserve(fileSize / 10);
     //res = LVMapFileStream( (_cacheDir+fn).c_str(), LVOM_APPEND, fileSize );
     LVDeleteFile(pathname); // try to delete, ignore errors
-    res = LVOpenFileStream(pathname.c_str(), LVOM_APPEND | LVOM_FLAG_SYNC);
+    res = openLockedCacheFile(pathname, true);
     if (!res) {
         CRLog::error("ldomDocCache::createNew - file %s is cannot be created", UnicodeToUtf8(fn).c_str());
         return res;
@@ -378,3 +807,11 @@ LVStreamRef ldomDocCacheImpl::createNew(lString32 filename, lUInt32 crc, lUInt32
     moveFileToTop(fn, fileSize);
     return res;
 }
+
+bool ldomDocCacheImpl::updateFileInfo(lString32 cachePath, lUInt32 size, lUInt32 buildTime) {
+    if (!cachePath.startsWith(_cacheDir))
+        return false;
+    ldomDocCacheLock lock(_cacheDir);
+    refreshIndex();
+    return setFileInfo(cachePath.substr(_cacheDir.length()), size, buildTime);
+}
@@ -26,19 +26,43 @@
 #include <lvptrvec.h>
 
 /// document cache
+/**
+ * Files are removed by their priority (GreedyDual-Size): priority of file is set
+ * to current inflation value plus its credit (time spent to build its content per
+ * kilobyte of file) when it's used, file with lowest priority is removed first,
+ * and inflation value is raised to its priority. So files of documents expensive
+ * to parse and render stay in cache longer than cheap ones of the same size,
+ * and files not used for a long time are removed anyway.
+ *
+ * Several processes may share cache directory: index is reread when changed
+ * and updated under advisory lock of cr3cache.lock file, and is replaced
+ * atomically. Each open cache file holds its own advisory lock, shared for
+ * reading and exclusive for writing, and files locked by other processes are
+ * neither removed nor overwritten.
+ */
 class ldomDocCacheImpl: public ldomDocCache
 {
     lString32 _cacheDir;
     lvsize_t _maxSize;
     lUInt32 _oldStreamSize;
     lUInt32 _oldStreamCRC;
+    lUInt32 _inflation;
+    // modification time, size and file id of index file when it was last read or written
+    lUInt64 _indexStamp[3];
 
     struct FileItem
     {
         lString32 filename;
         lUInt32 size;
+        lUInt32 buildTime; // milliseconds spent to parse and render document, 0 if unknown
+        lUInt32 priority;
     };
     LVPtrVector<FileItem> _files;
+
+    /// returns priority gain of file on use
+    static lUInt32 calcCredit(lUInt32 size, lUInt32 buildTime);
+    /// sets priority of file as used right now
+    void touch(FileItem* item);
 public:
     ldomDocCacheImpl(lString32 cacheDir, lvsize_t maxSize);
 
@@ -46,6 +70,9 @@ public:
 
     bool readIndex();
 
+    /// rereads index if it's changed by other process since last reading or writing
+    bool refreshIndex();
+
     /// remove all .cr3 files which are not listed in index
     bool removeExtraFiles();
 
@@ -56,6 +83,9 @@ public:
 
     bool moveFileToTop(lString32 filename, lUInt32 size);
 
+    /// sets size of cache file and time spent to build document, called with locked index
+    bool setFileInfo(lString32 filename, lUInt32 size, lUInt32 buildTime);
+
     bool init();
 
     /// remove all files
@@ -70,6 +100,9 @@ public:
     /// create new cache file
     LVStreamRef createNew(lString32 filename, lUInt32 crc, lUInt32 docFlags, lUInt32 fileSize, lString32& cachePath);
 
+    /// update size and build time of cache file
+    bool updateFileInfo(lString32 cachePath, lUInt32 size, lUInt32 buildTime);
+
     virtual ~ldomDocCacheImpl() {
     }
 };
@@ -37,15 +37,19 @@
 #include <lvdocviewcallback.h>
 #include <lvdocviewprops.h>
 #include <crlog.h>
+#include <crconcurrent.h>
+#include <ldomdoccache.h>
 
 #include "lxmlattribute.h"
 #include "lvimportstylesheetparser.h"
 #include "renderrectaccessor.h"
+#include "ldomparallelformatter.h"
 #include "ldomnodeidpredicate.h"
 #include "cachefile.h"
 #include "ldomdatastoragemanager.h"
 #include "lvtinydom_private.h"
 #include "ldomblobcache.h"
+#include "ldomrendervariants.h"
 #include "../lvstream/lvbase64stream.h"
 #include "../textlang.h"
 
@@ -184,6 +188,12 @@ ldomDocument::ldomDocument()
         , _warnings_seen_bitmap(0)
         , _doc_rendering_hash(0)
         , _open_from_cache(false)
+        , _parallelFormatting(false)
+        , _parallelFormatter(NULL)
+        , _asyncCacheWrites(false)
+        , _parseTime(0)
+        , _renderTime(0)
+        , _styledDefaultsHash(0)
         , lists(100) {
     _docIndex = ldomNode::registerDocument(this);
     ldomNode* node = allocTinyElement(NULL, 0, 0);
@@ -203,6 +213,12 @@ ldomDocument::ldomDocument(ldomDocument& doc)
         , _last_docflags(doc._last_docflags)
         , _page_height(doc._page_height)
         , _page_width(doc._page_width)
+        , _parallelFormatting(doc._parallelFormatting)
+        , _parallelFormatter(NULL)
+        , _asyncCacheWrites(doc._asyncCacheWrites)
+        , _parseTime(0)
+        , _renderTime(0)
+        , _styledDefaultsHash(0)
         , _container(doc._container)
         , lists(100) {
     _docIndex = ldomNode::registerDocument(this);
@@ -454,6 +470,40 @@ void ldomDocument::applyDocumentStyleSheet() {
     }
 }
 
+// Above this number of changed selectors, checking them all against each
+// node would not be much faster than initializing all node styles again
+#define MAX_CHANGED_SELECTORS_TO_UPDATE 256
+
+int ldomDocument::updateChangedStyles(LVDocViewCallback* callback) {
+    if (_styledStylesheet.isNull() || getRootNode()->getFont().isNull())
+        return -1;
+    // Node styles depend on more than stylesheet, which must be the only change
+    lUInt32 defaultsHash = calcHash(_def_style) * 31 + calcHash(_def_font);
+    if (defaultsHash != _styledDefaultsHash || calcStyleHash(_rendered) != _hdr.render_style_hash ||
+        _docFlags != _hdr.render_docflags || _page_width != (int)_hdr.render_dx || _page_height != (int)_hdr.render_dy)
+        return -1;
+    _stylesheet.push();
+    applyDocumentStyleSheet();
+    // Node styles can only change when matched by selectors added or removed,
+    // or when inheriting from a node whose style changed
+    LVArray<LVCssSelector*> changed;
+    int changedCount = -1;
+    if (!_stylesheet.getChangedSelectors(*_styledStylesheet, changed)) {
+        CRLog::info("updateChangedStyles: order of stylesheet selectors changed");
+    } else if (changed.length() > MAX_CHANGED_SELECTORS_TO_UPDATE) {
+        CRLog::info("updateChangedStyles: too many stylesheet selectors changed (%d)", changed.length());
+    } else {
+        TextLangMan::resetCounters();
+        changedCount = getRootNode()->updateNodeStyleRecursive(changed, callback);
+        CRLog::info("updateChangedStyles: %d selectors changed, %d node styles changed", changed.length(), changedCount);
+        _styledStylesheet = new LVStyleSheet(_stylesheet);
+        if (changedCount > 0)
+            resetNodeNumberingProps();
+    }
+    _stylesheet.pop();
+    return changedCount;
+}
+
 bool ldomDocument::parseStyleSheet(lString32 codeBase, lString32 css) {
     LVImportStylesheetParser parser(this);
     return parser.Parse(codeBase, css);
@@ -468,6 +518,8 @@ bool ldomDocument::render(LVRendPageList* pages, LVDocViewCallback* callback, in
                           bool showCover, int y0, font_ref_t def_font, int def_interline_space,
                           CRPropRef props, int usable_left_overflow, int usable_right_overflow) {
     CRLog::info("Render is called for width %d, pageHeight=%d, fontFace=%s, docFlags=%d", width, dy, def_font->getTypeFace().c_str(), getDocFlags());
+    // nodes are accessed by paragraphs formatted ahead and by progress callbacks
+    ldomUseGuard use(this);
     CRLog::trace("initializing default style...");
     //persist();
     //    {
@@ -476,6 +528,7 @@ bool ldomDocument::render(LVRendPageList* pages, LVDocViewCallback* callback, in
     //        CRLog::debug("Style hash before setRenderProps: %x", styleHash);
     //    } //bool propsChanged =
     setRenderProps(width, dy, showCover, y0, def_font, def_interline_space, props);
+    lUInt32 variantKey = _maxRenderVariants > 0 ? calcRenderVariantKey(showCover, y0, usable_left_overflow, usable_right_overflow) : 0;
 
     // update styles
     //    if ( getRootNode()->getStyle().isNull() || getRootNode()->getFont().isNull()
@@ -487,67 +540,102 @@ bool ldomDocument::render(LVRendPageList* pages, LVDocViewCallback* callback, in
     //        CRLog::trace("reusing existing format data...");
     //    }
 
+    CRTimerUtil renderTimer;
     bool was_just_rendered_from_cache = _just_rendered_from_cache; // cleared by checkRenderContext()
     if (!checkRenderContext()) {
+        if (variantKey && !getRootNode()->getFont().isNull()) {
+            // keep current rendering in cache file, reuse kept one of new render context if there is one
+            if (_rendered)
+                saveRenderVariant();
+            if (restoreRenderVariant(variantKey, pages)) {
+                _renderVariants->setCurrentKey(variantKey);
+                _renderVariants->save();
+                updateTraversalIndex();
+                if (callback)
+                    callback->OnDocumentReady();
+                return true; // rendering is changed
+            }
+        }
         if (_nodeDisplayStyleHashInitial == NODE_DISPLAY_STYLE_HASH_UNINITIALIZED) { // happen when just loaded
             // For knowing/debugging cases when node styles set up during loading
             // is invalid (should happen now only when EPUB has embedded fonts
             // or some pseudoclass like :last-child has been met).
             CRLog::warn("CRE: styles re-init needed after load, re-rendering\n");
         }
-        CRLog::info("rendering context is changed - full render required...");
-        // Clear LFormattedTextRef cache
-        _renderedBlockCache.clear();
-        CRLog::trace("init format data...");
-        //CRLog::trace("validate 1...");
-        //validateDocument();
-        CRLog::trace("Dropping existing styles...");
-        //CRLog::debug( "root style before drop style %d", getNodeStyleIndex(getRootNode()->getDataIndex()));
-        dropStyles();
-        //CRLog::debug( "root style after drop style %d", getNodeStyleIndex(getRootNode()->getDataIndex()));
-
-        // After having dropped styles, which should have dropped most references
-        // to fonts instances, we want to drop these fonts instances.
-        // Mostly because some fallback fonts, possibly synthetized (fake bold and
-        // italic) may have been instantiated in the late phase of text rendering.
-        // We don't want such instances to be used for styles as it could cause some
-        // cache check issues (perpetual "style hash mismatch", as these synthetised
-        // fonts would not yet be there when loading from cache).
-        // We need 2 gc() for a complete cleanup. The performance impact of
-        // reinstantiating the fonts is minimal.
-        gc(); // drop font instances that were only referenced by dropped styles
-        gc(); // drop fallback font instances that were only referenced by dropped fonts
-
-        //ldomNode * root = getRootNode();
-        //css_style_ref_t roots = root->getStyle();
-        //CRLog::trace("validate 2...");
-        //validateDocument();
-
-        // Reset counters (quotes nesting levels...)
-        TextLangMan::resetCounters();
-
-        CRLog::trace("Save stylesheet...");
-        _stylesheet.push();
-        CRLog::trace("Init node styles...");
-        applyDocumentStyleSheet();
-        getRootNode()->initNodeStyleRecursive(callback);
-        CRLog::trace("Restoring stylesheet...");
-        _stylesheet.pop();
-
-        CRLog::trace("init render method...");
-        getRootNode()->initNodeRendMethodRecursive();
-
-        //        getRootNode()->setFont( _def_font );
-        //        getRootNode()->setStyle( _def_style );
-        updateRenderContext();
-
-        // DEBUG dump of render methods
-        //dumpRendMethods( getRootNode(), cs32(" - ") );
-        //        lUInt32 styleHash = calcStyleHash();
-        //        styleHash = styleHash * 31 + calcGlobalSettingsHash();
-        //        CRLog::debug("Style hash: %x", styleHash);
-
-        _rendered = false;
+        int changedStyles = updateChangedStyles(callback);
+        if (changedStyles == 0 && _rendered) {
+            // Nodes matched by changed selectors kept their styles: current rendering is still valid
+            CRLog::info("rendering context is changed - no node style changed, no render!");
+            updateRenderContext();
+            setCacheFileStale(true); // render context in cache file will be updated
+            if (variantKey)
+                _renderVariants->setCurrentKey(variantKey);
+        } else if (changedStyles >= 0) {
+            // Layout is not incremental: blocks are formatted and pages split again from the start
+            CRLog::info("rendering context is changed - %d node styles changed, render required...", changedStyles);
+            _renderedBlockCache.clear();
+            CRLog::trace("init render method...");
+            getRootNode()->initNodeRendMethodRecursive();
+            updateRenderContext();
+            _rendered = false;
+        } else {
+            CRLog::info("rendering context is changed - full render required...");
+            // Clear LFormattedTextRef cache
+            _renderedBlockCache.clear();
+            CRLog::trace("init format data...");
+            //CRLog::trace("validate 1...");
+            //validateDocument();
+            CRLog::trace("Dropping existing styles...");
+            //CRLog::debug( "root style before drop style %d", getNodeStyleIndex(getRootNode()->getDataIndex()));
+            dropStyles();
+            //CRLog::debug( "root style after drop style %d", getNodeStyleIndex(getRootNode()->getDataIndex()));
+
+            // After having dropped styles, which should have dropped most references
+            // to fonts instances, we want to drop these fonts instances.
+            // Mostly because some fallback fonts, possibly synthetized (fake bold and
+            // italic) may have been instantiated in the late phase of text rendering.
+            // We don't want such instances to be used for styles as it could cause some
+            // cache check issues (perpetual "style hash mismatch", as these synthetised
+            // fonts would not yet be there when loading from cache).
+            // We need 2 gc() for a complete cleanup. The performance impact of
+            // reinstantiating the fonts is minimal.
+            gc(); // drop font instances that were only referenced by dropped styles
+            gc(); // drop fallback font instances that were only referenced by dropped fonts
+
+            //ldomNode * root = getRootNode();
+            //css_style_ref_t roots = root->getStyle();
+            //CRLog::trace("validate 2...");
+            //validateDocument();
+
+            // Reset counters (quotes nesting levels...)
+            TextLangMan::resetCounters();
+
+            CRLog::trace("Save stylesheet...");
+            _stylesheet.push();
+            CRLog::trace("Init node styles...");
+            applyDocumentStyleSheet();
+            getRootNode()->initNodeStyleRecursive(callback);
+            // Keep stylesheet to only update styles of nodes it changes on next change (see updateChangedStyles())
+            _styledStylesheet = new LVStyleSheet(_stylesheet);
+            _styledDefaultsHash = calcHash(_def_style) * 31 + calcHash(_def_font);
+            CRLog::trace("Restoring stylesheet...");
+            _stylesheet.pop();
+
+            CRLog::trace("init render method...");
+            getRootNode()->initNodeRendMethodRecursive();
+
+            //        getRootNode()->setFont( _def_font );
+            //        getRootNode()->setStyle( _def_style );
+            updateRenderContext();
+
+            // DEBUG dump of render methods
+            //dumpRendMethods( getRootNode(), cs32(" - ") );
+            //        lUInt32 styleHash = calcStyleHash();
+            //        styleHash = styleHash * 31 + calcGlobalSettingsHash();
+            //        CRLog::debug("Style hash: %x", styleHash);
+
+            _rendered = false;
+        }
     }
     if (!_rendered) {
         if (callback) {
@@ -569,7 +657,14 @@ bool ldomDocument::render(LVRendPageList* pages, LVDocViewCallback* callback, in
         context.setCallback(callback, numFinalBlocks);
         //updateStyles();
         CRLog::trace("rendering...");
+        CRThreadPool* pool = _parallelFormatting ? CRGetSharedThreadPool() : NULL;
+        if (pool && pool->getThreadCount() > 0 && !getDocFlag(DOC_FLAG_FOOTNOTES_INLINE) && !getDocFlag(DOC_FLAG_FOOTNOTES_INLINE_BLOCK))
+            _parallelFormatter = new ldomParallelFormatter(this, pool);
         renderBlockElement(context, getRootNode(), 0, y0, width, usable_left_overflow, usable_right_overflow);
+        if (_parallelFormatter) {
+            delete _parallelFormatter;
+            _parallelFormatter = NULL;
+        }
         _rendered = true;
 #if 0 //def _DEBUG
         LVStreamRef ostream = LVOpenFileStream( "test_save_after_init_rend_method.xml", LVOM_WRITE );
@@ -701,6 +796,9 @@ bool ldomDocument::render(LVRendPageList* pages, LVDocViewCallback* callback, in
         _pagesData.reset();
         pages->serialize(_pagesData);
         _renderedBlockCache.restoreSize(); // Restore original cache size
+        _renderVariants->setCurrentKey(variantKey);
+        updateTraversalIndex();
+        _renderTime = (lUInt32)renderTimer.elapsed();
 
         if (_nodeDisplayStyleHashInitial == NODE_DISPLAY_STYLE_HASH_UNINITIALIZED) {
             // If _nodeDisplayStyleHashInitial has not been initialized from its
@@ -730,11 +828,14 @@ bool ldomDocument::render(LVRendPageList* pages, LVDocViewCallback* callback, in
 
     } else {
         CRLog::info("rendering context is not changed - no render!");
+        if (variantKey && !_renderVariants->getCurrentKey())
+            _renderVariants->setCurrentKey(variantKey);
         if (_pagesData.pos()) {
             _pagesData.setPos(0);
             pages->deserialize(_pagesData);
         }
         CRLog::info("%d rendered pages found", pages->length());
+        updateTraversalIndex();
 
         if (was_just_rendered_from_cache && callback)
             callback->OnDocumentReady();
@@ -773,6 +874,57 @@ lString32 ldomDocument::textFromXPath(const lString32& xPointerStr) {
     return node->getText();
 }
 
+// element bounding a range of rendered elements at xpointer: its final block,
+// or the block it points to the start or the end of when it's between final blocks (in margins, paddings)
+static ldomNode* getRenderedRangeBound(const ldomXPointer& ptr) {
+    if (ptr.isNull())
+        return NULL;
+    ldomNode* node = ptr.getFinalNode();
+    if (node)
+        return node;
+    node = ptr.getNode();
+    if (!node->isElement())
+        return NULL;
+    if (ptr.getOffset() > 0) {
+        while (node->getChildCount() && node->getLastChild()->isElement())
+            node = node->getLastChild();
+    }
+    return node;
+}
+
+/// unpacks render rects of elements shown between doc y positions at once, before drawing or hit testing them
+int ldomDocument::prefetchRenderRects(int y0, int y1) {
+    ldomNode* root = getRootNode();
+    if (!root || !_rendered)
+        return 0;
+    if (y0 > y1) {
+        int tmp = y0;
+        y0 = y1;
+        y1 = tmp;
+    }
+    // bounds of range shown, like page start and end xpointers:
+    // element at a point may be an ancestor of much more than this range (margins, paddings)
+    ldomNode* first = getRenderedRangeBound(createXPointer(lvPoint(0, y0), PT_DIR_SCAN_FORWARD));
+    ldomNode* last = getRenderedRangeBound(createXPointer(lvPoint(0, y1), PT_DIR_SCAN_BACKWARD));
+    if (!first || !last)
+        return 0;
+    // elements are numbered in document order, except for ones added by autoboxing:
+    // take embedded ones of last final block too
+    if (last->getRendMethod() == erm_final) {
+        while (last->getChildCount() && last->getLastChild()->isElement())
+            last = last->getLastChild();
+    }
+    lUInt32 firstIndex = first->getDataIndex();
+    lUInt32 lastIndex = last->getDataIndex();
+    if (firstIndex > lastIndex) {
+        lUInt32 tmp = firstIndex;
+        firstIndex = lastIndex;
+        lastIndex = tmp;
+    }
+    _rectStorage->prefetchRendRectData(firstIndex, lastIndex);
+    return ((lastIndex >> 4) - (firstIndex >> 4)) + 1;
+}
+
 /// create xpointer from doc point
 ldomXPointer ldomDocument::createXPointer(lvPoint pt, int direction, bool strictBounds, ldomNode* fromNode) {
     //
@@ -1345,11 +1497,19 @@ bool ldomDocument::openFromCache(CacheLoadingCallback* formatCallback, LVDocView
         clear();
         return false;
     }
-    if (!loadCacheFileContent(formatCallback, progressCallback)) {
+    bool loaded;
+    {
+        // nodes are accessed while progress callbacks are called
+        ldomUseGuard use(this);
+        loaded = loadCacheFileContent(formatCallback, progressCallback);
+    }
+    if (!loaded) {
         CRLog::info("Error while loading document content from cache file.");
         clear();
         return false;
     }
+    // segments read by styles loading pass are not needed until rendering
+    unloadNodeParts(false);
 #if 0
     LVStreamRef s = LVOpenFileStream("/tmp/test.xml", LVOM_WRITE);
     if ( !s.isNull() )
@@ -1376,7 +1536,7 @@ bool ldomDocument::loadCacheFileContent(CacheLoadingCallback* formatCallback, LV
         if (progressCallback)
             progressCallback->OnLoadFileProgress(5);
         SerialBuf propsbuf(0, true);
-        if (!_cacheFile->read(CBT_PROP_DATA, propsbuf)) {
+        if (!_cacheFile->readInPlace(CBT_PROP_DATA, propsbuf)) {
             CRLog::error("Error while reading props data");
             return false;
         }
@@ -1441,7 +1601,7 @@ bool ldomDocument::loadCacheFileContent(CacheLoadingCallback* formatCallback, LV
             progressCallback->OnLoadFileProgress(10);
         CRLog::trace("ldomDocument::loadCacheFileContent() - ID data");
         SerialBuf idbuf(0, true);
-        if (!_cacheFile->read(CBT_MAPS_DATA, idbuf)) {
+        if (!_cacheFile->readInPlace(CBT_MAPS_DATA, idbuf)) {
             CRLog::error("Error while reading Id data");
             return false;
         }
@@ -1475,7 +1635,7 @@ bool ldomDocument::loadCacheFileContent(CacheLoadingCallback* formatCallback, LV
         CRLog::trace("ldomDocument::loadCacheFileContent() - embedded font data");
         {
             SerialBuf buf(0, true);
-            if (!_cacheFile->read(CBT_FONT_DATA, buf)) {
+            if (!_cacheFile->readInPlace(CBT_FONT_DATA, buf)) {
                 CRLog::error("Error while reading font data");
                 return false;
             }
@@ -1490,7 +1650,7 @@ bool ldomDocument::loadCacheFileContent(CacheLoadingCallback* formatCallback, LV
             progressCallback->OnLoadFileProgress(25);
         DocFileHeader h = {};
         SerialBuf hdrbuf(0, true);
-        if (!_cacheFile->read(CBT_REND_PARAMS, hdrbuf)) {
+        if (!_cacheFile->readInPlace(CBT_REND_PARAMS, hdrbuf)) {
             CRLog::error("Error while reading header data");
             return false;
         } else if (!h.deserialize(hdrbuf)) {
@@ -1509,6 +1669,8 @@ bool ldomDocument::loadCacheFileContent(CacheLoadingCallback* formatCallback, LV
         CRLog::error("Error while reading node instance data");
         return false;
     }
+    if (_traversalIndexEnabled && !loadTraversalIndex())
+        CRLog::info("No traversal index in cache file, it will be built after rendering");
 
     if (progressCallback)
         progressCallback->OnLoadFileProgress(40);
@@ -1544,7 +1706,7 @@ bool ldomDocument::loadCacheFileContent(CacheLoadingCallback* formatCallback, LV
     CRLog::trace("ldomDocument::loadCacheFileContent() - TOC");
     {
         SerialBuf tocbuf(0, true);
-        if (!_cacheFile->read(CBT_TOC_DATA, tocbuf)) {
+        if (!_cacheFile->readInPlace(CBT_TOC_DATA, tocbuf)) {
             CRLog::error("Error while reading TOC data");
             return false;
         } else if (!m_toc.deserialize(this, tocbuf)) {
@@ -1557,7 +1719,7 @@ bool ldomDocument::loadCacheFileContent(CacheLoadingCallback* formatCallback, LV
     CRLog::trace("ldomDocument::loadCacheFileContent() - PageMap");
     {
         SerialBuf pagemapbuf(0, true);
-        if (!_cacheFile->read(CBT_PAGEMAP_DATA, pagemapbuf)) {
+        if (!_cacheFile->readInPlace(CBT_PAGEMAP_DATA, pagemapbuf)) {
             CRLog::error("Error while reading PageMap data");
             return false;
         } else if (!m_pagemap.deserialize(this, pagemapbuf)) {
@@ -1580,6 +1742,8 @@ bool ldomDocument::loadCacheFileContent(CacheLoadingCallback* formatCallback, LV
         CRLog::trace("ldomDocument::loadCacheFileContent() - style loading failed: will reinit ");
         updateLoadedStyles(false);
     }
+    if (!_renderVariants->load())
+        CRLog::error("Error while reading render variants list, kept renderings are not used");
 
     CRLog::trace("ldomDocument::loadCacheFileContent() - completed successfully");
     if (progressCallback)
@@ -1603,6 +1767,7 @@ bool ldomDocument::loadCacheFileContent(CacheLoadingCallback* formatCallback, LV
 ContinuousOperationResult ldomDocument::saveChanges(CRTimerUtil& maxTime, LVDocViewCallback* progressCallback) {
     if (!_cacheFile)
         return CR_DONE;
+    ldomUseGuard use(this);
 
     if (progressCallback)
         progressCallback->OnSaveCacheFileStart();
@@ -1615,6 +1780,14 @@ ContinuousOperationResult ldomDocument::saveChanges(CRTimerUtil& maxTime, LVDocV
         _cacheFile->setAutoSyncSize(STREAM_AUTO_SYNC_SIZE);
         //CRLog::trace("setting autosync - done");
     }
+    if (_asyncCacheWrites) {
+        CRThreadPool* pool = CRGetSharedThreadPool();
+        if (pool && pool->getThreadCount() > 0)
+            _cacheFile->startAsyncWrites(pool);
+    }
+    // trained by background writer if it's started: blocks queued after it are packed with dictionary
+    if (_mapSavingStage == 0)
+        trainCacheDictionary();
 
     CRLog::trace("ldomDocument::saveChanges(timeout=%d stage=%d)", maxTime.interval(), _mapSavingStage);
     setCacheFileStale(true);
@@ -1776,6 +1949,10 @@ ContinuousOperationResult ldomDocument::saveChanges(CRTimerUtil& maxTime, LVDocV
             }
             CRLog::info("Saving render properties: styleHash=%x, stylesheetHash=%x, docflags=%x, width=%x, height=%x, nodeDisplayStyleHash=%x",
                         _hdr.render_style_hash, _hdr.stylesheet_hash, _hdr.render_docflags, _hdr.render_dx, _hdr.render_dy, _hdr.node_displaystyle_hash);
+            if (!_renderVariants->save()) {
+                CRLog::error("Error while writing render variants list");
+                return CR_ERROR;
+            }
             if (progressCallback)
                 progressCallback->OnSaveCacheFileProgress(73);
 
@@ -1852,10 +2029,13 @@ ContinuousOperationResult ldomDocument::saveChanges(CRTimerUtil& maxTime, LVDocV
         case 13:
             _mapSavingStage = 13;
             setCacheFileStale(false);
+            // rebuild cost of document is used by cache to choose files to remove
+            ldomDocCache::updateFileInfo(_cacheFile->getCachePath(), (lUInt32)_cacheFile->getSize(), _parseTime + _renderTime);
     }
     CRLog::trace("ldomDocument::saveChanges() - done");
     if (progressCallback)
         progressCallback->OnSaveCacheFileEnd();
+    _cacheFile->notifyAsyncWritten(progressCallback);
 
     // And now should be a good place to release compression resources...
     _cacheFile->cleanupCompressor();
@@ -1897,12 +2077,28 @@ ContinuousOperationResult ldomDocument::swapToCache(CRTimerUtil& maxTime) {
         _maperror = true;
         return CR_ERROR;
     }
-    CRLog::info("Successfully saved document to cache file: %dK", _cacheFile->getSize() / 1024);
+    if (_cacheFile->isAsyncWriting()) // don't wait for background writes
+        CRLog::info("Successfully queued document saving to cache file");
+    else
+        CRLog::info("Successfully saved document to cache file: %dK", _cacheFile->getSize() / 1024);
     return res;
 }
 
+/// calls OnCacheFileWritten() of callbacks whose data is already written in background
+void ldomDocument::deliverCacheFileNotifications() {
+    if (_cacheFile)
+        _cacheFile->deliverAsyncNotifications();
+}
+
+/// drops notifications of data still being written in background
+void ldomDocument::discardCacheFileNotifications() {
+    if (_cacheFile)
+        _cacheFile->discardAsyncNotifications();
+}
+
 /// saves recent changes to mapped file
 ContinuousOperationResult ldomDocument::updateMap(CRTimerUtil& maxTime, LVDocViewCallback* progressCallback) {
+    deliverCacheFileNotifications();
     if (!_cacheFile || !_mapped) {
         CRLog::info("No cache file or not mapped");
         return CR_DONE;
@@ -1933,6 +2129,16 @@ ContinuousOperationResult ldomDocument::updateMap(CRTimerUtil& maxTime, LVDocVie
     return res;
 }
 
+/// moves blocks of cache file to its start without gaps and truncates it, limited by time interval
+ContinuousOperationResult ldomDocument::compactCacheFile(CRTimerUtil& maxTime) {
+    if (!_cacheFile || !_mapped)
+        return CR_DONE;
+    ContinuousOperationResult res = _cacheFile->compact(maxTime);
+    if (res == CR_ERROR)
+        CRLog::error("Error while compacting cache file");
+    return res;
+}
+
 /// save document formatting parameters after render
 void ldomDocument::updateRenderContext() {
     int dx = _page_width;
@@ -2025,6 +2231,123 @@ bool ldomDocument::checkRenderContext() {
     return false;
 }
 
+/// returns hash of render context parameters, known before initialization of node styles
+lUInt32 ldomDocument::calcRenderVariantKey(bool showCover, int y0, int usable_left_overflow, int usable_right_overflow) {
+    // node styles are defined by stylesheet, default style and global settings: style hash
+    // of rendered document is calculated from their hash instead of node styles
+    lUInt32 stylesheetHash = (((_stylesheet.getHash() * 31) + calcHash(_def_style)) * 31 + calcHash(_def_font));
+    lUInt32 key = calcStyleHash(true, stylesheetHash);
+    key = key * 31 + (lUInt32)_page_width;
+    key = key * 31 + (lUInt32)_page_height;
+    key = key * 31 + _DOMVersionRequested;
+    key = key * 31 + (showCover ? 1 : 0);
+    key = key * 31 + (lUInt32)y0;
+    key = key * 31 + (lUInt32)usable_left_overflow;
+    key = key * 31 + (lUInt32)usable_right_overflow;
+    return key ? key : 1; // 0 is key of unknown rendering
+}
+
+/// keeps current rendering in cache file as render variant
+bool ldomDocument::saveRenderVariant() {
+    lUInt32 key = _renderVariants->getCurrentKey();
+    if (!key || !_cacheFile || _maxRenderVariants <= 0 || !_pagesData.pos())
+        return false;
+    int index = _renderVariants->find(key);
+    if (index < 0) {
+        while (_renderVariants->length() >= _maxRenderVariants)
+            removeRenderVariant(_renderVariants->findLeastRecent());
+    }
+    ldomRenderVariant item;
+    item.key = key;
+    item.displayHash = _nodeDisplayStyleHash;
+    item.elemCount = (lUInt32)_elemCount;
+    item.lastUse = 0;
+    item.slot = index >= 0 ? _renderVariants->get(index).slot : (lUInt32)_renderVariants->findFreeSlot();
+    CRLog::info("Saving rendering %x as render variant, slot %d", key, (int)item.slot);
+    setCacheFileStale(true);
+    lUInt16 firstBlock = RENDER_VARIANT_FIRST_BLOCK(item.slot);
+    SerialBuf buf(0, true);
+    buf << _pagesData; // serialized page list
+    bool res = serializeStyles(buf) && _renderVariants->saveData(item.slot, buf) &&
+               _rectStorage->saveCopy(CBT_REND_VARIANT_RECT_DATA, firstBlock, RENDER_VARIANT_SLOT_BLOCKS) &&
+               _styleStorage->saveCopy(CBT_REND_VARIANT_STYLE_DATA, firstBlock, RENDER_VARIANT_SLOT_BLOCKS);
+    if (res) {
+        _renderVariants->set(item);
+    } else {
+        CRLog::error("Error while saving render variant %x", key);
+        // drop partially written variant
+        _renderVariants->set(item);
+        removeRenderVariant(_renderVariants->find(key));
+    }
+    _renderVariants->save();
+    return res;
+}
+
+/// replaces current rendering by render variant kept in cache file
+bool ldomDocument::restoreRenderVariant(lUInt32 key, LVRendPageList* pages) {
+    int index = _renderVariants->find(key);
+    if (index < 0 || !_cacheFile)
+        return false;
+    ldomRenderVariant item = _renderVariants->get(index);
+    if (item.displayHash != _nodeDisplayStyleHash || item.elemCount != (lUInt32)_elemCount) {
+        // render methods of elements are set for other display styles
+        CRLog::info("Render variant %x doesn't match current node display styles", key);
+        return false;
+    }
+    SerialBuf buf(0, true);
+    LVRendPageList variantPages;
+    LVArray<css_style_ref_t> styles;
+    if (!_renderVariants->loadData(item.slot, buf) || !variantPages.deserialize(buf) || !deserializeStyles(buf, styles)) {
+        CRLog::error("Error while reading render variant %x", key);
+        removeRenderVariant(index);
+        _renderVariants->save();
+        return false;
+    }
+    setCacheFileStale(true);
+    lUInt16 firstBlock = RENDER_VARIANT_FIRST_BLOCK(item.slot);
+    if (!_rectStorage->loadCopy(CBT_REND_VARIANT_RECT_DATA, firstBlock) ||
+        !_styleStorage->loadCopy(CBT_REND_VARIANT_STYLE_DATA, firstBlock)) {
+        // full rendering fills storages again
+        removeRenderVariant(index);
+        _renderVariants->save();
+        return false;
+    }
+    _renderedBlockCache.clear();
+    _styles.setIndex(styles);
+    _fonts.clear(-1);
+    resetNodeNumberingProps();
+    // node styles are no more the ones set with the kept stylesheet (see updateChangedStyles())
+    _styledStylesheet.clear();
+    if (!updateLoadedStyles(true)) {
+        CRLog::error("Error while restoring styles of render variant %x", key);
+        removeRenderVariant(index);
+        _renderVariants->save();
+        return false;
+    }
+    gc(); // drop font instances of previous rendering
+    _pagesData.reset();
+    variantPages.serialize(_pagesData);
+    _pagesData.setPos(0);
+    pages->deserialize(_pagesData);
+    _rendered = true;
+    updateRenderContext();
+    _toc_from_cache_valid = false;
+    m_toc.invalidatePageNumbers();
+    m_pagemap.invalidatePageInfo();
+    _renderVariants->touch(index);
+    CRLog::info("Render variant %x is restored, %d pages", key, pages->length());
+    return true;
+}
+
+/// frees cache file blocks of render variant and removes it from list
+void ldomDocument::removeRenderVariant(int index) {
+    lUInt32 slot = _renderVariants->get(index).slot;
+    _renderVariants->removeData(slot);
+    _rectStorage->removeCopy(CBT_REND_VARIANT_RECT_DATA, RENDER_VARIANT_FIRST_BLOCK(slot));
+    _styleStorage->removeCopy(CBT_REND_VARIANT_STYLE_DATA, RENDER_VARIANT_FIRST_BLOCK(slot));
+    _renderVariants->remove(index);
+}
+
 /// register embedded document fonts in font manager, if any exist in document
 void ldomDocument::registerEmbeddedFonts() {
     if (_fontList.empty())
@@ -85,6 +85,13 @@ public:
     virtual void setFlags(lUInt32 flags) {
         parent->setFlags(flags);
     }
+    /// head elements are handled by tag name only: depends on parent writer
+    virtual bool canParseAhead() {
+        return parent->canParseAhead();
+    }
+    virtual bool isParseAheadBarrier(const lChar32* tagname) {
+        return parent->isParseAheadBarrier(tagname);
+    }
     // overrides
     /// called when encoding directive found in document
     virtual void OnEncoding(const lChar32* name, const lChar32* table) {
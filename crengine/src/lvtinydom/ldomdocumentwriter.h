@@ -70,6 +70,10 @@ public:
     virtual void setFlags(lUInt32 flags) {
         _flags = flags;
     }
+    /// DOM is built only from parser events: parser may tokenize ahead
+    virtual bool canParseAhead() {
+        return true;
+    }
     // overrides
     /// called when encoding directive found in document
     virtual void OnEncoding(const lChar32* name, const lChar32* table);
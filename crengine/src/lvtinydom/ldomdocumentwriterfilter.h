@@ -61,6 +61,14 @@ protected:
     virtual void appendStyle(const lChar32* style);
     virtual void setClass(const lChar32* className, bool overrideExisting = false);
 public:
+    /// parser may tokenize ahead, unless this is a Lib.ru document (which needs paragraph splitting)
+    virtual bool canParseAhead() {
+        return !_libRuDocumentDetected;
+    }
+    /// Lib.ru document is detected on FORM element
+    virtual bool isParseAheadBarrier(const lChar32* tagname) {
+        return lStr_cmp(tagname, "form") == 0;
+    }
     /// called on attribute
     virtual void OnAttribute(const lChar32* nsname, const lChar32* attrname, const lChar32* attrvalue);
     /// called on opening tag
@@ -0,0 +1,202 @@
+/***************************************************************************
+ *   crengine-ng                                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License           *
+ *   as published by the Free Software Foundation; either version 2        *
+ *   of the License, or (at your option) any later version.                *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,            *
+ *   MA 02110-1301, USA.                                                   *
+ ***************************************************************************/
+
+#include <ldommemorygovernor.h>
+#include <lvtinynodecollection.h>
+#include <lvarray.h>
+#include <lvthread.h>
+#include <crlog.h>
+
+#include <stdlib.h>
+
+#include "ldommemorygovernorimpl.h"
+#include "ldomdatastoragemanager.h"
+#include "ldomtextstoragechunk.h"
+
+// restoring of not yet saved chunk costs writing of it as well
+#define UNSAVED_CHUNK_RESTORE_COST 3
+
+std::atomic<lUInt32> ldomMemoryGovernorImpl::_usedMemory(0);
+std::atomic<lUInt32> ldomMemoryGovernorImpl::_accessTick(0);
+
+static std::atomic<lUInt32> _memoryBudget(0);
+static std::atomic<int> _storageCount(0);
+
+// created on first use and never destroyed: documents may be destroyed after static objects
+static LVMutex& storagesMutex() {
+    static LVMutex* mutex = new LVMutex();
+    return *mutex;
+}
+
+static LVArray<ldomDataStorageManager*>& storages() {
+    static LVArray<ldomDataStorageManager*>* list = new LVArray<ldomDataStorageManager*>();
+    return *list;
+}
+
+int ldomMemoryGovernorImpl::compareCandidates(const void* a, const void* b) {
+    double sa = ((const ChunkCandidate*)a)->score;
+    double sb = ((const ChunkCandidate*)b)->score;
+    return sa > sb ? -1 : (sa < sb ? 1 : 0);
+}
+
+void ldomMemoryGovernorImpl::addCandidates(LVArray<ChunkCandidate>& list, ldomDataStorageManager* storage, const ldomTextStorageChunk* excludedChunk) {
+    lUInt32 tick = nextTick();
+    for (int i = 0; i < storage->_chunks.length(); i++) {
+        ldomTextStorageChunk* p = storage->_chunks[i];
+        // chunk being filled is kept, like per-storage limit does
+        if (!p->_buf || p->_mapped || p->_pinCount || p == excludedChunk || p == storage->_activeChunk)
+            continue;
+        // most recent chunk of storage is in use right now
+        lUInt32 age = p == storage->_recentChunk ? 0 : tick - p->_lastAccess;
+        ChunkCandidate c;
+        c.chunk = p;
+        c.score = ((double)age + 1) * p->_bufsize / (p->_saved ? 1 : UNSAVED_CHUNK_RESTORE_COST);
+        list.add(c);
+    }
+}
+
+bool ldomMemoryGovernorImpl::swapOut(ldomTextStorageChunk* chunk) {
+    ldomDataStorageManager* storage = chunk->_manager;
+    if (!storage->_cache)
+        storage->_owner->createCacheFile();
+    if (!storage->_cache)
+        return false;
+    storage->_owner->setCacheFileStale(true); // we may write: consider cache file stale
+    if (!chunk->swapToCache(true))
+        crFatalError(111, "Swap file writing error!");
+    return true;
+}
+
+static bool containsDocument(LVArray<tinyNodeCollection*>& owners, tinyNodeCollection* owner) {
+    for (int i = 0; i < owners.length(); i++) {
+        if (owners[i] == owner)
+            return true;
+    }
+    return false;
+}
+
+void ldomMemoryGovernorImpl::registerStorage(ldomDataStorageManager* storage) {
+    LVLock lock(storagesMutex());
+    storages().add(storage);
+    _storageCount++;
+}
+
+void ldomMemoryGovernorImpl::unregisterStorage(ldomDataStorageManager* storage) {
+    LVLock lock(storagesMutex());
+    LVArray<ldomDataStorageManager*>& list = storages();
+    for (int i = list.length() - 1; i >= 0; i--) {
+        if (list[i] == storage) {
+            list.erase(i, 1);
+            _storageCount--;
+        }
+    }
+}
+
+void ldomMemoryGovernorImpl::unregisterDocument(tinyNodeCollection* owner) {
+    LVLock lock(storagesMutex());
+    LVArray<ldomDataStorageManager*>& list = storages();
+    for (int i = list.length() - 1; i >= 0; i--) {
+        if (list[i]->_owner == owner) {
+            list.erase(i, 1);
+            _storageCount--;
+        }
+    }
+}
+
+void ldomMemoryGovernorImpl::compactStorage(ldomDataStorageManager* storage, lUInt32 reservedSpace, const ldomTextStorageChunk* excludedChunk) {
+    lUInt32 budget = _memoryBudget.load(std::memory_order_relaxed);
+    if ((lUInt64)getUsedMemory() + reservedSpace <= (lUInt64)budget + budget / 10) // allow +10% overflow
+        return;
+    // tinyNodeCollection::compact() passes huge reserved space to swap out everything
+    bool minimize = reservedSpace >= budget;
+    // when other documents take most of budget, keep fair share of it to avoid thrashing
+    int count = _storageCount.load(std::memory_order_relaxed);
+    lUInt32 minSize = budget / (count > 0 ? count : 1);
+    LVArray<ChunkCandidate> list;
+    addCandidates(list, storage, excludedChunk);
+    qsort(list.get(), list.length(), sizeof(ChunkCandidate), compareCandidates);
+    for (int i = 0; i < list.length(); i++) {
+        if (!minimize && ((lUInt64)getUsedMemory() + reservedSpace <= budget || storage->_uncompressedSize <= minSize))
+            break;
+        if (!swapOut(list[i].chunk))
+            break;
+    }
+}
+
+lUInt32 ldomMemoryGovernorImpl::freeMemory(lUInt32 target, bool unloadNodes) {
+    lUInt32 before = getUsedMemory();
+    LVLock lock(storagesMutex());
+    LVArray<ldomDataStorageManager*>& list = storages();
+    // documents of views busy in other threads are skipped, as well as ones used by this thread
+    // (we may be called from callback of rendering or drawing), and ones without access lock
+    LVArray<tinyNodeCollection*> owners;
+    for (int i = 0; i < list.length(); i++) {
+        tinyNodeCollection* owner = list[i]->_owner;
+        if (containsDocument(owners, owner))
+            continue;
+        LVMutex* mutex = owner->getAccessMutex();
+        if (!mutex || !mutex->trylock())
+            continue;
+        if (owner->isInUse()) {
+            mutex->unlock();
+            continue;
+        }
+        owners.add(owner);
+    }
+    if (unloadNodes) {
+        for (int i = 0; i < owners.length(); i++)
+            owners[i]->unloadNodeParts();
+    }
+    LVArray<ChunkCandidate> candidates;
+    for (int i = 0; i < list.length(); i++) {
+        if (containsDocument(owners, list[i]->_owner))
+            addCandidates(candidates, list[i], NULL);
+    }
+    qsort(candidates.get(), candidates.length(), sizeof(ChunkCandidate), compareCandidates);
+    for (int i = 0; i < candidates.length() && getUsedMemory() > target; i++)
+        swapOut(candidates[i].chunk);
+    for (int i = 0; i < owners.length(); i++)
+        owners[i]->getAccessMutex()->unlock();
+    lUInt32 after = getUsedMemory();
+    lUInt32 freed = before > after ? before - after : 0;
+    CRLog::info("ldomMemoryGovernor: %u bytes of unpacked data freed, %u bytes used", freed, after);
+    return freed;
+}
+
+void ldomMemoryGovernor::setMemoryBudget(lUInt32 budget) {
+    _memoryBudget = budget;
+    if (budget && ldomMemoryGovernorImpl::getUsedMemory() > budget)
+        ldomMemoryGovernorImpl::freeMemory(budget, false);
+}
+
+lUInt32 ldomMemoryGovernor::getMemoryBudget() {
+    return _memoryBudget.load(std::memory_order_relaxed);
+}
+
+lUInt32 ldomMemoryGovernor::getUsedMemory() {
+    return ldomMemoryGovernorImpl::getUsedMemory();
+}
+
+lUInt32 ldomMemoryGovernor::onMemoryPressure(ldomMemoryPressure level) {
+    if (level == MEMORY_PRESSURE_CRITICAL)
+        return ldomMemoryGovernorImpl::freeMemory(0, true);
+    lUInt32 budget = getMemoryBudget();
+    lUInt32 target = budget ? budget / 2 : ldomMemoryGovernorImpl::getUsedMemory() / 2;
+    return ldomMemoryGovernorImpl::freeMemory(target, false);
+}
@@ -0,0 +1,70 @@
+/***************************************************************************
+ *   crengine-ng                                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License           *
+ *   as published by the Free Software Foundation; either version 2        *
+ *   of the License, or (at your option) any later version.                *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,            *
+ *   MA 02110-1301, USA.                                                   *
+ ***************************************************************************/
+
+#ifndef __LDOMMEMORYGOVERNORIMPL_H_INCLUDED__
+#define __LDOMMEMORYGOVERNORIMPL_H_INCLUDED__
+
+#include <lvtypes.h>
+#include <lvarray.h>
+
+#include <atomic>
+
+class ldomDataStorageManager;
+class ldomTextStorageChunk;
+class tinyNodeCollection;
+
+/// storage side of ldomMemoryGovernor
+class ldomMemoryGovernorImpl
+{
+    static std::atomic<lUInt32> _usedMemory;
+    static std::atomic<lUInt32> _accessTick;
+    struct ChunkCandidate
+    {
+        ldomTextStorageChunk* chunk;
+        double score;
+    };
+    static int compareCandidates(const void* a, const void* b);
+    /// adds unpacked chunks of storage which can be swapped out, scored by age and size per restore cost
+    static void addCandidates(LVArray<ChunkCandidate>& list, ldomDataStorageManager* storage, const ldomTextStorageChunk* excludedChunk);
+    /// swaps chunk out to cache file, creating it if needed; returns false if document has no cache file
+    static bool swapOut(ldomTextStorageChunk* chunk);
+public:
+    static void registerStorage(ldomDataStorageManager* storage);
+    static void unregisterStorage(ldomDataStorageManager* storage);
+    /// removes all storages of document, waits if governor is freeing memory now
+    static void unregisterDocument(tinyNodeCollection* owner);
+    /// accounts change of unpacked data size
+    static void addUsedMemory(lInt32 delta) {
+        _usedMemory.fetch_add((lUInt32)delta, std::memory_order_relaxed);
+    }
+    static lUInt32 getUsedMemory() {
+        return _usedMemory.load(std::memory_order_relaxed);
+    }
+    /// returns access tick for chunk which becomes most recent in its storage
+    static lUInt32 nextTick() {
+        return _accessTick.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+    /// used instead of per-storage limit when memory budget is set:
+    /// swaps out least recently used chunks of this storage only, as caller may keep pointers to data in other storages
+    static void compactStorage(ldomDataStorageManager* storage, lUInt32 reservedSpace, const ldomTextStorageChunk* excludedChunk);
+    /// swaps out chunks of all documents with access mutex not used by any thread until used memory is not greater than target
+    static lUInt32 freeMemory(lUInt32 target, bool unloadNodes);
+};
+
+#endif // __LDOMMEMORYGOVERNORIMPL_H_INCLUDED__
@@ -25,6 +25,7 @@
  ***************************************************************************/
 
 #include <ldomnode.h>
+#include <ldomtextview.h>
 #include <lvdocviewcallback.h>
 #include <fb2def.h>
 #include <lvrend.h>
@@ -39,6 +40,8 @@
 #include "lvbase64nodestream.h"
 #include "nodeimageproxy.h"
 #include "renderrectaccessor.h"
+#include "ldomparallelformatter.h"
+#include "ldomtraversalindex.h"
 #include "../textlang.h"
 
 #if MATHML_SUPPORT == 1
@@ -62,6 +65,12 @@
 #define NPELEM _data._elem_ptr
 #define NPTEXT _data._text_ptr._str
 
+/// returns traversal index of document if it's valid and node was in tree when it was built, NULL otherwise
+static inline const ldomTraversalIndex* getTraversalIndex(const ldomNode* node) {
+    const ldomTraversalIndex* index = node->getDocument()->getValidTraversalIndex();
+    return index && index->hasNode(node->getDataIndex()) ? index : NULL;
+}
+
 static bool isInlineNode(ldomNode* node) {
     if (node->isText())
         return true;
@@ -389,7 +398,14 @@ ldomDocument* ldomNode::_documentInstances[MAX_DOCUMENT_INSTANCE_COUNT] = {
 };
 
 /// adds document to list, returns ID of allocated document, -1 if no space in instance array
+// documents are created and destroyed by different threads
+static LVMutex& documentInstancesMutex() {
+    static LVMutex mutex;
+    return mutex;
+}
+
 int ldomNode::registerDocument(ldomDocument* doc) {
+    LVLock lock(documentInstancesMutex());
     for (int i = 0; i < MAX_DOCUMENT_INSTANCE_COUNT; i++) {
         if (_nextDocumentIndex < 0 || _nextDocumentIndex >= MAX_DOCUMENT_INSTANCE_COUNT)
             _nextDocumentIndex = 0;
@@ -405,6 +421,7 @@ int ldomNode::registerDocument(ldomDocument* doc) {
 
 /// removes document from list
 void ldomNode::unregisterDocument(ldomDocument* doc) {
+    LVLock lock(documentInstancesMutex());
     for (int i = 0; i < MAX_DOCUMENT_INSTANCE_COUNT; i++) {
         if (_documentInstances[i] == doc) {
             CRLog::info("ldomNode::unregisterDocument() - for index %d", i);
@@ -2228,6 +2245,12 @@ int ldomNode::getChildIndex(lUInt32 dataIndex) const {
             }
         } break;
         case NT_PELEMENT: {
+            const ldomTraversalIndex* index = getTraversalIndex(this);
+            if (index && index->hasNode(dataIndex)) {
+                if ((index->getParent(dataIndex) >> 4) == ((lUInt32)_handle._dataIndex >> 4))
+                    parentIndex = index->getNodeIndex(dataIndex);
+                break;
+            }
             ElementDataStorageItem* me = getDocument()->_elemStorage->getElem(_data._pelem_addr);
             for (int i = 0; i < me->childCount; i++) {
                 if ((me->children[i] & 0xFFFFFFF1) == dataIndex) {
@@ -2247,6 +2270,9 @@ int ldomNode::getChildIndex(lUInt32 dataIndex) const {
 /// returns index of node inside parent's child collection
 int ldomNode::getNodeIndex() const {
     ASSERT_NODE_NOT_NULL;
+    const ldomTraversalIndex* index = getTraversalIndex(this);
+    if (index)
+        return index->getNodeIndex(_handle._dataIndex);
     ldomNode* parent = getParentNode();
     if (parent)
         return parent->getChildIndex(getDataIndex());
@@ -2256,6 +2282,11 @@ int ldomNode::getNodeIndex() const {
 /// returns true if node is document's root
 bool ldomNode::isRoot() const {
     ASSERT_NODE_NOT_NULL;
+    if (isPersistent()) {
+        const ldomTraversalIndex* index = getTraversalIndex(this);
+        if (index)
+            return index->getParent(_handle._dataIndex) == 0;
+    }
     switch (TNTYPE) {
         case NT_ELEMENT:
             return !NPELEM->_parentNode;
@@ -2291,6 +2322,7 @@ void ldomNode::setParentNode(ldomNode* parent) {
     if (getParentNode() != NULL && parent != NULL)
         CRLog::trace("Changing parent of %d from %d to %d", getDataIndex(), getParentNode()->getDataIndex(), parent->getDataIndex());
 #endif
+    getDocument()->dropTraversalIndex();
     switch (TNTYPE) {
         case NT_ELEMENT:
             NPELEM->_parentNode = parent;
@@ -2321,6 +2353,14 @@ void ldomNode::setParentNode(ldomNode* parent) {
 /// returns dataIndex of node's parent, 0 if no parent
 int ldomNode::getParentIndex() const {
     ASSERT_NODE_NOT_NULL;
+    if (isPersistent()) {
+        const ldomTraversalIndex* index = getTraversalIndex(this);
+        if (index) {
+            lUInt32 parentIndex = index->getParent(_handle._dataIndex);
+            // type bits of index entry may be out of date
+            return parentIndex ? getTinyNode(parentIndex)->_handle._dataIndex : 0;
+        }
+    }
 
     switch (TNTYPE) {
         case NT_ELEMENT:
@@ -2342,6 +2382,13 @@ int ldomNode::getParentIndex() const {
 ldomNode* ldomNode::getParentNode() const {
     ASSERT_NODE_NOT_NULL;
     int parentIndex = 0;
+    if (isPersistent()) {
+        const ldomTraversalIndex* index = getTraversalIndex(this);
+        if (index) {
+            parentIndex = index->getParent(_handle._dataIndex);
+            return parentIndex ? getTinyNode(parentIndex) : NULL;
+        }
+    }
     switch (TNTYPE) {
         case NT_ELEMENT:
             return NPELEM->_parentNode;
@@ -2370,6 +2417,9 @@ bool ldomNode::isChildNodeElement(lUInt32 index) const {
         return ((n & 1) == 1);
     } else {
         // persistent element
+        const ldomTraversalIndex* traversalIndex = getTraversalIndex(this);
+        if (traversalIndex)
+            return ((traversalIndex->getChild(_handle._dataIndex, index) & 1) == 1);
         ElementDataStorageItem* me = getDocument()->_elemStorage->getElem(_data._pelem_addr);
         int n = me->children[index];
         return ((n & 1) == 1);
@@ -2386,6 +2436,9 @@ bool ldomNode::isChildNodeText(lUInt32 index) const {
         return ((n & 1) == 0);
     } else {
         // persistent element
+        const ldomTraversalIndex* traversalIndex = getTraversalIndex(this);
+        if (traversalIndex)
+            return ((traversalIndex->getChild(_handle._dataIndex, index) & 1) == 0);
         ElementDataStorageItem* me = getDocument()->_elemStorage->getElem(_data._pelem_addr);
         int n = me->children[index];
         return ((n & 1) == 0);
@@ -2411,8 +2464,14 @@ ldomNode* ldomNode::getChildElementNode(lUInt32 index, lUInt16 nodeId) const {
         res = getTinyNode(n);
     } else {
         // persistent element
-        ElementDataStorageItem* me = getDocument()->_elemStorage->getElem(_data._pelem_addr);
-        int n = me->children[index];
+        const ldomTraversalIndex* traversalIndex = getTraversalIndex(this);
+        int n;
+        if (traversalIndex) {
+            n = traversalIndex->getChild(_handle._dataIndex, index);
+        } else {
+            ElementDataStorageItem* me = getDocument()->_elemStorage->getElem(_data._pelem_addr);
+            n = me->children[index];
+        }
         if ((n & 1) == 0) // not element
             return NULL;
         res = getTinyNode(n);
@@ -2431,6 +2490,9 @@ ldomNode* ldomNode::getChildNode(lUInt32 index) const {
         return getTinyNode(me->_children[index]);
     } else {
         // persistent element
+        const ldomTraversalIndex* traversalIndex = getTraversalIndex(this);
+        if (traversalIndex)
+            return getTinyNode(traversalIndex->getChild(_handle._dataIndex, index));
         ElementDataStorageItem* me = getDocument()->_elemStorage->getElem(_data._pelem_addr);
         return getTinyNode(me->children[index]);
     }
@@ -2447,7 +2509,9 @@ int ldomNode::getChildCount() const {
         return me->_children.length();
     } else {
         // persistent element
-        // persistent element
+        const ldomTraversalIndex* index = getTraversalIndex(this);
+        if (index)
+            return index->getChildCount(_handle._dataIndex);
         {
             ElementDataStorageItem* me = getDocument()->_elemStorage->getElem(_data._pelem_addr);
             //            if ( me==NULL ) { // DEBUG
@@ -2649,6 +2713,9 @@ lUInt16 ldomNode::getNodeId() const {
         return NPELEM->_id;
     } else {
         // persistent element
+        const ldomTraversalIndex* index = getTraversalIndex(this);
+        if (index)
+            return index->getNodeId(_handle._dataIndex);
         ElementDataStorageItem* me = getDocument()->_elemStorage->getElem(_data._pelem_addr);
         return me->id;
     }
@@ -2674,6 +2741,7 @@ void ldomNode::setNodeId(lUInt16 id) {
     ASSERT_NODE_NOT_NULL;
     if (!isElement())
         return;
+    getDocument()->dropTraversalIndex();
     if (!isPersistent()) {
         // element
         NPELEM->_id = id;
@@ -2740,10 +2808,17 @@ lString32 ldomNode::getText(lChar32 blockDelimiter, int maxSize) const {
         case NT_PELEMENT:
         case NT_ELEMENT: {
             lString32 txt;
+            // text of children is decoded in place to the same buffer, it's not put to decoded text cache
+            lString32 childText;
             unsigned cc = getChildCount();
             for (unsigned i = 0; i < cc; i++) {
                 ldomNode* child = getChildNode(i);
-                txt += child->getText(blockDelimiter, maxSize);
+                if (child->isText()) {
+                    ldomTextView(child).decode(childText);
+                    txt += childText;
+                } else {
+                    txt += child->getText(blockDelimiter, maxSize);
+                }
                 if (maxSize != 0 && txt.length() > maxSize)
                     break;
                 if (i >= cc - 1)
@@ -2756,7 +2831,7 @@ lString32 ldomNode::getText(lChar32 blockDelimiter, int maxSize) const {
             return txt;
         } break;
         case NT_PTEXT:
-            return Utf8ToUnicode(getDocument()->_textStorage->getText(_data._ptext_addr));
+            return getDocument()->getDecodedText(_handle._dataIndex, _data._ptext_addr);
         case NT_TEXT:
             return _data._text_ptr->getText32();
     }
@@ -2845,7 +2920,7 @@ void ldomNode::setText8(lString8 utf8) {
 void ldomNode::getAbsRect(lvRect& rect, bool inner) {
     ASSERT_NODE_NOT_NULL;
     ldomNode* node = this;
-    RenderRectAccessor fmt(node);
+    RenderRectReader fmt(node);
     rect.left = fmt.getX();
     rect.top = fmt.getY();
     rect.right = fmt.getWidth();
@@ -2859,7 +2934,7 @@ void ldomNode::getAbsRect(lvRect& rect, bool inner) {
     }
     node = node->getParentNode();
     for (; node; node = node->getParentNode()) {
-        RenderRectAccessor fmt(node);
+        RenderRectReader fmt(node);
         rect.left += fmt.getX();
         rect.top += fmt.getY();
         if (RENDER_RECT_HAS_FLAG(fmt, INNER_FIELDS_SET)) {
@@ -2958,7 +3033,7 @@ static void updateStyleData( ldomNode * node )
 }
 #endif
 
-static void updateStyleDataRecursive(ldomNode* node, LVDocViewCallback* progressCallback, int& lastProgressPercent) {
+static void updateStyleDataRecursive(ldomNode* node, LVCssAncestorFilter& filter, LVDocViewCallback* progressCallback, int& lastProgressPercent) {
     if (!node->isElement())
         return;
     bool styleSheetChanged = false;
@@ -2983,12 +3058,15 @@ static void updateStyleDataRecursive(ldomNode* node, LVDocViewCallback* progress
     }
 
     node->initNodeStyle();
+    // make this node an ancestor of its children for the stylesheet ancestor filter
+    filter.push(node);
     int n = node->getChildCount();
     for (int i = 0; i < n; i++) {
         ldomNode* child = node->getChildNode(i);
         if (child && child->isElement())
-            updateStyleDataRecursive(child, progressCallback, lastProgressPercent);
+            updateStyleDataRecursive(child, filter, progressCallback, lastProgressPercent);
     }
+    filter.pop();
     if (styleSheetChanged)
         node->getDocument()->getStyleSheet()->pop();
 }
@@ -2999,12 +3077,89 @@ void ldomNode::initNodeStyleRecursive(LVDocViewCallback* progressCallback) {
         progressCallback->OnNodeStylesUpdateStart();
     getDocument()->_fontMap.clear();
     int lastProgressPercent = -1;
-    updateStyleDataRecursive(this, progressCallback, lastProgressPercent);
+    // The filter knows only ancestors met while walking, so the stylesheet
+    // can use it only when all of them are met, from the root node
+    LVCssAncestorFilter filter;
+    if (isRoot())
+        getDocument()->getStyleSheet()->setAncestorFilter(&filter);
+    lUInt32 sharingLookups = getDocument()->getStyleSharingLookups();
+    lUInt32 sharingHits = getDocument()->getStyleSharingHits();
+    getDocument()->startStyleSharing();
+    updateStyleDataRecursive(this, filter, progressCallback, lastProgressPercent);
+    getDocument()->endStyleSharing();
+    getDocument()->getStyleSheet()->setAncestorFilter(NULL);
+    sharingLookups = getDocument()->getStyleSharingLookups() - sharingLookups;
+    sharingHits = getDocument()->getStyleSharingHits() - sharingHits;
+    if (sharingLookups > 0)
+        CRLog::debug("initNodeStyleRecursive: style shared by %u of %u elements (%u%%)",
+                     sharingHits, sharingLookups, sharingHits * 100 / sharingLookups);
     //recurseElements( updateStyleData );
     if (progressCallback)
         progressCallback->OnNodeStylesUpdateEnd();
 }
 
+static bool matchesAnySelector(ldomNode* node, const LVArray<LVCssSelector*>& selectors, const LVCssAncestorFilter* filter) {
+    for (int i = 0; i < selectors.length(); i++) {
+        if ((!filter || selectors[i]->mayMatch(filter)) && selectors[i]->check(node))
+            return true;
+    }
+    return false;
+}
+
+// filter is NULL when it does not know all ancestors of node
+static int updateChangedStyleRecursive(ldomNode* node, LVCssAncestorFilter* filter, const LVArray<LVCssSelector*>& selectors, bool parentChanged) {
+    if (!node->isElement())
+        return 0;
+    ldomDocument* doc = node->getDocument();
+    bool styleSheetChanged = false;
+    if (node->getNodeId() == el_DocFragment || node->getNodeId() == el_body)
+        styleSheetChanged = node->applyNodeStylesheet();
+
+    int changedCount = 0;
+    bool changed = false;
+    if (parentChanged || matchesAnySelector(node, selectors, filter)) {
+        // (equal styles and fonts are shared by document caches)
+        css_style_ref_t style = node->getStyle();
+        LVFontRef font = node->getFont();
+        node->initNodeStyle();
+        changed = node->getStyle().get() != style.get() || node->getFont().get() != font.get();
+        if (changed)
+            changedCount++;
+    }
+    if (filter)
+        filter->push(node);
+    int n = node->getChildCount();
+    for (int i = 0; i < n; i++) {
+        ldomNode* child = node->getChildNode(i);
+        if (child && child->isElement()) {
+            // Pseudo elements are all restyled, in document order, as their
+            // content may have quotes depending on the nesting level of all
+            // previous ones
+            bool restyle = changed || child->getNodeId() == el_pseudoElem;
+            changedCount += updateChangedStyleRecursive(child, filter, selectors, restyle);
+        }
+    }
+    if (filter)
+        filter->pop();
+    if (styleSheetChanged)
+        doc->getStyleSheet()->pop();
+    return changedCount;
+}
+
+int ldomNode::updateNodeStyleRecursive(const LVArray<LVCssSelector*>& selectors, LVDocViewCallback* progressCallback) {
+    if (progressCallback)
+        progressCallback->OnNodeStylesUpdateStart();
+    getDocument()->_fontMap.clear();
+    LVCssAncestorFilter filter;
+    if (isRoot())
+        getDocument()->getStyleSheet()->setAncestorFilter(&filter);
+    int changedCount = updateChangedStyleRecursive(this, isRoot() ? &filter : NULL, selectors, false);
+    getDocument()->getStyleSheet()->setAncestorFilter(NULL);
+    if (progressCallback)
+        progressCallback->OnNodeStylesUpdateEnd();
+    return changedCount;
+}
+
 /// calls specified function recursively for all elements of DOM tree
 void ldomNode::recurseElements(void (*pFun)(ldomNode* node)) {
     ASSERT_NODE_NOT_NULL;
@@ -3128,7 +3283,7 @@ ldomNode* ldomNode::elementFromPoint(lvPoint pt, int direction, bool strict_boun
         return NULL; // nothing found
     }
 
-    RenderRectAccessor fmt(this);
+    RenderRectReader fmt(this);
 
     if (BLOCK_RENDERING_N(this, ENHANCED)) {
         // In enhanced rendering mode, because of collapsing of vertical margins
@@ -3829,6 +3984,9 @@ ldomNode* ldomNode::getFirstChild() const {
             if (me->_children.length())
                 return getDocument()->getTinyNode(me->_children[0]);
         } else {
+            const ldomTraversalIndex* index = getTraversalIndex(this);
+            if (index)
+                return index->getChildCount(_handle._dataIndex) ? getDocument()->getTinyNode(index->getChild(_handle._dataIndex, 0)) : NULL;
             ElementDataStorageItem* me = getDocument()->_elemStorage->getElem(_data._pelem_addr);
             if (me->childCount)
                 return getDocument()->getTinyNode(me->children[0]);
@@ -3846,6 +4004,11 @@ ldomNode* ldomNode::getLastChild() const {
             if (me->_children.length())
                 return getDocument()->getTinyNode(me->_children[me->_children.length() - 1]);
         } else {
+            const ldomTraversalIndex* index = getTraversalIndex(this);
+            if (index) {
+                int count = index->getChildCount(_handle._dataIndex);
+                return count ? getDocument()->getTinyNode(index->getChild(_handle._dataIndex, count - 1)) : NULL;
+            }
             ElementDataStorageItem* me = getDocument()->_elemStorage->getElem(_data._pelem_addr);
             if (me->childCount)
                 return getDocument()->getTinyNode(me->children[me->childCount - 1]);
@@ -3886,6 +4049,7 @@ void ldomNode::addChild(lInt32 childNodeIndex) {
         return;
     if (isPersistent())
         modify(); // convert to mutable element
+    getDocument()->dropTraversalIndex();
     tinyElement* me = NPELEM;
     me->_children.add(childNodeIndex);
 }
@@ -3897,6 +4061,7 @@ void ldomNode::moveItemsTo(ldomNode* destination, int startChildIndex, int endCh
         return;
     if (isPersistent())
         modify();
+    getDocument()->dropTraversalIndex();
 
 #ifdef TRACE_AUTOBOX
     CRLog::debug("moveItemsTo() invoked from %d to %d", getDataIndex(), destination->getDataIndex());
@@ -4076,6 +4241,7 @@ ldomNode* ldomNode::removeChild(lUInt32 index) {
     if (isElement()) {
         if (isPersistent())
             modify();
+        getDocument()->dropTraversalIndex();
         lUInt32 removedIndex = NPELEM->_children.remove(index);
         ldomNode* node = getTinyNode(removedIndex);
         return node;
@@ -4294,6 +4460,20 @@ int ldomNode::renderFinalBlock(LFormattedTextRef& frmtext, RenderRectAccessor* f
     if (rm != erm_final)
         return 0;
 
+    // When rendering the document with parallel formatting enabled,
+    // this node may have already been formatted ahead by a worker thread
+    ldomParallelFormatter* parallelFormatter = float_footprint ? getDocument()->getParallelFormatter() : NULL;
+    if (parallelFormatter) {
+        int h;
+        if (parallelFormatter->take(this, fmt, width, float_footprint, f, h)) {
+            cache.set(this, f);
+            float_footprint->store(this);
+            parallelFormatter->formatAhead(this, fmt, width, float_footprint);
+            frmtext = f;
+            return h;
+        }
+    }
+
     /// Render whole node content as single formatted object
 
     // Get some properties cached in this node's RenderRectAccessor
@@ -4349,6 +4529,8 @@ int ldomNode::renderFinalBlock(LFormattedTextRef& frmtext, RenderRectAccessor* f
     // and text selection.
     int h = f->Format((lUInt16)width, (lUInt16)page_h, direction, usable_left_overflow, usable_right_overflow,
                       getDocument()->getHangingPunctiationEnabled(), float_footprint);
+    if (parallelFormatter)
+        parallelFormatter->formatAhead(this, fmt, width, float_footprint);
     frmtext = f;
     //CRLog::trace("Created new formatted object for node #%08X", (lUInt32)this);
     return h;
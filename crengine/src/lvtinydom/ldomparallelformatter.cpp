@@ -0,0 +1,204 @@
+/***************************************************************************
+ *   crengine-ng                                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License           *
+ *   as published by the Free Software Foundation; either version 2        *
+ *   of the License, or (at your option) any later version.                *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,            *
+ *   MA 02110-1301, USA.                                                   *
+ ***************************************************************************/
+
+#include "ldomparallelformatter.h"
+
+#include <ldomdocument.h>
+#include <lvrend.h>
+#include <fb2def.h>
+#include <crconcurrent.h>
+
+#include "renderrectaccessor.h"
+#include "../textlang.h"
+
+// RenderRectAccessor flags having effect on text formatting
+#define FORMAT_AHEAD_RECT_FLAGS_MASK (RENDER_RECT_FLAG_DIRECTION_MASK | RENDER_RECT_FLAG_NO_INTERLINE_SCALE_UP | RENDER_RECT_FLAG_DO_MATH_TRANSFORM)
+
+// Source text fragments flags needing document or outer flow access when formatting
+#define FORMAT_AHEAD_EXCLUDED_SRC_FLAGS                                                         \
+    (LTEXT_SRC_IS_OBJECT | LTEXT_SRC_IS_INLINE_BOX | LTEXT_SRC_IS_FLOAT | LTEXT_SRC_IS_FLOAT_DONE | \
+     LTEXT_SRC_IS_CLEAR_BOTH | LTEXT_SRC_IS_CLEAR_LAST | LTEXT_HAS_EXTRA | LTEXT_FLAG_NOWRAP |        \
+     LTEXT_MATH_TRANSFORM | LTEXT_SRC_SEPARATE_STRUT)
+
+struct ldomParallelFormatter::Entry
+{
+    ldomNode* node;
+    LFormattedTextRef text;
+    // parameters the text was formatted with
+    int width;
+    int fmtWidth;
+    int usableLeftOverflow;
+    int usableRightOverflow;
+    unsigned short rectFlags;
+    int langNodeIndex;
+    bool noClearOwnFloats;
+    // result
+    int height;
+    CRTaskGroup* task;
+    Entry(ldomNode* n, LFormattedTextRef txt)
+            : node(n)
+            , text(txt)
+            , height(0)
+            , task(NULL) { }
+    ~Entry() {
+        if (task) {
+            task->cancel();
+            task->join();
+            delete task;
+        }
+    }
+};
+
+/// returns true if node content is only text and plain inline elements
+static bool hasPlainInlineContent(ldomNode* node) {
+    int count = node->getChildCount();
+    for (int i = 0; i < count; i++) {
+        ldomNode* child = node->getChildNode(i);
+        if (child->isText())
+            continue;
+        if (child->getRendMethod() != erm_inline || child->getNodeId() == el_pseudoElem)
+            return false;
+        if (child->getStyle()->display != css_d_inline || child->isBoxingNode(true))
+            return false;
+        const css_elem_def_props_t* ntype = child->getElementTypePtr();
+        if (ntype && ntype->is_object)
+            return false;
+        if (!hasPlainInlineContent(child))
+            return false;
+    }
+    return true;
+}
+
+ldomParallelFormatter::ldomParallelFormatter(ldomDocument* doc, CRThreadPool* pool)
+        : _doc(doc)
+        , _pool(pool)
+        , _current(NULL)
+        , _stop(NULL) {
+    _maxEntries = pool->getThreadCount() * 4;
+}
+
+ldomParallelFormatter::~ldomParallelFormatter() {
+    discard();
+}
+
+void ldomParallelFormatter::discard() {
+    _entries.clear();
+}
+
+bool ldomParallelFormatter::isCandidate(ldomNode* node) {
+    if (!node->isElement() || node->getRendMethod() != erm_final)
+        return false;
+    if (node->getStyle()->display != css_d_block || node->isFloatingBox() || node->isBoxingInlineBox())
+        return false;
+    return hasPlainInlineContent(node);
+}
+
+bool ldomParallelFormatter::take(ldomNode* node, RenderRectAccessor* fmt, int width, BlockFloatFootprint* float_footprint,
+                                 LFormattedTextRef& frmtext, int& height) {
+    if (_current)
+        return false; // final block rendered while formatting another one (float, inline-block...)
+    _current = node;
+    if (_entries.empty())
+        return false;
+    if (_entries[0]->node != node) {
+        // Rendering did not go the way we expected
+        discard();
+        return false;
+    }
+    LVAutoPtr<Entry> entry(_entries.remove(0));
+    entry->task->join();
+    if (width != entry->width || fmt->getWidth() != entry->fmtWidth ||
+        fmt->getUsableLeftOverflow() != entry->usableLeftOverflow ||
+        fmt->getUsableRightOverflow() != entry->usableRightOverflow ||
+        (fmt->getFlags() & FORMAT_AHEAD_RECT_FLAGS_MASK) != entry->rectFlags ||
+        fmt->getLangNodeIndex() != entry->langNodeIndex || fmt->getListPropNodeIndex() != 0 ||
+        float_footprint->floats_cnt > 0 || float_footprint->no_clear_own_floats != entry->noClearOwnFloats)
+        return false;
+    frmtext = entry->text;
+    height = entry->height;
+    return true;
+}
+
+void ldomParallelFormatter::formatAhead(ldomNode* node, RenderRectAccessor* fmt, int width, BlockFloatFootprint* float_footprint) {
+    if (node != _current)
+        return;
+    _current = NULL;
+    // Following blocks would most probably be affected by the same floats
+    if (float_footprint->floats_cnt > 0 || fmt->getListPropNodeIndex() != 0)
+        return;
+    ldomNode* parent = node->getParentNode();
+    if (!parent)
+        return;
+    ldomNode* last = _entries.empty() ? node : _entries[_entries.length() - 1]->node;
+    if (last->getParentNode() != parent)
+        return;
+
+    // Guess that following siblings get the same parameters as this node
+    int direction = RENDER_RECT_PTR_GET_DIRECTION(fmt);
+    int lang_node_idx = fmt->getLangNodeIndex();
+    TextLangCfg* lang_cfg = TextLangMan::getTextLangCfg(lang_node_idx > 0 ? _doc->getTinyNode(lang_node_idx) : NULL);
+    int page_h = _doc->getPageHeight();
+    bool hanging_punctuation = _doc->getHangingPunctiationEnabled();
+    int count = parent->getChildCount();
+    for (int i = last->getNodeIndex() + 1; i < count && _entries.length() < _maxEntries; i++) {
+        ldomNode* sibling = parent->getChildNode(i);
+        if (sibling == _stop)
+            break;
+        if (sibling->isText() || sibling->getRendMethod() == erm_invisible)
+            continue; // skipped by render pass too
+        if (!isCandidate(sibling)) {
+            _stop = sibling;
+            break;
+        }
+        // Gather text in this thread, as it needs access to the document
+        LFormattedTextRef text(_doc->createFormattedText());
+        lUInt32 flags = styleToTextFmtFlags(true, sibling->getStyle(), 0, direction);
+        ::renderFinalBlock(sibling, text.get(), fmt, flags, 0, -1, lang_cfg);
+        bool plain = true;
+        for (int k = 0; k < text->GetSrcCount(); k++) {
+            if (text->GetSrcInfo(k)->flags & FORMAT_AHEAD_EXCLUDED_SRC_FLAGS) {
+                plain = false;
+                break;
+            }
+        }
+        if (!plain) {
+            _stop = sibling;
+            break;
+        }
+        if (!_doc->isRendered())
+            text->requestLightFormatting();
+        Entry* entry = new Entry(sibling, text);
+        entry->width = width;
+        entry->fmtWidth = fmt->getWidth();
+        entry->usableLeftOverflow = fmt->getUsableLeftOverflow();
+        entry->usableRightOverflow = fmt->getUsableRightOverflow();
+        entry->rectFlags = fmt->getFlags() & FORMAT_AHEAD_RECT_FLAGS_MASK;
+        entry->langNodeIndex = lang_node_idx;
+        entry->noClearOwnFloats = float_footprint->no_clear_own_floats;
+        entry->task = new CRTaskGroup(_pool);
+        _entries.add(entry);
+        entry->task->runFunc([entry, direction, page_h, hanging_punctuation]() {
+            // no outer floats: same as an empty footprint from the render pass
+            BlockFloatFootprint footprint(NULL, 0, 0, entry->noClearOwnFloats);
+            entry->height = entry->text->Format((lUInt16)entry->width, (lUInt16)page_h, direction,
+                                                entry->usableLeftOverflow, entry->usableRightOverflow,
+                                                hanging_punctuation, &footprint);
+        });
+    }
+}
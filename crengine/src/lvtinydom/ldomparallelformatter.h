@@ -0,0 +1,72 @@
+/***************************************************************************
+ *   crengine-ng                                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License           *
+ *   as published by the Free Software Foundation; either version 2        *
+ *   of the License, or (at your option) any later version.                *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,            *
+ *   MA 02110-1301, USA.                                                   *
+ ***************************************************************************/
+
+#ifndef __LDOMPARALLELFORMATTER_H_INCLUDED__
+#define __LDOMPARALLELFORMATTER_H_INCLUDED__
+
+#include <lvptrvec.h>
+#include <lvtinynodecollection.h>
+
+class ldomDocument;
+class ldomNode;
+class CRThreadPool;
+class RenderRectAccessor;
+class BlockFloatFootprint;
+
+/// Formats final blocks ahead of the document render pass, using thread pool
+/**
+ * Document rendering is sequential: the position and available width of
+ * each final block (paragraph) is known only when all previous blocks are
+ * laid out. But consecutive sibling paragraphs mostly get the same width
+ * and outer context, so while rendering one paragraph we can guess the
+ * parameters of the next ones, gather their text (on the rendering thread,
+ * as this accesses the DOM) and run LFormattedText::Format() for them on
+ * pool workers.
+ * When the render pass reaches such a paragraph, its real parameters are
+ * compared with the guessed ones: the result is used only if they match,
+ * so the rendered document is the same as without formatting ahead.
+ * Only paragraphs with plain text and inline elements (no images, inline
+ * boxes, floats or generated content) not affected by outer floats are
+ * formatted ahead.
+ * Exists only while ldomDocument::render() is running.
+ */
+class ldomParallelFormatter
+{
+    struct Entry;
+    ldomDocument* _doc;
+    CRThreadPool* _pool;
+    LVPtrVector<Entry> _entries; // formatted ahead, in document order
+    ldomNode* _current;          // outermost final block being rendered
+    ldomNode* _stop;             // sibling that stopped formatting ahead
+    int _maxEntries;
+    bool isCandidate(ldomNode* node);
+    void discard();
+public:
+    ldomParallelFormatter(ldomDocument* doc, CRThreadPool* pool);
+    /// waits for not yet finished formatting tasks and drops their results
+    ~ldomParallelFormatter();
+    /// to be called when starting rendering of final node,
+    /// returns true and formatted text with its height if node was formatted ahead with the same parameters
+    bool take(ldomNode* node, RenderRectAccessor* fmt, int width, BlockFloatFootprint* float_footprint,
+              LFormattedTextRef& frmtext, int& height);
+    /// to be called when final node is rendered, starts formatting of next siblings
+    void formatAhead(ldomNode* node, RenderRectAccessor* fmt, int width, BlockFloatFootprint* float_footprint);
+};
+
+#endif // __LDOMPARALLELFORMATTER_H_INCLUDED__
@@ -0,0 +1,134 @@
+/***************************************************************************
+ *   crengine-ng                                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License           *
+ *   as published by the Free Software Foundation; either version 2        *
+ *   of the License, or (at your option) any later version.                *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,            *
+ *   MA 02110-1301, USA.                                                   *
+ ***************************************************************************/
+
+#include "ldomrendervariants.h"
+#include <lvserialbuf.h>
+
+#include "lvtinydom_private.h"
+#include "cachefile.h"
+
+#define REND_VARIANTS_MAGIC "RVARIANT"
+
+ldomRenderVariants::ldomRenderVariants()
+        : _cacheFile(NULL)
+        , _currentKey(0)
+        , _useCounter(0) {
+}
+
+int ldomRenderVariants::find(lUInt32 key) const {
+    for (int i = 0; i < _list.length(); i++) {
+        if (_list[i].key == key)
+            return i;
+    }
+    return -1;
+}
+
+int ldomRenderVariants::findLeastRecent() const {
+    int res = -1;
+    for (int i = 0; i < _list.length(); i++) {
+        if (res < 0 || _list[i].lastUse < _list[res].lastUse)
+            res = i;
+    }
+    return res;
+}
+
+int ldomRenderVariants::findFreeSlot() const {
+    for (int slot = 0; slot < MAX_RENDER_VARIANTS; slot++) {
+        bool used = false;
+        for (int i = 0; i < _list.length() && !used; i++)
+            used = _list[i].slot == (lUInt32)slot;
+        if (!used)
+            return slot;
+    }
+    return -1;
+}
+
+void ldomRenderVariants::set(const ldomRenderVariant& item) {
+    int index = find(item.key);
+    if (index < 0) {
+        _list.add(item);
+        index = _list.length() - 1;
+    } else {
+        _list[index] = item;
+    }
+    touch(index);
+}
+
+void ldomRenderVariants::touch(int index) {
+    _list[index].lastUse = ++_useCounter;
+}
+
+void ldomRenderVariants::remove(int index) {
+    _list.erase(index, 1);
+}
+
+bool ldomRenderVariants::load() {
+    _list.clear();
+    _currentKey = 0;
+    _useCounter = 0;
+    if (!_cacheFile || !_cacheFile->hasBlock(CBT_REND_VARIANTS, 0))
+        return true; // no list: no renderings kept
+    SerialBuf buf(0, true);
+    if (!_cacheFile->readInPlace(CBT_REND_VARIANTS, 0, buf) || !buf.checkMagic(REND_VARIANTS_MAGIC))
+        return false;
+    lUInt32 len = 0;
+    buf >> _currentKey >> _useCounter >> len;
+    for (lUInt32 i = 0; i < len && i < MAX_RENDER_VARIANTS && !buf.error(); i++) {
+        ldomRenderVariant item;
+        buf >> item.key >> item.displayHash >> item.elemCount >> item.lastUse >> item.slot;
+        if (!buf.error() && item.slot < MAX_RENDER_VARIANTS)
+            _list.add(item);
+    }
+    buf.checkMagic(REND_VARIANTS_MAGIC);
+    if (buf.error()) {
+        _list.clear();
+        _currentKey = 0;
+        return false;
+    }
+    return true;
+}
+
+bool ldomRenderVariants::save() {
+    if (!_cacheFile)
+        return false;
+    if (!_currentKey && !_list.length() && !_cacheFile->hasBlock(CBT_REND_VARIANTS, 0))
+        return true; // nothing to keep
+    SerialBuf buf(0, true);
+    buf.putMagic(REND_VARIANTS_MAGIC);
+    buf << _currentKey << _useCounter << (lUInt32)_list.length();
+    for (int i = 0; i < _list.length(); i++) {
+        const ldomRenderVariant& item = _list[i];
+        buf << item.key << item.displayHash << item.elemCount << item.lastUse << item.slot;
+    }
+    buf.putMagic(REND_VARIANTS_MAGIC);
+    return !buf.error() && _cacheFile->write(CBT_REND_VARIANTS, 0, buf, false);
+}
+
+bool ldomRenderVariants::saveData(lUInt32 slot, SerialBuf& buf) {
+    return _cacheFile && _cacheFile->write(CBT_REND_VARIANTS, (lUInt16)(slot + 1), buf, COMPRESS_PAGES_DATA);
+}
+
+bool ldomRenderVariants::loadData(lUInt32 slot, SerialBuf& buf) {
+    return _cacheFile && _cacheFile->read(CBT_REND_VARIANTS, (lUInt16)(slot + 1), buf);
+}
+
+void ldomRenderVariants::removeData(lUInt32 slot) {
+    if (_cacheFile)
+        _cacheFile->removeBlock(CBT_REND_VARIANTS, (lUInt16)(slot + 1));
+}
@@ -0,0 +1,98 @@
+/***************************************************************************
+ *   crengine-ng                                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License           *
+ *   as published by the Free Software Foundation; either version 2        *
+ *   of the License, or (at your option) any later version.                *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,            *
+ *   MA 02110-1301, USA.                                                   *
+ ***************************************************************************/
+
+#ifndef __LDOMRENDERVARIANTS_H_INCLUDED__
+#define __LDOMRENDERVARIANTS_H_INCLUDED__
+
+#include <lvarray.h>
+
+class CacheFile;
+class SerialBuf;
+
+/// max number of render variants kept in cache file
+#define MAX_RENDER_VARIANTS 16
+/// max number of blocks of storage copy of render variant, see ldomDataStorageManager::saveCopy()
+#define RENDER_VARIANT_SLOT_BLOCKS 0x1000
+/// first block index of storage copy of render variant in slot
+#define RENDER_VARIANT_FIRST_BLOCK(slot) ((lUInt16)((slot) * RENDER_VARIANT_SLOT_BLOCKS))
+
+/// rendering kept in cache file
+struct ldomRenderVariant
+{
+    lUInt32 key;         // hash of render context, see ldomDocument::calcRenderVariantKey()
+    lUInt32 displayHash; // node display style hash: render methods of elements depend on it
+    lUInt32 elemCount;   // element count of document when rendered
+    lUInt32 lastUse;     // value of use counter when saved or restored
+    lUInt32 slot;        // slot of cache file blocks of rendering
+};
+
+/// list of renderings of recent render contexts kept in cache file
+/**
+ * List is stored in CBT_REND_VARIANTS block 0, pages and style table of variant are stored
+ * in CBT_REND_VARIANTS block slot+1, render rect and node style storage copies in
+ * CBT_REND_VARIANT_RECT_DATA and CBT_REND_VARIANT_STYLE_DATA blocks of slot.
+ */
+class ldomRenderVariants
+{
+    CacheFile* _cacheFile;
+    LVArray<ldomRenderVariant> _list;
+    lUInt32 _currentKey;
+    lUInt32 _useCounter;
+public:
+    ldomRenderVariants();
+    void setCacheFile(CacheFile* cacheFile) {
+        _cacheFile = cacheFile;
+    }
+    /// key of current rendering of document, 0 if unknown
+    lUInt32 getCurrentKey() const {
+        return _currentKey;
+    }
+    void setCurrentKey(lUInt32 key) {
+        _currentKey = key;
+    }
+    int length() const {
+        return _list.length();
+    }
+    ldomRenderVariant get(int index) const {
+        return _list[index];
+    }
+    /// returns index of variant with key, -1 if not found
+    int find(lUInt32 key) const;
+    /// returns index of least recently used variant, -1 if list is empty
+    int findLeastRecent() const;
+    /// returns slot not used by any variant, -1 if all of them are used
+    int findFreeSlot() const;
+    /// adds or replaces variant with the same key, marks it as most recently used
+    void set(const ldomRenderVariant& item);
+    /// marks variant as most recently used
+    void touch(int index);
+    void remove(int index);
+    /// reads list from cache file, empty list if there is none
+    bool load();
+    /// writes list to cache file
+    bool save();
+    /// writes pages and style table of variant
+    bool saveData(lUInt32 slot, SerialBuf& buf);
+    /// reads pages and style table of variant
+    bool loadData(lUInt32 slot, SerialBuf& buf);
+    /// frees block of pages and style table of variant
+    void removeData(lUInt32 slot);
+};
+
+#endif // __LDOMRENDERVARIANTS_H_INCLUDED__
@@ -25,6 +25,7 @@
 
 #include <ldomnodecallback.h>
 #include <ldomxrange.h>
+#include <ldomtextview.h>
 
 class ldomTextCollector: public ldomNodeCallback
 {
@@ -33,6 +34,7 @@ private:
     bool newBlock;
     lChar32 delimiter;
     lString32 text;
+    lString32 nodeText; // text of current node, decoded in place to the same buffer
 public:
     ldomTextCollector(lChar32 blockDelimiter, int maxTextLen)
             : lastText(false)
@@ -46,11 +48,11 @@ public:
         if (newBlock && !text.empty()) {
             text << delimiter;
         }
-        lString32 txt = nodeRange->getStart().getNode()->getText();
+        ldomTextView(nodeRange->getStart().getNode()).decode(nodeText);
         int start = nodeRange->getStart().getOffset();
         int end = nodeRange->getEnd().getOffset();
         if (start < end) {
-            text << txt.substr(start, end - start);
+            text.append(nodeText, start, end - start);
         }
         lastText = true;
         newBlock = false;
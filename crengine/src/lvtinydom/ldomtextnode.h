@@ -47,6 +47,14 @@ public:
         return _text;
     }
 
+    /// returns utf8 text, for access in place
+    const lChar8* getTextData() const {
+        return _text.c_str();
+    }
+    int getTextLength() const {
+        return _text.length();
+    }
+
     lString32 getText32() {
         return Utf8ToUnicode(_text);
     }
@@ -40,7 +40,10 @@ ldomTextStorageChunk::ldomTextStorageChunk(ldomDataStorageManager* manager, lUIn
         , _bufpos(uncompsize) /// _buf (uncompressed) data write position (for appending of new data)
         , _index(index)       /// ? index of chunk in storage
         , _type(manager->_type)
-        , _saved(true) {
+        , _saved(true)
+        , _mapped(false)
+        , _lastAccess(0)
+        , _pinCount(0) {
     CR_UNUSED(compsize);
 }
 
@@ -53,9 +56,12 @@ ldomTextStorageChunk::ldomTextStorageChunk(lUInt32 preAllocSize, ldomDataStorage
         , _bufpos(preAllocSize)  /// _buf (uncompressed) data write position (for appending of new data)
         , _index(index)          /// ? index of chunk in storage
         , _type(manager->_type)
-        , _saved(false) {
+        , _saved(false)
+        , _mapped(false)
+        , _lastAccess(0)
+        , _pinCount(0) {
     _buf = (lUInt8*)calloc(preAllocSize, sizeof(*_buf));
-    _manager->_uncompressedSize += _bufsize;
+    _manager->addUncompressedSize(_bufsize);
 }
 
 ldomTextStorageChunk::ldomTextStorageChunk(ldomDataStorageManager* manager, lUInt16 index)
@@ -67,7 +73,10 @@ ldomTextStorageChunk::ldomTextStorageChunk(ldomDataStorageManager* manager, lUIn
         , _bufpos(0)    /// _buf (uncompressed) data write position (for appending of new data)
         , _index(index) /// ? index of chunk in storage
         , _type(manager->_type)
-        , _saved(false) {
+        , _saved(false)
+        , _mapped(false)
+        , _lastAccess(0)
+        , _pinCount(0) {
 }
 
 /// saves data to cache file, if unsaved
@@ -98,7 +107,7 @@ bool ldomTextStorageChunk::swapToCache(bool removeFromMemory) {
             _saved = true;
         }
     }
-    if (removeFromMemory) {
+    if (removeFromMemory && !_pinCount) {
         setunpacked(NULL, 0);
     }
     return true;
@@ -111,10 +120,20 @@ bool ldomTextStorageChunk::restoreFromCache() {
     if (!_saved)
         return false;
     int size;
+    if (_type == 'r' || _type == 's') {
+        // raw data chunks are accessed by getRaw()/setRaw() only: use uncompressed data in place
+        const lUInt8* data = _manager->_cache->readMapped(_manager->cacheType(), _index, size);
+        if (data) {
+            _buf = const_cast<lUInt8*>(data);
+            _bufsize = size;
+            _mapped = true;
+            return true;
+        }
+    }
     if (!_manager->_cache->read(_manager->cacheType(), _index, _buf, size))
         return false;
     _bufsize = size;
-    _manager->_uncompressedSize += _bufsize;
+    _manager->addUncompressedSize(_bufsize);
 #if DEBUG_DOM_STORAGE == 1
     CRLog::debug("Read %d bytes of chunk %c%d from cache", _bufsize, _type, _index);
 #endif
@@ -137,6 +156,14 @@ void ldomTextStorageChunk::setRaw(int offset, int size, const lUInt8* buf) {
         crFatalError(123, "ldomTextStorageChunk: Invalid raw data buffer position");
 #endif
     if (memcmp(_buf + offset, buf, size) != 0) {
+        if (_mapped) {
+            // mapping is read only: copy data before modification
+            lUInt8* copy = (lUInt8*)malloc(_bufsize);
+            memcpy(copy, _buf, _bufsize);
+            _buf = copy;
+            _mapped = false;
+            _manager->addUncompressedSize(_bufsize);
+        }
         memcpy(_buf + offset, buf, size);
         modified();
     }
@@ -155,7 +182,7 @@ int ldomTextStorageChunk::addText(lUInt32 dataIndex, lUInt32 parentIndex, const
         _bufsize = _manager->_chunkSize > itemsize ? _manager->_chunkSize : itemsize;
         _buf = (lUInt8*)calloc(_bufsize, sizeof(*_buf));
         _bufpos = 0;
-        _manager->_uncompressedSize += _bufsize;
+        _manager->addUncompressedSize(_bufsize);
     }
     if (_bufsize - _bufpos < itemsize)
         return -1;
@@ -179,7 +206,7 @@ int ldomTextStorageChunk::addElem(lUInt32 dataIndex, lUInt32 parentIndex, lUInt3
         _bufsize = _manager->_chunkSize > itemsize ? _manager->_chunkSize : itemsize;
         _buf = (lUInt8*)calloc(_bufsize, sizeof(*_buf));
         _bufpos = 0;
-        _manager->_uncompressedSize += _bufsize;
+        _manager->addUncompressedSize(_bufsize);
     }
     if (_bufsize - _bufpos < itemsize)
         return -1;
@@ -267,10 +294,26 @@ lString8 ldomTextStorageChunk::getText(int offset) {
     return lString8::empty_str;
 }
 
+/// get pointer to utf8 text (w/o zero byte at end) of text item and its length, in buffer
+bool ldomTextStorageChunk::getTextData(int offset, const lChar8*& text, int& length) {
+    offset <<= 4;
+    if (_buf && offset >= 0 && offset < (int)_bufpos) {
+        TextDataStorageItem* item = (TextDataStorageItem*)(_buf + offset);
+        text = item->text;
+        length = item->length;
+        return true;
+    }
+    return false;
+}
+
 void ldomTextStorageChunk::setunpacked(const lUInt8* buf, int bufsize) {
     if (_buf) {
-        _manager->_uncompressedSize -= _bufsize;
-        free(_buf);
+        if (_mapped)
+            _mapped = false;
+        else {
+            _manager->addUncompressedSize(-(lInt32)_bufsize);
+            free(_buf);
+        }
         _buf = NULL;
         _bufsize = 0;
     }
@@ -278,7 +321,7 @@ void ldomTextStorageChunk::setunpacked(const lUInt8* buf, int bufsize) {
         _bufsize = bufsize;
         _bufpos = bufsize;
         _buf = (lUInt8*)malloc(sizeof(lUInt8) * bufsize);
-        _manager->_uncompressedSize += _bufsize;
+        _manager->addUncompressedSize(_bufsize);
         memcpy(_buf, buf, bufsize);
     }
 }
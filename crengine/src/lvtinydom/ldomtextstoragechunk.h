@@ -24,6 +24,8 @@
 
 #include <lvstring.h>
 
+#include <atomic>
+
 class ldomDataStorageManager;
 struct ElementDataStorageItem;
 
@@ -31,6 +33,7 @@ struct ElementDataStorageItem;
 class ldomTextStorageChunk
 {
     friend class ldomDataStorageManager;
+    friend class ldomMemoryGovernorImpl;
     ldomDataStorageManager* _manager;
     ldomTextStorageChunk* _nextRecent;
     ldomTextStorageChunk* _prevRecent;
@@ -40,6 +43,9 @@ class ldomTextStorageChunk
     lUInt16 _index;   /// ? index of chunk in storage
     char _type;       /// type, to show in log
     bool _saved;
+    bool _mapped; /// _buf refers to data in cache file mapping, copied on first modification
+    lUInt32 _lastAccess; /// access tick of ldomMemoryGovernor, updated when chunk becomes most recent in storage
+    std::atomic<lUInt32> _pinCount; /// number of text views using unpacked data in place, chunk is kept unpacked while non-zero
 
     void setunpacked(const lUInt8* buf, int bufsize);
     /// pack data, and remove unpacked
@@ -69,6 +75,18 @@ public:
     int addElem(lUInt32 dataIndex, lUInt32 parentIndex, lUInt32 childCount, lUInt32 attrCount);
     /// get text item from buffer by offset
     lString8 getText(int offset);
+    /// get pointer to utf8 text (w/o zero byte at end) of text item and its length, in buffer
+    bool getTextData(int offset, const lChar8*& text, int& length);
+    /// keeps unpacked data in memory until unpin(), for access in place
+    void pin() {
+        _pinCount++;
+    }
+    void unpin() {
+        _pinCount--;
+    }
+    bool isPinned() const {
+        return _pinCount > 0;
+    }
     /// get node parent by offset
     lUInt32 getParent(int offset);
     /// set node parent by offset
@@ -0,0 +1,59 @@
+/***************************************************************************
+ *   crengine-ng                                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License           *
+ *   as published by the Free Software Foundation; either version 2        *
+ *   of the License, or (at your option) any later version.                *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,            *
+ *   MA 02110-1301, USA.                                                   *
+ ***************************************************************************/
+
+
+#include <ldomtextview.h>
+#include <ldomnode.h>
+#include <lvtinynodecollection.h>
+
+#include "ldomdatastoragemanager.h"
+#include "ldomtextstoragechunk.h"
+#include "ldomtextnode.h"
+
+ldomTextView::ldomTextView(const ldomNode* node)
+        : _text(NULL)
+        , _length(0)
+        , _chunk(NULL) {
+    if (!node)
+        return;
+    switch (node->_handle._dataIndex & 0x0F) {
+        case ldomNode::NT_PTEXT:
+            _chunk = ((tinyNodeCollection*)node->getDocument())->pinText(node->_data._ptext_addr, _text, _length);
+            break;
+        case ldomNode::NT_TEXT:
+            _text = node->_data._text_ptr->getTextData();
+            _length = node->_data._text_ptr->getTextLength();
+            break;
+    }
+    if (!_text)
+        _length = 0;
+}
+
+ldomTextView::~ldomTextView() {
+    if (_chunk)
+        _chunk->unpin();
+}
+
+int ldomTextView::charCount() const {
+    return _length ? Utf8CharCount(_text, _length) : 0;
+}
+
+void ldomTextView::decode(lString32& dst) const {
+    Utf8ToUnicode(_text, _length, dst);
+}
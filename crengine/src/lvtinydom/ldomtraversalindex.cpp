@@ -0,0 +1,133 @@
+/***************************************************************************
+ *   crengine-ng                                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License           *
+ *   as published by the Free Software Foundation; either version 2        *
+ *   of the License, or (at your option) any later version.                *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,            *
+ *   MA 02110-1301, USA.                                                   *
+ ***************************************************************************/
+
+
+#include "ldomtraversalindex.h"
+#include <ldomnode.h>
+#include <lvserialbuf.h>
+
+#define TRAVERSAL_INDEX_MAGIC "TRAVINDX"
+
+ldomTraversalIndex::ldomTraversalIndex()
+        : _elemCount(0)
+        , _textCount(0) {
+}
+
+void ldomTraversalIndex::build(ldomNode* root, int elemCount, int textCount) {
+    _elemCount = elemCount;
+    _textCount = textCount;
+    _elemParent = LVArray<lUInt32>(elemCount + 1, 0);
+    _elemPos = LVArray<lUInt32>(elemCount + 1, TRAVERSAL_NO_NODE);
+    _elemFirstChild = LVArray<lUInt32>(elemCount + 1, 0);
+    _elemChildCount = LVArray<lUInt32>(elemCount + 1, 0);
+    _elemNodeId = LVArray<lUInt16>(elemCount + 1, 0);
+    _textParent = LVArray<lUInt32>(textCount + 1, 0);
+    _textPos = LVArray<lUInt32>(textCount + 1, TRAVERSAL_NO_NODE);
+    _children.clear();
+    _children.reserve(elemCount + textCount);
+    if (!root)
+        return;
+    _elemPos[root->getDataIndex() >> 4] = 0;
+    LVArray<ldomNode*> stack;
+    stack.add(root);
+    while (stack.length()) {
+        ldomNode* node = stack.remove(stack.length() - 1);
+        lUInt32 n = node->getDataIndex() >> 4;
+        int childCount = node->getChildCount();
+        _elemNodeId[n] = node->getNodeId();
+        _elemFirstChild[n] = _children.length();
+        _elemChildCount[n] = childCount;
+        for (int i = 0; i < childCount; i++) {
+            ldomNode* child = node->getChildNode(i);
+            lUInt32 childIndex = child->getDataIndex();
+            lUInt32 pos = _children.length();
+            _children.add(childIndex);
+            if (child->isElement()) {
+                _elemParent[childIndex >> 4] = node->getDataIndex();
+                _elemPos[childIndex >> 4] = pos;
+                stack.add(child);
+            } else {
+                _textParent[childIndex >> 4] = node->getDataIndex();
+                _textPos[childIndex >> 4] = pos;
+            }
+        }
+    }
+}
+
+static void serializeArray(SerialBuf& buf, const LVArray<lUInt32>& list) {
+    buf << (lUInt32)list.length();
+    for (int i = 0; i < list.length(); i++)
+        buf << list[i];
+}
+
+static bool deserializeArray(SerialBuf& buf, LVArray<lUInt32>& list, int expectedLength) {
+    lUInt32 len = 0;
+    buf >> len;
+    if (buf.error() || (expectedLength >= 0 && len != (lUInt32)expectedLength))
+        return false;
+    list = LVArray<lUInt32>(len, 0);
+    for (lUInt32 i = 0; i < len && !buf.error(); i++)
+        buf >> list[i];
+    return !buf.error();
+}
+
+void ldomTraversalIndex::serialize(SerialBuf& buf) {
+    buf.putMagic(TRAVERSAL_INDEX_MAGIC);
+    buf << (lUInt32)_elemCount << (lUInt32)_textCount;
+    serializeArray(buf, _elemParent);
+    serializeArray(buf, _elemPos);
+    serializeArray(buf, _elemFirstChild);
+    serializeArray(buf, _elemChildCount);
+    for (int i = 0; i <= _elemCount; i++)
+        buf << _elemNodeId[i];
+    serializeArray(buf, _textParent);
+    serializeArray(buf, _textPos);
+    serializeArray(buf, _children);
+    buf.putMagic(TRAVERSAL_INDEX_MAGIC);
+}
+
+bool ldomTraversalIndex::deserialize(SerialBuf& buf, int elemCount, int textCount) {
+    if (!buf.checkMagic(TRAVERSAL_INDEX_MAGIC))
+        return false;
+    lUInt32 elems = 0;
+    lUInt32 texts = 0;
+    buf >> elems >> texts;
+    if (buf.error() || elems != (lUInt32)elemCount || texts != (lUInt32)textCount)
+        return false;
+    _elemCount = elemCount;
+    _textCount = textCount;
+    if (!deserializeArray(buf, _elemParent, elemCount + 1) ||
+        !deserializeArray(buf, _elemPos, elemCount + 1) ||
+        !deserializeArray(buf, _elemFirstChild, elemCount + 1) ||
+        !deserializeArray(buf, _elemChildCount, elemCount + 1))
+        return false;
+    _elemNodeId = LVArray<lUInt16>(elemCount + 1, 0);
+    for (int i = 0; i <= elemCount && !buf.error(); i++)
+        buf >> _elemNodeId[i];
+    if (!deserializeArray(buf, _textParent, textCount + 1) ||
+        !deserializeArray(buf, _textPos, textCount + 1) ||
+        !deserializeArray(buf, _children, -1))
+        return false;
+    // child ranges must stay inside child list
+    for (int i = 0; i <= elemCount; i++) {
+        if (_elemPos[i] != TRAVERSAL_NO_NODE && _elemFirstChild[i] + _elemChildCount[i] > (lUInt32)_children.length())
+            return false;
+    }
+    return buf.checkMagic(TRAVERSAL_INDEX_MAGIC);
+}
@@ -0,0 +1,95 @@
+/***************************************************************************
+ *   crengine-ng                                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License           *
+ *   as published by the Free Software Foundation; either version 2        *
+ *   of the License, or (at your option) any later version.                *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,            *
+ *   MA 02110-1301, USA.                                                   *
+ ***************************************************************************/
+
+
+#ifndef __LDOMTRAVERSALINDEX_H_INCLUDED__
+#define __LDOMTRAVERSALINDEX_H_INCLUDED__
+
+#include <lvarray.h>
+
+struct ldomNode;
+class SerialBuf;
+
+/// value of node position for nodes not reached from document root
+#define TRAVERSAL_NO_NODE 0xFFFFFFFF
+
+/// tree structure of document kept in plain arrays, to walk it without unpacking element storage chunks
+/**
+ * Arrays are indexed by node number (dataIndex >> 4), separately for elements and text nodes.
+ * Children of each element are kept contiguously in one list, so next and previous siblings
+ * are neighbours of node in it. Index is valid only while tree structure is not changed:
+ * owner drops it on any change, see tinyNodeCollection::dropTraversalIndex().
+ */
+class ldomTraversalIndex
+{
+    LVArray<lUInt32> _elemParent;     // data index of parent element
+    LVArray<lUInt32> _elemPos;        // position of element in _children, TRAVERSAL_NO_NODE if not in tree
+    LVArray<lUInt32> _elemFirstChild; // position of first child of element in _children
+    LVArray<lUInt32> _elemChildCount;
+    LVArray<lUInt16> _elemNodeId;
+    LVArray<lUInt32> _textParent;
+    LVArray<lUInt32> _textPos;
+    LVArray<lUInt32> _children; // data indexes of child nodes
+    int _elemCount;
+    int _textCount;
+public:
+    ldomTraversalIndex();
+    /// walks tree of root node, elemCount and textCount are max node numbers
+    void build(ldomNode* root, int elemCount, int textCount);
+    /// returns true if node was in tree when index was built
+    bool hasNode(lUInt32 dataIndex) const {
+        lUInt32 n = dataIndex >> 4;
+        if (dataIndex & 1)
+            return (int)n <= _elemCount && _elemPos[n] != TRAVERSAL_NO_NODE;
+        return (int)n <= _textCount && _textPos[n] != TRAVERSAL_NO_NODE;
+    }
+    /// returns data index of parent node, 0 for root; node type bits may be out of date
+    lUInt32 getParent(lUInt32 dataIndex) const {
+        return (dataIndex & 1) ? _elemParent[dataIndex >> 4] : _textParent[dataIndex >> 4];
+    }
+    /// returns index of node inside parent's child collection
+    int getNodeIndex(lUInt32 dataIndex) const {
+        lUInt32 parent = getParent(dataIndex);
+        if (!parent)
+            return 0;
+        lUInt32 pos = (dataIndex & 1) ? _elemPos[dataIndex >> 4] : _textPos[dataIndex >> 4];
+        return (int)(pos - _elemFirstChild[parent >> 4]);
+    }
+    int getChildCount(lUInt32 dataIndex) const {
+        return (int)_elemChildCount[dataIndex >> 4];
+    }
+    /// returns data index of child node; node type bits may be out of date
+    lUInt32 getChild(lUInt32 dataIndex, int index) const {
+        return _children[_elemFirstChild[dataIndex >> 4] + index];
+    }
+    lUInt16 getNodeId(lUInt32 dataIndex) const {
+        return _elemNodeId[dataIndex >> 4];
+    }
+    int getElementCount() const {
+        return _elemCount;
+    }
+    int getTextCount() const {
+        return _textCount;
+    }
+    void serialize(SerialBuf& buf);
+    /// reads index written by serialize(), returns false if it's broken or doesn't match node counts
+    bool deserialize(SerialBuf& buf, int elemCount, int textCount);
+};
+
+#endif // __LDOMTRAVERSALINDEX_H_INCLUDED__
@@ -497,7 +497,7 @@ bool ldomXPointerEx::prevVisibleChar(bool thisBlockOnly) {
         if (!prevVisibleText(thisBlockOnly))
             return false;
         ldomNode* node = getNode();
-        lString32 text = node->getText();
+        const lString32 text = node->getText();
         int textLen = text.length();
         _data->setOffset(textLen);
     }
@@ -517,7 +517,7 @@ bool ldomXPointerEx::nextVisibleChar(bool thisBlockOnly) {
         return true;
     }
     ldomNode* node = getNode();
-    lString32 text = node->getText();
+    const lString32 text = node->getText();
     int textLen = text.length();
     if (_data->getOffset() == textLen) {
         // move to next text
@@ -536,7 +536,7 @@ bool ldomXPointerEx::isVisibleWordChar() {
     if (!isText() || !isVisible())
         return false;
     ldomNode* node = getNode();
-    lString32 text = node->getText();
+    const lString32 text = node->getText();
     return !IsWordSeparator(text[_data->getOffset()]);
 }
 
@@ -544,21 +544,17 @@ bool ldomXPointerEx::isVisibleWordChar() {
 bool ldomXPointerEx::prevVisibleWordStart(bool thisBlockOnly) {
     if (isNull())
         return false;
-    ldomNode* node = NULL;
-    lString32 text;
     for (;;) {
+        bool toTextEnd = false;
         if (!isText() || !isVisible() || _data->getOffset() == 0) {
             // move to previous text
             if (!prevVisibleText(thisBlockOnly))
                 return false;
-            node = getNode();
-            text = node->getText();
-            int textLen = text.length();
-            _data->setOffset(textLen);
-        } else {
-            node = getNode();
-            text = node->getText();
+            toTextEnd = true;
         }
+        const lString32 text = getNode()->getText();
+        if (toTextEnd)
+            _data->setOffset(text.length());
         bool foundNonSeparator = false;
         while (_data->getOffset() > 0 && IsWordSeparator(text[_data->getOffset() - 1]))
             _data->addOffset(-1); // skip preceeding space if any (we were on a visible word start)
@@ -579,23 +575,19 @@ bool ldomXPointerEx::prevVisibleWordStart(bool thisBlockOnly) {
 bool ldomXPointerEx::prevVisibleWordEnd(bool thisBlockOnly) {
     if (isNull())
         return false;
-    ldomNode* node = NULL;
-    lString32 text;
     bool moved = false;
     for (;;) {
+        bool toTextEnd = false;
         if (!isText() || !isVisible() || _data->getOffset() == 0) {
             // move to previous text
             if (!prevVisibleText(thisBlockOnly))
                 return false;
-            node = getNode();
-            text = node->getText();
-            int textLen = text.length();
-            _data->setOffset(textLen);
+            toTextEnd = true;
             moved = true;
-        } else {
-            node = getNode();
-            text = node->getText();
         }
+        const lString32 text = getNode()->getText();
+        if (toTextEnd)
+            _data->setOffset(text.length());
         // skip separators
         while (_data->getOffset() > 0 && IsWordSeparator(text[_data->getOffset() - 1])) {
             _data->addOffset(-1);
@@ -626,32 +618,24 @@ bool ldomXPointerEx::prevVisibleWordEnd(bool thisBlockOnly) {
 bool ldomXPointerEx::nextVisibleWordStart(bool thisBlockOnly) {
     if (isNull())
         return false;
-    ldomNode* node = NULL;
-    lString32 text;
-    int textLen = 0;
     bool moved = false;
     for (;;) {
         if (!isText() || !isVisible()) {
-            // move to previous text
+            // move to next text
             if (!nextVisibleText(thisBlockOnly))
                 return false;
-            node = getNode();
-            text = node->getText();
-            textLen = text.length();
             _data->setOffset(0);
             moved = true;
-        } else {
-            for (;;) {
-                node = getNode();
-                text = node->getText();
-                textLen = text.length();
-                if (_data->getOffset() < textLen)
-                    break;
-                if (!nextVisibleText(thisBlockOnly))
-                    return false;
-                _data->setOffset(0);
-                moved = true;
-            }
+        }
+        const lString32 text = getNode()->getText();
+        int textLen = text.length();
+        if (_data->getOffset() >= textLen) {
+            // nothing left in this text: move to next one
+            if (!nextVisibleText(thisBlockOnly))
+                return false;
+            _data->setOffset(0);
+            moved = true;
+            continue;
         }
         // skip separators
         while (_data->getOffset() < textLen && IsWordSeparator(text[_data->getOffset()])) {
@@ -684,15 +668,11 @@ bool ldomXPointerEx::thisVisibleWordEnd(bool thisBlockOnly) {
     CR_UNUSED(thisBlockOnly);
     if (isNull())
         return false;
-    ldomNode* node = NULL;
-    lString32 text;
-    int textLen = 0;
     bool moved = false;
     if (!isText() || !isVisible())
         return false;
-    node = getNode();
-    text = node->getText();
-    textLen = text.length();
+    const lString32 text = getNode()->getText();
+    int textLen = text.length();
     if (_data->getOffset() >= textLen)
         return false;
     // skip separators
@@ -714,31 +694,21 @@ bool ldomXPointerEx::thisVisibleWordEnd(bool thisBlockOnly) {
 bool ldomXPointerEx::nextVisibleWordEnd(bool thisBlockOnly) {
     if (isNull())
         return false;
-    ldomNode* node = NULL;
-    lString32 text;
-    int textLen = 0;
-    //bool moved = false;
     for (;;) {
         if (!isText() || !isVisible()) {
-            // move to previous text
+            // move to next text
             if (!nextVisibleText(thisBlockOnly))
                 return false;
-            node = getNode();
-            text = node->getText();
-            textLen = text.length();
             _data->setOffset(0);
-            //moved = true;
-        } else {
-            for (;;) {
-                node = getNode();
-                text = node->getText();
-                textLen = text.length();
-                if (_data->getOffset() < textLen)
-                    break;
-                if (!nextVisibleText(thisBlockOnly))
-                    return false;
-                _data->setOffset(0);
-            }
+        }
+        const lString32 text = getNode()->getText();
+        int textLen = text.length();
+        if (_data->getOffset() >= textLen) {
+            // nothing left in this text: move to next one
+            if (!nextVisibleText(thisBlockOnly))
+                return false;
+            _data->setOffset(0);
+            continue;
         }
         bool nonSeparatorFound = false;
         // skip non-separators
@@ -775,21 +745,17 @@ bool ldomXPointerEx::nextVisibleWordEnd(bool thisBlockOnly) {
 bool ldomXPointerEx::prevVisibleWordStartInSentence(bool thisBlockOnly) {
     if (isNull())
         return false;
-    ldomNode* node = NULL;
-    lString32 text;
     for (;;) {
+        bool toTextEnd = false;
         if (!isText() || !isVisible() || _data->getOffset() == 0) {
             // move to previous text
             if (!prevVisibleText(thisBlockOnly))
                 return false;
-            node = getNode();
-            text = node->getText();
-            int textLen = text.length();
-            _data->setOffset(textLen);
-        } else {
-            node = getNode();
-            text = node->getText();
+            toTextEnd = true;
         }
+        const lString32 text = getNode()->getText();
+        if (toTextEnd)
+            _data->setOffset(text.length());
         bool foundNonSpace = false;
         while (_data->getOffset() > 0 && IsUnicodeSpace(text[_data->getOffset() - 1]))
             _data->addOffset(-1); // skip preceeding space if any (we were on a visible word start)
@@ -810,32 +776,24 @@ bool ldomXPointerEx::prevVisibleWordStartInSentence(bool thisBlockOnly) {
 bool ldomXPointerEx::nextVisibleWordStartInSentence(bool thisBlockOnly) {
     if (isNull())
         return false;
-    ldomNode* node = NULL;
-    lString32 text;
-    int textLen = 0;
     bool moved = false;
     for (;;) {
         if (!isText() || !isVisible()) {
             // move to next text
             if (!nextVisibleText(thisBlockOnly))
                 return false;
-            node = getNode();
-            text = node->getText();
-            textLen = text.length();
             _data->setOffset(0);
             moved = true;
-        } else {
-            for (;;) {
-                node = getNode();
-                text = node->getText();
-                textLen = text.length();
-                if (_data->getOffset() < textLen)
-                    break;
-                if (!nextVisibleText(thisBlockOnly))
-                    return false;
-                _data->setOffset(0);
-                moved = true;
-            }
+        }
+        const lString32 text = getNode()->getText();
+        int textLen = text.length();
+        if (_data->getOffset() >= textLen) {
+            // nothing left in this text: move to next one
+            if (!nextVisibleText(thisBlockOnly))
+                return false;
+            _data->setOffset(0);
+            moved = true;
+            continue;
         }
         // skip spaces
         while (_data->getOffset() < textLen && IsUnicodeSpace(text[_data->getOffset()])) {
@@ -867,15 +825,11 @@ bool ldomXPointerEx::nextVisibleWordStartInSentence(bool thisBlockOnly) {
 bool ldomXPointerEx::thisVisibleWordEndInSentence() {
     if (isNull())
         return false;
-    ldomNode* node = NULL;
-    lString32 text;
-    int textLen = 0;
     bool moved = false;
     if (!isText() || !isVisible())
         return false;
-    node = getNode();
-    text = node->getText();
-    textLen = text.length();
+    const lString32 text = getNode()->getText();
+    int textLen = text.length();
     if (_data->getOffset() >= textLen)
         return false;
     // skip spaces
@@ -897,31 +851,21 @@ bool ldomXPointerEx::thisVisibleWordEndInSentence() {
 bool ldomXPointerEx::nextVisibleWordEndInSentence(bool thisBlockOnly) {
     if (isNull())
         return false;
-    ldomNode* node = NULL;
-    lString32 text;
-    int textLen = 0;
-    //bool moved = false;
     for (;;) {
         if (!isText() || !isVisible()) {
-            // move to previous text
+            // move to next text
             if (!nextVisibleText(thisBlockOnly))
                 return false;
-            node = getNode();
-            text = node->getText();
-            textLen = text.length();
             _data->setOffset(0);
-            //moved = true;
-        } else {
-            for (;;) {
-                node = getNode();
-                text = node->getText();
-                textLen = text.length();
-                if (_data->getOffset() < textLen)
-                    break;
-                if (!nextVisibleText(thisBlockOnly))
-                    return false;
-                _data->setOffset(0);
-            }
+        }
+        const lString32 text = getNode()->getText();
+        int textLen = text.length();
+        if (_data->getOffset() >= textLen) {
+            // nothing left in this text: move to next one
+            if (!nextVisibleText(thisBlockOnly))
+                return false;
+            _data->setOffset(0);
+            continue;
         }
         bool nonSpaceFound = false;
         // skip non-spaces
@@ -958,23 +902,19 @@ bool ldomXPointerEx::nextVisibleWordEndInSentence(bool thisBlockOnly) {
 bool ldomXPointerEx::prevVisibleWordEndInSentence(bool thisBlockOnly) {
     if (isNull())
         return false;
-    ldomNode* node = NULL;
-    lString32 text;
     bool moved = false;
     for (;;) {
+        bool toTextEnd = false;
         if (!isText() || !isVisible() || _data->getOffset() == 0) {
             // move to previous text
             if (!prevVisibleText(thisBlockOnly))
                 return false;
-            node = getNode();
-            text = node->getText();
-            int textLen = text.length();
-            _data->setOffset(textLen);
+            toTextEnd = true;
             moved = true;
-        } else {
-            node = getNode();
-            text = node->getText();
         }
+        const lString32 text = getNode()->getText();
+        if (toTextEnd)
+            _data->setOffset(text.length());
         // skip spaces
         while (_data->getOffset() > 0 && IsUnicodeSpace(text[_data->getOffset() - 1])) {
             _data->addOffset(-1);
@@ -1008,7 +948,7 @@ bool ldomXPointerEx::isVisibleWordStart() {
     if (!isText() || !isVisible())
         return false;
     ldomNode* node = getNode();
-    lString32 text = node->getText();
+    const lString32 text = node->getText();
     int textLen = text.length();
     int i = _data->getOffset();
     // We're actually testing the boundary between the char at i-1 and
@@ -1036,7 +976,7 @@ bool ldomXPointerEx::isVisibleWordEnd() {
     if (!isText() || !isVisible())
         return false;
     ldomNode* node = getNode();
-    lString32 text = node->getText();
+    const lString32 text = node->getText();
     int textLen = text.length();
     int i = _data->getOffset();
     // We're actually testing the boundary between the char at i-1 and
@@ -1107,7 +1047,7 @@ bool ldomXPointerEx::isSentenceStart() {
     if (!isText() || !isVisible())
         return false;
     ldomNode* node = getNode();
-    lString32 text = node->getText();
+    const lString32 text = node->getText();
     int textLen = text.length();
     int i = _data->getOffset();
     lChar32 currCh = i < textLen ? text[i] : 0;
@@ -1135,7 +1075,7 @@ bool ldomXPointerEx::isSentenceStart() {
     if (!prevNonSpace) {
         ldomXPointerEx pos(*this);
         while (!prevNonSpace && pos.prevVisibleText(true)) {
-            lString32 prevText = pos.getText();
+            const lString32 prevText = pos.getText();
             for (int j = prevText.length() - 1; j >= 0; j--) {
                 lChar32 ch = prevText[j];
                 if (!IsUnicodeSpace(ch)) {
@@ -1196,7 +1136,7 @@ bool ldomXPointerEx::isSentenceEnd() {
     if (!isText() || !isVisible())
         return false;
     ldomNode* node = getNode();
-    lString32 text = node->getText();
+    const lString32 text = node->getText();
     int textLen = text.length();
     int i = _data->getOffset();
     lChar32 currCh = i < textLen ? text[i] : 0;
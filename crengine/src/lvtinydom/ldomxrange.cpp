@@ -27,6 +27,7 @@
 #include <ldomdocument.h>
 #include <lvrend.h>
 #include <lvstreamutils.h>
+#include <ldomtextview.h>
 
 #include "renderrectaccessor.h"
 #include "writenodeex.h"
@@ -175,16 +176,17 @@ bool ldomXRange::findText(lString32 pattern, bool caseInsensitive, bool reverse,
     words.clear();
     if (pattern.empty())
         return false;
+    // text of each node is decoded from text storage in place, to the same buffer
+    lString32 txt;
     if (reverse) {
         // reverse search
         if (!_end.isText()) {
             _end.prevVisibleText();
-            lString32 txt = _end.getNode()->getText();
-            _end.setOffset(txt.length());
+            _end.setOffset(ldomTextView(_end.getNode()).charCount());
         }
         int firstFoundTextY = -1;
         while (!isNull()) {
-            lString32 txt = _end.getNode()->getText();
+            ldomTextView(_end.getNode()).decode(txt);
             int offs = _end.getOffset();
             int endpos;
 
@@ -210,8 +212,7 @@ bool ldomXRange::findText(lString32 pattern, bool caseInsensitive, bool reverse,
             }
             if (!_end.prevVisibleText())
                 break;
-            txt = _end.getNode()->getText();
-            _end.setOffset(txt.length());
+            _end.setOffset(ldomTextView(_end.getNode()).charCount());
             if (words.length() >= maxCount)
                 break;
         }
@@ -236,7 +237,7 @@ bool ldomXRange::findText(lString32 pattern, bool caseInsensitive, bool reverse,
                     return words.length() > 0;
             }
 
-            lString32 txt = _start.getNode()->getText();
+            ldomTextView(_start.getNode()).decode(txt);
             if (caseInsensitive)
                 txt.lowercase();
 
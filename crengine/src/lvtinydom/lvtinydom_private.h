@@ -23,8 +23,10 @@
 #ifndef __LV_TINYDOM_PRIVATE_H_INCLUDED__
 #define __LV_TINYDOM_PRIVATE_H_INCLUDED__
 
+#include <lvtypes.h>
+
 /// change in case of incompatible changes in swap/cache file format to avoid using incompatible swap file
-#define CACHE_FILE_FORMAT_VERSION "3.12.84"
+#define CACHE_FILE_FORMAT_VERSION "3.12.85"
 
 /// increment following value to force re-formatting of old book after load
 #define FORMATTING_VERSION_ID 0x0031
@@ -48,4 +50,7 @@
 #error DOC_BUFFER_SIZE value is too large. This results in integer overflow.
 #endif
 
+/// returns hash of global font manager, hyphenation and text language settings affecting rendering
+lUInt32 calcGlobalSettingsHash(int documentId, bool already_rendered);
+
 #endif // __LV_TINYDOM_PRIVATE_H_INCLUDED__
@@ -31,9 +31,13 @@
 
 #include "lvtinydom_private.h"
 #include "ldomblobcache.h"
+#include "ldomrendervariants.h"
+#include "ldomtraversalindex.h"
 #include "tinyelement.h"
+#include "lxmlattribute.h"
 #include "cachefile.h"
 #include "ldomdatastoragemanager.h"
+#include "ldomtextstoragechunk.h"
 
 #include "../textlang.h"
 
@@ -51,6 +55,12 @@
 #define RECT_CACHE_CHUNK_SIZE      0x00F000 // 64K
 #define STYLE_CACHE_UNPACKED_SPACE (10 * DOC_BUFFER_SIZE / 100)
 #define STYLE_CACHE_CHUNK_SIZE     0x00C000 // 48K
+#define DECODED_TEXT_CACHE_SIZE    32       // text nodes
+
+// cache file compression dictionary training
+#define CACHE_DICT_SAMPLE_SIZE      0x000400 // 1K pieces of chunks
+#define CACHE_DICT_MIN_DATA_SIZE    0x100000 // 1M, smaller documents get no dictionary
+#define CACHE_DICT_MAX_SAMPLES_SIZE 0x080000 // 512K
 
 // default is to compress to use smaller cache files (but slower rendering
 // and page turns with big documents)
@@ -68,8 +78,6 @@ void setCacheCompressionType(CacheCompressionType type) {
 
 static const char* styles_magic = "CRSTYLES";
 
-lUInt32 calcGlobalSettingsHash(int documentId, bool already_rendered);
-
 img_scaling_option_t::img_scaling_option_t() {
     mode = (MAX_IMAGE_SCALE_MUL > 1) ? (ARBITRARY_IMAGE_SCALE_ENABLED == 1 ? IMG_FREE_SCALING : IMG_INTEGER_SCALING) : IMG_NO_SCALE;
     max_scale = (MAX_IMAGE_SCALE_MUL > 1) ? MAX_IMAGE_SCALE_MUL : 1;
@@ -194,10 +202,23 @@ tinyNodeCollection::tinyNodeCollection()
         , _fonts(FONT_HASH_TABLE_SIZE)
         , _tinyElementCount(0)
         , _itemCount(0)
+        , _lazyParts(NULL)
+        , _decodedTextCache(DECODED_TEXT_CACHE_SIZE)
+        , _styleSharing(NULL)
+        , _styleSharingEnabled(true)
+        , _styleSharingLookups(0)
+        , _styleSharingHits(0)
         , _renderedBlockCache(256)
         , _cacheFile(NULL)
         , _cacheFileStale(true)
         , _cacheFileLeaveAsDirty(false)
+        , _mappedCacheReads(false)
+        , _lazyNodeLoading(false)
+        , _cacheCompressionDictionary(false)
+        , _maxRenderVariants(0)
+        , _traversalIndexEnabled(false)
+        , _accessMutex(NULL)
+        , _useDepth(0)
         , _mapped(false)
         , _maperror(false)
         , _mapSavingStage(0)
@@ -225,6 +246,8 @@ tinyNodeCollection::tinyNodeCollection()
     memset(_textList, 0, sizeof(_textList));
     memset(_elemList, 0, sizeof(_elemList));
     _blobCache = new ldomBlobCache;
+    _renderVariants = new ldomRenderVariants;
+    _traversalIndex = NULL;
     // _docIndex assigned in ldomDocument constructor
 }
 
@@ -237,10 +260,23 @@ tinyNodeCollection::tinyNodeCollection(tinyNodeCollection& v)
         , _fonts(FONT_HASH_TABLE_SIZE)
         , _tinyElementCount(0)
         , _itemCount(0)
+        , _lazyParts(NULL)
+        , _decodedTextCache(DECODED_TEXT_CACHE_SIZE)
+        , _styleSharing(NULL)
+        , _styleSharingEnabled(v._styleSharingEnabled)
+        , _styleSharingLookups(0)
+        , _styleSharingHits(0)
         , _renderedBlockCache(256)
         , _cacheFile(NULL)
         , _cacheFileStale(true)
         , _cacheFileLeaveAsDirty(false)
+        , _mappedCacheReads(v._mappedCacheReads)
+        , _lazyNodeLoading(v._lazyNodeLoading)
+        , _cacheCompressionDictionary(v._cacheCompressionDictionary)
+        , _maxRenderVariants(v._maxRenderVariants)
+        , _traversalIndexEnabled(v._traversalIndexEnabled)
+        , _accessMutex(NULL)
+        , _useDepth(0)
         , _mapped(false)
         , _maperror(false)
         , _mapSavingStage(0)
@@ -269,6 +305,8 @@ tinyNodeCollection::tinyNodeCollection(tinyNodeCollection& v)
     memset(_textList, 0, sizeof(_textList));
     memset(_elemList, 0, sizeof(_elemList));
     _blobCache = new ldomBlobCache;
+    _renderVariants = new ldomRenderVariants;
+    _traversalIndex = NULL;
     // _docIndex assigned in ldomDocument constructor
 }
 
@@ -320,6 +358,38 @@ bool tinyNodeCollection::setInterlineScaleFactor(int value) {
     return false;
 }
 
+void tinyNodeCollection::setMaxRenderVariants(int count) {
+    if (count < 0)
+        count = 0;
+    if (count > MAX_RENDER_VARIANTS)
+        count = MAX_RENDER_VARIANTS;
+    _maxRenderVariants = count;
+}
+
+void tinyNodeCollection::setTraversalIndex(bool enabled) {
+    _traversalIndexEnabled = enabled;
+    if (!enabled)
+        dropTraversalIndex();
+}
+
+void tinyNodeCollection::freeTraversalIndex() {
+    delete _traversalIndex;
+    _traversalIndex = NULL;
+}
+
+void tinyNodeCollection::updateTraversalIndex() {
+    if (!_traversalIndexEnabled || _traversalIndex)
+        return;
+    ldomNode* root = getTinyNode(17); // see lxmlDocBase::getRootNode()
+    if (!root)
+        return;
+    // tree is walked through storage while index is not set
+    ldomTraversalIndex* index = new ldomTraversalIndex;
+    index->build(root, _elemCount, _textCount);
+    _traversalIndex = index;
+    CRLog::debug("Traversal index is built for %d elements and %d text nodes", _elemCount, _textCount);
+}
+
 bool tinyNodeCollection::openCacheFile() {
     if (_cacheFile)
         return true;
@@ -351,6 +421,8 @@ bool tinyNodeCollection::openCacheFile() {
         return false;
     }
     CRLog::info("ldomDocument::openCacheFile() - index read successfully %s", UnicodeToUtf8(fname).c_str());
+    if (_mappedCacheReads && !f->mapForReading(cache_path))
+        CRLog::warn("ldomDocument::openCacheFile() - cannot map cache file, reading from stream");
     f->setCachePath(cache_path);
     _cacheFile = f;
     _textStorage->setCache(f);
@@ -358,6 +430,7 @@ bool tinyNodeCollection::openCacheFile() {
     _rectStorage->setCache(f);
     _styleStorage->setCache(f);
     _blobCache->setCacheFile(f);
+    _renderVariants->setCacheFile(f);
     return true;
 }
 
@@ -408,10 +481,27 @@ bool tinyNodeCollection::createCacheFile() {
     _rectStorage->setCache(f);
     _styleStorage->setCache(f);
     _blobCache->setCacheFile(f);
+    _renderVariants->setCacheFile(f);
     setCacheFileStale(true);
     return true;
 }
 
+void tinyNodeCollection::trainCacheDictionary() {
+    if (!_cacheCompressionDictionary || !_cacheFile || !_cacheFile->canTrainDictionary())
+        return;
+    // dictionary is stored in file too: it's worth it for big enough data only,
+    // may be tried again on next saving, when more data is unpacked
+    lUInt32 dataSize = _textStorage->getUncompressedSize() + _elemStorage->getUncompressedSize() + _rectStorage->getUncompressedSize();
+    if (dataSize < CACHE_DICT_MIN_DATA_SIZE)
+        return;
+    LVArray<lUInt8> samples;
+    LVArray<size_t> sampleSizes;
+    _textStorage->addDictionarySamples(samples, sampleSizes, CACHE_DICT_SAMPLE_SIZE, CACHE_DICT_MAX_SAMPLES_SIZE / 3);
+    _elemStorage->addDictionarySamples(samples, sampleSizes, CACHE_DICT_SAMPLE_SIZE, CACHE_DICT_MAX_SAMPLES_SIZE / 3);
+    _rectStorage->addDictionarySamples(samples, sampleSizes, CACHE_DICT_SAMPLE_SIZE, CACHE_DICT_MAX_SAMPLES_SIZE / 3);
+    _cacheFile->trainDictionary(samples.get(), sampleSizes.get(), sampleSizes.length());
+}
+
 lString32 tinyNodeCollection::getCacheFilePath() {
     return _cacheFile != NULL ? _cacheFile->getCachePath() : lString32::empty_str;
 }
@@ -499,47 +589,167 @@ lUInt16 tinyNodeCollection::getNodeFontIndex(lUInt32 dataIndex) {
     return info._fontIndex;
 }
 
-bool tinyNodeCollection::loadNodeData(lUInt16 type, ldomNode** list, int nodecount) {
-    int count = ((nodecount + TNC_PART_LEN - 1) >> TNC_PART_SHIFT);
-    for (lUInt16 i = 0; i < count; i++) {
-        int offs = i * TNC_PART_LEN;
-        int sz = TNC_PART_LEN;
-        if (offs + sz > nodecount) {
-            sz = nodecount - offs;
-        }
+/// number of recently styled elements remembered for style sharing
+#define STYLE_SHARING_CACHE_SIZE 8
+
+struct tinyNodeCollection::StyleSharingCache
+{
+    struct Item
+    {
+        lUInt32 parentIndex; // data index of parent element
+        lUInt32 dataIndex;   // data index of styled element
+        lUInt16 id;          // element name id
+        bool pseudoBefore;   // element requires ::before pseudo element
+        bool pseudoAfter;    // element requires ::after pseudo element
+        // results of stylesheet selectors checking siblings or children, see LVStyleSheet::getLastApplyChecks()
+        LVArray<lUInt32> checks;
+    };
+    Item items[STYLE_SHARING_CACHE_SIZE];
+    int count;
+    int next; // item to replace when cache is full
+    StyleSharingCache()
+            : count(0)
+            , next(0) { }
+};
+
+void tinyNodeCollection::startStyleSharing() {
+    endStyleSharing();
+    if (_styleSharingEnabled)
+        _styleSharing = new StyleSharingCache;
+}
+
+void tinyNodeCollection::endStyleSharing() {
+    delete _styleSharing;
+    _styleSharing = NULL;
+}
 
-        lUInt8* p;
-        int buflen;
-        if (!_cacheFile->read(type, i, p, buflen))
+// Both elements must have the same attributes in the same order: class, id and
+// any other attribute may be checked by stylesheet
+static bool sameNodeAttributes(const ldomNode* node1, const ldomNode* node2) {
+    int count = node1->getAttrCount();
+    if (node2->getAttrCount() != count)
+        return false;
+    for (int i = 0; i < count; i++) {
+        const lxmlAttribute* attr1 = node1->getAttribute(i);
+        const lxmlAttribute* attr2 = node2->getAttribute(i);
+        if (attr1->id != attr2->id || attr1->nsid != attr2->nsid || attr1->index != attr2->index)
+            return false;
+    }
+    return true;
+}
+
+bool tinyNodeCollection::shareNodeStyle(ldomNode* node, bool& pseudoBefore, bool& pseudoAfter) {
+    if (!_styleSharing)
+        return false;
+    _styleSharingLookups++;
+    lUInt32 parentIndex = node->getParentNode()->getDataIndex();
+    lUInt32 dataIndex = node->getDataIndex();
+    lUInt16 id = node->getNodeId();
+    for (int i = 0; i < _styleSharing->count; i++) {
+        const StyleSharingCache::Item& item = _styleSharing->items[i];
+        if (item.parentIndex != parentIndex || item.id != id || item.dataIndex == dataIndex)
+            continue;
+        ldomNode* sibling = getTinyNode(item.dataIndex);
+        if (!sibling || !sameNodeAttributes(node, sibling) || !_stylesheet.checkSameResults(node, item.checks))
+            continue;
+        lUInt16 styleIndex = getNodeStyleIndex(item.dataIndex);
+        lUInt16 fontIndex = getNodeFontIndex(item.dataIndex);
+        if (!styleIndex || !fontIndex)
             return false;
-        if (!p || (unsigned)buflen != sizeof(ldomNode) * sz)
+        ldomNodeStyleInfo info;
+        _styleStorage->getStyleData(node->getDataIndex(), &info);
+        if (info._styleIndex != styleIndex) {
+            _styles.addIndexRef(styleIndex);
+            _styles.release(info._styleIndex);
+            info._styleIndex = styleIndex;
+        }
+        if (info._fontIndex != fontIndex) {
+            _fonts.addIndexRef(fontIndex);
+            _fonts.release(info._fontIndex);
+            info._fontIndex = fontIndex;
+        }
+        _styleStorage->setStyleData(node->getDataIndex(), &info);
+        _nodeStyleHash = 0;
+        pseudoBefore = item.pseudoBefore;
+        pseudoAfter = item.pseudoAfter;
+        _styleSharingHits++;
+        return true;
+    }
+    return false;
+}
+
+void tinyNodeCollection::addSharedNodeStyle(ldomNode* node, bool pseudoBefore, bool pseudoAfter) {
+    if (!_styleSharing)
+        return;
+    int index;
+    if (_styleSharing->count < STYLE_SHARING_CACHE_SIZE) {
+        index = _styleSharing->count++;
+    } else {
+        index = _styleSharing->next;
+        _styleSharing->next = (index + 1) % STYLE_SHARING_CACHE_SIZE;
+    }
+    StyleSharingCache::Item& item = _styleSharing->items[index];
+    item.parentIndex = node->getParentNode()->getDataIndex();
+    item.dataIndex = node->getDataIndex();
+    item.id = node->getNodeId();
+    item.pseudoBefore = pseudoBefore;
+    item.pseudoAfter = pseudoAfter;
+    item.checks = _stylesheet.getLastApplyChecks();
+}
+
+struct tinyNodeCollection::LazyNodeParts
+{
+    int partCount[2];                      // number of segments in cache file: [0] - text nodes, [1] - elements
+    int nodeCount[2];                      // number of nodes in cache file, including NULL node
+    lUInt32 hash[2][TNC_PART_COUNT];       // crc32 of segment data after reading
+    bool modified[2][TNC_PART_COUNT];      // segment is changed since reading, can't be freed
+    bool used[2][TNC_PART_COUNT];          // segment is accessed since previous unloadNodeParts() call
+};
+
+bool tinyNodeCollection::loadNodeData(lUInt16 type, int index, ldomNode** list, int nodecount) {
+    int offs = index * TNC_PART_LEN;
+    int sz = TNC_PART_LEN;
+    if (offs + sz > nodecount) {
+        sz = nodecount - offs;
+    }
+
+    lUInt8* p;
+    int buflen;
+    // _elemList, _textList (as `list' argument) must always be TNC_PART_LEN size:
+    // read block directly into buffer of this size
+    if (!_cacheFile->read(type, index, p, buflen, TNC_PART_LEN * sizeof(ldomNode)))
+        return false;
+    if (!p || (unsigned)buflen != sizeof(ldomNode) * sz) {
+        free(p);
+        return false;
+    }
+    list[index] = (ldomNode*)p;
+    if (sz < TNC_PART_LEN) {
+        // buf contains `sz' ldomNode items, zero fill the rest (TNC_PART_LEN - sz) items
+        memset(list[index] + sz, 0, (TNC_PART_LEN - sz) * sizeof(ldomNode));
+    }
+    for (int j = 0; j < sz; j++) {
+        list[index][j].setDocumentIndex(_docIndex);
+        // validate loaded nodes: all non-null nodes should be marked as persistent, i.e. the actual node data: _data._pelem_addr, _data._ptext_addr,
+        // NOT _data._elem_ptr, _data._text_ptr.
+        // So we check this flag, but after setting document so that isNull() works correctly.
+        // If the node is not persistent now, then _data._elem_ptr will be used, which then generate SEGFAULT.
+        if (!list[index][j].isNull() && !list[index][j].isPersistent()) {
+            CRLog::error("Invalid cached node, flag PERSISTENT are NOT set: segment=%d, index=%d", index, j);
+            // list[index] will be freed in the caller method.
             return false;
-        ldomNode* buf = (ldomNode*)p;
-        if (sz == TNC_PART_LEN)
-            list[i] = buf;
-        else {
-            // buf contains `sz' ldomNode items
-            // _elemList, _textList (as `list' argument) must always be TNC_PART_LEN size
-            // add into `list' zero filled (TNC_PART_LEN - sz) items
-            list[i] = (ldomNode*)realloc(buf, TNC_PART_LEN * sizeof(ldomNode));
-            if (NULL == list[i]) {
-                free(buf);
-                CRLog::error("Not enough memory!");
-                return false;
-            }
-            memset(list[i] + sz, 0, (TNC_PART_LEN - sz) * sizeof(ldomNode));
         }
+    }
+    return true;
+}
+
+bool tinyNodeCollection::loadNodeData(lUInt16 type, ldomNode** list, int nodecount) {
+    int count = ((nodecount + TNC_PART_LEN - 1) >> TNC_PART_SHIFT);
+    for (lUInt16 i = 0; i < count; i++) {
+        if (!loadNodeData(type, i, list, nodecount))
+            return false;
+        int sz = i < count - 1 ? TNC_PART_LEN : nodecount - i * TNC_PART_LEN;
         for (int j = 0; j < sz; j++) {
-            list[i][j].setDocumentIndex(_docIndex);
-            // validate loaded nodes: all non-null nodes should be marked as persistent, i.e. the actual node data: _data._pelem_addr, _data._ptext_addr,
-            // NOT _data._elem_ptr, _data._text_ptr.
-            // So we check this flag, but after setting document so that isNull() works correctly.
-            // If the node is not persistent now, then _data._elem_ptr will be used, which then generate SEGFAULT.
-            if (!list[i][j].isNull() && !list[i][j].isPersistent()) {
-                CRLog::error("Invalid cached node, flag PERSISTENT are NOT set: segment=%d, index=%d", i, j);
-                // list[i] will be freed in the caller method.
-                return false;
-            }
             if (list[i][j].isElement()) {
                 // will be set by loadStyles/updateStyles
                 //list[i][j]._data._pelem._styleIndex = 0;
@@ -596,12 +806,21 @@ bool tinyNodeCollection::saveNodeData() {
         return false;
     if (!_cacheFile->write(CBT_NODE_INDEX, buf, COMPRESS_NODE_DATA))
         return false;
+    if (_traversalIndex) {
+        SerialBuf indexbuf(0, true);
+        _traversalIndex->serialize(indexbuf);
+        if (indexbuf.error() || !_cacheFile->write(CBT_TRAVERSAL_INDEX, indexbuf, COMPRESS_NODE_DATA))
+            return false;
+    } else {
+        // tree is changed or index is disabled: don't leave out of date one
+        _cacheFile->removeBlock(CBT_TRAVERSAL_INDEX, 0);
+    }
     return true;
 }
 
 bool tinyNodeCollection::loadNodeData() {
     SerialBuf buf(0, true);
-    if (!_cacheFile->read((lUInt16)CBT_NODE_INDEX, buf))
+    if (!_cacheFile->readInPlace((lUInt16)CBT_NODE_INDEX, buf))
         return false;
     lUInt32 magic;
     lInt32 elemcount;
@@ -614,6 +833,27 @@ bool tinyNodeCollection::loadNodeData() {
         return false;
     if (textcount <= 0)
         return false;
+    if (_lazyNodeLoading) {
+        // segments are read by getNodePart() on first access
+        for (int i = 0; i < TNC_PART_COUNT; i++) {
+            if (_elemList[i])
+                free(_elemList[i]);
+            if (_textList[i])
+                free(_textList[i]);
+        }
+        memset(_elemList, 0, sizeof(_elemList));
+        memset(_textList, 0, sizeof(_textList));
+        if (!_lazyParts)
+            _lazyParts = new LazyNodeParts;
+        memset(_lazyParts, 0, sizeof(LazyNodeParts));
+        _lazyParts->nodeCount[0] = textcount + 1;
+        _lazyParts->nodeCount[1] = elemcount + 1;
+        for (int i = 0; i < 2; i++)
+            _lazyParts->partCount[i] = (_lazyParts->nodeCount[i] + TNC_PART_LEN - 1) >> TNC_PART_SHIFT;
+        _elemCount = elemcount;
+        _textCount = textcount;
+        return true;
+    }
     ldomNode* elemList[TNC_PART_COUNT] = { 0 };
     ldomNode* textList[TNC_PART_COUNT] = { 0 };
     if (!loadNodeData(CBT_ELEM_NODE, elemList, elemcount + 1)) {
@@ -640,21 +880,136 @@ bool tinyNodeCollection::loadNodeData() {
     }
     memcpy(_elemList, elemList, sizeof(elemList));
     memcpy(_textList, textList, sizeof(textList));
+    delete _lazyParts;
+    _lazyParts = NULL;
     _elemCount = elemcount;
     _textCount = textcount;
     return true;
 }
 
+bool tinyNodeCollection::loadTraversalIndex() {
+    dropTraversalIndex();
+    if (!_traversalIndexEnabled || !_cacheFile->hasBlock(CBT_TRAVERSAL_INDEX, 0))
+        return false;
+    SerialBuf buf(0, true);
+    if (!_cacheFile->readInPlace(CBT_TRAVERSAL_INDEX, buf))
+        return false;
+    ldomTraversalIndex* index = new ldomTraversalIndex;
+    if (!index->deserialize(buf, _elemCount, _textCount)) {
+        CRLog::warn("Traversal index in cache file is invalid, ignored");
+        delete index;
+        return false;
+    }
+    _traversalIndex = index;
+    return true;
+}
+
 /// get ldomNode instance pointer
 ldomNode* tinyNodeCollection::getTinyNode(lUInt32 index) const {
     if (!index)
         return NULL;
+    if (_lazyParts) // segment may be not loaded yet
+        return &(((tinyNodeCollection*)this)->getNodePart(index & 1, index >> TNC_PART_INDEX_SHIFT)[(index >> 4) & TNC_PART_MASK]);
     if (index & 1) // element
         return &(_elemList[index >> TNC_PART_INDEX_SHIFT][(index >> 4) & TNC_PART_MASK]);
     else // text
         return &(_textList[index >> TNC_PART_INDEX_SHIFT][(index >> 4) & TNC_PART_MASK]);
 }
 
+ldomNode* tinyNodeCollection::getNodePart(bool elem, int part) {
+    ldomNode* res = elem ? _elemList[part] : _textList[part];
+    if (_lazyParts && part < _lazyParts->partCount[elem]) {
+        if (!res)
+            res = loadNodePart(elem, part);
+        _lazyParts->used[elem][part] = true;
+    }
+    return res;
+}
+
+ldomNode* tinyNodeCollection::loadNodePart(bool elem, int part) {
+    ldomNode** list = elem ? _elemList : _textList;
+    if (!loadNodeData(elem ? CBT_ELEM_NODE : CBT_TEXT_NODE, part, list, _lazyParts->nodeCount[elem])) {
+        // cache file is validated on opening, so it's either I/O error or corrupted file
+        free(list[part]);
+        list[part] = NULL;
+        crFatalError(-1, "Cannot read node data");
+    }
+    _lazyParts->hash[elem][part] = lStr_crc32(0, list[part], TNC_PART_LEN * sizeof(ldomNode));
+    _lazyParts->modified[elem][part] = false;
+    return list[part];
+}
+
+lString32 tinyNodeCollection::getDecodedText(lUInt32 dataIndex, lUInt32 addr) {
+    // text storage address is never reused, so pair of it with node data index (never 0) identifies text
+    lUInt64 key = ((lUInt64)addr << 32) | dataIndex;
+    lString32 text;
+    // reading text storage updates its recent chunks list and may unpack chunk, so it's done under the lock too
+    LVLock lock(_textReadMutex);
+    if (_decodedTextCache.get(key, text))
+        return text;
+    const lChar8* utf8;
+    int len;
+    ldomTextStorageChunk* chunk = _textStorage->pinText(addr, utf8, len);
+    if (!chunk)
+        return lString32::empty_str;
+    text = Utf8ToUnicode(utf8, len);
+    chunk->unpin();
+    _decodedTextCache.set(key, text);
+    return text;
+}
+
+ldomTextStorageChunk* tinyNodeCollection::pinText(lUInt32 addr, const lChar8*& text, int& length) {
+    LVLock lock(_textReadMutex);
+    return _textStorage->pinText(addr, text, length);
+}
+
+int tinyNodeCollection::unloadNodeParts(bool unusedOnly) {
+    // mutable elements keep pointers to their parent nodes; rendering, drawing and
+    // formatting tasks keep pointers to nodes and formatted blocks referring to them
+    if (!_lazyParts || _tinyElementCount > 0 || isInUse())
+        return 0;
+    int count = 0;
+    for (int elem = 0; elem < 2; elem++) {
+        ldomNode** list = elem ? _elemList : _textList;
+        for (int i = 0; i < _lazyParts->partCount[elem]; i++) {
+            if (!list[i] || _lazyParts->modified[elem][i])
+                continue;
+            if (unusedOnly && _lazyParts->used[elem][i]) {
+                _lazyParts->used[elem][i] = false;
+                continue;
+            }
+            if (lStr_crc32(0, list[i], TNC_PART_LEN * sizeof(ldomNode)) != _lazyParts->hash[elem][i]) {
+                // nodes are added or changed: keep in memory, will be saved to cache file
+                _lazyParts->modified[elem][i] = true;
+                continue;
+            }
+            free(list[i]);
+            list[i] = NULL;
+            _lazyParts->used[elem][i] = false;
+            count++;
+        }
+    }
+    if (count > 0) {
+        // formatted blocks refer to nodes by pointers
+        _renderedBlockCache.clear();
+        CRLog::debug("unloadNodeParts: %d node segments freed, %d left in memory", count, getLoadedNodePartCount());
+    }
+    return count;
+}
+
+int tinyNodeCollection::getLoadedNodePartCount() const {
+    int count = 0;
+    for (int i = 0; i <= (_elemCount >> TNC_PART_SHIFT); i++) {
+        if (_elemList[i])
+            count++;
+    }
+    for (int i = 0; i <= (_textCount >> TNC_PART_SHIFT); i++) {
+        if (_textList[i])
+            count++;
+    }
+    return count;
+}
+
 /// allocate new tiny node
 ldomNode* tinyNodeCollection::allocTinyNode(int type) {
     ldomNode* res;
@@ -672,7 +1027,7 @@ ldomNode* tinyNodeCollection::allocTinyNode(int type) {
             int idx = _elemCount >> TNC_PART_SHIFT;
             if (idx >= TNC_PART_COUNT)
                 crFatalError(1003, "allocTinyNode: can't create any more element nodes (hard limit)");
-            ldomNode* part = _elemList[idx];
+            ldomNode* part = getNodePart(true, idx);
             if (!part) {
                 part = (ldomNode*)calloc(TNC_PART_LEN, sizeof(*part));
                 _elemList[idx] = part;
@@ -695,7 +1050,7 @@ ldomNode* tinyNodeCollection::allocTinyNode(int type) {
             _textCount++;
             if (_textCount >= (TNC_PART_COUNT << TNC_PART_SHIFT))
                 crFatalError(1003, "allocTinyNode: can't create any more text nodes (hard limit)");
-            ldomNode* part = _textList[_textCount >> TNC_PART_SHIFT];
+            ldomNode* part = getNodePart(false, _textCount >> TNC_PART_SHIFT);
             if (!part) {
                 part = (ldomNode*)calloc(TNC_PART_LEN, sizeof(*part));
                 _textList[_textCount >> TNC_PART_SHIFT] = part;
@@ -707,6 +1062,7 @@ ldomNode* tinyNodeCollection::allocTinyNode(int type) {
         _itemCount++;
     }
     _nodeStyleHash = 0;
+    dropTraversalIndex();
     return res;
 }
 
@@ -714,7 +1070,7 @@ void tinyNodeCollection::recycleTinyNode(lUInt32 index) {
     if (index & 1) {
         // element
         index >>= 4;
-        ldomNode* part = _elemList[index >> TNC_PART_SHIFT];
+        ldomNode* part = getNodePart(true, index >> TNC_PART_SHIFT);
         ldomNode* p = &part[index & TNC_PART_MASK];
         p->_handle._dataIndex = 0; // indicates NULL node
         p->_data._nextFreeIndex = _elemNextFree;
@@ -723,7 +1079,7 @@ void tinyNodeCollection::recycleTinyNode(lUInt32 index) {
     } else {
         // text
         index >>= 4;
-        ldomNode* part = _textList[index >> TNC_PART_SHIFT];
+        ldomNode* part = getNodePart(false, index >> TNC_PART_SHIFT);
         ldomNode* p = &part[index & TNC_PART_MASK];
         p->_handle._dataIndex = 0; // indicates NULL node
         p->_data._nextFreeIndex = _textNextFree;
@@ -731,11 +1087,14 @@ void tinyNodeCollection::recycleTinyNode(lUInt32 index) {
         _itemCount--;
     }
     _nodeStyleHash = 0;
+    dropTraversalIndex();
 }
 
 tinyNodeCollection::~tinyNodeCollection() {
-    if (_cacheFile)
-        delete _cacheFile;
+    // memory governor may be working with storages in another thread
+    ldomMemoryGovernorImpl::unregisterDocument(this);
+    // pending background writes are finished without blocking
+    CacheFile::release(_cacheFile);
     // clear all elem parts
     for (int partindex = 0; partindex <= (_elemCount >> TNC_PART_SHIFT); partindex++) {
         ldomNode* part = _elemList[partindex];
@@ -758,7 +1117,11 @@ tinyNodeCollection::~tinyNodeCollection() {
             _textList[partindex] = NULL;
         }
     }
+    delete _lazyParts;
+    delete _styleSharing;
     delete _blobCache;
+    delete _renderVariants;
+    delete _traversalIndex;
     delete _textStorage;
     delete _elemStorage;
     delete _rectStorage;
@@ -815,7 +1178,7 @@ void tinyNodeCollection::dropStyles() {
         if (offs + sz > _elemCount + 1) {
             sz = _elemCount + 1 - offs;
         }
-        ldomNode* buf = _elemList[i];
+        ldomNode* buf = getNodePart(true, i);
         for (int j = 0; j < sz; j++) {
             if (buf[j].isElement()) {
                 setNodeStyleIndex(buf[j]._handle._dataIndex, 0);
@@ -835,7 +1198,7 @@ int tinyNodeCollection::calcFinalBlocks() {
         if (offs + sz > _elemCount + 1) {
             sz = _elemCount + 1 - offs;
         }
-        ldomNode* buf = _elemList[i];
+        ldomNode* buf = getNodePart(true, i);
         for (int j = 0; j < sz; j++) {
             if (buf[j].isElement()) {
                 int rm = buf[j].getRendMethod();
@@ -867,8 +1230,7 @@ int tinyNodeCollection::getPersistenceFlags() {
     return flag;
 }
 
-bool tinyNodeCollection::saveStylesData() {
-    SerialBuf stylebuf(0, true);
+bool tinyNodeCollection::serializeStyles(SerialBuf& stylebuf) {
     lUInt32 stHash = _stylesheet.getHash();
     LVArray<css_style_ref_t>* list = _styles.getIndex();
     stylebuf.putMagic(styles_magic);
@@ -884,7 +1246,12 @@ bool tinyNodeCollection::saveStylesData() {
     stylebuf << (lUInt32)0; // index=0 is end list mark
     stylebuf.putMagic(styles_magic);
     delete list;
-    if (stylebuf.error())
+    return !stylebuf.error();
+}
+
+bool tinyNodeCollection::saveStylesData() {
+    SerialBuf stylebuf(0, true);
+    if (!serializeStyles(stylebuf))
         return false;
     CRLog::trace("Writing style data: %d bytes", stylebuf.pos());
     if (!_cacheFile->write(CBT_STYLE_DATA, stylebuf, COMPRESS_STYLE_DATA)) {
@@ -893,12 +1260,7 @@ bool tinyNodeCollection::saveStylesData() {
     return !stylebuf.error();
 }
 
-bool tinyNodeCollection::loadStylesData() {
-    SerialBuf stylebuf(0, true);
-    if (!_cacheFile->read(CBT_STYLE_DATA, stylebuf)) {
-        CRLog::error("Error while reading style data");
-        return false;
-    }
+bool tinyNodeCollection::deserializeStyles(SerialBuf& stylebuf, LVArray<css_style_ref_t>& list) {
     lUInt32 stHash = 0;
     lInt32 len = 0;
 
@@ -924,7 +1286,7 @@ bool tinyNodeCollection::loadStylesData() {
     stylebuf >> len; // index
     if (stylebuf.error())
         return false;
-    LVArray<css_style_ref_t> list(len, css_style_ref_t());
+    list = LVArray<css_style_ref_t>(len, css_style_ref_t());
     for (int i = 0; i < list.length(); i++) {
         lUInt32 index = 0;
         stylebuf >> index; // index
@@ -936,7 +1298,17 @@ bool tinyNodeCollection::loadStylesData() {
         list.set(index, rec);
     }
     stylebuf.checkMagic(styles_magic);
-    if (stylebuf.error())
+    return !stylebuf.error();
+}
+
+bool tinyNodeCollection::loadStylesData() {
+    SerialBuf stylebuf(0, true);
+    if (!_cacheFile->readInPlace(CBT_STYLE_DATA, stylebuf)) {
+        CRLog::error("Error while reading style data");
+        return false;
+    }
+    LVArray<css_style_ref_t> list;
+    if (!deserializeStyles(stylebuf, list))
         return false;
 
     CRLog::trace("Setting style data: %d bytes", stylebuf.size());
@@ -945,13 +1317,33 @@ bool tinyNodeCollection::loadStylesData() {
     return !stylebuf.error();
 }
 
+lUInt32 tinyNodeCollection::addNodeStyleHash(lUInt32 hash, ldomNode* node) {
+    css_style_ref_t style = node->getStyle();
+    lUInt32 sh = calcHash(style);
+    hash = hash * 31 + sh;
+    if (!style.isNull()) {
+        _nodeDisplayStyleHash = _nodeDisplayStyleHash * 31 + style.get()->display;
+        // Also account in this hash if this node is "white_space: pre" or alike.
+        // If white_space changes from/to "pre"-like to/from "normal"-like,
+        // the document will need to be reloaded so that the HTML text parts
+        // are parsed according the the PRE/not-PRE rules
+        if (style.get()->white_space >= css_ws_pre_line)
+            _nodeDisplayStyleHash += 29;
+        // Also account for style->float_, as it should create/remove new floatBox
+        // elements wrapping floats when toggling BLOCK_RENDERING_ENHANCED
+        if (style.get()->float_ > css_f_none)
+            _nodeDisplayStyleHash += 123;
+    }
+    LVFontRef font = node->getFont();
+    lUInt32 fh = calcHash(font);
+    hash = hash * 31 + fh;
+    return hash;
+}
+
 lUInt32 tinyNodeCollection::calcStyleHash(bool already_rendered) {
     CRLog::debug("calcStyleHash start");
     //    int maxlog = 20;
     lUInt32 res = 0; //_elemCount;
-    lUInt32 globalHash = calcGlobalSettingsHash(getFontContextDocIndex(), already_rendered);
-    lUInt32 docFlags = getDocFlags();
-    //CRLog::info("Calculating style hash...  elemCount=%d, globalHash=%08x, docFlags=%08x", _elemCount, globalHash, docFlags);
     if (_nodeStyleHash) {
         // Re-use saved _nodeStyleHash if it has not been invalidated,
         // as the following loop can be expensive
@@ -973,38 +1365,12 @@ lUInt32 tinyNodeCollection::calcStyleHash(bool already_rendered) {
             if (offs + sz > _elemCount + 1) {
                 sz = _elemCount + 1 - offs;
             }
-            ldomNode* buf = _elemList[i];
+            ldomNode* buf = getNodePart(true, i);
             if (!buf)
                 continue; // avoid clang-tidy warning
             for (int j = 0; j < sz; j++) {
-                if (buf[j].isElement()) {
-                    css_style_ref_t style = buf[j].getStyle();
-                    lUInt32 sh = calcHash(style);
-                    res = res * 31 + sh;
-                    if (!style.isNull()) {
-                        _nodeDisplayStyleHash = _nodeDisplayStyleHash * 31 + style.get()->display;
-                        // Also account in this hash if this node is "white_space: pre" or alike.
-                        // If white_space changes from/to "pre"-like to/from "normal"-like,
-                        // the document will need to be reloaded so that the HTML text parts
-                        // are parsed according the the PRE/not-PRE rules
-                        if (style.get()->white_space >= css_ws_pre_line)
-                            _nodeDisplayStyleHash += 29;
-                        // Also account for style->float_, as it should create/remove new floatBox
-                        // elements wrapping floats when toggling BLOCK_RENDERING_ENHANCED
-                        if (style.get()->float_ > css_f_none)
-                            _nodeDisplayStyleHash += 123;
-                    }
-                    //printf("element %d %d style hash: %x\n", i, j, sh);
-                    LVFontRef font = buf[j].getFont();
-                    lUInt32 fh = calcHash(font);
-                    res = res * 31 + fh;
-                    //printf("element %d %d font hash: %x\n", i, j, fh);
-                    //                    if ( maxlog>0 && sh==0 ) {
-                    //                        style = buf[j].getStyle();
-                    //                        CRLog::trace("[%06d] : s=%08x f=%08x  res=%08x", offs+j, sh, fh, res);
-                    //                        maxlog--;
-                    //                    }
-                }
+                if (buf[j].isElement())
+                    res = addNodeStyleHash(res, &buf[j]);
             }
         }
 
@@ -1012,6 +1378,15 @@ lUInt32 tinyNodeCollection::calcStyleHash(bool already_rendered) {
         _nodeStyleHash = res;
         CRLog::debug("  COMPUTED _nodeDisplayStyleHash %x (initial: %x)", _nodeDisplayStyleHash, _nodeDisplayStyleHashInitial);
     }
+    res = calcStyleHash(already_rendered, res);
+    CRLog::debug("calcStyleHash done");
+    return res;
+}
+
+lUInt32 tinyNodeCollection::calcStyleHash(bool already_rendered, lUInt32 nodeStyleHash) {
+    lUInt32 res = nodeStyleHash;
+    lUInt32 globalHash = calcGlobalSettingsHash(getFontContextDocIndex(), already_rendered);
+    lUInt32 docFlags = getDocFlags();
     CRLog::info("Calculating style hash...  elemCount=%d, globalHash=%08x, docFlags=%08x, nodeStyleHash=%08x", _elemCount, globalHash, docFlags, res);
     res = res * 31 + _imgScalingOptions.getHash();
     res = res * 31 + (_imgAutoRotate ? 1 : 0);
@@ -1035,7 +1410,6 @@ lUInt32 tinyNodeCollection::calcStyleHash(bool already_rendered) {
 
     res = (res * 31 + globalHash) * 31 + docFlags;
     //    CRLog::info("Calculated style hash = %08x", res);
-    CRLog::debug("calcStyleHash done");
     return res;
 }
 
@@ -1057,7 +1431,7 @@ bool tinyNodeCollection::validateDocument() {
         if (offs + sz > _elemCount + 1) {
             sz = _elemCount + 1 - offs;
         }
-        ldomNode* buf = _elemList[i];
+        ldomNode* buf = getNodePart(true, i);
         for (int j = 0; j < sz; j++) {
             buf[j].setDocumentIndex(_docIndex);
             if (buf[j].isElement()) {
@@ -1094,6 +1468,11 @@ bool tinyNodeCollection::updateLoadedStyles(bool enabled) {
     LVArray<css_style_ref_t>* list = _styles.getIndex();
 
     _fontMap.clear(); // style index to font index
+    // node style hash is calculated in the same pass, so that calcStyleHash()
+    // doesn't need to walk through all elements once again
+    lUInt32 styleHash = 0;
+    if (enabled)
+        _nodeDisplayStyleHash = 0;
 
     for (int i = 0; i < count; i++) {
         int offs = i * TNC_PART_LEN;
@@ -1101,7 +1480,7 @@ bool tinyNodeCollection::updateLoadedStyles(bool enabled) {
         if (offs + sz > _elemCount + 1) {
             sz = _elemCount + 1 - offs;
         }
-        ldomNode* buf = _elemList[i];
+        ldomNode* buf = getNodePart(true, i);
         for (int j = 0; j < sz; j++) {
             buf[j].setDocumentIndex(_docIndex);
             if (buf[j].isElement()) {
@@ -1142,6 +1521,8 @@ bool tinyNodeCollection::updateLoadedStyles(bool enabled) {
                     //                    buf[j]._data._pelem._styleIndex = 0;
                     //                    buf[j]._data._pelem._fontIndex = 0;
                 }
+                if (enabled)
+                    styleHash = addNodeStyleHash(styleHash, &buf[j]);
             }
         }
     }
@@ -1162,7 +1543,7 @@ bool tinyNodeCollection::updateLoadedStyles(bool enabled) {
     delete list;
     //    getRootNode()->setFont( _def_font );
     //    getRootNode()->setStyle( _def_style );
-    _nodeStyleHash = 0;
+    _nodeStyleHash = enabled && res ? styleHash : 0;
     return res;
 }
 
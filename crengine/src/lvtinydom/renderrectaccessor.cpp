@@ -21,7 +21,10 @@
 
 #include "renderrectaccessor.h"
 
-#include <ldomnode.h>
+#include <ldomdocument.h>
+
+#include "ldomdatastoragemanager.h"
+#include "ldomtextstoragechunk.h"
 
 //#define DEBUG_RENDER_RECT_ACCESS
 #ifdef DEBUG_RENDER_RECT_ACCESS
@@ -540,3 +543,21 @@ void RenderRectAccessor::setInvolvedFloatIds(int float_count, lUInt32* float_ids
         _extra5 = float_ids[4];
     _modified = true;
 }
+
+// render rect of nodes without rect data: text nodes, elements not rendered yet
+static const lvdomElementFormatRec _emptyRenderRect;
+
+RenderRectReader::RenderRectReader(ldomNode* node)
+        : _rec(&_emptyRenderRect)
+        , _chunk(NULL) {
+    if (node->isElement()) {
+        _chunk = node->getDocument()->_rectStorage->pinRendRectData(node->getDataIndex(), _rec);
+        if (!_chunk)
+            _rec = &_emptyRenderRect;
+    }
+}
+
+RenderRectReader::~RenderRectReader() {
+    if (_chunk)
+        _chunk->unpin();
+}
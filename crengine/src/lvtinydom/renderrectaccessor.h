@@ -81,4 +81,74 @@ public:
     ~RenderRectAccessor();
 };
 
+class ldomTextStorageChunk;
+
+/// read-only access to element render rect in place, without copying it out of rect storage
+/**
+ * Unpacked rect storage chunk is pinned while reader exists. Render rect of the node
+ * should not be changed with RenderRectAccessor while reader is in use.
+ */
+class RenderRectReader
+{
+    const lvdomElementFormatRec* _rec;
+    ldomTextStorageChunk* _chunk;
+    // non-copyable: pinned chunk is released once
+    RenderRectReader(const RenderRectReader&);
+    RenderRectReader& operator=(const RenderRectReader&);
+public:
+    explicit RenderRectReader(ldomNode* node);
+    ~RenderRectReader();
+    int getX() const {
+        return _rec->_x;
+    }
+    int getY() const {
+        return _rec->_y;
+    }
+    int getWidth() const {
+        return _rec->_width;
+    }
+    int getHeight() const {
+        return _rec->_height;
+    }
+    void getRect(lvRect& rc) const {
+        rc.left = _rec->_x;
+        rc.top = _rec->_y;
+        rc.right = _rec->_x + _rec->_width;
+        rc.bottom = _rec->_y + _rec->_height;
+    }
+    int getInnerWidth() const {
+        return _rec->_inner_width;
+    }
+    int getInnerX() const {
+        return _rec->_inner_x;
+    }
+    int getInnerY() const {
+        return _rec->_inner_y;
+    }
+    int getUsableLeftOverflow() const {
+        return _rec->_usable_left_overflow;
+    }
+    int getUsableRightOverflow() const {
+        return _rec->_usable_right_overflow;
+    }
+    int getTopOverflow() const {
+        return _rec->_top_overflow;
+    }
+    int getBottomOverflow() const {
+        return _rec->_bottom_overflow;
+    }
+    int getBaseline() const {
+        return _rec->_baseline;
+    }
+    int getListPropNodeIndex() const {
+        return _rec->_listprop_node_idx;
+    }
+    int getLangNodeIndex() const {
+        return _rec->_lang_node_idx;
+    }
+    unsigned short getFlags() const {
+        return _rec->_flags;
+    }
+};
+
 #endif // __RENDERRECTACCESSOR_H_INCLUDED__
@@ -49,6 +49,8 @@ public:
     virtual void SetCharsetTable(const lChar32* table) = 0;
     /// returns 8-bit charset conversion table (128 items, for codes 128..255)
     virtual lChar32* GetCharsetTable() = 0;
+    /// allows parser to run its stages in separate threads, if supported
+    virtual void setPipelined(bool) { }
     /// changes space mode
     virtual void SetSpaceMode(bool) { }
     /// returns space mode
@@ -25,6 +25,8 @@
 
 #include <lvstream.h>
 
+#include <atomic>
+
 class LVFileParserBase: public LVFileFormatParser
 {
 protected:
@@ -35,7 +37,7 @@ protected:
     int m_buf_len;
     int m_buf_pos;
     lvpos_t m_buf_fpos;
-    bool m_stopped; // true if Stop() is called
+    std::atomic<bool> m_stopped; // true if Stop() is called (may be called from other thread)
     LVDocViewCallback* m_progressCallback;
     time_t m_lastProgressTime;
     int m_progressLastPercent;
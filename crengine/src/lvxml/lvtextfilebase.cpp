@@ -23,6 +23,7 @@
 #include "lvtextfilebase.h"
 
 #include <crlog.h>
+#include <crconcurrent.h>
 #include <string.h>
 
 #include "lvxmlutils.h"
@@ -53,6 +54,8 @@ typedef unsigned int ucs4_t;
 
 #define MIN_BUF_DATA_SIZE      4096
 #define CP_AUTODETECT_BUF_SIZE 0x20000
+// number of decoded chunks (of XML_CHAR_BUFFER_SIZE chars) decoder thread may run ahead
+#define DECODER_RING_SIZE 16
 
 static int charToHex(lUInt8 ch) {
     if (ch >= '0' && ch <= '9')
@@ -216,11 +219,13 @@ LVTextFileBase::LVTextFileBase(LVStreamRef stream)
         , m_enc_type(ce_8bit_cp)
         , m_conv_table(NULL)
         , m_eof(false) {
+    m_decoder = NULL;
     clearCharBuffer();
 }
 
 /// destructor
 LVTextFileBase::~LVTextFileBase() {
+    stopDecoderThread();
     if (m_conv_table)
         delete[] m_conv_table;
 }
@@ -727,6 +732,7 @@ int LVTextFileBase::ReadTextBytes(lvpos_t pos, int bytesToRead, lChar32* buf, in
 }
 
 void LVTextFileBase::Reset() {
+    stopDecoderThread();
     LVFileParserBase::Reset();
     clearCharBuffer();
     // Remove Byte Order Mark from beginning of file
@@ -886,6 +892,8 @@ int LVTextFileBase::fillCharBuffer() {
     int available = m_read_buffer_len - m_read_buffer_pos;
     if (available > (XML_CHAR_BUFFER_SIZE >> 3))
         return available; // don't update if more than 1/8 of buffer filled
+    if (m_decoder)
+        return fillCharBufferFromDecoder();
     if (m_buf_len - m_buf_pos < MIN_BUF_DATA_SIZE)
         FillBuffer(MIN_BUF_DATA_SIZE * 2);
     if (m_read_buffer_len > (XML_CHAR_BUFFER_SIZE - (XML_CHAR_BUFFER_SIZE >> 3))) {
@@ -901,3 +909,102 @@ int LVTextFileBase::fillCharBuffer() {
     //CRLog::trace("Buf:'%s'", LCSTR(lString32(m_read_buffer, m_read_buffer_len)) );
     return m_read_buffer_len - m_read_buffer_pos;
 }
+
+/// decodes stream to chunks of characters ahead of parser
+class LVTextFileBase::DecoderThread: public CRRunnable
+{
+public:
+    struct Chunk
+    {
+        lChar32 chars[XML_CHAR_BUFFER_SIZE];
+        int len;
+        lvpos_t fpos; // stream position after last decoded byte
+    };
+    LVTextFileBase* parser;
+    CRSpscRing<Chunk> ring;
+    CRThreadRef thread;
+    // consumer side
+    Chunk* current;
+    int currentPos;
+    lvpos_t fpos;
+    explicit DecoderThread(LVTextFileBase* p)
+            : parser(p)
+            , ring(DECODER_RING_SIZE)
+            , current(NULL)
+            , currentPos(0) {
+        fpos = p->m_buf_fpos + p->m_buf_pos;
+    }
+    virtual void run() {
+        for (;;) {
+            Chunk* chunk = ring.beginWrite();
+            if (!chunk)
+                break; // cancelled
+            if (parser->m_buf_len - parser->m_buf_pos < MIN_BUF_DATA_SIZE)
+                parser->FillBuffer(MIN_BUF_DATA_SIZE * 2);
+            chunk->len = parser->ReadChars(chunk->chars, XML_CHAR_BUFFER_SIZE);
+            chunk->fpos = parser->m_buf_fpos + parser->m_buf_pos;
+            if (chunk->len <= 0)
+                break; // end of stream
+            ring.endWrite();
+        }
+        ring.close();
+    }
+};
+
+bool LVTextFileBase::startDecoderThread() {
+    if (m_decoder)
+        return true;
+    if (!concurrencyProvider)
+        return false;
+    m_decoder = new DecoderThread(this);
+    m_decoder->thread = concurrencyProvider->createThread(m_decoder);
+    m_decoder->thread->start();
+    return true;
+}
+
+void LVTextFileBase::stopDecoderThread() {
+    if (!m_decoder)
+        return;
+    m_decoder->ring.cancel();
+    m_decoder->thread->join();
+    delete m_decoder;
+    m_decoder = NULL;
+}
+
+lvpos_t LVTextFileBase::getDecodedPos() {
+    if (m_decoder)
+        return m_decoder->fpos;
+    return m_buf_fpos + m_buf_pos;
+}
+
+int LVTextFileBase::fillCharBufferFromDecoder() {
+    // Move the rest to the beginning and fill whole buffer, so parser may peek
+    // as far as without decoder thread
+    int available = m_read_buffer_len - m_read_buffer_pos;
+    if (m_read_buffer_pos > 0) {
+        memmove(m_read_buffer, m_read_buffer + m_read_buffer_pos, available * sizeof(lChar32));
+        m_read_buffer_pos = 0;
+        m_read_buffer_len = available;
+    }
+    DecoderThread* d = m_decoder;
+    while (m_read_buffer_len < XML_CHAR_BUFFER_SIZE) {
+        if (!d->current) {
+            d->current = d->ring.beginRead();
+            d->currentPos = 0;
+            if (!d->current)
+                break; // end of stream
+        }
+        int count = d->current->len - d->currentPos;
+        if (count > XML_CHAR_BUFFER_SIZE - m_read_buffer_len)
+            count = XML_CHAR_BUFFER_SIZE - m_read_buffer_len;
+        memcpy(m_read_buffer + m_read_buffer_len, d->current->chars + d->currentPos, count * sizeof(lChar32));
+        m_read_buffer_len += count;
+        d->currentPos += count;
+        if (d->currentPos >= d->current->len) {
+            d->fpos = d->current->fpos;
+            d->current = NULL;
+            d->ring.endRead();
+        }
+    }
+    return m_read_buffer_len - m_read_buffer_pos;
+}
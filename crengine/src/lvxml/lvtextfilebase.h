@@ -32,6 +32,9 @@
 
 class LVTextFileBase: public LVFileParserBase
 {
+    class DecoderThread;
+    DecoderThread* m_decoder;
+    int fillCharBufferFromDecoder();
 protected:
     char_encoding_type m_enc_type;
     lString32 m_txt_buf;
@@ -103,6 +106,16 @@ protected:
     void clearCharBuffer();
     /// returns number of available characters in buffer
     int fillCharBuffer();
+    /// starts decoding of the rest of stream in separate thread, fillCharBuffer() then takes characters from it
+    /**
+     * From this point stream and byte buffer belong to decoder thread: only character buffer
+     * methods may be used. Returns false if there is no concurrency provider.
+     */
+    bool startDecoderThread();
+    /// stops decoder thread (if running), not yet consumed decoded characters are dropped
+    void stopDecoderThread();
+    /// returns stream position after the characters passed to character buffer by decoder thread
+    lvpos_t getDecodedPos();
 
     /// reads one character from buffer
     //lChar32 ReadChar();
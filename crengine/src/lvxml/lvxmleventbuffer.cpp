@@ -0,0 +1,181 @@
+/***************************************************************************
+ *   crengine-ng                                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License           *
+ *   as published by the Free Software Foundation; either version 2        *
+ *   of the License, or (at your option) any later version.                *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,            *
+ *   MA 02110-1301, USA.                                                   *
+ ***************************************************************************/
+
+#include "lvxmleventbuffer.h"
+#include "lvxmlparser.h"
+#include "lvxmlutils.h"
+
+enum xml_event_t
+{
+    xe_encoding,
+    xe_tag_open,
+    xe_tag_body,
+    xe_tag_close,
+    xe_attribute,
+    xe_text,
+    xe_raw_text,
+    xe_progress
+};
+
+// raw text flags
+#define XML_EVENT_TEXT_START 1
+#define XML_EVENT_TEXT_CDATA 2
+
+lChar32* LVXMLEventBuffer::addSpace(int count) {
+    // LVArray grows to exact size, avoid reallocation on each event
+    int required = _data.length() + count;
+    if (required > _data.size())
+        _data.reserve(required > _data.size() * 2 ? required : _data.size() * 2);
+    return _data.addSpace(count);
+}
+
+void LVXMLEventBuffer::addString(const lChar32* str) {
+    int len = str ? lStr_len(str) : 0;
+    lChar32* p = addSpace(len + 2);
+    *p++ = (lChar32)len;
+    for (int i = 0; i < len; i++)
+        *p++ = str[i];
+    *p = 0;
+}
+
+void LVXMLEventBuffer::OnEncoding(const lChar32* name, const lChar32*) {
+    *addSpace(1) = xe_encoding;
+    addString(name);
+}
+
+ldomNode* LVXMLEventBuffer::OnTagOpen(const lChar32* nsname, const lChar32* tagname) {
+    *addSpace(1) = xe_tag_open;
+    addString(nsname);
+    addString(tagname);
+    return NULL;
+}
+
+void LVXMLEventBuffer::OnTagBody() {
+    *addSpace(1) = xe_tag_body;
+}
+
+void LVXMLEventBuffer::OnTagClose(const lChar32* nsname, const lChar32* tagname, bool self_closing_tag) {
+    lChar32* p = addSpace(2);
+    p[0] = xe_tag_close;
+    p[1] = self_closing_tag ? 1 : 0;
+    addString(nsname);
+    addString(tagname);
+}
+
+void LVXMLEventBuffer::OnAttribute(const lChar32* nsname, const lChar32* attrname, const lChar32* attrvalue) {
+    *addSpace(1) = xe_attribute;
+    addString(nsname);
+    addString(attrname);
+    addString(attrvalue);
+}
+
+void LVXMLEventBuffer::OnText(const lChar32* text, int len, lUInt32 flags) {
+    lChar32* p = addSpace(3 + len);
+    *p++ = xe_text;
+    *p++ = (lChar32)flags;
+    *p++ = (lChar32)len;
+    for (int i = 0; i < len; i++)
+        *p++ = text[i];
+}
+
+void LVXMLEventBuffer::OnRawText(const lChar32* text, int len, bool textStart, bool cdata) {
+    lChar32* p = addSpace(3 + len);
+    *p++ = xe_raw_text;
+    *p++ = (lChar32)((textStart ? XML_EVENT_TEXT_START : 0) | (cdata ? XML_EVENT_TEXT_CDATA : 0));
+    *p++ = (lChar32)len;
+    for (int i = 0; i < len; i++)
+        *p++ = text[i];
+}
+
+void LVXMLEventBuffer::OnProgress(lvpos_t pos) {
+    lChar32* p = addSpace(3);
+    p[0] = xe_progress;
+    p[1] = (lChar32)((lUInt64)pos & 0xFFFFFFFF);
+    p[2] = (lChar32)((lUInt64)pos >> 32);
+}
+
+bool LVXMLEventBuffer::replay(LVXMLParserCallback* callback, LVXMLParser* parser) {
+    lChar32* p = _data.get();
+    lChar32* end = p + _data.length();
+    lUInt32 textFlags = 0;
+    while (p < end) {
+        switch (*p++) {
+            case xe_encoding: {
+                const lChar32* name = p + 1;
+                p += *p + 2;
+                callback->OnEncoding(name, parser->GetCharsetTable());
+            } break;
+            case xe_tag_open: {
+                const lChar32* nsname = p + 1;
+                p += *p + 2;
+                const lChar32* tagname = p + 1;
+                p += *p + 2;
+                callback->OnTagOpen(nsname, tagname);
+            } break;
+            case xe_tag_body:
+                callback->OnTagBody();
+                break;
+            case xe_tag_close: {
+                bool selfClosing = *p++ != 0;
+                const lChar32* nsname = p + 1;
+                p += *p + 2;
+                const lChar32* tagname = p + 1;
+                p += *p + 2;
+                callback->OnTagClose(nsname, tagname, selfClosing);
+            } break;
+            case xe_attribute: {
+                const lChar32* nsname = p + 1;
+                p += *p + 2;
+                const lChar32* attrname = p + 1;
+                p += *p + 2;
+                const lChar32* attrvalue = p + 1;
+                p += *p + 2;
+                callback->OnAttribute(nsname, attrname, attrvalue);
+            } break;
+            case xe_text: {
+                lUInt32 flags = p[0];
+                int len = (int)p[1];
+                callback->OnText(p + 2, len, flags);
+                p += len + 2;
+            } break;
+            case xe_raw_text: {
+                lUInt32 rawFlags = p[0];
+                int len = (int)p[1];
+                // parser takes callback flags once for whole text node
+                if (rawFlags & XML_EVENT_TEXT_START)
+                    textFlags = callback->getFlags();
+                if (rawFlags & XML_EVENT_TEXT_CDATA)
+                    textFlags |= TXTFLG_CDATA;
+                parser->processText(callback, p + 2, len, textFlags);
+                p += len + 2;
+            } break;
+            case xe_progress: {
+                lvpos_t pos = (lvpos_t)((lUInt64)p[0] | ((lUInt64)p[1] << 32));
+                p += 2;
+                parser->setReplayPos(pos);
+                parser->updateProgress();
+            } break;
+            default:
+                return false; // corrupted buffer
+        }
+        if (parser->m_stopped)
+            return false;
+    }
+    return true;
+}
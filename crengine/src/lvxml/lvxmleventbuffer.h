@@ -0,0 +1,88 @@
+/***************************************************************************
+ *   crengine-ng                                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License           *
+ *   as published by the Free Software Foundation; either version 2        *
+ *   of the License, or (at your option) any later version.                *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,            *
+ *   MA 02110-1301, USA.                                                   *
+ ***************************************************************************/
+
+#ifndef __LVXMLEVENTBUFFER_H_INCLUDED__
+#define __LVXMLEVENTBUFFER_H_INCLUDED__
+
+#include "lvxmlparsercallback.h"
+
+#include <lvarray.h>
+
+class LVXMLParser;
+
+/// XML parser callback which records events to compact buffer, to be replayed to another callback later
+/**
+ * Allows to tokenize document in one thread and build DOM from it in another one.
+ * As parser text handling depends on flags of the target callback (which are changed
+ * by the target while DOM is being built), parser records text not yet processed
+ * with OnRawText(); processing is done on replay, with flags of the target.
+ * Target may stop parser while replaying, events following the one which stopped it are dropped.
+ */
+class LVXMLEventBuffer: public LVXMLParserCallback
+{
+    LVArray<lChar32> _data;
+    lUInt32 _flags;
+    lChar32* addSpace(int count);
+    void addString(const lChar32* str);
+public:
+    LVXMLEventBuffer()
+            : _flags(0) { }
+    /// returns flags
+    virtual lUInt32 getFlags() {
+        return _flags;
+    }
+    /// sets flags to be returned to parser while recording
+    virtual void setFlags(lUInt32 flags) {
+        _flags = flags;
+    }
+    /// called on document encoding definition
+    virtual void OnEncoding(const lChar32* name, const lChar32* table);
+    /// called on parsing end
+    virtual void OnStop() { }
+    /// called on opening tag <
+    virtual ldomNode* OnTagOpen(const lChar32* nsname, const lChar32* tagname);
+    /// called after > of opening tag (when entering tag body)
+    virtual void OnTagBody();
+    /// called on tag close
+    virtual void OnTagClose(const lChar32* nsname, const lChar32* tagname, bool self_closing_tag = false);
+    /// called on element attribute
+    virtual void OnAttribute(const lChar32* nsname, const lChar32* attrname, const lChar32* attrvalue);
+    /// called on text
+    virtual void OnText(const lChar32* text, int len, lUInt32 flags);
+    /// BLOBs are not recorded
+    virtual bool OnBlob(lString32 /*name*/, const lUInt8* /*data*/, int /*size*/) {
+        return false;
+    }
+    /// called on text to be processed by parser on replay; textStart is true for first part of text node
+    void OnRawText(const lChar32* text, int len, bool textStart, bool cdata);
+    /// called when parser has read stream till specified position
+    void OnProgress(lvpos_t pos);
+    /// removes all recorded events, keeps allocated storage
+    void reset() {
+        _data.reset();
+    }
+    /// returns size of recorded events, in characters
+    int size() const {
+        return _data.length();
+    }
+    /// sends recorded events to callback, returns false if parser was stopped
+    bool replay(LVXMLParserCallback* callback, LVXMLParser* parser);
+};
+
+#endif // __LVXMLEVENTBUFFER_H_INCLUDED__
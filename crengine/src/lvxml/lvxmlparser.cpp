@@ -25,7 +25,10 @@
 #include "lvxmlparser.h"
 
 #include <lvxmlparsercallback.h>
+#include <crconcurrent.h>
+#include <crlog.h>
 
+#include "lvxmleventbuffer.h"
 #include "lvxmlutils.h"
 
 /// states of XML parser
@@ -39,6 +42,12 @@ enum parser_state_t
 
 #define TEXT_SPLIT_SIZE 8192
 
+// pipelined parsing: size of events block passed to callback thread at once (in chars), and number of blocks
+#define XML_EVENTS_FLUSH_SIZE 16384
+#define XML_EVENTS_RING_SIZE  8
+// longer tag names are not checked by LVXMLParserCallback::isParseAheadBarrier()
+#define XML_BARRIER_TAG_MAX_LEN 32
+
 inline bool isValidFirstIdentChar(lChar32 ch) {
     return ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z'));
 }
@@ -89,6 +98,12 @@ void ExpandTabs(lString32& s) {
 }
 
 void LVXMLParser::SetCharset(const lChar32* name) {
+    if (m_pipeline) {
+        // Stream is being decoded by another thread
+        CRLog::warn("LVXMLParser: encoding change to %s ignored in pipelined mode", LCSTR(lString32(name)));
+        m_callback->OnEncoding(name, m_conv_table);
+        return;
+    }
     LVTextFileBase::SetCharset(name);
     m_callback->OnEncoding(name, m_conv_table);
 }
@@ -108,6 +123,13 @@ LVXMLParser::LVXMLParser(LVStreamRef stream, LVXMLParserCallback* callback, bool
         , m_state(0)
         , m_in_cdata(false)
         , m_in_html_script_tag(false)
+        , m_in_xml_tag(false)
+        , m_body_started(false)
+        , m_attr_flags(0)
+        , m_pipelined(false)
+        , m_pipeline(NULL)
+        , m_events(NULL)
+        , m_replay_pos(0)
         , m_citags(false)
         , m_allowHtml(allowHtml)
         , m_fb2Only(fb2Only)
@@ -119,6 +141,103 @@ LVXMLParser::LVXMLParser(LVStreamRef stream, LVXMLParserCallback* callback, bool
 LVXMLParser::~LVXMLParser() {
 }
 
+/// tokenizer thread of pipelined parsing
+class LVXMLParser::Pipeline: public CRRunnable
+{
+public:
+    LVXMLParser* parser;
+    LVXMLParserCallback* callback;
+    CRSpscRing<LVXMLEventBuffer> ring;
+    CRThreadRef thread;
+    lUInt32 flags; // callback flags when tokenizing ahead was started
+    Pipeline(LVXMLParser* p, LVXMLParserCallback* cb)
+            : parser(p)
+            , callback(cb)
+            , ring(XML_EVENTS_RING_SIZE)
+            , flags(cb->getFlags()) { }
+    /// takes next free events block to record to, returns false if cancelled
+    bool next() {
+        LVXMLEventBuffer* events = ring.beginWrite();
+        parser->m_events = events;
+        if (!events)
+            return false;
+        events->reset();
+        events->setFlags(flags);
+        parser->m_callback = events;
+        return true;
+    }
+    virtual void run() {
+        if (next()) {
+            parser->ParseSteps(false);
+            if (parser->m_events)
+                ring.endWrite();
+        }
+        ring.close();
+    }
+};
+
+int LVXMLParser::getProgressPercent() {
+    if (m_stream_size <= 0)
+        return 0;
+    // stream may be read by decoder thread
+    lvpos_t pos = m_pipeline ? m_replay_pos : getDecodedPos();
+    return (int)((lInt64)100 * pos / m_stream_size);
+}
+
+bool LVXMLParser::isParseAheadBarrier() {
+    if (!SkipSpaces())
+        return false;
+    // peek name of opening tag
+    lChar32 tagname[XML_BARRIER_TAG_MAX_LEN + 1];
+    int len = 0;
+    lChar32 ch = PeekCharFromBuffer();
+    if (!isValidFirstIdentChar(ch))
+        return false;
+    for (; len < XML_BARRIER_TAG_MAX_LEN; len++) {
+        ch = PeekCharFromBuffer(len);
+        if (!isValidIdentChar(ch))
+            break;
+        tagname[len] = (m_citags && ch >= 'A' && ch <= 'Z') ? ch - 'A' + 'a' : ch;
+    }
+    tagname[len] = 0;
+    return m_pipeline->callback->isParseAheadBarrier(tagname);
+}
+
+bool LVXMLParser::flushEvents() {
+    m_pipeline->ring.endWrite();
+    return m_pipeline->next();
+}
+
+void LVXMLParser::ParsePipelined() {
+    LVXMLParserCallback* callback = m_callback;
+    if (!startDecoderThread()) {
+        ParseSteps(false);
+        return;
+    }
+    Pipeline pipeline(this, callback);
+    m_replay_pos = getDecodedPos();
+    CRLog::debug("LVXMLParser: tokenizing ahead from position %d", (int)m_replay_pos);
+    m_pipeline = &pipeline;
+    pipeline.thread = concurrencyProvider->createThread(&pipeline);
+    pipeline.thread->start();
+    // Build DOM in this thread
+    for (;;) {
+        LVXMLEventBuffer* events = pipeline.ring.beginRead();
+        if (!events)
+            break;
+        bool ok = events->replay(callback, this);
+        pipeline.ring.endRead();
+        if (!ok) {
+            pipeline.ring.cancel();
+            break;
+        }
+    }
+    pipeline.thread->join();
+    m_pipeline = NULL;
+    m_events = NULL;
+    m_callback = callback;
+}
+
 /// returns true if format is recognized by parser
 bool LVXMLParser::CheckFormat() {
     //CRLog::trace("LVXMLParser::CheckFormat()");
@@ -168,23 +287,74 @@ bool LVXMLParser::Parse() {
     //
     //CRLog::trace("LVXMLParser::Parse()");
     Reset();
+    m_callback->OnStart(this);
+    m_tagname.clear();
+    m_tagns.clear();
+    m_in_xml_tag = false;
+    m_body_started = false;
+    m_attr_flags = m_callback->getFlags();
+    bool canStartPipeline = m_pipelined && concurrencyProvider != NULL;
+    while (ParseSteps(canStartPipeline))
+        ParsePipelined();
+    stopDecoderThread();
+    //CRLog::trace("LVXMLParser::Parse() is finished, m_stopped=%s", m_stopped?"true":"false");
+    m_callback->OnStop();
+    return true;
+}
+
+bool LVXMLParser::Tokenize(LVXMLEventBuffer* events) {
+    LVXMLParserCallback* callback = m_callback;
+    Reset();
+    m_callback = events;
+    m_events = events;
+    m_tagname.clear();
+    m_tagns.clear();
+    m_in_xml_tag = false;
+    m_body_started = false;
+    m_attr_flags = events->getFlags();
+    ParseSteps(false);
+    m_events = NULL;
+    m_callback = callback;
+    return !m_stopped;
+}
+
+bool LVXMLParser::Replay(LVXMLEventBuffer* events, LVXMLParserCallback* callback) {
+    LVXMLParserCallback* saved = m_callback;
+    m_callback = callback;
+    m_replay_pos = 0;
+    callback->OnStart(this);
+    events->replay(callback, this);
+    callback->OnStop();
+    m_callback = saved;
+    return true;
+}
+
+bool LVXMLParser::ParseSteps(bool canStartPipeline) {
     //    bool dumpActive = false;
     //    int txt_count = 0;
-    bool inXmlTag = false;
-    m_callback->OnStart(this);
     bool closeFlag = false;
     bool qFlag = false;
-    bool bodyStarted = false;
-    lString32 tagname;
-    lString32 tagns;
+    lString32& tagname = m_tagname;
+    lString32& tagns = m_tagns;
     lString32 attrname;
     lString32 attrns;
     lString32 attrvalue;
-    bool errorFlag = false;
-    int flags = m_callback->getFlags();
-    for (; !m_eof && !errorFlag;) {
+    lUInt32 flags = m_attr_flags;
+    // don't restart pipeline before passing the tag it was stopped on
+    bool firstStep = true;
+    for (; !m_eof; firstStep = false) {
         if (m_stopped)
             break;
+        if (m_pipeline) {
+            if (m_events->size() >= XML_EVENTS_FLUSH_SIZE && !flushEvents())
+                break;
+            if (m_state == ps_lt && isParseAheadBarrier())
+                break;
+        } else if (m_events) {
+            // whole stream is recorded by Tokenize()
+        } else if (canStartPipeline && !firstStep && m_state == ps_lt && m_body_started && m_callback->canParseAhead()) {
+            return true;
+        }
         // load next portion of data if necessary
         lChar32 ch = PeekCharFromBuffer();
         switch (m_state) {
@@ -267,15 +437,15 @@ bool LVXMLParser::Parse() {
 
                 if (qFlag) {
                     tagname.insert(0, 1, '?');
-                    inXmlTag = (tagname == "?xml");
+                    m_in_xml_tag = (tagname == "?xml");
                 } else {
-                    inXmlTag = false;
+                    m_in_xml_tag = false;
                 }
                 m_callback->OnTagOpen(tagns.c_str(), tagname.c_str());
                 //                if ( dumpActive )
                 //                    CRLog::trace("<%s>", LCSTR(tagname) );
-                if (!bodyStarted && tagname == "body")
-                    bodyStarted = true;
+                if (!m_body_started && tagname == "body")
+                    m_body_started = true;
                 else if (tagname.length() == 6 &&
                          (tagname[0] == U'S' || tagname[0] == U's') &&
                          (tagname[1] == U'C' || tagname[1] == U'c') &&
@@ -371,7 +541,7 @@ bool LVXMLParser::Parse() {
                 attrvalue.trim();
                 m_callback->OnAttribute(attrns.c_str(), attrname.c_str(), attrvalue.c_str());
 
-                if (inXmlTag && attrname == "encoding") {
+                if (m_in_xml_tag && attrname == "encoding") {
                     SetCharset(attrvalue.c_str());
                 }
             } break;
@@ -390,8 +560,12 @@ bool LVXMLParser::Parse() {
                 //                    }
                 //                }
                 ReadText();
-                if (bodyStarted)
-                    updateProgress();
+                if (m_body_started) {
+                    if (m_events)
+                        m_events->OnProgress(getDecodedPos());
+                    else
+                        updateProgress();
+                }
                 m_state = ps_lt;
                 if (m_in_cdata) {
                     m_in_cdata = false;
@@ -406,9 +580,7 @@ bool LVXMLParser::Parse() {
             }
         }
     }
-    //CRLog::trace("LVXMLParser::Parse() is finished, m_stopped=%s", m_stopped?"true":"false");
-    m_callback->OnStop();
-    return !errorFlag;
+    return false;
 }
 
 bool LVXMLParser::ReadText() {
@@ -418,6 +590,7 @@ bool LVXMLParser::ReadText() {
     lUInt32 flags = m_callback->getFlags();
     bool pre_para_splitting = (flags & TXTFLG_PRE_PARA_SPLITTING) != 0;
     bool last_eol = false;
+    bool textStart = true;
 
     bool flgBreak = false; // set when this text node should end
     int nbCharToSkipOnFlgBreak = 0;
@@ -550,37 +723,15 @@ bool LVXMLParser::ReadText() {
             //=====================================================
             // Provide accumulated text to callback
             lChar32* buf = m_txt_buf.modify();
-
-            const lChar32* enc_table = NULL;
-            if (flags & TXTFLG_CONVERT_8BIT_ENTITY_ENCODING)
-                enc_table = this->m_conv_table;
-
-            if (m_in_cdata)
-                flags |= TXTFLG_CDATA;
-            int nlen = PreProcessXmlString(buf, last_split_txtlen, flags, enc_table);
-
-            if ((flags & TXTFLG_TRIM) && (!(flags & TXTFLG_PRE) || (flags & TXTFLG_PRE_PARA_SPLITTING))) {
-                nlen = TrimDoubleSpaces(buf, nlen,
-                                        ((flags & TXTFLG_TRIM_ALLOW_START_SPACE) || pre_para_splitting) ? true : false,
-                                        (flags & TXTFLG_TRIM_ALLOW_END_SPACE) ? true : false,
-                                        (flags & TXTFLG_TRIM_REMOVE_EOL_HYPHENS) ? true : false);
-            }
-
-            if (flags & TXTFLG_PRE) {
-                // check for tabs
-                int tabCount = CalcTabCount(buf, nlen);
-                if (tabCount > 0) {
-                    // expand tabs
-                    lString32 tmp;
-                    tmp.reserve(nlen + tabCount * 8);
-                    ExpandTabs(tmp, buf, nlen);
-                    m_callback->OnText(tmp.c_str(), tmp.length(), flags);
-                } else {
-                    m_callback->OnText(buf, nlen, flags);
-                }
+            if (m_events) {
+                // callback flags may change before callback gets this text: process it on replay
+                m_events->OnRawText(buf, last_split_txtlen, textStart, m_in_cdata);
             } else {
-                m_callback->OnText(buf, nlen, flags);
+                if (m_in_cdata)
+                    flags |= TXTFLG_CDATA;
+                processText(m_callback, buf, last_split_txtlen, flags);
             }
+            textStart = false;
 
             m_txt_buf.erase(0, last_split_txtlen);
             tlen = m_txt_buf.length();
@@ -597,6 +748,37 @@ bool LVXMLParser::ReadText() {
     return (!m_eof);
 }
 
+void LVXMLParser::processText(LVXMLParserCallback* callback, lChar32* buf, int len, lUInt32 flags) {
+    const lChar32* enc_table = NULL;
+    if (flags & TXTFLG_CONVERT_8BIT_ENTITY_ENCODING)
+        enc_table = this->m_conv_table;
+
+    int nlen = PreProcessXmlString(buf, len, flags, enc_table);
+
+    if ((flags & TXTFLG_TRIM) && (!(flags & TXTFLG_PRE) || (flags & TXTFLG_PRE_PARA_SPLITTING))) {
+        nlen = TrimDoubleSpaces(buf, nlen,
+                                ((flags & TXTFLG_TRIM_ALLOW_START_SPACE) || (flags & TXTFLG_PRE_PARA_SPLITTING)) ? true : false,
+                                (flags & TXTFLG_TRIM_ALLOW_END_SPACE) ? true : false,
+                                (flags & TXTFLG_TRIM_REMOVE_EOL_HYPHENS) ? true : false);
+    }
+
+    if (flags & TXTFLG_PRE) {
+        // check for tabs
+        int tabCount = CalcTabCount(buf, nlen);
+        if (tabCount > 0) {
+            // expand tabs
+            lString32 tmp;
+            tmp.reserve(nlen + tabCount * 8);
+            ExpandTabs(tmp, buf, nlen);
+            callback->OnText(tmp.c_str(), tmp.length(), flags);
+        } else {
+            callback->OnText(buf, nlen, flags);
+        }
+    } else {
+        callback->OnText(buf, nlen, flags);
+    }
+}
+
 bool LVXMLParser::SkipSpaces() {
     for (lUInt16 ch = PeekCharFromBuffer(); !m_eof; ch = PeekNextCharFromBuffer()) {
         if (!IsSpaceChar(ch))
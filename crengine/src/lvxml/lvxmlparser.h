@@ -33,24 +33,53 @@
 #define XML_PARSER_DETECT_SIZE 8192
 
 class LVXMLParserCallback;
+class LVXMLEventBuffer;
 
 /// XML parser
 class LVXMLParser: public LVTextFileBase
 {
+    friend class LVXMLEventBuffer;
+    class Pipeline;
 private:
     LVXMLParserCallback* m_callback;
     bool m_trimspaces;
     int m_state;
     bool m_in_cdata;
     bool m_in_html_script_tag;
+    // state kept between parse steps
+    lString32 m_tagname;
+    lString32 m_tagns;
+    bool m_in_xml_tag;
+    bool m_body_started;
+    lUInt32 m_attr_flags;
+    // pipelined parsing
+    bool m_pipelined;
+    Pipeline* m_pipeline;
+    LVXMLEventBuffer* m_events; // set while tokenizing ahead of callback
+    lvpos_t m_replay_pos;
     bool SkipSpaces();
     bool SkipTillChar(lChar32 ch);
     bool ReadIdent(lString32& ns, lString32& str);
     bool ReadText();
+    /// runs parse steps until end of stream or stop; returns true early if pipeline can be started
+    bool ParseSteps(bool canStartPipeline);
+    /// parses the rest of stream with decoding and tokenizing in separate threads
+    void ParsePipelined();
+    /// passes recorded events to callback thread, returns false if it doesn't need them anymore
+    bool flushEvents();
+    /// returns true if tokenizing ahead should be stopped before next tag
+    bool isParseAheadBarrier();
+    /// processes text and passes it to callback
+    void processText(LVXMLParserCallback* callback, lChar32* buf, int len, lUInt32 flags);
+    void setReplayPos(lvpos_t pos) {
+        m_replay_pos = pos;
+    }
 protected:
     bool m_citags;
     bool m_allowHtml;
     bool m_fb2Only;
+    /// returns file reading position percent
+    virtual int getProgressPercent();
 public:
     /// returns true if format is recognized by parser
     virtual bool CheckFormat();
@@ -60,6 +89,28 @@ public:
     virtual void SetCharset(const lChar32* name);
     /// resets parsing, moves to beginning of stream
     virtual void Reset();
+    /// allows decoding, tokenizing and callback calls to run in 3 threads connected by bounded queues
+    /**
+     * Pipeline is started once document body is reached and callback reports with
+     * LVXMLParserCallback::canParseAhead() that it won't change flags affecting
+     * tokenizing anymore; before that parsing is done in calling thread as usual.
+     * Tokenizing ahead is stopped before barrier tags (see LVXMLParserCallback::isParseAheadBarrier()),
+     * such tag is passed to callback in calling thread, then pipeline may be started again.
+     * Callback is still called only from the thread calling Parse().
+     * Requires concurrencyProvider, ignored otherwise.
+     */
+    virtual void setPipelined(bool pipelined) {
+        m_pipelined = pipelined;
+    }
+    /// records events of whole stream to buffer instead of passing them to callback, may be called from any thread
+    /**
+     * Text handling flags are taken from buffer (see LVXMLEventBuffer::setFlags()), they should be
+     * flags of callback the events will be replayed to. Unlike with setPipelined(), tokenizing is not stopped
+     * at barrier tags: callback should allow LVXMLParserCallback::canParseAhead() and have no barriers.
+     */
+    bool Tokenize(LVXMLEventBuffer* events);
+    /// passes events recorded by Tokenize() to callback, as Parse() does
+    bool Replay(LVXMLEventBuffer* events, LVXMLParserCallback* callback);
     /// constructor
     LVXMLParser(LVStreamRef stream, LVXMLParserCallback* callback, bool allowHtml = true, bool fb2Only = false);
     /// changes space mode
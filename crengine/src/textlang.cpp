@@ -31,6 +31,7 @@
 #include <crhyphman.h>
 #include <ldomnode.h>
 #include <fb2def.h>
+#include <lvthread.h>
 #include <crlog.h>
 
 #if (USE_UTF8PROC == 1)
@@ -62,6 +63,12 @@ static bool langStartsWith(const lString32 lang_tag, const char* prefix) {
     return false;
 }
 
+// TextLangCfg cache is shared by documents loaded and rendered in different threads
+static LVMutex& langCfgListMutex() {
+    static LVMutex mutex;
+    return mutex;
+}
+
 // Init global TextLangMan members
 lString32 TextLangMan::_main_lang = TEXTLANG_DEFAULT_MAIN_LANG_32;
 bool TextLangMan::_embedded_langs_enabled = TEXTLANG_DEFAULT_EMBEDDED_LANGS_ENABLED;
@@ -96,6 +103,7 @@ lUInt32 TextLangMan::getHash() {
 // No need to explicitely call this in frontend code.
 // Calling HyphMan::uninit() will have this one called.
 void TextLangMan::uninit() {
+    LVLock lock(langCfgListMutex());
     _lang_cfg_list.clear();
 }
 
@@ -133,6 +141,7 @@ TextLangCfg* TextLangMan::getTextLangCfg(lString32 lang_tag) {
     }
     // Not sure if we can lowercase lang_tag and avoid duplicate (Harfbuzz might
     // need the proper lang tag with some parts starting with some uppercase letter)
+    LVLock lock(langCfgListMutex());
     for (int i = 0; i < _lang_cfg_list.length(); i++) {
         if (_lang_cfg_list[i]->_lang_tag == lang_tag) {
             // printf("TextLangCfg %s reused\n", UnicodeToLocal(lang_tag).c_str());
@@ -201,6 +210,7 @@ HyphMethod* TextLangMan::getMainLangHyphMethod() {
 }
 
 void TextLangMan::resetCounters() {
+    LVLock lock(langCfgListMutex());
     for (int i = 0; i < _lang_cfg_list.length(); i++) {
         _lang_cfg_list[i]->resetCounters();
     }
@@ -23,6 +23,7 @@
 #include <lvdocview.h>
 #include <lvtocitem.h>
 #include <crlog.h>
+#include <crconcurrent.h>
 #include <cstring>
 #include <cstdio>
 #include <ctime>
@@ -38,35 +39,51 @@ uint32_t XtgWriter::getTotalSize(uint16_t width, uint16_t height) {
     return sizeof(xtg_header_t) + xtg_data_size(width, height);
 }
 
-bool XtgWriter::write(LVStream* stream, LVGrayDrawBuf& buf, GrayToMonoPolicy grayPolicy) {
-    if (!stream)
-        return false;
-
-    uint16_t width = (uint16_t)buf.GetWidth();
-    uint16_t height = (uint16_t)buf.GetHeight();
-    int srcBpp = buf.GetBitsPerPixel();
-    uint32_t dataSize = xtg_data_size(width, height);
-
-    // Write XTG header
-    xtg_header_t header;
+/// Fill XTG/XTH page header
+static void initPageHeader(xtg_header_t& header, uint32_t magic, uint16_t width, uint16_t height, uint32_t dataSize) {
     memset(&header, 0, sizeof(header));
-    header.magic = XTG_MAGIC;
+    header.magic = magic;
     header.width = width;
     header.height = height;
     header.colorMode = 0;
     header.compression = 0;
     header.dataSize = dataSize;
     header.md5 = 0; // Optional, not computed
+}
 
-    if (stream->Write(&header, sizeof(header), NULL) != LVERR_OK)
+bool XtgWriter::write(LVStream* stream, LVGrayDrawBuf& buf, GrayToMonoPolicy grayPolicy) {
+    if (!stream)
         return false;
+    LVArray<lUInt8> data;
+    encode(buf, data, grayPolicy);
+    return stream->Write(data.get(), data.length(), NULL) == LVERR_OK;
+}
+
+void XtgWriter::encode(LVGrayDrawBuf& buf, LVArray<lUInt8>& data, GrayToMonoPolicy grayPolicy) {
+    uint16_t width = (uint16_t)buf.GetWidth();
+    uint16_t height = (uint16_t)buf.GetHeight();
+    data.clear();
+    data.addSpace(getTotalSize(width, height));
+
+    // XTG header
+    xtg_header_t header;
+    initPageHeader(header, XTG_MAGIC, width, height, xtg_data_size(width, height));
+    memcpy(data.get(), &header, sizeof(header));
+
+    pack(buf, data.get() + sizeof(header), grayPolicy);
+}
+
+void XtgWriter::pack(LVGrayDrawBuf& buf, uint8_t* data, GrayToMonoPolicy grayPolicy) {
+    uint16_t width = (uint16_t)buf.GetWidth();
+    uint16_t height = (uint16_t)buf.GetHeight();
+    int srcBpp = buf.GetBitsPerPixel();
 
     // Calculate row size in bytes (1 bit per pixel, packed)
     int rowBytes = (width + 7) / 8;
-    uint8_t* rowBuffer = new uint8_t[rowBytes];
 
-    // Write image data row by row (top to bottom)
+    // Pack image data row by row (top to bottom)
     for (int y = 0; y < height; y++) {
+        uint8_t* rowBuffer = data + y * rowBytes;
         memset(rowBuffer, 0, rowBytes);
         const uint8_t* srcRow = buf.GetScanLine(y);
 
@@ -142,14 +159,7 @@ bool XtgWriter::write(LVStream* stream, LVGrayDrawBuf& buf, GrayToMonoPolicy gra
             }
         }
 
-        if (stream->Write(rowBuffer, rowBytes, NULL) != LVERR_OK) {
-            delete[] rowBuffer;
-            return false;
-        }
     }
-
-    delete[] rowBuffer;
-    return true;
 }
 
 // =============================================================================
@@ -163,33 +173,36 @@ uint32_t XthWriter::getTotalSize(uint16_t width, uint16_t height) {
 bool XthWriter::write(LVStream* stream, LVGrayDrawBuf& buf) {
     if (!stream)
         return false;
+    LVArray<lUInt8> data;
+    encode(buf, data);
+    return stream->Write(data.get(), data.length(), NULL) == LVERR_OK;
+}
 
+void XthWriter::encode(LVGrayDrawBuf& buf, LVArray<lUInt8>& data) {
     uint16_t width = (uint16_t)buf.GetWidth();
     uint16_t height = (uint16_t)buf.GetHeight();
-    int srcBpp = buf.GetBitsPerPixel();
-    uint32_t dataSize = xth_data_size(width, height);
-    uint32_t pixelCount = (uint32_t)width * height;
-    uint32_t planeSize = (pixelCount + 7) / 8;
+    data.clear();
+    data.addSpace(getTotalSize(width, height));
 
-    // Write XTH header
+    // XTH header
     xtg_header_t header;
-    memset(&header, 0, sizeof(header));
-    header.magic = XTH_MAGIC;
-    header.width = width;
-    header.height = height;
-    header.colorMode = 0;
-    header.compression = 0;
-    header.dataSize = dataSize;
-    header.md5 = 0;
+    initPageHeader(header, XTH_MAGIC, width, height, xth_data_size(width, height));
+    memcpy(data.get(), &header, sizeof(header));
 
-    if (stream->Write(&header, sizeof(header), NULL) != LVERR_OK)
-        return false;
+    pack(buf, data.get() + sizeof(header));
+}
 
-    // Allocate bit planes
-    uint8_t* plane1 = new uint8_t[planeSize];
-    uint8_t* plane2 = new uint8_t[planeSize];
-    memset(plane1, 0, planeSize);
-    memset(plane2, 0, planeSize);
+void XthWriter::pack(LVGrayDrawBuf& buf, uint8_t* data) {
+    uint16_t width = (uint16_t)buf.GetWidth();
+    uint16_t height = (uint16_t)buf.GetHeight();
+    int srcBpp = buf.GetBitsPerPixel();
+    uint32_t pixelCount = (uint32_t)width * height;
+    uint32_t planeSize = (pixelCount + 7) / 8;
+
+    // Bit planes follow each other
+    uint8_t* plane1 = data;
+    uint8_t* plane2 = data + planeSize;
+    memset(data, 0, planeSize * 2);
 
     // XTH format uses vertical scan order (column-major):
     // - Columns are scanned from RIGHT to LEFT (x = width-1 down to 0)
@@ -279,16 +292,6 @@ bool XthWriter::write(LVStream* stream, LVGrayDrawBuf& buf) {
         }
     }
 
-    // Write bit planes
-    bool ok = true;
-    if (stream->Write(plane1, planeSize, NULL) != LVERR_OK)
-        ok = false;
-    if (ok && stream->Write(plane2, planeSize, NULL) != LVERR_OK)
-        ok = false;
-
-    delete[] plane1;
-    delete[] plane2;
-    return ok;
 }
 
 // =============================================================================
@@ -311,6 +314,7 @@ XtcExporter::XtcExporter()
     , m_startPage(-1)
     , m_endPage(-1)
     , m_dumpImagesLimit(0)
+    , m_threadCount(0)
     , m_previewPage(-1)
     , m_lastTotalPageCount(0)
     , m_callback(nullptr) {
@@ -400,6 +404,11 @@ XtcExporter& XtcExporter::dumpImages(int limit) {
     return *this;
 }
 
+XtcExporter& XtcExporter::setThreadCount(int count) {
+    m_threadCount = count < 0 ? 0 : count;
+    return *this;
+}
+
 XtcExporter& XtcExporter::setPreviewPage(int pageNumber) {
     m_previewPage = pageNumber;
     // Clear previous preview data when mode changes
@@ -754,24 +763,43 @@ bool XtcExporter::writePageIndex(LVStream* stream, const LVArray<xtc_page_index_
     return true;
 }
 
-bool XtcExporter::writePage(LVStream* stream, LVGrayDrawBuf& buf, xtc_page_index_t& indexEntry) {
-    // Record current position
-    indexEntry.offset = stream->GetPos();
-    indexEntry.width = (uint16_t)buf.GetWidth();
-    indexEntry.height = (uint16_t)buf.GetHeight();
-
-    bool ok;
+void XtcExporter::encodePage(LVGrayDrawBuf& buf, LVArray<lUInt8>& data) {
     if (m_format == XTC_FORMAT_XTC) {
-        indexEntry.size = XtgWriter::getTotalSize(indexEntry.width, indexEntry.height);
-        ok = XtgWriter::write(stream, buf, m_grayPolicy);
+        XtgWriter::encode(buf, data, m_grayPolicy);
     } else {
-        indexEntry.size = XthWriter::getTotalSize(indexEntry.width, indexEntry.height);
-        ok = XthWriter::write(stream, buf);
+        XthWriter::encode(buf, data);
     }
+}
 
-    return ok;
+bool XtcExporter::writePage(LVStream* stream, LVArray<lUInt8>& data, uint16_t width, uint16_t height,
+                            xtc_page_index_t& indexEntry) {
+    // Record current position
+    indexEntry.offset = stream->GetPos();
+    indexEntry.width = width;
+    indexEntry.height = height;
+    indexEntry.size = (uint32_t)data.length();
+    return stream->Write(data.get(), data.length(), NULL) == LVERR_OK;
 }
 
+/// Rendered page waiting for packing and writing
+struct XtcPendingPage
+{
+    LVGrayDrawBuf* buf;
+    LVArray<lUInt8> data;
+    CRTaskGroup* task;
+    XtcPendingPage(LVGrayDrawBuf* drawbuf)
+        : buf(drawbuf)
+        , task(NULL) {}
+    ~XtcPendingPage() {
+        if (task) {
+            task->cancel();
+            task->join();
+            delete task;
+        }
+        delete buf;
+    }
+};
+
 bool XtcExporter::exportDocument(LVDocView* docView, const lChar32* filename) {
     // In preview mode, filename can be null - we don't create any files
     if (isPreviewMode()) {
@@ -1028,6 +1056,25 @@ bool XtcExporter::exportDocument(LVDocView* docView, LVStreamRef stream) {
 
     int basePage = getBasePage(pages);
 
+    // Pipeline: pages are rendered one by one on this thread (document is not thread safe),
+    // packed into XTG/XTH data by pool threads, and written here in page order.
+    CRThreadPool* pool = NULL;
+    LVAutoPtr<CRThreadPool> privatePool;
+    if (!isPreviewMode()) {
+        if (m_threadCount == 0) {
+            pool = CRGetSharedThreadPool();
+        } else if (m_threadCount > 1) {
+            privatePool = new CRThreadPool(m_threadCount);
+            pool = privatePool.get();
+        }
+        if (pool && pool->getThreadCount() == 0)
+            pool = NULL;
+    }
+    // limit number of rendered pages kept in memory
+    int maxPendingPages = pool ? pool->getThreadCount() * 2 : 1;
+    LVPtrVector<XtcPendingPage> pendingPages;
+    int writtenCount = 0;
+
     for (int i = 0; i < exportPageCount; i++) {
         // Check for cancellation before each page
         if (m_callback && m_callback->isCancelled()) {
@@ -1052,7 +1099,10 @@ bool XtcExporter::exportDocument(LVDocView* docView, LVStreamRef stream) {
         int bufWidth = (isLandscape && !skipRotation) ? m_height : m_width;
         int bufHeight = (isLandscape && !skipRotation) ? m_width : m_height;
 
-        LVGrayDrawBuf drawbuf(bufWidth, bufHeight, renderBpp);
+        LVGrayDrawBuf* pageBuf = new LVGrayDrawBuf(bufWidth, bufHeight, renderBpp);
+        XtcPendingPage* page = new XtcPendingPage(pageBuf);
+        pendingPages.add(page);
+        LVGrayDrawBuf& drawbuf = *pageBuf;
         drawbuf.Clear(docView->getBackgroundColor());
         drawbuf.setImageDitherMode(m_imageDitherMode);
         drawbuf.setDitheringOptions(m_ditheringOptions);
@@ -1091,11 +1141,33 @@ bool XtcExporter::exportDocument(LVDocView* docView, LVStreamRef stream) {
                 }
             }
 
-            // Write page data and record index entry
-            if (!writePage(stream.get(), drawbuf, pageIndex[i])) {
-                CRLog::error("XtcExporter: Failed to write page %d (source page %d)", i, srcPageIdx);
-                return false;
+            // Pack page data
+            if (pool) {
+                page->task = new CRTaskGroup(pool);
+                page->task->runFunc([this, page]() {
+                    encodePage(*page->buf, page->data);
+                });
+            } else {
+                encodePage(drawbuf, page->data);
+            }
+        }
+
+        // Write packed pages in order, keeping the rest in the pipeline
+        bool lastPage = (i == exportPageCount - 1);
+        while (pendingPages.length() > 0 && (pendingPages.length() >= maxPendingPages || lastPage)) {
+            XtcPendingPage* done = pendingPages[0];
+            if (done->task)
+                done->task->join();
+            if (!isPreviewMode()) {
+                int srcPageIdx = actualStartPage + writtenCount;
+                if (!writePage(stream.get(), done->data, (uint16_t)done->buf->GetWidth(),
+                               (uint16_t)done->buf->GetHeight(), pageIndex[writtenCount])) {
+                    CRLog::error("XtcExporter: Failed to write page %d (source page %d)", writtenCount, srcPageIdx);
+                    return false;
+                }
             }
+            writtenCount++;
+            pendingPages.erase(0, 1);
         }
     }
 
@@ -25,6 +25,9 @@
 
 #include <crlog.h>
 #include <lvdocview.h>
+#include <lvbatchextractor.h>
+#include <lvstreamutils.h>
+#include <crconcurrent.h>
 
 #include "gtest/gtest.h"
 
@@ -118,3 +121,77 @@ TEST(BookCoverTests, GetBookCoverInEPUB_fast) {
     CRLog::info("Finished GetBookCoverInEPUB_fast");
     CRLog::info("================================");
 }
+
+class BatchInfoCollector: public LVBatchExtractorCallback
+{
+public:
+    LVPtrVector<LVBookInfo> infos;
+    virtual void onBookInfo(const LVBookInfo& info) {
+        infos.add(new LVBookInfo(info));
+    }
+};
+
+TEST(BookCoverTests, BatchExtractConcurrent) {
+    CRLog::info("===================================");
+    CRLog::info("Starting BatchExtractConcurrent");
+
+    CRSetupStdConcurrencyProvider();
+
+    CRSetupEngineConcurrency();
+    lString32Collection files;
+    files.add(cs32(TESTS_DATADIR "example.fb2.zip@/example.fb2"));
+    files.add(cs32(TESTS_DATADIR "simple-epub2-cover.epub"));
+    files.add(cs32(TESTS_DATADIR "testprops-two-authors.fb2"));
+    files.add(cs32(TESTS_DATADIR "no-such-book.fb2"));
+    files.add(cs32(TESTS_DATADIR "testprops-one-author.epub"));
+    files.add(cs32(TESTS_DATADIR "hello_fb2.fb2"));
+
+    // sequential reference
+    LVBatchExtractor extractor;
+    extractor.setThreadCount(1);
+    BatchInfoCollector reference;
+    EXPECT_EQ(extractor.run(files, &reference), 5);
+
+    // 3 workers, covers saved, memory budget allows two small books at a time
+    extractor.setThreadCount(3);
+    extractor.setMemoryBudget(5 * 1024 * 1024);
+    extractor.setCoverDir(cs32("batch-covers"));
+    extractor.setThumbSize(60, 80);
+    extractor.setGenerateCovers(true);
+    BatchInfoCollector results;
+    EXPECT_EQ(extractor.run(files, &results), 5);
+
+    ASSERT_EQ(results.infos.length(), files.length());
+    ASSERT_EQ(reference.infos.length(), files.length());
+    for (int i = 0; i < files.length(); i++) {
+        LVBookInfo* info = results.infos[i];
+        LVBookInfo* ref = reference.infos[i];
+        EXPECT_EQ(info->path, files[i]);
+        EXPECT_EQ(info->ok, ref->ok);
+        EXPECT_EQ(info->title, ref->title);
+        EXPECT_EQ(info->authors, ref->authors);
+        EXPECT_EQ(info->format, ref->format);
+        EXPECT_EQ(info->fileSize, ref->fileSize);
+        EXPECT_TRUE(ref->coverPath.empty());
+        if (info->ok) {
+            EXPECT_FALSE(info->coverPath.empty());
+            EXPECT_TRUE(LVFileExists(info->coverPath));
+            LVDeleteFile(info->coverPath);
+        }
+    }
+    EXPECT_FALSE(results.infos[3]->ok);
+    EXPECT_EQ(results.infos[0]->coverWidth, 120);
+    EXPECT_EQ(results.infos[0]->coverHeight, 171);
+    EXPECT_FALSE(results.infos[0]->coverGenerated);
+    EXPECT_EQ(results.infos[1]->coverWidth, 188);
+    EXPECT_EQ(results.infos[1]->coverHeight, 334);
+    EXPECT_EQ(results.infos[2]->authors, reference.infos[2]->authors);
+    lString8 json = results.infos[1]->toJson();
+    EXPECT_EQ(json.pos("{\"path\":"), 0);
+    EXPECT_NE(json.pos("\"coverWidth\":188"), -1);
+    EXPECT_NE(json.pos("\"timings\":{"), -1);
+    LVDeleteDirectory(cs32("batch-covers"));
+
+    CRLog::info("Finished BatchExtractConcurrent");
+    CRLog::info("===================================");
+}
@@ -24,6 +24,7 @@
  */
 
 #include <crlog.h>
+#include <crconcurrent.h>
 #include <lvdocview.h>
 #include <ldomdocument.h>
 #include <lvrend.h>
@@ -429,6 +430,79 @@ TEST_F(DocParseTests, ParseMathMLinHTML) {
     CRLog::info("=======================");
 }
 
+TEST_F(DocParseTests, ParsePipelinedIsIdentical) {
+    CRLog::info("==================================");
+    CRLog::info("Starting ParsePipelinedIsIdentical");
+    ASSERT_TRUE(m_initOK);
+
+    CRSetupStdConcurrencyProvider();
+
+    CRSetupEngineConcurrency();
+    ASSERT_TRUE(setProperty(PROP_REQUESTED_DOM_VERSION, 20200824));
+    ASSERT_TRUE(setProperty(PROP_RENDER_BLOCK_RENDERING_FLAGS, BLOCK_RENDERING_FLAGS_WEB));
+    ASSERT_TRUE(setCSS("htm.css"));
+
+    // HTML passed by several blocks of events, with FORM stopping tokenizing ahead in the middle
+    lString8 html("<html><head><title>Pipelined</title></head><body>\n<div>start</div>\n");
+    for (int i = 0; i < 600; i++) {
+        html << "<p class=\"c" << lString8::itoa(i % 3) << "\">Paragraph " << lString8::itoa(i);
+        html << " &amp; some&nbsp;text,\r\n  with <i>inline</i> elements.</p>\n";
+        if (i == 300) {
+            html << "<form action=\"find\"><input name=\"q\"></form>\n";
+            html << "<pre>\tpre\tformatted\n    text</pre><script>if (a<b) x();</script>\n";
+        }
+    }
+    html << "</body></html>";
+    const char* dumps[2] = { "doc-dump.xml", "doc-dump-pipelined.xml" };
+    for (int pipelined = 0; pipelined < 2; pipelined++) {
+        ASSERT_TRUE(setProperty(PROP_LOAD_PIPELINED, pipelined));
+        ASSERT_TRUE(m_view->LoadDocument(LVCreateStringStream(html), U"pipelined.html"));
+        ASSERT_TRUE(dumpXML(dumps[pipelined]));
+    }
+    EXPECT_TRUE(crengine_ng::unittesting::compareTwoTextFiles(dumps[0], dumps[1]));
+
+    for (int pipelined = 0; pipelined < 2; pipelined++) {
+        ASSERT_TRUE(setProperty(PROP_LOAD_PIPELINED, pipelined));
+        ASSERT_TRUE(m_view->LoadDocument(TESTS_DATADIR "example.fb2.zip@/example.fb2"));
+        ASSERT_TRUE(dumpXML(dumps[pipelined]));
+    }
+    EXPECT_TRUE(crengine_ng::unittesting::compareTwoTextFiles(dumps[0], dumps[1]));
+
+    CRLog::info("Finished ParsePipelinedIsIdentical");
+    CRLog::info("==================================");
+}
+
+TEST_F(DocParseTests, ParseEpubPipelinedIsIdentical) {
+    CRLog::info("======================================");
+    CRLog::info("Starting ParseEpubPipelinedIsIdentical");
+    ASSERT_TRUE(m_initOK);
+
+    CRSetupStdConcurrencyProvider();
+
+    CRSetupEngineConcurrency();
+    ASSERT_TRUE(setProperty(PROP_REQUESTED_DOM_VERSION, 20200824));
+    ASSERT_TRUE(setProperty(PROP_RENDER_BLOCK_RENDERING_FLAGS, BLOCK_RENDERING_FLAGS_WEB));
+    ASSERT_TRUE(setCSS("epub.css"));
+    CRSetSharedThreadPoolSize(3);
+
+    // spine items parsed by thread pool workers must be added to document in spine order
+    const char* files[] = { TESTS_DATADIR "structured-doc.epub", TESTS_DATADIR "simple-epub2.epub" };
+    const char* dumps[2] = { "doc-dump.xml", "doc-dump-pipelined.xml" };
+    for (int f = 0; f < 2; f++) {
+        for (int pipelined = 0; pipelined < 2; pipelined++) {
+            ASSERT_TRUE(setProperty(PROP_LOAD_PIPELINED, pipelined));
+            ASSERT_TRUE(m_view->LoadDocument(files[f]));
+            ASSERT_TRUE(dumpXML(dumps[pipelined]));
+        }
+        EXPECT_TRUE(crengine_ng::unittesting::compareTwoTextFiles(dumps[0], dumps[1]));
+    }
+    CRShutdownSharedThreadPool();
+    CRSetSharedThreadPoolSize(0);
+
+    CRLog::info("Finished ParseEpubPipelinedIsIdentical");
+    CRLog::info("======================================");
+}
+
 TEST_F(DocParseTests, OpenBrokenTextFile) {
     CRLog::info("===========================");
     CRLog::info("Starting OpenBrokenTextFile");
@@ -29,6 +29,9 @@
 #include <lvrend.h>
 #include <lvstreamutils.h>
 #include <ldomdoccache.h>
+#include <crconcurrent.h>
+
+#include <string.h>
 
 #include "gtest/gtest.h"
 
@@ -539,3 +542,161 @@ TEST_F(DocViewFuncsTests, GetFB2FilePropsInArc2FromCache) {
     CRLog::info("Finished GetFB2FilePropsInArc2FromCache");
     CRLog::info("=======================================");
 }
+
+static bool sameDrawBuf(LVDrawBuf* buf1, LVDrawBuf* buf2) {
+    if (buf1->GetWidth() != buf2->GetWidth() || buf1->GetHeight() != buf2->GetHeight() ||
+        buf1->GetBitsPerPixel() != buf2->GetBitsPerPixel())
+        return false;
+    for (int y = 0; y < buf1->GetHeight(); y++) {
+        if (memcmp(buf1->GetScanLine(y), buf2->GetScanLine(y), buf1->GetRowSize()) != 0)
+            return false;
+    }
+    return true;
+}
+
+#if CR_ENABLE_PAGE_IMAGE_CACHE == 1
+TEST_F(DocViewFuncsTests, PageImageCachePrerender) {
+    CRLog::info("=================================");
+    CRLog::info("Starting PageImageCachePrerender");
+    ASSERT_TRUE(m_initOK);
+
+    CRSetupStdConcurrencyProvider();
+
+    CRSetupEngineConcurrency();
+    CRSetSharedThreadPoolSize(2);
+    ASSERT_TRUE(setProperty(PROP_PAGE_IMAGE_CACHE_AHEAD, 3));
+    ASSERT_TRUE(setProperty(PROP_PAGE_IMAGE_CACHE_BEHIND, 1));
+    ASSERT_TRUE(m_view->LoadDocument(TESTS_DATADIR "example.fb2.zip@/example.fb2"));
+    m_view->checkRender();
+    ASSERT_GT(m_view->getPageCount(), 5);
+
+    LVColorDrawBuf expected(640, 360, 32);
+    int step = m_view->getVisiblePageCount();
+    for (int i = 0; i < 5; i++) {
+        {
+            LVDocImageRef image = m_view->getPageImage(0);
+            ASSERT_FALSE(image.isNull());
+            EXPECT_TRUE(m_view->isPageImageReady(0));
+            m_view->Draw(expected, -1, m_view->getCurPage(), true, false);
+            EXPECT_TRUE(sameDrawBuf(image->getDrawBuf(), &expected));
+        }
+        {
+            LVDocImageRef image = m_view->getPageImage(1);
+            ASSERT_FALSE(image.isNull());
+            m_view->Draw(expected, -1, m_view->getCurPage() + step, true, false);
+            EXPECT_TRUE(sameDrawBuf(image->getDrawBuf(), &expected));
+        }
+        // give some time to background rendering of next pages
+        concurrencyProvider->sleepMs(20);
+        m_view->moveByPage(1);
+    }
+    // cancel of queued pages
+    m_view->moveByPage(-3);
+    m_view->clearImageCache();
+    m_view->prerenderPageImages();
+    {
+        LVDocImageRef image = m_view->getPageImage(-1);
+        ASSERT_FALSE(image.isNull());
+        m_view->Draw(expected, -1, m_view->getCurPage() - step, true, false);
+        EXPECT_TRUE(sameDrawBuf(image->getDrawBuf(), &expected));
+    }
+    // document is closed while next pages are queued or being rendered
+    for (int i = 0; i < 3; i++) {
+        m_view->prerenderPageImages();
+        ASSERT_TRUE(m_view->LoadDocument(TESTS_DATADIR "example.fb2.zip@/example.fb2"));
+        m_view->checkRender();
+        EXPECT_FALSE(m_view->getPageImage(0).isNull());
+    }
+    delete m_view;
+    m_view = NULL;
+    CRShutdownSharedThreadPool();
+    CRSetSharedThreadPoolSize(0);
+
+    CRLog::info("Finished PageImageCachePrerender");
+    CRLog::info("=================================");
+}
+
+TEST_F(DocViewFuncsTests, PageImageCacheSinglePage) {
+    CRLog::info("=================================");
+    CRLog::info("Starting PageImageCacheSinglePage");
+    ASSERT_TRUE(m_initOK);
+
+    // no pre-rendering: cache holds two pages, new page replaces the farthest one
+    ASSERT_TRUE(m_view->LoadDocument(TESTS_DATADIR "example.fb2.zip@/example.fb2"));
+    m_view->checkRender();
+    ASSERT_GT(m_view->getPageCount(), 5);
+    int step = m_view->getVisiblePageCount();
+    for (int i = 0; i < 3; i++) {
+        m_view->goToPage(i * step);
+        LVDocImageRef image = m_view->getPageImage(0);
+        EXPECT_FALSE(image.isNull());
+    }
+    // previous page is dropped, not the current one
+    m_view->goToPage(3 * step);
+    EXPECT_FALSE(m_view->getPageImage(0).isNull());
+    EXPECT_FALSE(m_view->getPageImage(1).isNull());
+    EXPECT_TRUE(m_view->isPageImageReady(0));
+    EXPECT_TRUE(m_view->isPageImageReady(1));
+    EXPECT_FALSE(m_view->isPageImageReady(-1));
+
+    CRLog::info("Finished PageImageCacheSinglePage");
+    CRLog::info("=================================");
+}
+#endif
+
+TEST_F(DocViewFuncsTests, ParallelFormattingIsIdentical) {
+    CRLog::info("=================================");
+    CRLog::info("Starting ParallelFormattingIsIdentical");
+    ASSERT_TRUE(m_initOK);
+
+    CRSetupStdConcurrencyProvider();
+
+    CRSetupEngineConcurrency();
+    CRSetSharedThreadPoolSize(3);
+    ASSERT_TRUE(setProperty(PROP_FONT_SIZE, 24));
+    ASSERT_TRUE(m_view->LoadDocument(TESTS_DATADIR "example.fb2.zip@/example.fb2"));
+    m_view->checkRender();
+    // reference is a re-render too: first rendering of a document may differ a bit
+    ASSERT_TRUE(setProperty(PROP_FONT_SIZE, 30));
+    m_view->checkRender();
+    ASSERT_TRUE(setProperty(PROP_FONT_SIZE, 24));
+    m_view->checkRender();
+    LVRendPageList expectedPages;
+    LVRendPageList* pages = m_view->getPageList();
+    for (int i = 0; i < pages->length(); i++) {
+        LVRendPageInfo* page = (*pages)[i];
+        expectedPages.add(new LVRendPageInfo(page->start, page->height, page->index));
+    }
+    ASSERT_GT(expectedPages.length(), 5);
+    LVPtrVector<LVColorDrawBuf> expectedImages;
+    for (int i = 0; i < 5; i++) {
+        LVColorDrawBuf* buf = new LVColorDrawBuf(640, 360, 32);
+        m_view->Draw(*buf, -1, i, true, false);
+        expectedImages.add(buf);
+    }
+
+    // render again at the same font size, with paragraphs formatted ahead by workers
+    ASSERT_TRUE(setProperty(PROP_RENDER_PARALLEL_FORMATTING, 1));
+    ASSERT_TRUE(setProperty(PROP_FONT_SIZE, 30));
+    m_view->checkRender();
+    ASSERT_TRUE(setProperty(PROP_FONT_SIZE, 24));
+    m_view->checkRender();
+    pages = m_view->getPageList();
+    ASSERT_EQ(pages->length(), expectedPages.length());
+    for (int i = 0; i < pages->length(); i++) {
+        EXPECT_EQ((*pages)[i]->start, expectedPages[i]->start);
+        EXPECT_EQ((*pages)[i]->height, expectedPages[i]->height);
+    }
+    LVColorDrawBuf buf(640, 360, 32);
+    for (int i = 0; i < expectedImages.length(); i++) {
+        m_view->Draw(buf, -1, i, true, false);
+        EXPECT_TRUE(sameDrawBuf(&buf, expectedImages[i]));
+    }
+    delete m_view;
+    m_view = NULL;
+    CRShutdownSharedThreadPool();
+    CRSetSharedThreadPoolSize(0);
+
+    CRLog::info("Finished ParallelFormattingIsIdentical");
+    CRLog::info("=================================");
+}
@@ -25,6 +25,12 @@
 
 #include <crlog.h>
 #include <lvfntman.h>
+#include <lvcolordrawbuf.h>
+#include <lvptrvec.h>
+#include <crconcurrent.h>
+
+#include <thread>
+#include <vector>
 
 #if (USE_FREETYPE == 1) && (USE_LOCALE_DATA == 1)
 
@@ -82,4 +88,74 @@ TEST(FontManFuncsTests, TestCheckFontLangCompat) {
     CRLog::info("================================");
 }
 
+// measure and draw text with given font, returns sum of measured widths
+static int measureAndDraw(LVFont* font, const lString32& text, LVColorDrawBuf& buf) {
+    lUInt16 widths[64];
+    lUInt8 flags[64];
+    int len = text.length() < 64 ? text.length() : 64;
+    int n = font->measureText(text.c_str(), len, widths, flags, 10000, U'?');
+    int sum = 0;
+    for (int i = 0; i < n; i++)
+        sum += widths[i];
+    buf.Clear(0xFFFFFF);
+    buf.SetTextColor(0x000000);
+    font->DrawTextString(&buf, 2, 2, text.c_str(), len, U'?');
+    return sum + (int)font->getTextWidth(text.c_str(), len);
+}
+
+TEST(FontManFuncsTests, ConcurrentMeasureAndDraw) {
+    CRLog::info("==================================");
+    CRLog::info("Starting ConcurrentMeasureAndDraw");
+
+    CRSetupStdConcurrencyProvider();
+
+    CRSetupEngineConcurrency();
+    const int fontCount = 3;
+    LVFontRef fonts[fontCount];
+    fonts[0] = fontMan->GetFont(18, 400, false, css_ff_sans_serif, cs8("FreeSans"));
+    fonts[1] = fontMan->GetFont(22, 400, true, css_ff_serif, cs8("FreeSerif"));
+    fonts[2] = fontMan->GetFont(20, 700, false, css_ff_monospace, cs8("FreeMono"));
+    lString32 text = cs32("The quick brown fox jumps over the lazy dog 0123456789");
+    int expectedWidths[fontCount];
+    LVPtrVector<LVColorDrawBuf> expectedBufs;
+    for (int i = 0; i < fontCount; i++) {
+        ASSERT_FALSE(fonts[i].isNull());
+        expectedBufs.add(new LVColorDrawBuf(600, 40, 32));
+        expectedWidths[i] = measureAndDraw(fonts[i].get(), text, *expectedBufs[i]);
+        EXPECT_GT(expectedWidths[i], 0);
+    }
+
+    CRResetLockStats();
+    CRSetLockStatsEnabled(true);
+    const int threadCount = 4;
+    std::vector<int> mismatches(threadCount, 0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; t++) {
+        threads.push_back(std::thread([&, t]() {
+            LVColorDrawBuf buf(600, 40, 32);
+            for (int k = 0; k < 200; k++) {
+                int i = (t + k) % fontCount;
+                int w = measureAndDraw(fonts[i].get(), text, buf);
+                if (w != expectedWidths[i] || memcmp(buf.GetScanLine(0), expectedBufs[i]->GetScanLine(0), 600 * 40 * 4) != 0)
+                    mismatches[t]++;
+            }
+        }));
+    }
+    for (int t = 0; t < threadCount; t++) {
+        threads[t].join();
+        EXPECT_EQ(mismatches[t], 0);
+    }
+    CRSetLockStatsEnabled(false);
+    // text measuring and drawing uses only locks of font instances
+    CRLockStats globalStats = CRGetLockStats(CR_LOCK_STATS_FONT);
+    CRLockStats faceStats = CRGetLockStats(CR_LOCK_STATS_FONT_FACE);
+    CRLog::info("font face locks: acquired %llu, contended %llu", faceStats.acquired, faceStats.contended);
+    EXPECT_EQ(globalStats.acquired, 0ULL);
+    EXPECT_GT(faceStats.acquired, 0ULL);
+    EXPECT_LE(faceStats.contended, faceStats.acquired);
+
+    CRLog::info("Finished ConcurrentMeasureAndDraw");
+    CRLog::info("==================================");
+}
+
 #endif // (USE_FREETYPE == 1) && (USE_LOCALE_DATA == 1)
@@ -0,0 +1,251 @@
+/***************************************************************************
+ *   crengine-ng, unit testing                                             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License           *
+ *   as published by the Free Software Foundation; either version 2        *
+ *   of the License, or (at your option) any later version.                *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,            *
+ *   MA 02110-1301, USA.                                                   *
+ ***************************************************************************/
+
+/**
+ * \file tests_threadpool.cpp
+ * \brief Tests built-in concurrency provider, CRThreadPool class, LVProtectedFastRef and LVMutex.
+ */
+
+#include <crconcurrent.h>
+#include <lvref.h>
+#include <lvthread.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+// auxiliary classes
+
+class CounterTask: public CRRunnable
+{
+    std::atomic<int>& _counter;
+public:
+    explicit CounterTask(std::atomic<int>& counter)
+            : _counter(counter) { }
+    virtual void run() {
+        _counter++;
+    }
+};
+
+class DeleteCounter: public LVAtomicRefCounter
+{
+    std::atomic<int>& _deleted;
+public:
+    explicit DeleteCounter(std::atomic<int>& deleted)
+            : _deleted(deleted) { }
+    ~DeleteCounter() {
+        _deleted++;
+    }
+};
+
+// Fixtures
+
+class ThreadPoolTests: public testing::Test
+{
+protected:
+    void SetUp() {
+        CRSetupStdConcurrencyProvider();
+        CRSetupEngineConcurrency();
+    }
+};
+
+// units tests
+
+TEST_F(ThreadPoolTests, DefaultProvider) {
+    ASSERT_TRUE(concurrencyProvider != NULL);
+    EXPECT_GE(concurrencyProvider->getProcessorCount(), 1);
+    EXPECT_TRUE(_refMutex != NULL);
+    EXPECT_TRUE(_crengineMutex != NULL);
+}
+
+TEST_F(ThreadPoolTests, GroupJoin) {
+    std::atomic<int> counter(0);
+    CRThreadPool pool(4);
+    EXPECT_EQ(pool.getThreadCount(), 4);
+    CRTaskGroup group(&pool);
+    for (int i = 0; i < 1000; i++)
+        group.run(new CounterTask(counter));
+    group.join();
+    EXPECT_EQ(counter, 1000);
+    EXPECT_EQ(group.pendingCount(), 0);
+}
+
+TEST_F(ThreadPoolTests, NestedGroups) {
+    // tasks spawn sub-tasks into their own groups and wait for them from worker threads
+    std::atomic<int> counter(0);
+    CRThreadPool pool(2);
+    CRTaskGroup group(&pool);
+    for (int i = 0; i < 16; i++) {
+        group.runFunc([&pool, &counter]() {
+            CRTaskGroup subgroup(&pool);
+            for (int j = 0; j < 16; j++)
+                subgroup.run(new CounterTask(counter));
+            subgroup.join();
+        });
+    }
+    group.join();
+    EXPECT_EQ(counter, 256);
+}
+
+TEST_F(ThreadPoolTests, WaitRunsNoTasks) {
+    // tasks are executed by workers only, waiting thread doesn't help
+    std::atomic<int> counter(0);
+    std::atomic<int> runByCaller(0);
+    std::thread::id caller = std::this_thread::get_id();
+    CRThreadPool pool(2);
+    CRTaskGroup group(&pool);
+    for (int i = 0; i < 100; i++) {
+        group.runFunc([&counter, &runByCaller, caller]() {
+            if (std::this_thread::get_id() == caller)
+                runByCaller++;
+            counter++;
+        });
+    }
+    group.wait();
+    EXPECT_EQ(counter, 100);
+    EXPECT_EQ(runByCaller, 0);
+    EXPECT_EQ(group.pendingCount(), 0);
+}
+
+TEST_F(ThreadPoolTests, Cancel) {
+    std::atomic<int> counter(0);
+    CRThreadPool pool(1);
+    CRTaskGroup blocker(&pool);
+    std::atomic<bool> release(false);
+    // occupy the only worker
+    blocker.runFunc([&release]() {
+        while (!release)
+            concurrencyProvider->sleepMs(1);
+    });
+    CRTaskGroup group(&pool);
+    for (int i = 0; i < 100; i++)
+        group.run(new CounterTask(counter));
+    group.cancel();
+    EXPECT_TRUE(group.isCancelled());
+    release = true;
+    group.join();
+    blocker.join();
+    EXPECT_EQ(counter, 0);
+}
+
+TEST_F(ThreadPoolTests, NoThreads) {
+    std::atomic<int> counter(0);
+    CRThreadPool pool(0);
+    EXPECT_EQ(pool.getThreadCount(), 0);
+    pool.execute(new CounterTask(counter));
+    EXPECT_EQ(counter, 1);
+    CRTaskGroup group(&pool);
+    group.run(new CounterTask(counter));
+    EXPECT_EQ(counter, 2);
+    group.cancel();
+    group.run(new CounterTask(counter));
+    EXPECT_EQ(counter, 2);
+}
+
+TEST_F(ThreadPoolTests, SharedPool) {
+    CRSetSharedThreadPoolSize(3);
+    CRThreadPool* pool = CRGetSharedThreadPool();
+    ASSERT_TRUE(pool != NULL);
+    EXPECT_EQ(pool->getThreadCount(), 3);
+    EXPECT_EQ(pool, CRGetSharedThreadPool());
+    std::atomic<int> counter(0);
+    {
+        CRTaskGroup group(pool);
+        for (int i = 0; i < 10; i++)
+            group.run(new CounterTask(counter));
+    }
+    EXPECT_EQ(counter, 10);
+    CRShutdownSharedThreadPool();
+    // created once when first requested by several threads at the same time
+    std::atomic<CRThreadPool*> pools[4];
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+        threads.push_back(std::thread([&pools, t]() { pools[t] = CRGetSharedThreadPool(); }));
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+    pool = CRGetSharedThreadPool();
+    for (int t = 0; t < 4; t++)
+        EXPECT_EQ(pools[t].load(), pool);
+    CRSetSharedThreadPoolSize(2);
+    pool = CRGetSharedThreadPool();
+    ASSERT_TRUE(pool != NULL);
+    EXPECT_EQ(pool->getThreadCount(), 2);
+    CRShutdownSharedThreadPool();
+    CRSetSharedThreadPoolSize(0);
+}
+
+TEST_F(ThreadPoolTests, ProtectedRefConcurrentCopies) {
+    std::atomic<int> deleted(0);
+    {
+        LVProtectedFastRef<DeleteCounter> shared(new DeleteCounter(deleted));
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++) {
+            threads.push_back(std::thread([&shared]() {
+                LVProtectedFastRef<DeleteCounter> last;
+                for (int i = 0; i < 10000; i++) {
+                    LVProtectedFastRef<DeleteCounter> copy(shared);
+                    last = copy;
+                }
+            }));
+        }
+        for (size_t t = 0; t < threads.size(); t++)
+            threads[t].join();
+        EXPECT_EQ(shared.getRefCount(), 1);
+        EXPECT_EQ(deleted, 0);
+    }
+    EXPECT_EQ(deleted, 1);
+}
+
+TEST_F(ThreadPoolTests, MutexLockUnless) {
+    LVMutex mutex;
+    std::atomic<bool> cancelled(false);
+    std::atomic<int> result(-1);
+    // recursive for the owner
+    EXPECT_TRUE(mutex.lockUnless([&cancelled]() { return cancelled.load(); }));
+    EXPECT_TRUE(mutex.trylock());
+    mutex.unlock();
+    // waiting thread gives up when cancelled while lock is still held
+    std::thread waiter([&mutex, &cancelled, &result]() {
+        result = mutex.lockUnless([&cancelled]() { return cancelled.load(); }) ? 1 : 0;
+    });
+    concurrencyProvider->sleepMs(20);
+    EXPECT_EQ(result, -1);
+    cancelled = true;
+    mutex.wakeWaiters();
+    waiter.join();
+    EXPECT_EQ(result, 0);
+    // and gets the lock when it's released
+    cancelled = false;
+    result = -1;
+    std::thread locker([&mutex, &cancelled, &result]() {
+        bool locked = mutex.lockUnless([&cancelled]() { return cancelled.load(); });
+        result = locked ? 1 : 0;
+        if (locked)
+            mutex.unlock();
+    });
+    concurrencyProvider->sleepMs(20);
+    EXPECT_EQ(result, -1);
+    mutex.unlock();
+    locker.join();
+    EXPECT_EQ(result, 1);
+    EXPECT_TRUE(mutex.trylock());
+    mutex.unlock();
+}
@@ -28,10 +28,22 @@
 #include <crlog.h>
 #include <lvdocview.h>
 #include <ldomdocument.h>
+#include <ldomtextview.h>
+#include <ldomxpointerex.h>
 #include <ldomdoccache.h>
+#include <ldommemorygovernor.h>
 #include <lvstreamutils.h>
+#include <lvserialbuf.h>
+#include <lvdocviewcallback.h>
+#include <crconcurrent.h>
+#include <fb2def.h>
 
 #include "../src/lvtinydom/cachefile.h"
+#include "../src/lvtinydom/ldomdoccacheimpl.h"
+#include "../src/lvtinydom/renderrectaccessor.h"
+
+#include <atomic>
+#include <thread>
 
 #include "gtest/gtest.h"
 
@@ -43,6 +55,51 @@
 #define TESTS_TMPDIR "/tmp/"
 #endif
 
+// auxiliary classes
+
+class CacheWrittenCallback: public LVDocViewCallback
+{
+public:
+    std::atomic<int> count;
+    std::atomic<bool> success;
+    std::thread::id threadId;
+    CacheWrittenCallback()
+            : count(0)
+            , success(false) { }
+    virtual void OnCacheFileWritten(bool ok) {
+        success = ok;
+        threadId = std::this_thread::get_id();
+        count++;
+    }
+};
+
+class FormatCountCallback: public LVDocViewCallback
+{
+public:
+    int count;
+    FormatCountCallback()
+            : count(0) { }
+    virtual void OnFormatStart() {
+        count++;
+    }
+};
+
+class StylesUpdateCountCallback: public LVDocViewCallback
+{
+public:
+    int started;
+    int ended;
+    StylesUpdateCountCallback()
+            : started(0)
+            , ended(0) { }
+    virtual void OnNodeStylesUpdateStart() {
+        started++;
+    }
+    virtual void OnNodeStylesUpdateEnd() {
+        ended++;
+    }
+};
+
 // Fixtures
 
 class TinyDOMTests: public testing::Test
@@ -56,6 +113,7 @@ protected:
 
     virtual void TearDown() override {
         LVDeleteFile(U"cr3cache/cr3cache.inx");
+        LVDeleteFile(U"cr3cache/cr3cache.lock");
         LVDeleteDirectory(U"cr3cache");
     }
 };
@@ -273,6 +331,15 @@ TEST_F(TinyDOMTests, basicTinyDomUnitTests) {
         EXPECT_TRUE(el1->getStyle().get() == el2->getStyle().get()); // identical styles reused
         el21->setStyle(style3);
         EXPECT_TRUE(el1->getStyle().get() != el21->getStyle().get()); // different styles not reused
+        EXPECT_NE(calcHash(*style1), calcHash(*style3));              // different styles have different hashes
+
+        SerialBuf buf(1024);
+        EXPECT_TRUE(style3->serialize(buf));
+        buf.setPos(0);
+        css_style_ref_t style4 = css_style_ref_t(new css_style_rec_t);
+        EXPECT_TRUE(style4->deserialize(buf));
+        EXPECT_TRUE(*style3 == *style4);                         // serialization keeps all properties
+        EXPECT_EQ(calcHash(*style3), calcHash(*style4));         // and the hash
     }
 
     CRLog::info("* font cache");
@@ -354,6 +421,31 @@ TEST_F(TinyDOMTests, basicTinyDomUnitTests) {
     EXPECT_EQ(f2->getNodeId(), el_strong); // find 2
     EXPECT_TRUE(f2 == el211);              // find 2, ref
 
+    CRLog::info("* text views");
+    {
+        EXPECT_TRUE(text1->isPersistent()); // persistent text node
+        ldomTextView view(text1);
+        EXPECT_TRUE(lString8(view.data(), view.length()) == UnicodeToUtf8(sampleText3)); // text in place
+        EXPECT_EQ(view.charCount(), (int)sampleText3.length());
+        lString32 decoded("previous text of buffer");
+        view.decode(decoded);
+        EXPECT_TRUE(decoded == sampleText3); // decoded to buffer
+        // recently accessed text is decoded once
+        lString32 t1 = text1->getText();
+        lString32 t2 = text1->getText();
+        EXPECT_TRUE(t1 == sampleText3);
+        EXPECT_EQ(t1.c_str(), t2.c_str());
+        ldomTextView elemView(el1);
+        EXPECT_TRUE(elemView.empty()); // no text of element
+    }
+    text1->setText(sampleText);
+    EXPECT_FALSE(text1->isPersistent());
+    EXPECT_TRUE(text1->getText() == sampleText); // mutable text changed
+    EXPECT_EQ(ldomTextView(text1).charCount(), (int)sampleText.length());
+    CRTimerUtil infinite3;
+    doc->persist(infinite3);
+    EXPECT_TRUE(text1->getText() == sampleText); // persistent text changed
+
     CRLog::info("* compacting");
     doc->compact();
     doc->dumpStatistics();
@@ -441,6 +533,376 @@ TEST_F(TinyDOMTests, testCacheFileClass) {
     CRLog::info("===========================");
 }
 
+TEST_F(TinyDOMTests, testCacheFileAsyncWrites) {
+    CRLog::info("=================================");
+    CRLog::info("Starting testCacheFileAsyncWrites");
+    CRSetupStdConcurrencyProvider();
+    CRSetupEngineConcurrency();
+    CRSetSharedThreadPoolSize(3);
+#if (USE_ZSTD == 1)
+    CacheCompressionType compType = CacheCompressionZSTD;
+#elif (USE_ZLIB == 1)
+    CacheCompressionType compType = CacheCompressionZlib;
+#else
+    CacheCompressionType compType = CacheCompressionNone;
+#endif
+    const int blockCount = 64;
+    const int blockSize = 20000;
+    LVArray<lUInt8> data(blockSize, 0);
+    lString32 fn(TEST_FILE_NAME);
+    CacheWrittenCallback callback;
+    // write
+    {
+        CacheFile* f = new CacheFile(gDOMVersionCurrent, compType);
+        ASSERT_TRUE(f->create(LVOpenFileStream(fn.c_str(), LVOM_APPEND)));
+        ASSERT_TRUE(f->startAsyncWrites(CRGetSharedThreadPool()));
+        EXPECT_TRUE(f->isAsyncWriting());
+        for (int i = 0; i < blockCount; i++) {
+            for (int k = 0; k < blockSize; k++)
+                data[k] = (lUInt8)((k / (i + 1)) & 0xFF);
+            EXPECT_TRUE(f->write(CBT_TEXT_DATA, i, data.get(), blockSize, (i & 1) == 0));
+        }
+        // rewrite of block queued earlier, last one wins
+        memset(data.get(), 'X', blockSize);
+        EXPECT_TRUE(f->write(CBT_TEXT_DATA, 5, data.get(), blockSize, true));
+        CRTimerUtil inf;
+        EXPECT_TRUE(f->flush(true, inf));
+        f->notifyAsyncWritten(&callback);
+        // delivered on this thread only, once written
+        for (int i = 0; i < 2000 && callback.count == 0; i++) {
+            concurrencyProvider->sleepMs(5);
+            f->deliverAsyncNotifications();
+        }
+        EXPECT_EQ(callback.count, 1);
+        EXPECT_TRUE(callback.success);
+        EXPECT_TRUE(callback.threadId == std::this_thread::get_id());
+        EXPECT_TRUE(f->write(CBT_TEXT_DATA, 6, data.get(), blockSize, true));
+        EXPECT_TRUE(f->flush(true, inf));
+        f->notifyAsyncWritten(&callback);
+        // writes are finished in background, notification is dropped
+        CacheFile::release(f);
+        CacheFile::waitReleased();
+    }
+    EXPECT_EQ(callback.count, 1);
+    // read
+    {
+        CacheFile f(gDOMVersionCurrent, compType);
+        ASSERT_TRUE(f.open(fn));
+        for (int i = 0; i < blockCount; i++) {
+            if (i == 5 || i == 6)
+                memset(data.get(), 'X', blockSize);
+            else {
+                for (int k = 0; k < blockSize; k++)
+                    data[k] = (lUInt8)((k / (i + 1)) & 0xFF);
+            }
+            lUInt8* buf = NULL;
+            int sz = 0;
+            EXPECT_TRUE(f.read(CBT_TEXT_DATA, i, buf, sz));
+            ASSERT_TRUE(buf != NULL);
+            EXPECT_EQ(sz, blockSize);
+            EXPECT_EQ(memcmp(buf, data.get(), blockSize), 0);
+            free(buf);
+        }
+    }
+    LVDeleteFile(fn);
+    CRShutdownSharedThreadPool();
+    CRSetSharedThreadPoolSize(0);
+    CRLog::info("Finished testCacheFileAsyncWrites");
+    CRLog::info("=================================");
+}
+
+TEST_F(TinyDOMTests, testCacheFileMappedReads) {
+    CRLog::info("=================================");
+    CRLog::info("Starting testCacheFileMappedReads");
+#if (USE_ZSTD == 1)
+    CacheCompressionType compType = CacheCompressionZSTD;
+#elif (USE_ZLIB == 1)
+    CacheCompressionType compType = CacheCompressionZlib;
+#else
+    CacheCompressionType compType = CacheCompressionNone;
+#endif
+    const int blockCount = 16;
+    const int blockSize = 20000;
+    LVArray<lUInt8> data(blockSize, 0);
+    lString32 fn(TEST_FILE_NAME);
+    // write: even blocks are compressed, odd are not
+    {
+        CacheFile f(gDOMVersionCurrent, compType);
+        ASSERT_TRUE(f.create(LVOpenFileStream(fn.c_str(), LVOM_APPEND)));
+        for (int i = 0; i < blockCount; i++) {
+            for (int k = 0; k < blockSize; k++)
+                data[k] = (lUInt8)((k / (i + 1)) & 0xFF);
+            EXPECT_TRUE(f.write(CBT_TEXT_DATA, i, data.get(), blockSize, (i & 1) == 0));
+        }
+        SerialBuf buf(0, true);
+        buf.putMagic("MAPPED");
+        buf << (lUInt32)blockCount;
+        EXPECT_TRUE(f.write(CBT_PROP_DATA, buf, false));
+        CRTimerUtil inf;
+        EXPECT_TRUE(f.flush(true, inf));
+    }
+    // read through mapping
+    {
+        CacheFile f(gDOMVersionCurrent, compType);
+        ASSERT_TRUE(f.open(LVOpenFileStream(fn.c_str(), LVOM_APPEND)));
+#if !defined(_WIN32)
+        ASSERT_TRUE(f.mapForReading(fn));
+        EXPECT_TRUE(f.isMapped());
+#endif
+        for (int i = 0; i < blockCount; i++) {
+            for (int k = 0; k < blockSize; k++)
+                data[k] = (lUInt8)((k / (i + 1)) & 0xFF);
+            int sz = 0;
+            const lUInt8* mapped = f.readMapped(CBT_TEXT_DATA, i, sz);
+            bool inPlace = f.isMapped() && ((i & 1) != 0 || compType == CacheCompressionNone);
+            EXPECT_EQ(mapped != NULL, inPlace);
+            if (mapped) {
+                EXPECT_EQ(sz, blockSize);
+                EXPECT_EQ(memcmp(mapped, data.get(), blockSize), 0);
+            }
+            // node arrays are read to buffer of larger size
+            lUInt8* buf = NULL;
+            EXPECT_TRUE(f.read(CBT_TEXT_DATA, i, buf, sz, blockSize * 2));
+            ASSERT_TRUE(buf != NULL);
+            EXPECT_EQ(sz, blockSize);
+            EXPECT_EQ(memcmp(buf, data.get(), blockSize), 0);
+            memset(buf + blockSize, 0, blockSize);
+            free(buf);
+        }
+        SerialBuf buf(0, true);
+        ASSERT_TRUE(f.readInPlace(CBT_PROP_DATA, buf));
+        EXPECT_TRUE(buf.checkMagic("MAPPED"));
+        lUInt32 n = 0;
+        buf >> n;
+        EXPECT_EQ(n, (lUInt32)blockCount);
+        EXPECT_FALSE(buf.error());
+        // rewritten block is not read from mapping until flushed, new block is beyond mapping
+        memset(data.get(), 'X', blockSize);
+        EXPECT_TRUE(f.write(CBT_TEXT_DATA, 1, data.get(), blockSize, false));
+        EXPECT_TRUE(f.write(CBT_TEXT_DATA, blockCount, data.get(), blockSize, false));
+        int sz = 0;
+        EXPECT_TRUE(f.readMapped(CBT_TEXT_DATA, 1, sz) == NULL);
+        for (int i = 1; i <= blockCount; i += blockCount - 1) {
+            lUInt8* rbuf = NULL;
+            EXPECT_TRUE(f.read(CBT_TEXT_DATA, i, rbuf, sz));
+            ASSERT_TRUE(rbuf != NULL);
+            EXPECT_EQ(sz, blockSize);
+            EXPECT_EQ(memcmp(rbuf, data.get(), blockSize), 0);
+            free(rbuf);
+        }
+        CRTimerUtil inf;
+        EXPECT_TRUE(f.flush(true, inf));
+#if !defined(_WIN32)
+        const lUInt8* mapped = f.readMapped(CBT_TEXT_DATA, 1, sz);
+        ASSERT_TRUE(mapped != NULL);
+        EXPECT_EQ(memcmp(mapped, data.get(), blockSize), 0);
+        EXPECT_TRUE(f.readMapped(CBT_TEXT_DATA, blockCount, sz) == NULL);
+#endif
+    }
+    LVDeleteFile(fn);
+    CRLog::info("Finished testCacheFileMappedReads");
+    CRLog::info("=================================");
+}
+
+#if (USE_ZSTD == 1)
+// fills buffer with markup-like text of repeating words, different for each seed
+static void fillDictionaryTestData(lUInt8* buf, int size, lUInt32 seed) {
+    static const char* words[] = { "<p>", "</p>", "<emphasis>", "</emphasis>", "the", "of", "and", "reader",
+                                   "book", "chapter", "page", "text", "style", "section", " ", " ", " ", "\n" };
+    const int wordCount = sizeof(words) / sizeof(words[0]);
+    int pos = 0;
+    while (pos < size) {
+        seed = seed * 1103515245 + 12345;
+        const char* w = words[(seed >> 16) % wordCount];
+        for (; *w && pos < size; w++)
+            buf[pos++] = (lUInt8)*w;
+    }
+}
+#endif
+
+TEST_F(TinyDOMTests, testCacheFileDictionary) {
+    CRLog::info("=================================");
+    CRLog::info("Starting testCacheFileDictionary");
+    lString32 fn(TEST_FILE_NAME);
+#if (USE_ZSTD == 1)
+    const int blockCount = 32;
+    const int blockSize = 4000;
+    const int sampleCount = 256;
+    const int sampleSize = 1024;
+    LVArray<lUInt8> data(blockSize, 0);
+    LVArray<lUInt8> samples(sampleCount * sampleSize, 0);
+    LVArray<size_t> sampleSizes(sampleCount, sampleSize);
+    for (int i = 0; i < sampleCount; i++)
+        fillDictionaryTestData(samples.get() + i * sampleSize, sampleSize, 1000 + i);
+    lvsize_t packedSize[3] = { 0, 0, 0 };
+    CRSetupStdConcurrencyProvider();
+    CRSetupEngineConcurrency();
+    CRSetSharedThreadPoolSize(3);
+    // pass 1 trains dictionary in calling thread, pass 2 by background writer
+    for (int pass = 0; pass < 3; pass++) {
+        bool withDict = pass > 0;
+        {
+            CacheFile f(gDOMVersionCurrent, CacheCompressionZSTD);
+            ASSERT_TRUE(f.create(LVOpenFileStream(fn.c_str(), LVOM_APPEND)));
+            EXPECT_TRUE(f.canTrainDictionary());
+            if (pass == 2)
+                EXPECT_TRUE(f.startAsyncWrites(CRGetSharedThreadPool()));
+            if (withDict) {
+                EXPECT_TRUE(f.trainDictionary(samples.get(), sampleSizes.get(), sampleCount));
+                EXPECT_FALSE(f.canTrainDictionary()); // cannot be replaced
+            }
+            if (pass == 1) {
+                EXPECT_TRUE(f.hasDictionary());
+                // blocks are packed with dictionary by pool workers too
+                EXPECT_TRUE(f.startAsyncWrites(CRGetSharedThreadPool()));
+            }
+            for (int i = 0; i < blockCount; i++) {
+                fillDictionaryTestData(data.get(), blockSize, i);
+                EXPECT_TRUE(f.write(CBT_TEXT_DATA, i, data.get(), blockSize, true));
+            }
+            fillDictionaryTestData(data.get(), blockSize, 0);
+            EXPECT_TRUE(f.write(CBT_PROP_DATA, 0, data.get(), blockSize, true));
+            for (int i = 0; i < blockCount; i++)
+                packedSize[pass] += f.readStream(CBT_TEXT_DATA, i)->GetSize();
+            EXPECT_EQ(f.hasDictionary(), withDict);
+            CRTimerUtil inf;
+            EXPECT_TRUE(f.flush(true, inf));
+        }
+        // read
+        {
+            CacheFile f(gDOMVersionCurrent, CacheCompressionZSTD);
+            ASSERT_TRUE(f.open(fn));
+            EXPECT_EQ(f.hasDictionary(), withDict);
+            for (int i = 0; i <= blockCount; i++) {
+                fillDictionaryTestData(data.get(), blockSize, i < blockCount ? i : 0);
+                lUInt8* buf = NULL;
+                int sz = 0;
+                EXPECT_TRUE(f.read(i < blockCount ? CBT_TEXT_DATA : CBT_PROP_DATA, i < blockCount ? i : 0, buf, sz));
+                ASSERT_TRUE(buf != NULL);
+                EXPECT_EQ(sz, blockSize);
+                EXPECT_EQ(memcmp(buf, data.get(), blockSize), 0);
+                free(buf);
+            }
+        }
+        LVDeleteFile(fn);
+    }
+    CRLog::info("packed size of blocks: %d without dictionary, %d with it", (int)packedSize[0], (int)packedSize[1]);
+    EXPECT_LT(packedSize[1], packedSize[0]);
+    EXPECT_EQ(packedSize[2], packedSize[1]);
+    CRShutdownSharedThreadPool();
+    CRSetSharedThreadPoolSize(0);
+#else
+    CacheFile f(gDOMVersionCurrent, CacheCompressionNone);
+    ASSERT_TRUE(f.create(LVOpenFileStream(fn.c_str(), LVOM_APPEND)));
+    EXPECT_FALSE(f.canTrainDictionary());
+    EXPECT_FALSE(f.hasDictionary());
+    LVDeleteFile(fn);
+#endif
+    CRLog::info("Finished testCacheFileDictionary");
+    CRLog::info("=================================");
+}
+
+static void fillCompactionTestData(lUInt8* buf, int size, int seed) {
+    for (int i = 0; i < size; i++)
+        buf[i] = (lUInt8)(seed * 31 + i * 7 + (i >> 8));
+}
+
+TEST_F(TinyDOMTests, testCacheFileCompaction) {
+    CRLog::info("=================================");
+    CRLog::info("Starting testCacheFileCompaction");
+    lString32 fn(TEST_FILE_NAME);
+    const int blockCount = 20;
+    const int maxBlockSize = 6000;
+    int sizes[blockCount];
+    LVArray<lUInt8> data(maxBlockSize, 0);
+    int sizeBefore = 0;
+    int sizeAfter = 0;
+    {
+        CacheFile f(gDOMVersionCurrent, CacheCompressionNone);
+        ASSERT_TRUE(f.create(LVCreateBlockWriteStream(LVOpenFileStream(fn.c_str(), LVOM_APPEND), 0x8000, 16)));
+        for (int i = 0; i < blockCount; i++) {
+            sizes[i] = 3000;
+            fillCompactionTestData(data.get(), sizes[i], i);
+            EXPECT_TRUE(f.write(CBT_TEXT_DATA, i, data.get(), sizes[i], false));
+        }
+        fillCompactionTestData(data.get(), 2000, 100);
+        EXPECT_TRUE(f.write(CBT_PAGE_DATA, 0, data.get(), 2000, false));
+        // rewritten with larger size: freed blocks are left in file
+        for (int i = 0; i < blockCount; i += 2) {
+            sizes[i] = 5000 + i;
+            fillCompactionTestData(data.get(), sizes[i], i + 1000);
+            EXPECT_TRUE(f.write(CBT_TEXT_DATA, i, data.get(), sizes[i], false));
+        }
+        fillCompactionTestData(data.get(), maxBlockSize, 101);
+        EXPECT_TRUE(f.write(CBT_PAGE_DATA, 0, data.get(), maxBlockSize, false));
+        fillCompactionTestData(data.get(), 500, 102);
+        EXPECT_TRUE(f.write(CBT_NODE_INDEX, 0, data.get(), 500, false));
+        CRTimerUtil inf;
+        EXPECT_TRUE(f.flush(true, inf));
+        sizeBefore = f.getSize();
+        // interrupted by timeout after each moved block
+        int calls = 0;
+        ContinuousOperationResult res;
+        do {
+            CRTimerUtil timeout(0);
+            res = f.compact(timeout);
+            calls++;
+            if (calls == 3) {
+                // file can be written between calls
+                sizes[1] = 2500;
+                fillCompactionTestData(data.get(), sizes[1], 2001);
+                EXPECT_TRUE(f.write(CBT_TEXT_DATA, 1, data.get(), sizes[1], false));
+            }
+        } while (res == CR_TIMEOUT && calls < 1000);
+        EXPECT_EQ(res, CR_DONE);
+        EXPECT_GT(calls, 2);
+        sizeAfter = f.getSize();
+        EXPECT_LT(sizeAfter, sizeBefore);
+        EXPECT_EQ(f.compact(inf), CR_DONE); // nothing to do
+        EXPECT_EQ(f.getSize(), sizeAfter);
+    }
+    // file is truncated, all blocks are readable, hot blocks are at the start
+    EXPECT_EQ((int)LVOpenFileStream(fn.c_str(), LVOM_READ)->GetSize(), sizeAfter);
+    {
+        CacheFile f(gDOMVersionCurrent, CacheCompressionNone);
+        ASSERT_TRUE(f.open(fn));
+        for (int i = 0; i < blockCount; i++) {
+            fillCompactionTestData(data.get(), sizes[i], i == 1 ? 2001 : (i % 2 ? i : i + 1000));
+            lUInt8* buf = NULL;
+            int sz = 0;
+            EXPECT_TRUE(f.read(CBT_TEXT_DATA, i, buf, sz));
+            ASSERT_TRUE(buf != NULL);
+            EXPECT_EQ(sz, sizes[i]);
+            EXPECT_EQ(memcmp(buf, data.get(), sz), 0);
+            free(buf);
+        }
+        LVStreamRef pageData = f.readStream(CBT_PAGE_DATA, 0);
+        ASSERT_FALSE(pageData.isNull());
+        EXPECT_EQ((int)pageData->GetSize(), maxBlockSize);
+        lUInt8 nodeIndex[500];
+        lUInt8 expected[500];
+        LVStreamRef nodeIndexData = f.readStream(CBT_NODE_INDEX, 0);
+        ASSERT_FALSE(nodeIndexData.isNull());
+        EXPECT_EQ(nodeIndexData->Read(nodeIndex, sizeof(nodeIndex), NULL), LVERR_OK);
+        fillCompactionTestData(expected, sizeof(expected), 102);
+        EXPECT_EQ(memcmp(nodeIndex, expected, sizeof(expected)), 0);
+        // file header is followed by page list and node index
+        LVStreamRef s = LVOpenFileStream(fn.c_str(), LVOM_READ);
+        LVArray<lUInt8> head(maxBlockSize, 0);
+        s->SetPos(CACHE_FILE_SECTOR_SIZE);
+        EXPECT_EQ(s->Read(head.get(), maxBlockSize, NULL), LVERR_OK);
+        fillCompactionTestData(data.get(), maxBlockSize, 101);
+        EXPECT_EQ(memcmp(head.get(), data.get(), maxBlockSize), 0);
+        s->SetPos(CACHE_FILE_SECTOR_SIZE + f.roundSector(maxBlockSize));
+        EXPECT_EQ(s->Read(nodeIndex, sizeof(nodeIndex), NULL), LVERR_OK);
+        EXPECT_EQ(memcmp(nodeIndex, expected, sizeof(expected)), 0);
+    }
+    CRLog::info("cache file size: %d before compaction, %d after it", sizeBefore, sizeAfter);
+    LVDeleteFile(fn);
+    CRLog::info("Finished testCacheFileCompaction");
+    CRLog::info("=================================");
+}
+
 #define TEST_FN_TO_OPEN TESTS_DATADIR "example.fb2.zip"
 
 TEST_F(TinyDOMTests, testDocumentCaching) {
@@ -480,3 +942,1035 @@ TEST_F(TinyDOMTests, testDocumentCaching) {
     CRLog::info("Finished testDocumentCaching");
     CRLog::info("============================");
 }
+
+TEST_F(TinyDOMTests, testDocumentCachingAsync) {
+    CRLog::info("=================================");
+    CRLog::info("Starting testDocumentCachingAsync");
+    ASSERT_TRUE(m_initOK);
+    CRSetupStdConcurrencyProvider();
+    CRSetupEngineConcurrency();
+    CRSetSharedThreadPoolSize(3);
+    ldomDocCache::init(cs32(TESTS_TMPDIR "cr3cache"), 100);
+    EXPECT_TRUE(ldomDocCache::enabled()); // cache enabled
+    CacheWrittenCallback callback;
+    {
+        // open document and save to cache in background
+        LVDocView view(4, false);
+        CRPropRef props = LVCreatePropsContainer();
+        props->setBool(PROP_CACHE_ASYNC_WRITE, true);
+        view.propsApply(props);
+        view.Resize(600, 800);
+        bool res = view.LoadDocument(TEST_FN_TO_OPEN);
+        EXPECT_TRUE(res); // load document
+        EXPECT_TRUE(view.getDocument()->getAsyncCacheWrites());
+        LVDocImageRef image = view.getPageImage(0);
+        EXPECT_FALSE(image.isNull());
+        view.getDocProps()->setInt(PROP_FORCED_MIN_FILE_SIZE_TO_CACHE, 30000);
+        res = view.swapToCache();
+        ASSERT_TRUE(res);
+        view.getDocument()->setCacheFileStale(true);
+        CRTimerUtil infinite;
+        EXPECT_EQ(view.getDocument()->updateMap(infinite, &callback), CR_DONE);
+        // delivered on this thread by next update once written, updates don't wait for writes
+        for (int i = 0; i < 2000 && callback.count == 0; i++) {
+            concurrencyProvider->sleepMs(5);
+            EXPECT_EQ(view.getDocument()->updateMap(infinite), CR_DONE);
+        }
+        EXPECT_EQ(callback.count, 1);
+    }
+    {
+        // open document from cache, waits for previous writes
+        LVDocView view(4, false);
+        view.Resize(600, 800);
+        bool res = view.LoadDocument(TEST_FN_TO_OPEN);
+        EXPECT_TRUE(res); // load document
+        EXPECT_TRUE(view.isOpenFromCache());
+        LVDocImageRef image = view.getPageImage(0);
+        EXPECT_FALSE(image.isNull());
+    }
+    EXPECT_EQ(callback.count, 1);
+    EXPECT_TRUE(callback.success);
+    EXPECT_TRUE(callback.threadId == std::this_thread::get_id());
+    EXPECT_TRUE(ldomDocCache::clear()); // cache cleared
+    CRShutdownSharedThreadPool();
+    CRSetSharedThreadPoolSize(0);
+    CRLog::info("Finished testDocumentCachingAsync");
+    CRLog::info("=================================");
+}
+
+TEST_F(TinyDOMTests, testDocumentCachingMapped) {
+    CRLog::info("==================================");
+    CRLog::info("Starting testDocumentCachingMapped");
+    ASSERT_TRUE(m_initOK);
+    ldomDocCache::init(cs32(TESTS_TMPDIR "cr3cache"), 100);
+    EXPECT_TRUE(ldomDocCache::enabled()); // cache enabled
+    CRPropRef props = LVCreatePropsContainer();
+    props->setBool(PROP_CACHE_MMAP_READ, true);
+    int pageCount = 0;
+    {
+        // open document and save to cache
+        LVDocView view(4, false);
+        view.propsApply(props);
+        view.Resize(600, 800);
+        bool res = view.LoadDocument(TEST_FN_TO_OPEN);
+        EXPECT_TRUE(res); // load document
+        LVDocImageRef image = view.getPageImage(0);
+        EXPECT_FALSE(image.isNull());
+        pageCount = view.getPageCount();
+        view.getDocProps()->setInt(PROP_FORCED_MIN_FILE_SIZE_TO_CACHE, 30000);
+        res = view.swapToCache();
+        ASSERT_TRUE(res);
+        view.getDocument()->setCacheFileStale(true);
+        CRTimerUtil infinite;
+        EXPECT_EQ(view.getDocument()->updateMap(infinite), CR_DONE);
+    }
+    {
+        // open document from mapped cache file, then render with other size
+        LVDocView view(4, false);
+        view.propsApply(props);
+        view.Resize(600, 800);
+        bool res = view.LoadDocument(TEST_FN_TO_OPEN);
+        EXPECT_TRUE(res); // load document
+        EXPECT_TRUE(view.isOpenFromCache());
+        EXPECT_TRUE(view.getDocument()->getMappedCacheReads());
+        LVDocImageRef image = view.getPageImage(0);
+        EXPECT_FALSE(image.isNull());
+        EXPECT_EQ(view.getPageCount(), pageCount);
+        view.Resize(500, 700);
+        image = view.getPageImage(0);
+        EXPECT_FALSE(image.isNull());
+    }
+    EXPECT_TRUE(ldomDocCache::clear()); // cache cleared
+    CRLog::info("Finished testDocumentCachingMapped");
+    CRLog::info("==================================");
+}
+
+// writes FB2 document with specified number of sections and paragraphs in each
+static bool writeLargeTestDocument(const lString32& fileName, int sections, int paragraphs) {
+    LVStreamRef stream = LVOpenFileStream(fileName.c_str(), LVOM_WRITE);
+    if (stream.isNull())
+        return false;
+    *stream << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<FictionBook><body>\n";
+    for (int i = 0; i < sections; i++) {
+        *stream << "<section><title><p>Chapter " << lString8::itoa(i + 1) << "</p></title>\n";
+        for (int j = 0; j < paragraphs; j++)
+            *stream << "<p>Paragraph " << lString8::itoa(j + 1) << " of chapter " << lString8::itoa(i + 1) << ".</p>\n";
+        *stream << "</section>\n";
+    }
+    *stream << "</body></FictionBook>\n";
+    return true;
+}
+
+TEST_F(TinyDOMTests, testDocumentCachingLazyNodes) {
+    CRLog::info("==================================");
+    CRLog::info("Starting testDocumentCachingLazyNodes");
+    ASSERT_TRUE(m_initOK);
+    // document with several node segments
+    lString32 fileName = cs32(TESTS_TMPDIR "lazy-nodes-test.fb2");
+    ASSERT_TRUE(writeLargeTestDocument(fileName, 40, 400));
+    ldomDocCache::init(cs32(TESTS_TMPDIR "cr3cache"), 100);
+    EXPECT_TRUE(ldomDocCache::enabled()); // cache enabled
+    CRPropRef props = LVCreatePropsContainer();
+    props->setBool(PROP_CACHE_LAZY_NODES, true);
+    int pageCount = 0;
+    int partCount = 0;
+    lString32 firstPageText;
+    lString32 lastPageText;
+    {
+        // open document and save to cache
+        LVDocView view(4, false);
+        view.propsApply(props);
+        view.Resize(600, 800);
+        bool res = view.LoadDocument(fileName.c_str());
+        EXPECT_TRUE(res); // load document
+        pageCount = view.getPageCount();
+        firstPageText = view.getPageText(false, 0);
+        lastPageText = view.getPageText(false, pageCount - 1);
+        EXPECT_FALSE(firstPageText.empty());
+        EXPECT_FALSE(lastPageText.empty());
+        partCount = view.getDocument()->getLoadedNodePartCount();
+        EXPECT_GT(partCount, 4);
+        view.getDocProps()->setInt(PROP_FORCED_MIN_FILE_SIZE_TO_CACHE, 30000);
+        res = view.swapToCache();
+        ASSERT_TRUE(res);
+        // nodes are not read from cache file
+        EXPECT_EQ(view.getDocument()->unloadNodeParts(false), 0);
+    }
+    {
+        // open document from cache file, node segments are read on access
+        LVDocView view(4, false);
+        view.propsApply(props);
+        view.Resize(600, 800);
+        bool res = view.LoadDocument(fileName.c_str());
+        EXPECT_TRUE(res); // load document
+        EXPECT_TRUE(view.isOpenFromCache());
+        ldomDocument* doc = view.getDocument();
+        EXPECT_TRUE(doc->getLazyNodeLoading());
+        EXPECT_EQ(view.getPageCount(), pageCount);
+        EXPECT_EQ(view.getPageText(false, 0), firstPageText);
+        int loaded = doc->getLoadedNodePartCount();
+        EXPECT_GT(loaded, 0);
+        EXPECT_LT(loaded, partCount);
+        // segments accessed since loading are kept by first call, freed by second one
+        doc->unloadNodeParts();
+        EXPECT_GT(doc->unloadNodeParts(), 0);
+        EXPECT_EQ(doc->getLoadedNodePartCount(), 0);
+        // and read again on next access
+        EXPECT_EQ(view.getPageText(false, pageCount - 1), lastPageText);
+        EXPECT_EQ(view.getPageText(false, 0), firstPageText);
+        {
+            // not freed while rendering or drawing keeps node pointers
+            ldomUseGuard use(doc);
+            EXPECT_EQ(doc->unloadNodeParts(false), 0);
+            EXPECT_GT(doc->getLoadedNodePartCount(), 0);
+        }
+        LVDocImageRef image = view.getPageImage(0);
+        EXPECT_FALSE(image.isNull());
+        // full rendering with other page size
+        view.Resize(500, 700);
+        image = view.getPageImage(0);
+        EXPECT_FALSE(image.isNull());
+        int pageCount2 = view.getPageCount();
+        EXPECT_GT(pageCount2, pageCount);
+        lString32 lastPageText2 = view.getPageText(false, pageCount2 - 1);
+        EXPECT_GT(doc->unloadNodeParts(false), 0);
+        EXPECT_EQ(view.getPageText(false, pageCount2 - 1), lastPageText2);
+    }
+    EXPECT_TRUE(ldomDocCache::clear()); // cache cleared
+    LVDeleteFile(fileName);
+    CRLog::info("Finished testDocumentCachingLazyNodes");
+    CRLog::info("==================================");
+}
+
+TEST_F(TinyDOMTests, testDocumentCachingDictionary) {
+    CRLog::info("==================================");
+    CRLog::info("Starting testDocumentCachingDictionary");
+    ASSERT_TRUE(m_initOK);
+    lString32 fileName = cs32(TESTS_TMPDIR "cache-dictionary-test.fb2");
+    ASSERT_TRUE(writeLargeTestDocument(fileName, 40, 400));
+#if (USE_ZSTD == 1)
+    CacheCompressionType compType = CacheCompressionZSTD;
+#elif (USE_ZLIB == 1)
+    CacheCompressionType compType = CacheCompressionZlib;
+#else
+    CacheCompressionType compType = CacheCompressionNone;
+#endif
+    for (int pass = 0; pass < 2; pass++) {
+        ldomDocCache::init(cs32(TESTS_TMPDIR "cr3cache"), 100);
+        EXPECT_TRUE(ldomDocCache::enabled()); // cache enabled
+        CRPropRef props = LVCreatePropsContainer();
+        props->setBool(PROP_CACHE_COMPRESSION_DICT, pass == 1);
+        int pageCount = 0;
+        lString32 middlePageText;
+        lString32 cachePath;
+        {
+            // open document and save to cache
+            LVDocView view(4, false);
+            view.propsApply(props);
+            view.Resize(600, 800);
+            EXPECT_TRUE(view.LoadDocument(fileName.c_str()));
+            pageCount = view.getPageCount();
+            middlePageText = view.getPageText(false, pageCount / 2);
+            EXPECT_FALSE(middlePageText.empty());
+            view.getDocProps()->setInt(PROP_FORCED_MIN_FILE_SIZE_TO_CACHE, 30000);
+            ASSERT_TRUE(view.swapToCache());
+            cachePath = view.getDocument()->getCacheFilePath();
+        }
+        {
+            CacheFile f(gDOMVersionCurrent, compType);
+            ASSERT_TRUE(f.open(cachePath));
+            EXPECT_EQ(f.hasDictionary(), pass == 1 && compType == CacheCompressionZSTD);
+        }
+        {
+            // open document from cache file, all storage data is read again
+            LVDocView view(4, false);
+            view.propsApply(props);
+            view.Resize(600, 800);
+            EXPECT_TRUE(view.LoadDocument(fileName.c_str()));
+            EXPECT_TRUE(view.isOpenFromCache());
+            EXPECT_EQ(view.getPageCount(), pageCount);
+            EXPECT_EQ(view.getPageText(false, pageCount / 2), middlePageText);
+            view.Resize(500, 700);
+            EXPECT_FALSE(view.getPageImage(0).isNull());
+        }
+        EXPECT_TRUE(ldomDocCache::clear()); // cache cleared
+    }
+    LVDeleteFile(fileName);
+    CRLog::info("Finished testDocumentCachingDictionary");
+    CRLog::info("==================================");
+}
+
+TEST_F(TinyDOMTests, testDocumentCachingCompaction) {
+    CRLog::info("==================================");
+    CRLog::info("Starting testDocumentCachingCompaction");
+    ASSERT_TRUE(m_initOK);
+    lString32 fileName = cs32(TESTS_TMPDIR "cache-compaction-test.fb2");
+    ASSERT_TRUE(writeLargeTestDocument(fileName, 20, 200));
+    ldomDocCache::init(cs32(TESTS_TMPDIR "cr3cache"), 100);
+    EXPECT_TRUE(ldomDocCache::enabled()); // cache enabled
+    int pageCount = 0;
+    int fontSize = 0;
+    lString32 middlePageText;
+    {
+        // re-rendering rewrites pages, rects and styles in cache file
+        LVDocView view(4, false);
+        view.Resize(600, 800);
+        EXPECT_TRUE(view.LoadDocument(fileName.c_str()));
+        view.getDocProps()->setInt(PROP_FORCED_MIN_FILE_SIZE_TO_CACHE, 30000);
+        ASSERT_TRUE(view.swapToCache());
+        lString32 cachePath = view.getDocument()->getCacheFilePath();
+        for (int i = 1; i <= 3; i++) {
+            view.setFontSize(view.getFontSize() + 4);
+            view.Resize(600 - i * 50, 800);
+            EXPECT_FALSE(view.getPageImage(0).isNull());
+            EXPECT_NE(view.updateCache(), CR_ERROR);
+        }
+        fontSize = view.getFontSize();
+        pageCount = view.getPageCount();
+        middlePageText = view.getPageText(false, pageCount / 2);
+        lvsize_t sizeBefore = LVOpenFileStream(cachePath.c_str(), LVOM_READ)->GetSize();
+        CRTimerUtil infinite;
+        EXPECT_EQ(view.compactCache(infinite), CR_DONE);
+        lvsize_t sizeAfter = LVOpenFileStream(cachePath.c_str(), LVOM_READ)->GetSize();
+        CRLog::info("cache file size: %d before compaction, %d after it", (int)sizeBefore, (int)sizeAfter);
+        EXPECT_LE(sizeAfter, sizeBefore);
+        // document keeps working with compacted file
+        view.Resize(500, 800);
+        EXPECT_FALSE(view.getPageImage(0).isNull());
+        view.Resize(450, 800);
+        EXPECT_EQ(view.getPageText(false, pageCount / 2), middlePageText);
+        EXPECT_NE(view.updateCache(), CR_ERROR);
+    }
+    {
+        LVDocView view(4, false);
+        view.setFontSize(fontSize);
+        view.Resize(450, 800);
+        EXPECT_TRUE(view.LoadDocument(fileName.c_str()));
+        EXPECT_TRUE(view.isOpenFromCache());
+        EXPECT_FALSE(view.getPageImage(0).isNull());
+        EXPECT_EQ(view.getPageCount(), pageCount);
+        EXPECT_EQ(view.getPageText(false, pageCount / 2), middlePageText);
+    }
+    EXPECT_TRUE(ldomDocCache::clear()); // cache cleared
+    LVDeleteFile(fileName);
+    CRLog::info("Finished testDocumentCachingCompaction");
+    CRLog::info("==================================");
+}
+
+TEST_F(TinyDOMTests, testDocumentCachingRenderVariants) {
+    CRLog::info("==================================");
+    CRLog::info("Starting testDocumentCachingRenderVariants");
+    ASSERT_TRUE(m_initOK);
+    lString32 fileName = cs32(TESTS_TMPDIR "cache-variants-test.fb2");
+    ASSERT_TRUE(writeLargeTestDocument(fileName, 20, 200));
+    ldomDocCache::init(cs32(TESTS_TMPDIR "cr3cache"), 100);
+    EXPECT_TRUE(ldomDocCache::enabled()); // cache enabled
+    int fontSize = 0;
+    int pageCount = 0;
+    int otherPageCount = 0;
+    lString32 middlePageText;
+    lString32 otherPageText;
+    {
+        FormatCountCallback callback;
+        LVDocView view(4, false);
+        view.setCallback(&callback);
+        view.getDocProps()->setInt(PROP_CACHE_RENDER_VARIANTS, 2);
+        view.propsApply(view.getDocProps());
+        view.Resize(600, 800);
+        EXPECT_TRUE(view.LoadDocument(fileName.c_str()));
+        view.getDocProps()->setInt(PROP_FORCED_MIN_FILE_SIZE_TO_CACHE, 30000);
+        ASSERT_TRUE(view.swapToCache());
+        fontSize = view.getFontSize();
+        EXPECT_FALSE(view.getPageImage(0).isNull());
+        pageCount = view.getPageCount();
+        middlePageText = view.getPageText(false, pageCount / 2);
+        // other font size: full rendering
+        int formatCount = callback.count;
+        view.setFontSize(fontSize + 6);
+        EXPECT_FALSE(view.getPageImage(0).isNull());
+        EXPECT_GT(callback.count, formatCount);
+        otherPageCount = view.getPageCount();
+        otherPageText = view.getPageText(false, otherPageCount / 2);
+        EXPECT_NE(otherPageCount, pageCount);
+        // back to first font size: rendering is restored from cache file
+        formatCount = callback.count;
+        view.setFontSize(fontSize);
+        EXPECT_FALSE(view.getPageImage(0).isNull());
+        EXPECT_EQ(callback.count, formatCount);
+        EXPECT_EQ(view.getPageCount(), pageCount);
+        EXPECT_EQ(view.getPageText(false, pageCount / 2), middlePageText);
+        // and again
+        view.setFontSize(fontSize + 6);
+        EXPECT_FALSE(view.getPageImage(0).isNull());
+        EXPECT_EQ(callback.count, formatCount);
+        EXPECT_EQ(view.getPageCount(), otherPageCount);
+        EXPECT_EQ(view.getPageText(false, otherPageCount / 2), otherPageText);
+        EXPECT_NE(view.updateCache(), CR_ERROR);
+        view.setCallback(NULL);
+    }
+    {
+        // cache file keeps both renderings
+        FormatCountCallback callback;
+        LVDocView view(4, false);
+        view.setCallback(&callback);
+        view.getDocProps()->setInt(PROP_CACHE_RENDER_VARIANTS, 2);
+        view.propsApply(view.getDocProps());
+        view.setFontSize(fontSize);
+        view.Resize(600, 800);
+        EXPECT_TRUE(view.LoadDocument(fileName.c_str()));
+        EXPECT_TRUE(view.isOpenFromCache());
+        EXPECT_FALSE(view.getPageImage(0).isNull());
+        EXPECT_EQ(callback.count, 0);
+        EXPECT_EQ(view.getPageCount(), pageCount);
+        EXPECT_EQ(view.getPageText(false, pageCount / 2), middlePageText);
+        view.setFontSize(fontSize + 6);
+        EXPECT_FALSE(view.getPageImage(0).isNull());
+        EXPECT_EQ(callback.count, 0);
+        EXPECT_EQ(view.getPageCount(), otherPageCount);
+        EXPECT_EQ(view.getPageText(false, otherPageCount / 2), otherPageText);
+        view.setCallback(NULL);
+    }
+    EXPECT_TRUE(ldomDocCache::clear()); // cache cleared
+    LVDeleteFile(fileName);
+    CRLog::info("Finished testDocumentCachingRenderVariants");
+    CRLog::info("==================================");
+}
+
+TEST_F(TinyDOMTests, testFindTextAndWordNavigation) {
+    CRLog::info("==================================");
+    CRLog::info("Starting testFindTextAndWordNavigation");
+    ASSERT_TRUE(m_initOK);
+    lString32 fileName = cs32(TESTS_TMPDIR "find-text-test.fb2");
+    ASSERT_TRUE(writeLargeTestDocument(fileName, 5, 50));
+    {
+        LVDocView view(4, false);
+        view.Resize(600, 800);
+        EXPECT_TRUE(view.LoadDocument(fileName.c_str()));
+        EXPECT_FALSE(view.getPageImage(0).isNull());
+        ldomDocument* doc = view.getDocument();
+        LVArray<ldomWord> words;
+        EXPECT_TRUE(doc->findText(U"PARAGRAPH 7 OF", true, false, 0, -1, words, 100, 0));
+        EXPECT_EQ(words.length(), 5); // one in each chapter
+        for (int i = 0; i < words.length(); i++)
+            EXPECT_TRUE(words[i].getText() == U"Paragraph 7 of");
+        EXPECT_TRUE(doc->findText(U"paragraph 7 of", true, true, 0, -1, words, 100, 0));
+        EXPECT_EQ(words.length(), 5); // reverse search
+        EXPECT_FALSE(doc->findText(U"paragraph 7 of", false, false, 0, -1, words, 100, 0));
+        EXPECT_TRUE(doc->findText(U"of chapter 3.", false, false, 0, -1, words, 100, 0));
+        EXPECT_EQ(words.length(), 50);
+        ASSERT_GT(words.length(), 0);
+        // "Paragraph 1 of chapter 3."
+        ldomXPointerEx pos(words[0].getNode(), 0);
+        EXPECT_TRUE(pos.isVisibleWordStart());
+        EXPECT_TRUE(pos.nextVisibleWordStart());
+        EXPECT_EQ(pos.getOffset(), 10); // "1"
+        EXPECT_TRUE(pos.nextVisibleWordEnd());
+        EXPECT_EQ(pos.getOffset(), 11);
+        EXPECT_TRUE(pos.isVisibleWordEnd());
+        EXPECT_TRUE(pos.prevVisibleWordStart());
+        EXPECT_EQ(pos.getOffset(), 10);
+        EXPECT_TRUE(pos.prevVisibleWordStart());
+        EXPECT_EQ(pos.getOffset(), 0);
+        // navigation across text nodes: "Paragraph 2 of chapter 3."
+        ldomXPointerEx last(words[0].getNode(), 23); // "3."
+        EXPECT_TRUE(last.nextVisibleWordStart());
+        EXPECT_TRUE(last.getNode() == words[1].getNode());
+        EXPECT_EQ(last.getOffset(), 0);
+        EXPECT_TRUE(last.prevVisibleWordEnd());
+        EXPECT_TRUE(last.getNode() == words[0].getNode());
+        EXPECT_EQ(last.getOffset(), 24); // before "."
+        EXPECT_TRUE(last.nextVisibleWordEndInSentence(false));
+        EXPECT_EQ(last.getOffset(), 25);
+        EXPECT_TRUE(last.nextVisibleWordEndInSentence(false));
+        EXPECT_TRUE(last.getNode() == words[1].getNode());
+        EXPECT_EQ(last.getOffset(), 9);
+        EXPECT_TRUE(last.prevVisibleWordStartInSentence(false));
+        EXPECT_EQ(last.getOffset(), 0);
+        EXPECT_TRUE(last.prevVisibleWordStartInSentence(false));
+        EXPECT_TRUE(last.getNode() == words[0].getNode());
+        EXPECT_EQ(last.getOffset(), 23);
+    }
+    LVDeleteFile(fileName);
+    CRLog::info("Finished testFindTextAndWordNavigation");
+    CRLog::info("==================================");
+}
+
+// describes tree using navigation methods, walking siblings forth and back
+static void describeTree(ldomNode* node, lString8& out) {
+    out << "(" << fmt::decimal(node->getNodeId()) << ":" << fmt::decimal(node->getNodeIndex());
+    if (node->isText()) {
+        out << "'" << fmt::decimal(node->getText().length());
+    } else {
+        int count = 0;
+        for (ldomNode* child = node->getFirstChild(); child; child = child->getNextSibling()) {
+            if (child->getParentNode() != node || node->getChildNode(count) != child ||
+                node->isChildNodeElement(count) != child->isElement())
+                out << "!";
+            describeTree(child, out);
+            count++;
+        }
+        if (count != node->getChildCount())
+            out << "!";
+        for (ldomNode* child = node->getLastChild(); child; child = child->getPrevSibling())
+            count--;
+        if (count != 0)
+            out << "!";
+    }
+    out << ")";
+}
+
+TEST_F(TinyDOMTests, testDocumentCachingTraversalIndex) {
+    CRLog::info("==================================");
+    CRLog::info("Starting testDocumentCachingTraversalIndex");
+    ASSERT_TRUE(m_initOK);
+    lString32 fileName = cs32(TESTS_TMPDIR "traversal-index-test.fb2");
+    ASSERT_TRUE(writeLargeTestDocument(fileName, 20, 200));
+    ldomDocCache::init(cs32(TESTS_TMPDIR "cr3cache"), 100);
+    EXPECT_TRUE(ldomDocCache::enabled()); // cache enabled
+    int fontSize = 0;
+    int pageCount = 0;
+    lString32 middlePageText;
+    lString8 tree;
+    {
+        LVDocView view(4, false);
+        view.getDocProps()->setBool(PROP_DOM_TRAVERSAL_INDEX, true);
+        view.propsApply(view.getDocProps());
+        view.Resize(600, 800);
+        EXPECT_TRUE(view.LoadDocument(fileName.c_str()));
+        view.getDocProps()->setInt(PROP_FORCED_MIN_FILE_SIZE_TO_CACHE, 30000);
+        EXPECT_FALSE(view.getPageImage(0).isNull());
+        ldomDocument* doc = view.getDocument();
+        EXPECT_TRUE(doc->getValidTraversalIndex() != NULL); // built after rendering
+        describeTree(doc->getRootNode(), tree);
+        EXPECT_EQ(tree.pos("!"), -1);
+        // same walk through element storage
+        doc->setTraversalIndex(false);
+        EXPECT_TRUE(doc->getValidTraversalIndex() == NULL);
+        lString8 plainTree;
+        describeTree(doc->getRootNode(), plainTree);
+        EXPECT_TRUE(plainTree == tree);
+        // rebuilt on next rendering
+        doc->setTraversalIndex(true);
+        view.setFontSize(view.getFontSize() + 2);
+        EXPECT_FALSE(view.getPageImage(0).isNull());
+        EXPECT_TRUE(doc->getValidTraversalIndex() != NULL);
+        pageCount = view.getPageCount();
+        middlePageText = view.getPageText(false, pageCount / 2);
+        fontSize = view.getFontSize();
+        ASSERT_TRUE(view.swapToCache());
+        EXPECT_NE(view.updateCache(), CR_ERROR);
+    }
+    {
+        // index is read from cache file
+        LVDocView view(4, false);
+        view.getDocProps()->setBool(PROP_DOM_TRAVERSAL_INDEX, true);
+        view.propsApply(view.getDocProps());
+        view.setFontSize(fontSize);
+        view.Resize(600, 800);
+        EXPECT_TRUE(view.LoadDocument(fileName.c_str()));
+        EXPECT_TRUE(view.isOpenFromCache());
+        ldomDocument* doc = view.getDocument();
+        EXPECT_TRUE(doc->getValidTraversalIndex() != NULL);
+        EXPECT_FALSE(view.getPageImage(0).isNull());
+        EXPECT_EQ(view.getPageCount(), pageCount);
+        EXPECT_EQ(view.getPageText(false, pageCount / 2), middlePageText);
+        lString8 cachedTree;
+        describeTree(doc->getRootNode(), cachedTree);
+        EXPECT_TRUE(cachedTree == tree);
+        // any change of tree drops index
+        ldomNode* elem = doc->getRootNode()->getLastChild();
+        ASSERT_TRUE(elem != NULL);
+        elem->insertChildText(U"appended");
+        EXPECT_TRUE(doc->getValidTraversalIndex() == NULL);
+        EXPECT_TRUE(elem->getLastChild()->getText() == U"appended");
+    }
+    EXPECT_TRUE(ldomDocCache::clear()); // cache cleared
+    LVDeleteFile(fileName);
+    CRLog::info("Finished testDocumentCachingTraversalIndex");
+    CRLog::info("==================================");
+}
+
+TEST_F(TinyDOMTests, testDocCacheEviction) {
+    CRLog::info("==================================");
+    CRLog::info("Starting testDocCacheEviction");
+    ASSERT_TRUE(m_initOK);
+    lString32 cacheDir = cs32(TESTS_TMPDIR "cr3cache");
+    // two instances sharing the same directory, as in two processes
+    ldomDocCacheImpl cache1(cacheDir, 3000000);
+    ldomDocCacheImpl cache2(cacheDir, 3000000);
+    ASSERT_TRUE(cache1.init());
+    ASSERT_TRUE(cache2.init());
+    lString32 expensivePath, cheap1Path, cheap2Path, cheap3Path;
+    // oldest file: expensive to rebuild
+    EXPECT_FALSE(cache1.createNew(U"expensive.epub", 1, 0, 1000000, expensivePath).isNull());
+    EXPECT_TRUE(cache1.updateFileInfo(expensivePath, 1000000, 30000));
+    EXPECT_FALSE(cache2.createNew(U"cheap1.txt", 2, 0, 1000000, cheap1Path).isNull());
+    EXPECT_TRUE(cache2.updateFileInfo(cheap1Path, 1000000, 100));
+    EXPECT_FALSE(cache1.createNew(U"cheap2.txt", 3, 0, 1000000, cheap2Path).isNull());
+    EXPECT_TRUE(cache1.updateFileInfo(cheap2Path, 1000000, 100));
+    EXPECT_TRUE(LVFileExists(expensivePath));
+    EXPECT_TRUE(LVFileExists(cheap1Path));
+    EXPECT_TRUE(LVFileExists(cheap2Path));
+    // no space left: cheap file is removed instead of least recently used expensive one
+    EXPECT_FALSE(cache2.createNew(U"cheap3.txt", 4, 0, 1000000, cheap3Path).isNull());
+    EXPECT_TRUE(LVFileExists(expensivePath));
+    EXPECT_FALSE(LVFileExists(cheap1Path));
+    EXPECT_TRUE(LVFileExists(cheap2Path));
+    EXPECT_TRUE(LVFileExists(cheap3Path));
+    // both instances see changes of each other
+    lString32 path;
+    EXPECT_FALSE(cache2.openExisting(U"cheap2.txt", 3, 0, path).isNull());
+    EXPECT_TRUE(path == cheap2Path);
+    EXPECT_FALSE(cache1.openExisting(U"cheap3.txt", 4, 0, path).isNull());
+    EXPECT_TRUE(cache1.openExisting(U"cheap1.txt", 2, 0, path).isNull());
+    EXPECT_FALSE(cache1.openExisting(U"expensive.epub", 1, 0, path).isNull());
+    // index is replaced, not rewritten in place
+    EXPECT_FALSE(LVFileExists(cacheDir + "/cr3cache.inx.tmp"));
+    // reinitialized instance keeps list
+    ldomDocCacheImpl cache3(cacheDir, 3000000);
+    ASSERT_TRUE(cache3.init());
+    EXPECT_EQ(cache3.findFileIndex(U"cheap1.txt.00000002.0.cr3"), -1);
+    EXPECT_GE(cache3.findFileIndex(U"expensive.epub.00000001.0.cr3"), 0);
+    {
+        // file open by other instance may be read, but not changed, overwritten or removed
+        LVStreamRef reader = cache1.openExisting(U"cheap2.txt", 3, 0, path);
+        ASSERT_FALSE(reader.isNull());
+        LVStreamRef reader2 = cache2.openExisting(U"cheap2.txt", 3, 0, path);
+        ASSERT_FALSE(reader2.isNull());
+        lUInt8 data[16] = { 0 };
+        reader2->SetPos(0);
+        reader2->Write(data, sizeof(data), NULL);
+        EXPECT_NE(reader2->Flush(true), LVERR_OK);
+        reader2.Clear();
+        EXPECT_TRUE(cache2.createNew(U"cheap2.txt", 3, 0, 1000000, path).isNull());
+        EXPECT_TRUE(cache2.updateFileInfo(cheap3Path, 1000000, 1));
+        EXPECT_TRUE(cache2.updateFileInfo(cheap2Path, 1000000, 1));
+        EXPECT_FALSE(cache2.createNew(U"cheap4.txt", 5, 0, 20000000, path).isNull());
+        EXPECT_TRUE(LVFileExists(cheap2Path));
+        EXPECT_FALSE(LVFileExists(cheap3Path));
+        // file is writable by its only user
+        reader->SetPos(0);
+        reader->Write(data, sizeof(data), NULL);
+        EXPECT_EQ(reader->Flush(true), LVERR_OK);
+        EXPECT_TRUE(cache2.clear());
+        EXPECT_TRUE(LVFileExists(cheap2Path));
+    }
+    EXPECT_TRUE(cache2.clear());
+    EXPECT_FALSE(LVFileExists(expensivePath));
+    EXPECT_FALSE(LVFileExists(cheap2Path));
+    EXPECT_FALSE(LVFileExists(cheap3Path));
+    CRLog::info("Finished testDocCacheEviction");
+    CRLog::info("==================================");
+}
+
+static int compareRenderRects(ldomNode* node) {
+    int mismatches = 0;
+    if (!node->isElement())
+        return 0;
+    {
+        RenderRectAccessor fmt(node);
+        RenderRectReader rd(node);
+        lvRect rc1, rc2;
+        fmt.getRect(rc1);
+        rd.getRect(rc2);
+        if (rc1 != rc2 || fmt.getInnerX() != rd.getInnerX() || fmt.getInnerY() != rd.getInnerY() ||
+            fmt.getInnerWidth() != rd.getInnerWidth() || fmt.getBaseline() != rd.getBaseline() ||
+            fmt.getFlags() != rd.getFlags() || fmt.getTopOverflow() != rd.getTopOverflow() ||
+            fmt.getBottomOverflow() != rd.getBottomOverflow() || fmt.getLangNodeIndex() != rd.getLangNodeIndex())
+            mismatches++;
+    }
+    for (int i = 0; i < node->getChildCount(); i++)
+        mismatches += compareRenderRects(node->getChildNode(i));
+    return mismatches;
+}
+
+TEST_F(TinyDOMTests, testRenderRectReader) {
+    CRLog::info("==================================");
+    CRLog::info("Starting testRenderRectReader");
+    ASSERT_TRUE(m_initOK);
+    lString32 fileName = cs32(TESTS_TMPDIR "render-rect-reader-test.fb2");
+    ASSERT_TRUE(writeLargeTestDocument(fileName, 20, 200));
+    ldomDocCache::init(cs32(TESTS_TMPDIR "cr3cache"), 100);
+    EXPECT_TRUE(ldomDocCache::enabled()); // cache enabled
+    {
+        LVDocView view(4, false);
+        view.Resize(600, 800);
+        EXPECT_TRUE(view.LoadDocument(fileName.c_str()));
+        view.getDocProps()->setInt(PROP_FORCED_MIN_FILE_SIZE_TO_CACHE, 30000);
+        EXPECT_FALSE(view.getPageImage(0).isNull());
+        int pageCount = view.getPageCount();
+        ASSERT_GT(pageCount, 2);
+        lString32 middlePageText = view.getPageText(false, pageCount / 2);
+        ASSERT_TRUE(view.swapToCache());
+        ldomDocument* doc = view.getDocument();
+        ldomNode* root = doc->getRootNode();
+        // reader sees the same data as accessor, rect chunks are packed and unpacked on demand
+        EXPECT_EQ(compareRenderRects(root), 0);
+        // prefetch of rects of page range changes nothing
+        int y0 = doc->getFullHeight() / 2;
+        ldomXPointer ptr = doc->createXPointer(lvPoint(100, y0 + 200));
+        ASSERT_FALSE(ptr.isNull());
+        lvRect rc1;
+        ptr.getNode()->getAbsRect(rc1);
+        // only elements shown in range, not all ones of section holding it
+        int count = doc->prefetchRenderRects(y0, y0 + 800);
+        EXPECT_GT(count, 0);
+        EXPECT_LT(count, doc->prefetchRenderRects(0, doc->getFullHeight()) / 4);
+        EXPECT_EQ(doc->prefetchRenderRects(y0 + 800, y0), count); // reversed range
+        doc->prefetchRenderRects(-100, 0);
+        lvRect rc2;
+        ptr.getNode()->getAbsRect(rc2);
+        EXPECT_TRUE(rc1 == rc2);
+        EXPECT_TRUE(doc->createXPointer(lvPoint(100, y0 + 200)) == ptr);
+        EXPECT_EQ(view.getPageText(false, pageCount / 2), middlePageText);
+        EXPECT_FALSE(view.getPageImage(pageCount / 2).isNull());
+        EXPECT_EQ(compareRenderRects(root), 0);
+    }
+    {
+        // range ending in top padding of long block: element at this point is the block itself,
+        // while only paragraphs before it are shown
+        lString8 html("<html><body>\n");
+        for (int i = 0; i < 4; i++) {
+            html << "<div id=\"block" << lString8::itoa(i) << "\" style=\"padding-top: 400px\">\n";
+            for (int j = 0; j < 200; j++)
+                html << "<p>Paragraph " << lString8::itoa(j) << " of block " << lString8::itoa(i) << ".</p>\n";
+            html << "</div>\n";
+        }
+        html << "</body></html>\n";
+        LVDocView view(4, false);
+        view.Resize(600, 800);
+        ASSERT_TRUE(view.LoadDocument(LVCreateStringStream(html), U"padded.html"));
+        EXPECT_FALSE(view.getPageImage(0).isNull());
+        ldomDocument* doc = view.getDocument();
+        ldomNode* block = doc->getElementById(U"block2");
+        ASSERT_TRUE(block != NULL);
+        lvRect rc;
+        block->getAbsRect(rc);
+        int y1 = rc.top + 200;
+        int count = doc->prefetchRenderRects(y1 - 800, y1);
+        EXPECT_GT(count, 0);
+        EXPECT_LT(count, 100);
+    }
+    EXPECT_TRUE(ldomDocCache::clear()); // cache cleared
+    LVDeleteFile(fileName);
+    CRLog::info("Finished testRenderRectReader");
+    CRLog::info("==================================");
+}
+
+TEST_F(TinyDOMTests, testStyleSheetSelectorIndex) {
+    CRLog::info("==================================");
+    CRLog::info("Starting testStyleSheetSelectorIndex");
+    ASSERT_TRUE(m_initOK);
+    lString8 html(
+            "<html><head><style>\n"
+            ".em { font-style: italic }\n"
+            "p.right { text-align: right }\n"
+            "#first { font-weight: bold }\n"
+            "p[lang] { text-decoration: underline }\n"
+            "div.chapter p { text-align: center }\n"
+            "div.chapter > p.right { text-align: right }\n"
+            "section .em { font-style: normal }\n"
+            "p + p.next { font-weight: bold }\n"
+            "* { text-indent: 0 }\n"
+            "</style></head><body>\n"
+            "<p id=\"first\">First</p>\n"
+            "<p id=\"second\" class=\"x em right\">Second</p>\n"
+            "<p id=\"third\" lang=\"en\" class=\"next\">Third</p>\n"
+            "<div class=\"other chapter\"><p id=\"fourth\">Fourth</p><p id=\"fifth\" class=\"right\">Fifth</p>\n"
+            "<div><p id=\"sixth\" class=\"right em\">Sixth</p></div></div>\n"
+            "<div class=\"other\"><p id=\"seventh\" class=\"em\">Seventh</p></div>\n"
+            "</body></html>\n");
+    LVDocView view(4, false);
+    view.Resize(600, 800);
+    ASSERT_TRUE(view.LoadDocument(LVCreateStringStream(html), U"selectors.html"));
+    EXPECT_FALSE(view.getPageImage(0).isNull());
+    ldomDocument* doc = view.getDocument();
+    ldomNode* node = doc->getElementById(U"first");
+    ASSERT_TRUE(node != NULL);
+    EXPECT_EQ(node->getStyle()->font_weight, css_fw_700);
+    EXPECT_NE(node->getStyle()->font_style, css_fs_italic);
+    node = doc->getElementById(U"second");
+    ASSERT_TRUE(node != NULL);
+    EXPECT_EQ(node->getStyle()->font_style, css_fs_italic);
+    EXPECT_EQ(node->getStyle()->text_align, css_ta_right);
+    EXPECT_NE(node->getStyle()->font_weight, css_fw_700);
+    node = doc->getElementById(U"third");
+    ASSERT_TRUE(node != NULL);
+    EXPECT_EQ(node->getStyle()->text_decoration, css_td_underline);
+    EXPECT_EQ(node->getStyle()->font_weight, css_fw_700);
+    node = doc->getElementById(U"fourth");
+    ASSERT_TRUE(node != NULL);
+    EXPECT_EQ(node->getStyle()->text_align, css_ta_center);
+    node = doc->getElementById(U"fifth");
+    ASSERT_TRUE(node != NULL);
+    EXPECT_EQ(node->getStyle()->text_align, css_ta_right);
+    node = doc->getElementById(U"sixth");
+    ASSERT_TRUE(node != NULL);
+    // "div.chapter p" is more specific than "p.right", child combinator does not match
+    EXPECT_EQ(node->getStyle()->text_align, css_ta_center);
+    EXPECT_EQ(node->getStyle()->font_style, css_fs_italic);
+    // ancestor filter knows element names, ids and classes of pushed nodes
+    LVCssAncestorFilter filter;
+    lUInt32 divHash = LVCssAncestorFilter::elementHash(el_div);
+    lUInt32 classHash = LVCssAncestorFilter::classHash(cs32("chapter"));
+    EXPECT_FALSE(filter.mayContain(divHash));
+    EXPECT_FALSE(filter.mayContain(classHash));
+    filter.push(doc->getElementById(U"fourth")->getParentNode());
+    EXPECT_TRUE(filter.mayContain(divHash));
+    EXPECT_TRUE(filter.mayContain(classHash));
+    EXPECT_TRUE(filter.mayContain(LVCssAncestorFilter::classHash(cs32("other"))));
+    filter.push(node);
+    EXPECT_TRUE(filter.mayContain(LVCssAncestorFilter::idHash(cs32("sixth"))));
+    EXPECT_EQ(filter.top(), node->getDataIndex());
+    filter.pop();
+    filter.pop();
+    EXPECT_FALSE(filter.mayContain(divHash));
+    EXPECT_FALSE(filter.mayContain(classHash));
+    EXPECT_EQ(filter.top(), 0U);
+    node = doc->getElementById(U"seventh");
+    ASSERT_TRUE(node != NULL);
+    EXPECT_NE(node->getStyle()->text_align, css_ta_center);
+    EXPECT_EQ(node->getStyle()->font_style, css_fs_italic);
+    CRLog::info("Finished testStyleSheetSelectorIndex");
+    CRLog::info("==================================");
+}
+
+TEST_F(TinyDOMTests, testStyleSheetSetsReuse) {
+    CRLog::info("==================================");
+    CRLog::info("Starting testStyleSheetSetsReuse");
+    ASSERT_TRUE(m_initOK);
+    lString8 html("<html><body><p id=\"p1\" class=\"a\">Text</p></body></html>");
+    LVDocView view(4, false);
+    view.Resize(600, 800);
+    ASSERT_TRUE(view.LoadDocument(LVCreateStringStream(html), U"sets.html"));
+    ldomDocument* doc = view.getDocument();
+    ldomNode* node = doc->getElementById(U"p1");
+    ASSERT_TRUE(node != NULL);
+    const char* fragmentCss = "p { font-style: italic; text-align: right } .a { font-weight: bold }";
+    LVStyleSheet sheet(doc);
+    EXPECT_TRUE(sheet.parse("p { text-align: center } .a { font-style: normal }"));
+    lUInt32 baseHash = sheet.getHash();
+    css_style_rec_t style;
+    sheet.apply(node, &style);
+    EXPECT_EQ(style.text_align, css_ta_center);
+    // fragment rules go after base rules with the same specificity
+    sheet.push();
+    EXPECT_TRUE(sheet.parse(fragmentCss));
+    lUInt32 fragmentHash = sheet.getHash();
+    EXPECT_NE(fragmentHash, baseHash);
+    css_style_rec_t style1;
+    sheet.apply(node, &style1);
+    EXPECT_EQ(style1.text_align, css_ta_right);
+    EXPECT_EQ(style1.font_style, css_fs_normal); // .a is more specific than p
+    EXPECT_EQ(style1.font_weight, css_fw_bold);
+    EXPECT_TRUE(sheet.pop());
+    EXPECT_EQ(sheet.getHash(), baseHash);
+    css_style_rec_t style2;
+    sheet.apply(node, &style2);
+    EXPECT_EQ(style2.text_align, css_ta_center);
+    EXPECT_NE(style2.font_weight, css_fw_bold);
+    // next fragment linking the same CSS reuses compiled selectors
+    EXPECT_EQ(sheet.getParsedHits(), 0U);
+    sheet.push();
+    EXPECT_TRUE(sheet.parse(fragmentCss));
+    EXPECT_EQ(sheet.getParsedHits(), 1U);
+    EXPECT_EQ(sheet.getHash(), fragmentHash);
+    css_style_rec_t style3;
+    sheet.apply(node, &style3);
+    EXPECT_TRUE(style3 == style1);
+    // copy shares sets
+    LVStyleSheet copy(sheet);
+    EXPECT_EQ(copy.getHash(), fragmentHash);
+    EXPECT_TRUE(sheet.pop());
+    EXPECT_FALSE(sheet.pop()); // nothing more pushed
+    EXPECT_EQ(copy.getHash(), fragmentHash);
+    CRLog::info("Finished testStyleSheetSetsReuse");
+    CRLog::info("==================================");
+}
+
+static int compareNodeStyles(ldomNode* node1, ldomNode* node2) {
+    if (!node1->isElement())
+        return 0;
+    int mismatches = 0;
+    css_style_ref_t style1 = node1->getStyle();
+    css_style_ref_t style2 = node2->getStyle();
+    font_ref_t font1 = node1->getFont();
+    font_ref_t font2 = node2->getFont();
+    if (node1->getNodeId() != node2->getNodeId() || node1->getChildCount() != node2->getChildCount() ||
+        style1.isNull() || style2.isNull() || !(*style1 == *style2) ||
+        font1.isNull() || font2.isNull() || font1->getSize() != font2->getSize() ||
+        font1->getWeight() != font2->getWeight() || font1->getItalic() != font2->getItalic())
+        return 1;
+    for (int i = 0; i < node1->getChildCount(); i++)
+        mismatches += compareNodeStyles(node1->getChildNode(i), node2->getChildNode(i));
+    return mismatches;
+}
+
+TEST_F(TinyDOMTests, testStyleSharing) {
+    CRLog::info("==================================");
+    CRLog::info("Starting testStyleSharing");
+    ASSERT_TRUE(m_initOK);
+    lString8 html(
+            "<html><head><style>\n"
+            "p.a { font-style: italic }\n"
+            "p.b::before { content: '* ' }\n"
+            "p:first-child { font-weight: bold }\n"
+            "p + p.c { font-size: 120% }\n"
+            "div.x p.a { text-align: right }\n"
+            "</style></head><body>\n");
+    for (int i = 0; i < 20; i++) {
+        html << "<div class=\"" << (i % 2 ? "x" : "y") << "\">\n";
+        for (int j = 0; j < 30; j++) {
+            const char* cls = j % 4 == 0 ? "a" : (j % 4 == 1 ? "b" : (j % 4 == 2 ? "c" : "a b"));
+            html << "<p class=\"" << cls << "\"";
+            if (j % 7 == 6)
+                html << " style=\"color: red\"";
+            html << ">Paragraph " << lString8::itoa(j) << " <span lang=\"en\">of</span> div " << lString8::itoa(i) << "</p>\n";
+        }
+        html << "</div>\n";
+    }
+    html << "</body></html>\n";
+    LVDocView view1(4, false);
+    view1.Resize(600, 800);
+    ASSERT_TRUE(view1.LoadDocument(LVCreateStringStream(html), U"sharing.html"));
+    LVDocView view2(4, false);
+    view2.Resize(600, 800);
+    ASSERT_TRUE(view2.LoadDocument(LVCreateStringStream(html), U"sharing.html"));
+    ldomDocument* doc1 = view1.getDocument();
+    ldomDocument* doc2 = view2.getDocument();
+    EXPECT_TRUE(doc1->getStyleSharing()); // enabled by default
+    doc2->setStyleSharing(false);
+    // restyle both of them from scratch
+    doc1->forceReinitStyles();
+    doc2->forceReinitStyles();
+    lUInt32 lookups = doc1->getStyleSharingLookups();
+    lUInt32 hits = doc1->getStyleSharingHits();
+    EXPECT_FALSE(view1.getPageImage(0).isNull());
+    EXPECT_FALSE(view2.getPageImage(0).isNull());
+    EXPECT_GT(doc1->getStyleSharingLookups(), lookups);
+    EXPECT_GT(doc1->getStyleSharingHits(), hits);
+    EXPECT_EQ(doc2->getStyleSharingHits(), 0U);
+    // the same styles as without sharing, including pseudo elements
+    EXPECT_EQ(compareNodeStyles(doc1->getRootNode(), doc2->getRootNode()), 0);
+    EXPECT_EQ(view1.getPageCount(), view2.getPageCount());
+    EXPECT_EQ(view1.getPageText(false, 1), view2.getPageText(false, 1));
+    CRLog::info("Finished testStyleSharing");
+    CRLog::info("==================================");
+}
+
+TEST_F(TinyDOMTests, testIncrementalRestyle) {
+    CRLog::info("==================================");
+    CRLog::info("Starting testIncrementalRestyle");
+    ASSERT_TRUE(m_initOK);
+    lString8 html("<html><body>\n");
+    for (int i = 0; i < 20; i++) {
+        html << "<div class=\"" << (i % 2 ? "x" : "y") << "\">\n";
+        for (int j = 0; j < 20; j++) {
+            const char* cls = j % 3 == 0 ? "a" : (j % 3 == 1 ? "b" : "c");
+            html << "<p class=\"" << cls << "\">Paragraph " << lString8::itoa(j) << " <span>of</span> div " << lString8::itoa(i) << "</p>\n";
+        }
+        html << "</div>\n";
+    }
+    html << "</body></html>\n";
+    lString8 css("p { margin: 0 } p.a { font-style: italic } p.b::before { content: '> ' }\n");
+    lString8 tweaks("div.x { font-weight: bold } p.c { font-size: 150% } p.b::before { content: '>> ' }\n");
+    StylesUpdateCountCallback stylesCallback;
+    LVDocView view1(4, false);
+    view1.Resize(600, 800);
+    ASSERT_TRUE(view1.LoadDocument(LVCreateStringStream(html), U"restyle.html"));
+    view1.setStyleSheet(css);
+    EXPECT_FALSE(view1.getPageImage(0).isNull());
+    int pageCount = view1.getPageCount();
+    ldomDocument* doc1 = view1.getDocument();
+    // tweak matching no node keeps styles and rendering
+    lUInt32 lookups = doc1->getStyleSharingLookups();
+    view1.setStyleSheet(css + ".none { color: red }\n");
+    EXPECT_FALSE(view1.getPageImage(0).isNull());
+    EXPECT_EQ(doc1->getStyleSharingLookups(), lookups); // no full restyle
+    EXPECT_EQ(view1.getPageCount(), pageCount);
+    // tweaks only update styles of nodes they match, and of their descendants
+    view1.setCallback(&stylesCallback);
+    view1.setStyleSheet(css + tweaks);
+    EXPECT_FALSE(view1.getPageImage(0).isNull());
+    EXPECT_EQ(doc1->getStyleSharingLookups(), lookups);
+    EXPECT_EQ(stylesCallback.started, 1);
+    EXPECT_EQ(stylesCallback.ended, 1);
+    view1.setCallback(NULL);
+    EXPECT_GT(view1.getPageCount(), pageCount);
+
+    LVDocView view2(4, false);
+    view2.Resize(600, 800);
+    ASSERT_TRUE(view2.LoadDocument(LVCreateStringStream(html), U"restyle.html"));
+    view2.setStyleSheet(css + tweaks);
+    ldomDocument* doc2 = view2.getDocument();
+    doc2->forceReinitStyles();
+    EXPECT_FALSE(view2.getPageImage(0).isNull());
+    // the same styles as when initializing all of them
+    EXPECT_EQ(compareNodeStyles(doc1->getRootNode(), doc2->getRootNode()), 0);
+    EXPECT_EQ(view1.getPageCount(), view2.getPageCount());
+    EXPECT_EQ(view1.getPageText(false, 1), view2.getPageText(false, 1));
+    CRLog::info("Finished testIncrementalRestyle");
+    CRLog::info("==================================");
+}
+
+TEST_F(TinyDOMTests, testMemoryGovernor) {
+    CRLog::info("==================================");
+    CRLog::info("Starting testMemoryGovernor");
+    ASSERT_TRUE(m_initOK);
+    lString32 fileName1 = cs32(TESTS_TMPDIR "memory-governor-test1.fb2");
+    lString32 fileName2 = cs32(TESTS_TMPDIR "memory-governor-test2.fb2");
+    ASSERT_TRUE(writeLargeTestDocument(fileName1, 30, 400));
+    ASSERT_TRUE(writeLargeTestDocument(fileName2, 20, 300));
+    ldomDocCache::init(cs32(TESTS_TMPDIR "cr3cache"), 100);
+    EXPECT_TRUE(ldomDocCache::enabled()); // cache enabled
+    {
+        // two documents open at the same time, both with cache files
+        LVDocView view1(4, false);
+        view1.Resize(600, 800);
+        EXPECT_TRUE(view1.LoadDocument(fileName1.c_str()));
+        view1.getDocProps()->setInt(PROP_FORCED_MIN_FILE_SIZE_TO_CACHE, 30000);
+        EXPECT_TRUE(view1.swapToCache());
+        LVDocView view2(4, false);
+        view2.Resize(600, 800);
+        EXPECT_TRUE(view2.LoadDocument(fileName2.c_str()));
+        view2.getDocProps()->setInt(PROP_FORCED_MIN_FILE_SIZE_TO_CACHE, 30000);
+        EXPECT_TRUE(view2.swapToCache());
+        int pageCount1 = view1.getPageCount();
+        lString32 text1 = view1.getPageText(false, pageCount1 / 2);
+        lString32 text2 = view2.getPageText(false, 1);
+        EXPECT_FALSE(text1.empty());
+        EXPECT_FALSE(text2.empty());
+
+        lUInt32 used = ldomMemoryGovernor::getUsedMemory();
+        EXPECT_GT(used, 0u);
+        EXPECT_GT(ldomMemoryGovernor::onMemoryPressure(MEMORY_PRESSURE_MODERATE), 0u);
+        EXPECT_LE(ldomMemoryGovernor::getUsedMemory(), used / 2);
+        ldomMemoryGovernor::onMemoryPressure(MEMORY_PRESSURE_CRITICAL);
+        EXPECT_LT(ldomMemoryGovernor::getUsedMemory(), used / 2);
+        // swapped out data is read again on access
+        EXPECT_EQ(view1.getPageText(false, pageCount1 / 2), text1);
+        EXPECT_EQ(view2.getPageText(false, 1), text2);
+        {
+            // documents in use by calling thread are skipped
+            ldomUseGuard use1(view1.getDocument());
+            ldomUseGuard use2(view2.getDocument());
+            EXPECT_EQ(ldomMemoryGovernor::onMemoryPressure(MEMORY_PRESSURE_CRITICAL), 0u);
+        }
+
+        // budget replaces per-storage limits: walking through all pages keeps memory close to it
+        lUInt32 budget = 256 * 1024;
+        ldomMemoryGovernor::setMemoryBudget(budget);
+        EXPECT_EQ(ldomMemoryGovernor::getMemoryBudget(), budget);
+        EXPECT_LE(ldomMemoryGovernor::getUsedMemory(), budget);
+        for (int i = 0; i < pageCount1; i++)
+            EXPECT_FALSE(view1.getPageText(false, i).empty());
+        EXPECT_LE(ldomMemoryGovernor::getUsedMemory(), budget + budget / 10 + 0x10000);
+        EXPECT_EQ(view2.getPageText(false, 1), text2);
+        ldomMemoryGovernor::setMemoryBudget(0);
+    }
+    EXPECT_TRUE(ldomDocCache::clear()); // cache cleared
+    LVDeleteFile(fileName1);
+    LVDeleteFile(fileName2);
+    CRLog::info("Finished testMemoryGovernor");
+    CRLog::info("==================================");
+}
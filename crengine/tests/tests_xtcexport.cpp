@@ -0,0 +1,97 @@
+/***************************************************************************
+ *   crengine-ng, unit testing                                             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License           *
+ *   as published by the Free Software Foundation; either version 2        *
+ *   of the License, or (at your option) any later version.                *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,            *
+ *   MA 02110-1301, USA.                                                   *
+ ***************************************************************************/
+
+/**
+ * \file tests_xtcexport.cpp
+ * \brief Tests pipelined XTC/XTCH export against sequential export.
+ */
+
+#include <crlog.h>
+#include <lvdocview.h>
+#include <lvstreamutils.h>
+#include <crconcurrent.h>
+#include <xtcexport.h>
+
+#include <string.h>
+
+#include "gtest/gtest.h"
+
+#ifndef TESTS_DATADIR
+#error Please define TESTS_DATADIR, which points to the directory with the data files for the tests
+#endif
+
+// Fixtures
+
+class XtcExportTests: public testing::Test
+{
+protected:
+    LVDocView* m_view;
+protected:
+    XtcExportTests()
+            : testing::Test() {
+        m_view = NULL;
+    }
+    virtual void SetUp() override {
+        CRSetupStdConcurrencyProvider();
+        CRSetupEngineConcurrency();
+        m_view = new LVDocView(32, false);
+        CRPropRef props = LVCreatePropsContainer();
+        props->setString(PROP_FONT_FACE, "FreeSerif");
+        m_view->propsApply(props);
+    }
+    virtual void TearDown() override {
+        if (m_view) {
+            delete m_view;
+            m_view = NULL;
+        }
+    }
+    bool exportToArray(XtcExportFormat format, int threadCount, LVArray<lUInt8>& data) {
+        XtcExporter exporter;
+        exporter.setFormat(format).setDimensions(240, 320).enableChapters(true).setThreadCount(threadCount);
+        LVStreamRef stream = LVCreateMemoryStream(NULL, 0, false, LVOM_WRITE);
+        if (!exporter.exportDocument(m_view, stream))
+            return false;
+        data.clear();
+        lvsize_t size = stream->GetSize();
+        stream->SetPos(0);
+        return stream->Read(data.addSpace((int)size), size, NULL) == LVERR_OK;
+    }
+};
+
+// units tests
+
+TEST_F(XtcExportTests, PipelinedExportIsIdentical) {
+    CRLog::info("==================================");
+    CRLog::info("Starting PipelinedExportIsIdentical");
+    ASSERT_TRUE(m_view->LoadDocument(TESTS_DATADIR "example.fb2.zip@/example.fb2"));
+
+    XtcExportFormat formats[] = { XTC_FORMAT_XTC, XTC_FORMAT_XTCH };
+    for (int f = 0; f < 2; f++) {
+        LVArray<lUInt8> sequential;
+        ASSERT_TRUE(exportToArray(formats[f], 1, sequential));
+        EXPECT_GT(sequential.length(), 0);
+        LVArray<lUInt8> pipelined;
+        ASSERT_TRUE(exportToArray(formats[f], 4, pipelined));
+        ASSERT_EQ(sequential.length(), pipelined.length());
+        EXPECT_EQ(memcmp(sequential.get(), pipelined.get(), sequential.length()), 0);
+    }
+
+    CRLog::info("Finished PipelinedExportIsIdentical");
+    CRLog::info("==================================");
+}